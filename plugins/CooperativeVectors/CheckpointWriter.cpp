@@ -0,0 +1,263 @@
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include "CheckpointWriter.h"
+#include "NetworkFile.h"
+#include "Logger.h"
+
+NAMESPACE_BEGIN(fluxel)
+
+DeviceCheckpointSource::DeviceCheckpointSource(nvrhi::DeviceHandle device,
+                                               std::shared_ptr<NetworkUtilities> networkUtils,
+                                               NetworkLayout const& hostLayout,
+                                               NetworkLayout const& deviceLayout,
+                                               nvrhi::BufferHandle hostLayoutBuffer,
+                                               nvrhi::BufferHandle deviceLayoutBuffer,
+                                               uint32_t slotCount)
+    : m_device(device), m_networkUtils(networkUtils), m_hostLayout(hostLayout), m_deviceLayout(deviceLayout),
+      m_hostLayoutBuffer(hostLayoutBuffer), m_deviceLayoutBuffer(deviceLayoutBuffer)
+{
+    assert(m_device && "Device not present");
+    assert(m_networkUtils && "Network Utilities not present");
+
+    m_commandList = m_device->createCommandList();
+
+    // Staging buffers are created once and reused for every checkpoint
+    nvrhi::BufferDesc stagingDesc;
+    stagingDesc.byteSize = m_hostLayout.networkSize;
+    stagingDesc.cpuAccess = nvrhi::CpuAccessMode::Read;
+    stagingDesc.debugName = "Checkpoint Staging Buffer";
+
+    m_slots.resize(std::max(1u, slotCount));
+    for (Slot& slot : m_slots)
+    {
+        slot.stagingBuffer = m_device->createBuffer(stagingDesc);
+        slot.query = m_device->createEventQuery();
+    }
+}
+
+bool DeviceCheckpointSource::BeginReadback(uint32_t slot)
+{
+    Slot& staging = m_slots[slot];
+    if (!staging.stagingBuffer || !staging.query)
+    {
+        Log(Error, "DeviceCheckpointSource: Failed to create a staging buffer!");
+        return false;
+    }
+
+    m_commandList->open();
+
+    // Convert device layout to a host layout
+    m_networkUtils->ConvertWeights(m_deviceLayout, m_hostLayout, m_deviceLayoutBuffer, 0, m_hostLayoutBuffer, 0, m_device, m_commandList);
+
+    m_commandList->setBufferState(m_hostLayoutBuffer, nvrhi::ResourceStates::CopySource);
+    m_commandList->commitBarriers();
+
+    m_commandList->copyBuffer(staging.stagingBuffer, 0, m_hostLayoutBuffer, 0, m_hostLayout.networkSize);
+    m_commandList->close();
+
+    m_device->resetEventQuery(staging.query);
+    m_device->executeCommandList(m_commandList);
+    m_device->setEventQuery(staging.query, nvrhi::CommandQueue::Graphics);
+    return true;
+}
+
+bool DeviceCheckpointSource::IsReadbackComplete(uint32_t slot)
+{
+    return m_device->pollEventQuery(m_slots[slot].query);
+}
+
+bool DeviceCheckpointSource::ReadSlot(uint32_t slot, uint8_t* dst)
+{
+    const nvrhi::BufferHandle& stagingBuffer = m_slots[slot].stagingBuffer;
+    void* mappedData = m_device->mapBuffer(stagingBuffer, nvrhi::CpuAccessMode::Read);
+    if (!mappedData)
+    {
+        Log(Error, "DeviceCheckpointSource: Failed to map the staging buffer!");
+        return false;
+    }
+    std::memcpy(dst, mappedData, m_hostLayout.networkSize);
+    m_device->unmapBuffer(stagingBuffer);
+    return true;
+}
+
+MemoryCheckpointSource::MemoryCheckpointSource(const uint8_t* data, size_t size, uint32_t slotCount, uint32_t readbackLatency)
+    : m_data(data), m_size(size), m_readbackLatency(readbackLatency)
+{
+    m_slots.resize(std::max(1u, slotCount));
+}
+
+bool MemoryCheckpointSource::BeginReadback(uint32_t slot)
+{
+    m_slots[slot].data.assign(m_data, m_data + m_size);
+    m_slots[slot].remainingPolls = m_readbackLatency;
+    return true;
+}
+
+bool MemoryCheckpointSource::IsReadbackComplete(uint32_t slot)
+{
+    if (m_slots[slot].remainingPolls > 0)
+    {
+        m_slots[slot].remainingPolls--;
+        return false;
+    }
+    return true;
+}
+
+bool MemoryCheckpointSource::ReadSlot(uint32_t slot, uint8_t* dst)
+{
+    std::memcpy(dst, m_slots[slot].data.data(), m_size);
+    return true;
+}
+
+CheckpointWriter::CheckpointWriter(std::shared_ptr<ICheckpointSource> source, NetworkArchitecture const& netArch, NetworkLayout const& hostLayout)
+    : CheckpointWriter(source, [netArch, hostLayout](const std::string& fileName, const uint8_t* data, size_t size) {
+          return WriteNetworkFile(fileName, netArch, hostLayout, data, size);
+      })
+{
+    assert(m_source->GetSize() == hostLayout.networkSize && "Checkpoint source does not match the layout");
+}
+
+CheckpointWriter::CheckpointWriter(std::shared_ptr<ICheckpointSource> source, WriteFunction writeFile) : m_source(source), m_writeFile(writeFile)
+{
+    assert(m_source && "Checkpoint source not present");
+
+    m_slots.resize(m_source->GetSlotCount());
+    m_writerThread = std::thread(&CheckpointWriter::WriterLoop, this);
+}
+
+CheckpointWriter::~CheckpointWriter()
+{
+    Flush();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_shutdown = true;
+    }
+    m_writeAvailable.notify_all();
+    m_writerThread.join();
+}
+
+bool CheckpointWriter::RequestCheckpoint(const std::string& fileName)
+{
+    uint32_t slotIndex;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = std::find_if(m_slots.begin(), m_slots.end(), [](Slot const& slot) { return slot.state == SlotState::Free; });
+        if (it == m_slots.end())
+        {
+            Log(Warning, "CheckpointWriter: all %d slots are in flight, skipping checkpoint %s.", int(m_slots.size()), fileName.c_str());
+            return false;
+        }
+        slotIndex = uint32_t(it - m_slots.begin());
+        it->state = SlotState::Readback;
+        it->fileName = fileName;
+    }
+
+    if (!m_source->BeginReadback(slotIndex))
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_slots[slotIndex].state = SlotState::Free;
+        m_failedCount++;
+        return false;
+    }
+    m_readbackQueue.push_back(slotIndex);
+    return true;
+}
+
+void CheckpointWriter::Update()
+{
+    // Readbacks complete in submission order
+    while (!m_readbackQueue.empty() && m_source->IsReadbackComplete(m_readbackQueue.front()))
+    {
+        const uint32_t slotIndex = m_readbackQueue.front();
+        m_readbackQueue.pop_front();
+
+        // Only this thread touches a slot in readback, the copy frees the staging slot for the next request
+        Slot& slot = m_slots[slotIndex];
+        slot.data.resize(m_source->GetSize());
+        const bool result = m_source->ReadSlot(slotIndex, slot.data.data());
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!result)
+        {
+            slot.state = SlotState::Free;
+            m_failedCount++;
+            continue;
+        }
+        slot.state = SlotState::Writing;
+        m_writeQueue.push_back(slotIndex);
+        m_writeAvailable.notify_one();
+    }
+}
+
+void CheckpointWriter::Flush()
+{
+    while (!m_readbackQueue.empty())
+    {
+        Update();
+        std::this_thread::yield();
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_writeDone.wait(lock, [this]() {
+        return std::none_of(m_slots.begin(), m_slots.end(), [](Slot const& slot) { return slot.state == SlotState::Writing; });
+    });
+}
+
+uint32_t CheckpointWriter::GetPendingCount()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return uint32_t(std::count_if(m_slots.begin(), m_slots.end(), [](Slot const& slot) { return slot.state != SlotState::Free; }));
+}
+
+uint32_t CheckpointWriter::GetWrittenCount()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_writtenCount;
+}
+
+uint32_t CheckpointWriter::GetFailedCount()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_failedCount;
+}
+
+void CheckpointWriter::WriterLoop()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        m_writeAvailable.wait(lock, [this]() { return m_shutdown || !m_writeQueue.empty(); });
+        if (m_writeQueue.empty())
+        {
+            return;
+        }
+
+        const uint32_t slotIndex = m_writeQueue.front();
+        m_writeQueue.pop_front();
+        Slot& slot = m_slots[slotIndex];
+
+        // File I/O happens outside the lock, the slot is owned by this thread until it is freed
+        lock.unlock();
+        const bool result = m_writeFile(slot.fileName, slot.data.data(), slot.data.size());
+        if (!result)
+        {
+            Log(Error, "CheckpointWriter: Failed to write %s.", slot.fileName.c_str());
+        }
+        lock.lock();
+
+        slot.state = SlotState::Free;
+        if (result)
+        {
+            m_writtenCount++;
+        }
+        else
+        {
+            m_failedCount++;
+        }
+        m_writeDone.notify_all();
+    }
+}
+
+NAMESPACE_END(fluxel)
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Fluxel.h"
+#include "Network.h"
+
+NAMESPACE_BEGIN(fluxel)
+
+// Source of the parameters saved by a CheckpointWriter.
+// Parameters are read back through a ring of reusable staging slots and complete asynchronously.
+class ICheckpointSource
+{
+public:
+    virtual ~ICheckpointSource() = default;
+
+    virtual uint32_t GetSlotCount() const = 0;
+
+    // Size of the parameters in bytes, laid out as the host layout.
+    virtual size_t GetSize() const = 0;
+
+    // Start copying the current parameters into a staging slot.
+    virtual bool BeginReadback(uint32_t slot) = 0;
+
+    // Poll whether the readback into a slot has finished, never blocks.
+    virtual bool IsReadbackComplete(uint32_t slot) = 0;
+
+    // Copy the contents of a completed slot to dst, GetSize() bytes.
+    virtual bool ReadSlot(uint32_t slot, uint8_t* dst) = 0;
+};
+
+// Reads back device side parameters through persistent staging buffers.
+// Each readback converts the device layout to the host layout, copies it to the staging buffer of the slot
+// and signals an event query that is polled for completion.
+class DeviceCheckpointSource : public ICheckpointSource
+{
+public:
+    DeviceCheckpointSource(nvrhi::DeviceHandle device,
+                           std::shared_ptr<NetworkUtilities> networkUtils,
+                           NetworkLayout const& hostLayout,
+                           NetworkLayout const& deviceLayout,
+                           nvrhi::BufferHandle hostLayoutBuffer,
+                           nvrhi::BufferHandle deviceLayoutBuffer,
+                           uint32_t slotCount = 2);
+
+    uint32_t GetSlotCount() const override
+    {
+        return uint32_t(m_slots.size());
+    }
+
+    size_t GetSize() const override
+    {
+        return m_hostLayout.networkSize;
+    }
+
+    bool BeginReadback(uint32_t slot) override;
+    bool IsReadbackComplete(uint32_t slot) override;
+    bool ReadSlot(uint32_t slot, uint8_t* dst) override;
+
+private:
+    struct Slot
+    {
+        nvrhi::BufferHandle stagingBuffer;
+        nvrhi::EventQueryHandle query;
+    };
+
+    nvrhi::DeviceHandle m_device;
+    std::shared_ptr<NetworkUtilities> m_networkUtils;
+    NetworkLayout m_hostLayout;
+    NetworkLayout m_deviceLayout;
+    nvrhi::BufferHandle m_hostLayoutBuffer;
+    nvrhi::BufferHandle m_deviceLayoutBuffer;
+    nvrhi::CommandListHandle m_commandList;
+    std::vector<Slot> m_slots;
+};
+
+// Snapshots a CPU side buffer, for example the parameters of a cpu::TrainingEngine.
+// The data is copied when the readback starts. Readbacks report completion after readbackLatency polls
+// to mimic the latency of a device.
+class MemoryCheckpointSource : public ICheckpointSource
+{
+public:
+    MemoryCheckpointSource(const uint8_t* data, size_t size, uint32_t slotCount = 2, uint32_t readbackLatency = 0);
+
+    uint32_t GetSlotCount() const override
+    {
+        return uint32_t(m_slots.size());
+    }
+
+    size_t GetSize() const override
+    {
+        return m_size;
+    }
+
+    bool BeginReadback(uint32_t slot) override;
+    bool IsReadbackComplete(uint32_t slot) override;
+    bool ReadSlot(uint32_t slot, uint8_t* dst) override;
+
+private:
+    struct Slot
+    {
+        std::vector<uint8_t> data;
+        uint32_t remainingPolls = 0;
+    };
+
+    const uint8_t* m_data;
+    size_t m_size;
+    uint32_t m_readbackLatency;
+    std::vector<Slot> m_slots;
+};
+
+// Writes network checkpoints without stalling the calling thread.
+// Requests start a readback into a free slot of the source; Update() polls for completed readbacks and hands them
+// to a background thread that writes the version 2 network file. RequestCheckpoint and Update are expected
+// to be called from the thread that owns the source, typically once per frame.
+class CheckpointWriter
+{
+public:
+    // Writes the GetSize() bytes of a completed readback to a file, called on the writer thread.
+    using WriteFunction = std::function<bool(const std::string& fileName, const uint8_t* data, size_t size)>;
+
+    CheckpointWriter(std::shared_ptr<ICheckpointSource> source, NetworkArchitecture const& netArch, NetworkLayout const& hostLayout);
+
+    // Write the readbacks in another file format, for example a training state of TrainingState.h.
+    CheckpointWriter(std::shared_ptr<ICheckpointSource> source, WriteFunction writeFile);
+    ~CheckpointWriter();
+
+    CheckpointWriter(const CheckpointWriter&) = delete;
+    CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+
+    // Start a checkpoint of the current parameters. Fails when every slot is still in flight, the request is dropped.
+    bool RequestCheckpoint(const std::string& fileName);
+
+    // Hand completed readbacks to the writer thread, never waits for the source.
+    void Update();
+
+    // Block until every requested checkpoint has been written.
+    void Flush();
+
+    // Checkpoints requested but not yet written.
+    uint32_t GetPendingCount();
+
+    uint32_t GetWrittenCount();
+
+    uint32_t GetFailedCount();
+
+private:
+    enum class SlotState
+    {
+        Free,
+        Readback, ///< Waiting for the source.
+        Writing, ///< Owned by the writer thread.
+    };
+
+    struct Slot
+    {
+        SlotState state = SlotState::Free;
+        std::string fileName;
+        std::vector<uint8_t> data; ///< Host copy of the parameters, reused between checkpoints.
+    };
+
+    void WriterLoop();
+
+    std::shared_ptr<ICheckpointSource> m_source;
+    WriteFunction m_writeFile;
+
+    std::vector<Slot> m_slots;
+    std::deque<uint32_t> m_readbackQueue; ///< Slots in readback, in request order.
+    std::deque<uint32_t> m_writeQueue; ///< Slots ready to be written, in request order.
+
+    std::thread m_writerThread;
+    std::mutex m_mutex;
+    std::condition_variable m_writeAvailable;
+    std::condition_variable m_writeDone;
+    uint32_t m_writtenCount = 0;
+    uint32_t m_failedCount = 0;
+    bool m_shutdown = false;
+};
+
+NAMESPACE_END(fluxel)
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cmath>
+
+#include "Fluxel.h"
+
+NAMESPACE_BEGIN(fluxel)
+NAMESPACE_BEGIN(cpu)
+
+// Activation functions of the CPU network engines.
+// These mirror the IActivation implementations in Activation.slang.
+enum class Activation
+{
+    None,
+    Linear,
+    Exponential,
+    ShiftedExponential,
+    ReLU,
+    LeakyReLU,
+    Sigmoid,
+    Swish,
+    Tanh,
+};
+
+struct ActivationDesc
+{
+    Activation type = Activation::None;
+    float param = 0.f; ///< Slope for Linear, leak for LeakyReLU, unused otherwise.
+};
+
+// Scalar reference evaluation of an activation function.
+inline float EvaluateActivation(ActivationDesc const& act, float x)
+{
+    switch (act.type)
+    {
+    case Activation::None:
+        return x;
+    case Activation::Linear:
+        return act.param * x;
+    case Activation::Exponential:
+        return std::exp(x);
+    case Activation::ShiftedExponential:
+        return std::exp(x) - 1.f;
+    case Activation::ReLU:
+        return x > 0.f ? x : 0.f;
+    case Activation::LeakyReLU:
+        return x < 0.f ? act.param * x : x;
+    case Activation::Sigmoid:
+        return 1.f / (1.f + std::exp(-x));
+    case Activation::Swish:
+        return x / (1.f + std::exp(-x));
+    case Activation::Tanh:
+        return 2.f / (1.f + std::exp(-2.f * x)) - 1.f;
+    default:
+        return x; // Should not get here
+    }
+}
+
+// Scalar reference of the activation derivative, returns dResult scaled by the derivative at the pre-activation x.
+// Leaky ReLU and sigmoid follow leakyReLU_Derivative and sigmoid_Derivative in CooperativeVectorDerivatives.slang.
+inline float EvaluateActivationDerivative(ActivationDesc const& act, float x, float dResult)
+{
+    switch (act.type)
+    {
+    case Activation::None:
+        return dResult;
+    case Activation::Linear:
+        return act.param * dResult;
+    case Activation::Exponential:
+    case Activation::ShiftedExponential:
+        return std::exp(x) * dResult;
+    case Activation::ReLU:
+        return x > 0.f ? dResult : 0.f;
+    case Activation::LeakyReLU:
+        return x > 0.f ? dResult : act.param * dResult;
+    case Activation::Sigmoid:
+    {
+        const float s = 1.f / (1.f + std::exp(-x));
+        return dResult * s * (1.f - s);
+    }
+    case Activation::Swish:
+    {
+        const float s = 1.f / (1.f + std::exp(-x));
+        return dResult * (s + x * s * (1.f - s));
+    }
+    case Activation::Tanh:
+    {
+        const float t = 2.f / (1.f + std::exp(-2.f * x)) - 1.f;
+        return dResult * (1.f - t * t);
+    }
+    default:
+        return dResult; // Should not get here
+    }
+}
+
+NAMESPACE_END(cpu)
+NAMESPACE_END(fluxel)
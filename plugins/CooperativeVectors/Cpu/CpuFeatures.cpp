@@ -0,0 +1,150 @@
+#include <cstdint>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define FLUXEL_CPU_X64 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#include "CpuFeatures.h"
+
+NAMESPACE_BEGIN(fluxel)
+NAMESPACE_BEGIN(cpu)
+
+#if FLUXEL_CPU_X64
+namespace
+{
+void CpuId(uint32_t leaf, uint32_t subLeaf, uint32_t regs[4])
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuidex(info, int(leaf), int(subLeaf));
+    for (int i = 0; i < 4; i++)
+    {
+        regs[i] = uint32_t(info[i]);
+    }
+#else
+    __cpuid_count(leaf, subLeaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+uint64_t ReadXCR0()
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    uint32_t eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (uint64_t(edx) << 32) | eax;
+#endif
+}
+
+// L1 data cache size from the deterministic cache parameters (leaf 4), with the AMD extended leaf as fallback,
+// where leaf 4 is reserved.
+uint32_t DetectL1DataCacheSize(uint32_t maxLeaf)
+{
+    uint32_t regs[4];
+    for (uint32_t subLeaf = 0; maxLeaf >= 4 && subLeaf < 16; subLeaf++)
+    {
+        CpuId(4, subLeaf, regs);
+        const uint32_t type = regs[0] & 0x1F;
+        if (type == 0)
+        {
+            break;
+        }
+
+        // Type 1 is a data cache, 3 a unified cache
+        const uint32_t level = (regs[0] >> 5) & 0x7;
+        if (level == 1 && (type == 1 || type == 3))
+        {
+            const uint32_t ways = (regs[1] >> 22) + 1;
+            const uint32_t partitions = ((regs[1] >> 12) & 0x3FF) + 1;
+            const uint32_t lineSize = (regs[1] & 0xFFF) + 1;
+            const uint32_t sets = regs[2] + 1;
+            return ways * partitions * lineSize * sets;
+        }
+    }
+
+    CpuId(0x80000000, 0, regs);
+    if (regs[0] >= 0x80000005)
+    {
+        CpuId(0x80000005, 0, regs);
+        return (regs[2] >> 24) * 1024;
+    }
+    return 0;
+}
+
+CpuFeatures DetectCpuFeatures()
+{
+    CpuFeatures features;
+
+    uint32_t regs[4];
+    CpuId(0, 0, regs);
+    const uint32_t maxLeaf = regs[0];
+    if (maxLeaf < 1)
+    {
+        return features;
+    }
+
+    features.l1DataCacheSize = DetectL1DataCacheSize(maxLeaf);
+
+    CpuId(1, 0, regs);
+    const bool osxsave = (regs[2] >> 27) & 1;
+    const bool avx = (regs[2] >> 28) & 1;
+    const bool fma = (regs[2] >> 12) & 1;
+    const bool f16c = (regs[2] >> 29) & 1;
+    if (!osxsave || !avx)
+    {
+        return features;
+    }
+
+    // The OS must save the YMM (bits 1-2) and for AVX-512 also the opmask and ZMM state (bits 5-7).
+    const uint64_t xcr0 = ReadXCR0();
+    const bool ymmState = (xcr0 & 0x6) == 0x6;
+    const bool zmmState = (xcr0 & 0xE6) == 0xE6;
+    if (!ymmState)
+    {
+        return features;
+    }
+
+    features.fma = fma;
+    features.f16c = f16c;
+
+    if (maxLeaf >= 7)
+    {
+        CpuId(7, 0, regs);
+        const uint32_t maxSubLeaf = regs[0];
+        features.avx2 = (regs[1] >> 5) & 1;
+        if (zmmState)
+        {
+            features.avx512f = (regs[1] >> 16) & 1;
+            features.avx512bw = (regs[1] >> 30) & 1;
+            features.avx512vl = (regs[1] >> 31) & 1;
+            features.avx512vnni = (regs[2] >> 11) & 1;
+        }
+        if (maxSubLeaf >= 1)
+        {
+            CpuId(7, 1, regs);
+            features.avxvnni = (regs[0] >> 4) & 1;
+        }
+    }
+    return features;
+}
+} // namespace
+#endif
+
+const CpuFeatures& GetCpuFeatures()
+{
+#if FLUXEL_CPU_X64
+    static const CpuFeatures features = DetectCpuFeatures();
+#else
+    static const CpuFeatures features = {};
+#endif
+    return features;
+}
+
+NAMESPACE_END(cpu)
+NAMESPACE_END(fluxel)
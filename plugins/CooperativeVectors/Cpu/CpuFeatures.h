@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+
+#include "Fluxel.h"
+
+NAMESPACE_BEGIN(fluxel)
+NAMESPACE_BEGIN(cpu)
+
+// Instruction set extensions and L1 data cache size of the host CPU that are used by the CPU network kernels.
+// A feature is only reported when it is supported by both the CPU and the OS (saved register state).
+struct CpuFeatures
+{
+    bool avx2 = false;
+    bool fma = false;
+    bool f16c = false;
+    bool avx512f = false;
+    bool avx512bw = false;
+    bool avx512vl = false;
+    bool avx512vnni = false;
+    bool avxvnni = false; ///< VEX encoded 256 bit VNNI.
+
+    uint32_t l1DataCacheSize = 0; ///< Bytes per core, 0 when unknown.
+};
+
+// Query the host CPU features, the result is computed once and cached.
+const CpuFeatures& GetCpuFeatures();
+
+NAMESPACE_END(cpu)
+NAMESPACE_END(fluxel)
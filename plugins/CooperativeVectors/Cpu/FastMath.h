@@ -0,0 +1,153 @@
+#pragma once
+
+#include <bit>
+#include <cmath>
+#include <cstdint>
+
+#include "Fluxel.h"
+
+NAMESPACE_BEGIN(fluxel)
+NAMESPACE_BEGIN(cpu)
+
+// Polynomial approximations of the transcendental functions of the activations, shared by the scalar and SIMD kernels.
+// The SIMD kernels evaluate the same operations with fused multiply adds, the scalar versions below are the reference.
+// Maximum errors against the exact result, measured by samples/CpuMathBenchmark on a sweep over the finite floats:
+//   exp       1 ULP    Cody-Waite reduction to r in [-ln2/2, ln2/2], degree 7 polynomial of e^r (Cephes expf).
+//   sigmoid   2.5 ULP  1 / (1 + exp(-x)) for x >= 0, exp(x) / (1 + exp(x)) otherwise, so neither tail loses precision.
+//   tanh      1.5 ULP  Odd polynomial below s_tanhPolynomialRange (Cephes tanhf), 1 - 2 / (exp(2|x|) + 1) above.
+//   softplus  2 ULP    max(x, 0) + log1p(exp(-|x|)), with log1p from a degree 11 polynomial of the mantissa (Cephes logf).
+// Results that underflow are denormal or zero, exp overflows to infinity and NaN inputs return NaN.
+//
+// sin and cos of the input encoders reduce x by multiples of pi/2 and evaluate the Cephes sinf and cosf polynomials on
+// [-pi/4, pi/4]. The error is within 2 ULP for |x| < 4, which covers pi times coordinates in [-1, 1], and below 1e-7
+// absolute for |x| < 8192. Unlike the functions above the scalar version uses fused multiply adds too, so the encoders
+// of all kernel tables return the same values.
+
+// exp is evaluated on inputs clamped to this range, outside it the result is 0 or infinity.
+constexpr float s_expMinInput = -104.f;
+constexpr float s_expMaxInput = 89.f;
+
+constexpr float s_log2e = 1.44269504088896341f;
+
+// ln 2 split in a part with few significant bits, so n * s_ln2Hi is exact, and the remainder.
+constexpr float s_ln2Hi = 0.693359375f;
+constexpr float s_ln2Lo = -2.12194440e-4f;
+
+constexpr float s_sqrt2 = 1.41421356237309505f;
+
+// e^r = 1 + r + r^2 * P(r), highest degree first.
+constexpr float s_expPolynomial[] = {
+    1.9875691500e-4f, 1.3981999507e-3f, 8.3334519073e-3f, 4.1665795894e-2f, 1.6666665459e-1f, 5.0000001201e-1f,
+};
+
+// tanh(x) = x + x^3 * P(x^2) for |x| < s_tanhPolynomialRange, highest degree first.
+constexpr float s_tanhPolynomialRange = 0.625f;
+constexpr float s_tanhPolynomial[] = {
+    -5.70498872745e-3f, 2.06390887954e-2f, -5.37397155531e-2f, 1.33314422036e-1f, -3.33332819422e-1f,
+};
+
+// log(1 + f) = f - f^2 / 2 + f^3 * P(f) for 1 + f in [sqrt(1/2), sqrt(2)], highest degree first.
+constexpr float s_logPolynomial[] = {
+    7.0376836292e-2f,  -1.1514610310e-1f, 1.1676998740e-1f,  -1.2420140846e-1f, 1.4249322787e-1f,
+    -1.6668057665e-1f, 2.0000714765e-1f,  -2.4999993993e-1f, 3.3333331174e-1f,
+};
+
+constexpr float s_pi = 3.14159265358979323846f;
+
+// pi/2 split in parts with few significant bits for the reduction of the sin and cos arguments.
+constexpr float s_2OverPi = 0.636619772367581343f;
+constexpr float s_piOver2Hi = 1.5703125f;
+constexpr float s_piOver2Mid = 4.837512969970703125e-4f;
+constexpr float s_piOver2Lo = 7.54978995489188216e-8f;
+
+// sin(r) = r + r^3 * P(r^2) and cos(r) = 1 - r^2 / 2 + r^4 * Q(r^2) for |r| <= pi/4, highest degree first.
+constexpr float s_sinPolynomial[] = { -1.9515295891e-4f, 8.3321608736e-3f, -1.6666654611e-1f };
+constexpr float s_cosPolynomial[] = { 2.443315711809948e-5f, -1.388731625493765e-3f, 4.166664568298827e-2f };
+
+inline float FastExp(float x)
+{
+    x = x < s_expMinInput ? s_expMinInput : (x > s_expMaxInput ? s_expMaxInput : x);
+    const float n = std::nearbyint(x * s_log2e);
+    const float r = (x - n * s_ln2Hi) - n * s_ln2Lo;
+
+    float p = s_expPolynomial[0];
+    for (int i = 1; i < 6; i++)
+    {
+        p = p * r + s_expPolynomial[i];
+    }
+    p = p * (r * r) + r + 1.f;
+
+    // Scale by 2^n in two steps, so both factors are normal numbers over the whole input range
+    const int32_t a = int32_t(n) >> 1;
+    const int32_t b = int32_t(n) - a;
+    return p * std::bit_cast<float>(uint32_t(a + 127) << 23) * std::bit_cast<float>(uint32_t(b + 127) << 23);
+}
+
+inline float FastSigmoid(float x)
+{
+    const float e = FastExp(-std::fabs(x));
+    return (x < 0.f ? e : 1.f) / (1.f + e);
+}
+
+inline float FastTanh(float x)
+{
+    const float ax = std::fabs(x);
+    if (ax < s_tanhPolynomialRange)
+    {
+        const float z = x * x;
+        float p = s_tanhPolynomial[0];
+        for (int i = 1; i < 5; i++)
+        {
+            p = p * z + s_tanhPolynomial[i];
+        }
+        return p * z * x + x;
+    }
+    return std::copysign(1.f - 2.f / (FastExp(2.f * ax) + 1.f), x);
+}
+
+inline float FastSoftplus(float x)
+{
+    // log(u) with u = 1 + t in [1, 2], plus the rounding error of u divided by u
+    const float t = FastExp(-std::fabs(x));
+    const float u = 1.f + t;
+    const float c = t - (u - 1.f);
+    const bool upper = u > s_sqrt2;
+    const float e = upper ? 1.f : 0.f;
+    const float f = (upper ? 0.5f * u : u) - 1.f;
+    const float z = f * f;
+
+    float p = s_logPolynomial[0];
+    for (int i = 1; i < 9; i++)
+    {
+        p = p * f + s_logPolynomial[i];
+    }
+    float y = p * f * z;
+    y = e * s_ln2Lo + y;
+    y = y - 0.5f * z;
+    const float log1p = (f + y) + e * s_ln2Hi + c / u;
+    return (x > 0.f ? x : 0.f) + log1p;
+}
+
+inline void FastSinCos(float x, float& sinX, float& cosX)
+{
+    const float n = std::nearbyint(x * s_2OverPi);
+    float r = std::fma(-n, s_piOver2Hi, x);
+    r = std::fma(-n, s_piOver2Mid, r);
+    r = std::fma(-n, s_piOver2Lo, r);
+
+    const float z = r * r;
+    const float p = std::fma(std::fma(s_sinPolynomial[0], z, s_sinPolynomial[1]), z, s_sinPolynomial[2]);
+    const float q = std::fma(std::fma(s_cosPolynomial[0], z, s_cosPolynomial[1]), z, s_cosPolynomial[2]);
+    const float s = std::fma(p, z * r, r);
+    const float c = std::fma(q, z * z, std::fma(-0.5f, z, 1.f));
+
+    // Quadrant of x, odd quadrants swap sin and cos
+    const int32_t quadrant = int32_t(n);
+    sinX = quadrant & 1 ? c : s;
+    cosX = quadrant & 1 ? s : c;
+    sinX = quadrant & 2 ? -sinX : sinX;
+    cosX = (quadrant + 1) & 2 ? -cosX : cosX;
+}
+
+NAMESPACE_END(cpu)
+NAMESPACE_END(fluxel)
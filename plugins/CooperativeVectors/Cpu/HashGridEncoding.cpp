@@ -0,0 +1,126 @@
+#include <algorithm>
+#include <cmath>
+
+#include "HashGridEncoding.h"
+
+NAMESPACE_BEGIN(fluxel)
+NAMESPACE_BEGIN(cpu)
+
+namespace
+{
+constexpr uint32_t s_hashGridPrimes[3] = { 1u, 2654435761u, 805459861u };
+
+// Calls fn(corner, index, weight) for the vertices of the cell of a position on one level, in the corner order of
+// HashGrid.slang. index is the first feature of the vertex in the parameters of the grid.
+template <uint32_t DIMS, typename Fn>
+void ForEachCorner(HashGridLevel const& level, uint32_t featuresPerLevel, const float* position, Fn&& fn)
+{
+    uint32_t cell[DIMS];
+    float fraction[DIMS];
+    for (uint32_t d = 0; d < DIMS; d++)
+    {
+        const float scaled = position[d] * float(level.resolution);
+        cell[d] = std::min(uint32_t(std::max(std::floor(scaled), 0.f)), level.resolution - 1);
+        fraction[d] = scaled - float(cell[d]);
+    }
+
+    const size_t base = level.offset / sizeof(uint16_t);
+    for (uint32_t corner = 0; corner < (1u << DIMS); corner++)
+    {
+        float weight = 1.f;
+        uint32_t index = 0;
+        uint32_t stride = 1;
+        for (uint32_t d = 0; d < DIMS; d++)
+        {
+            const bool upper = (corner >> d) & 1;
+            const uint32_t vertex = cell[d] + (upper ? 1 : 0);
+            weight *= upper ? fraction[d] : 1.f - fraction[d];
+            if (level.hashed)
+            {
+                index ^= vertex * s_hashGridPrimes[d];
+            }
+            else
+            {
+                index += vertex * stride;
+                stride *= level.resolution + 1;
+            }
+        }
+        if (level.hashed)
+        {
+            index &= level.tableSize - 1;
+        }
+        fn(base + size_t(index) * featuresPerLevel, weight);
+    }
+}
+
+template <uint32_t DIMS>
+void EncodeLevels(HashGrid const& grid, const float* params, const float* positions, size_t count, float* outputs, size_t outputStride)
+{
+    const uint32_t features = grid.GetDesc().featuresPerLevel;
+    const std::vector<HashGridLevel>& levels = grid.GetLevels();
+    for (size_t s = 0; s < count; s++)
+    {
+        const float* position = positions + s * DIMS;
+        float* output = outputs + s * outputStride;
+        for (size_t l = 0; l < levels.size(); l++)
+        {
+            float* y = output + l * features;
+            std::fill(y, y + features, 0.f);
+            ForEachCorner<DIMS>(levels[l], features, position, [&](size_t index, float weight) {
+                for (uint32_t k = 0; k < features; k++)
+                {
+                    y[k] += weight * params[index + k];
+                }
+            });
+        }
+    }
+}
+
+template <uint32_t DIMS>
+void EncodeLevelsBackward(HashGrid const& grid, const float* positions, size_t count, const float* grad, size_t gradStride, float* paramsGrad)
+{
+    const uint32_t features = grid.GetDesc().featuresPerLevel;
+    const std::vector<HashGridLevel>& levels = grid.GetLevels();
+    for (size_t s = 0; s < count; s++)
+    {
+        const float* position = positions + s * DIMS;
+        for (size_t l = 0; l < levels.size(); l++)
+        {
+            const float* g = grad + s * gradStride + l * features;
+            ForEachCorner<DIMS>(levels[l], features, position, [&](size_t index, float weight) {
+                for (uint32_t k = 0; k < features; k++)
+                {
+                    paramsGrad[index + k] += weight * g[k];
+                }
+            });
+        }
+    }
+}
+} // namespace
+
+void EncodeHashGrid(HashGrid const& grid, const float* params, const float* positions, size_t count, float* outputs, size_t outputStride)
+{
+    if (grid.GetDesc().inputDimensions == 2)
+    {
+        EncodeLevels<2>(grid, params, positions, count, outputs, outputStride);
+    }
+    else
+    {
+        EncodeLevels<3>(grid, params, positions, count, outputs, outputStride);
+    }
+}
+
+void EncodeHashGridBackward(HashGrid const& grid, const float* positions, size_t count, const float* grad, size_t gradStride, float* paramsGrad)
+{
+    if (grid.GetDesc().inputDimensions == 2)
+    {
+        EncodeLevelsBackward<2>(grid, positions, count, grad, gradStride, paramsGrad);
+    }
+    else
+    {
+        EncodeLevelsBackward<3>(grid, positions, count, grad, gradStride, paramsGrad);
+    }
+}
+
+NAMESPACE_END(cpu)
+NAMESPACE_END(fluxel)
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "Fluxel.h"
+#include "HashGrid.h"
+
+NAMESPACE_BEGIN(fluxel)
+NAMESPACE_BEGIN(cpu)
+
+// CPU reference of the hash grid encoding of HashGrid.slang, with the same cells, hash and interpolation order.
+// params holds the features of the grid as floats, indexed like the F16 parameters of the grid (byte offset / 2).
+// Positions are stored as [count][inputDimensions] floats in [0, 1].
+
+// outputs[s * outputStride + l * featuresPerLevel + k] = interpolated feature k of level l, EncodeHashGrid.
+void EncodeHashGrid(HashGrid const& grid, const float* params, const float* positions, size_t count, float* outputs, size_t outputStride);
+
+// paramsGrad[i] += sum_s d outputs[s] / d params[i] * grad[s], EncodeHashGrid_Backward.
+// grad is laid out like the outputs of EncodeHashGrid, with a row stride of gradStride.
+void EncodeHashGridBackward(HashGrid const& grid, const float* positions, size_t count, const float* grad, size_t gradStride, float* paramsGrad);
+
+NAMESPACE_END(cpu)
+NAMESPACE_END(fluxel)
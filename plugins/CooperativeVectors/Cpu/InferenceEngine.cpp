@@ -0,0 +1,166 @@
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include "InferenceEngine.h"
+#include "AlignedVector.h"
+#include "Logger.h"
+
+NAMESPACE_BEGIN(fluxel)
+NAMESPACE_BEGIN(cpu)
+
+InferenceEngine::InferenceEngine(ThreadPool* threadPool) : m_threadPool(threadPool ? threadPool : &ThreadPool::GetDefault()), m_kernels(&GetBestKernels())
+{
+}
+
+bool InferenceEngine::Initialise(HostNetwork const& network, InferenceEngineDesc const& desc)
+{
+    const auto& params = network.GetNetworkParams();
+    return Initialise(network.GetNetworkLayout(), params.data(), params.size(), desc);
+}
+
+bool InferenceEngine::Initialise(NetworkLayout const& layout, const uint8_t* params, size_t paramsSize, InferenceEngineDesc const& desc)
+{
+    m_networks.clear();
+    m_desc = desc;
+
+    if (!LoadNetwork(layout, params, paramsSize, m_networks.emplace_back()))
+    {
+        Log(Error, "InferenceEngine: Failed to load network.");
+        m_networks.clear();
+        return false;
+    }
+
+    UpdateMaxWidth();
+    UpdateTileRows();
+    return true;
+}
+
+bool InferenceEngine::Initialise(NetworkPack const& pack, InferenceEngineDesc const& desc)
+{
+    m_networks.clear();
+    m_desc = desc;
+
+    m_networks.resize(pack.GetNetworkCount());
+    for (uint32_t i = 0; i < pack.GetNetworkCount(); i++)
+    {
+        const NetworkLayout& layout = pack.GetNetworkLayout(i);
+        if (!LoadNetwork(layout, pack.GetParams().data() + pack.GetNetworkOffset(i), layout.networkSize, m_networks[i]))
+        {
+            Log(Error, "InferenceEngine: Failed to load network %d of the pack.", i);
+            m_networks.clear();
+            return false;
+        }
+    }
+
+    UpdateMaxWidth();
+    UpdateTileRows();
+    return true;
+}
+
+bool InferenceEngine::LoadNetwork(NetworkLayout const& layout, const uint8_t* params, size_t paramsSize, Network& network)
+{
+    if (!PackNetworkLayers(layout, params, paramsSize, *m_kernels, network.layers))
+    {
+        return false;
+    }
+    GetKernelLayers(network.layers, network.kernelLayers);
+    network.forward = m_desc.specialisedKernels ? FindSpecialisedMLP(network.layers, *m_kernels) : ForwardGenericMLP;
+    return true;
+}
+
+void InferenceEngine::UpdateMaxWidth()
+{
+    m_maxWidth = 0;
+    for (const Network& network : m_networks)
+    {
+        m_maxWidth = std::max(m_maxWidth, PadKernelWidth(network.layers.front().inputs));
+        for (const PackedLayer& layer : network.layers)
+        {
+            m_maxWidth = std::max(m_maxWidth, layer.outputsPadded);
+        }
+    }
+}
+
+void InferenceEngine::UpdateTileRows()
+{
+    m_tileRows = m_desc.tileRows ? m_desc.tileRows : ChooseTileRows(m_maxWidth);
+}
+
+void InferenceEngine::Evaluate(const float* inputs, size_t count, float* outputs) const
+{
+    InferenceBatch batch;
+    batch.inputs = inputs;
+    batch.count = count;
+    batch.outputs = outputs;
+    Evaluate(&batch, 1);
+}
+
+void InferenceEngine::Evaluate(const InferenceBatch* batches, size_t batchCount) const
+{
+    if (m_networks.empty())
+    {
+        return;
+    }
+
+    const KernelTable& kernels = *m_kernels;
+    const uint32_t tileRows = m_tileRows;
+    const size_t stride = m_maxWidth;
+
+    // Tiles of all batches are numbered consecutively, firstTiles[b] is the first tile of batch b
+    std::vector<size_t> firstTiles(batchCount + 1, 0);
+    for (size_t b = 0; b < batchCount; b++)
+    {
+        assert(batches[b].networkIndex < m_networks.size() && "Network index out of range");
+        firstTiles[b + 1] = firstTiles[b] + (batches[b].count + tileRows - 1) / tileRows;
+    }
+
+    m_threadPool->ParallelFor(firstTiles.back(), [&](size_t tile, uint32_t) {
+        // Ping-pong activation buffers, reused by the thread across calls.
+        thread_local AlignedVector<float> scratch;
+        if (scratch.size() < 2 * tileRows * stride)
+        {
+            scratch.resize(2 * tileRows * stride);
+        }
+        float* src = scratch.data();
+        float* dst = src + tileRows * stride;
+
+        const size_t b = size_t(std::upper_bound(firstTiles.begin(), firstTiles.end(), tile) - firstTiles.begin()) - 1;
+        const InferenceBatch& batch = batches[b];
+        const Network& network = m_networks[batch.networkIndex];
+        const uint32_t numInputs = network.layers.front().inputs;
+        const uint32_t numOutputs = network.layers.back().outputs;
+
+        const size_t firstRow = (tile - firstTiles[b]) * tileRows;
+        const uint32_t rows = uint32_t(std::min<size_t>(tileRows, batch.count - firstRow));
+
+        for (uint32_t r = 0; r < rows; r++)
+        {
+            float* row = src + r * stride;
+            std::memcpy(row, batch.inputs + (firstRow + r) * numInputs, numInputs * sizeof(float));
+            if (m_desc.halfPrecisionActivations)
+            {
+                kernels.roundToHalf(row, numInputs);
+            }
+        }
+
+        MLPTileArgs args;
+        args.kernels = &kernels;
+        args.hiddenActivation = m_desc.hiddenActivation;
+        args.finalActivation = m_desc.finalActivation;
+        args.roundToHalf = m_desc.halfPrecisionActivations;
+        args.buffers[0] = src;
+        args.buffers[1] = dst;
+        args.stride = stride;
+        args.rows = rows;
+        const float* result = network.forward(network.kernelLayers.data(), network.kernelLayers.size(), args);
+
+        for (uint32_t r = 0; r < rows; r++)
+        {
+            std::memcpy(batch.outputs + (firstRow + r) * numOutputs, result + r * stride, numOutputs * sizeof(float));
+        }
+    });
+}
+
+NAMESPACE_END(cpu)
+NAMESPACE_END(fluxel)
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <vector>
+
+#include "Fluxel.h"
+#include "Network.h"
+#include "NetworkPack.h"
+#include "Activation.h"
+#include "Kernels.h"
+#include "PackedNetwork.h"
+#include "SpecialisedMLP.h"
+#include "ThreadPool.h"
+
+NAMESPACE_BEGIN(fluxel)
+NAMESPACE_BEGIN(cpu)
+
+struct InferenceEngineDesc
+{
+    // Defaults match inference_cs in SimpleTraining_Inference.slang.
+    ActivationDesc hiddenActivation = { Activation::LeakyReLU, 0.01f };
+    ActivationDesc finalActivation = { Activation::Sigmoid, 0.f };
+
+    // Round the inputs and the output of every layer to half precision, like the CoopVec<half> shader path.
+    // Accumulation is always performed in FP32.
+    bool halfPrecisionActivations = true;
+
+    // Number of input vectors processed by a worker per task, through all layers.
+    // 0 sizes the tiles so the activations stay in the L1 data cache, see ChooseTileRows.
+    uint32_t tileRows = 0;
+
+    // Use the forward passes specialised at compile time for the network shapes in FLUXEL_SPECIALISED_MLP_SHAPES.
+    bool specialisedKernels = true;
+};
+
+// Input vectors evaluated by one network of an engine.
+struct InferenceBatch
+{
+    uint32_t networkIndex = 0;
+    const float* inputs = nullptr; ///< [count][GetInputCount(networkIndex)] floats.
+    size_t count = 0;
+    float* outputs = nullptr; ///< [count][GetOutputCount(networkIndex)] floats.
+};
+
+// Batched, multi-threaded CPU evaluation of a host side network.
+// Runs the same forward pass as rtxns::mlp::InferenceMLP (MLP.slang) on the host parameters,
+// which makes it usable on machines without cooperative vector support.
+// Networks of a shape in FLUXEL_SPECIALISED_MLP_SHAPES run a forward pass specialised for it, see SpecialisedMLP.h.
+class InferenceEngine
+{
+public:
+    // Uses the default thread pool when none is provided.
+    explicit InferenceEngine(ThreadPool* threadPool = nullptr);
+
+    bool Initialise(HostNetwork const& network, InferenceEngineDesc const& desc = {});
+    // Initialise from raw parameters, params only needs to stay valid for the duration of the call.
+    bool Initialise(NetworkLayout const& layout, const uint8_t* params, size_t paramsSize, InferenceEngineDesc const& desc = {});
+    // Initialise every network of a pack, networks are selected by their index in the pack.
+    bool Initialise(NetworkPack const& pack, InferenceEngineDesc const& desc = {});
+
+    // Evaluate count input vectors stored contiguously as [count][GetInputCount()] floats.
+    // Writes [count][GetOutputCount()] floats to outputs.
+    void Evaluate(const float* inputs, size_t count, float* outputs) const;
+
+    // Evaluate several batches, each with its own network, in a single parallel dispatch.
+    void Evaluate(const InferenceBatch* batches, size_t batchCount) const;
+
+    uint32_t GetNetworkCount() const
+    {
+        return uint32_t(m_networks.size());
+    }
+
+    uint32_t GetInputCount(uint32_t networkIndex = 0) const
+    {
+        return networkIndex < m_networks.size() ? m_networks[networkIndex].layers.front().inputs : 0;
+    }
+
+    uint32_t GetOutputCount(uint32_t networkIndex = 0) const
+    {
+        return networkIndex < m_networks.size() ? m_networks[networkIndex].layers.back().outputs : 0;
+    }
+
+    // Name of the instruction set the kernels were selected for.
+    const char* GetKernelName() const
+    {
+        return m_kernels->name;
+    }
+
+    // Whether a network is evaluated by a forward pass specialised for its shape.
+    bool IsSpecialised(uint32_t networkIndex = 0) const
+    {
+        return networkIndex < m_networks.size() && m_networks[networkIndex].forward != ForwardGenericMLP;
+    }
+
+private:
+    struct Network
+    {
+        std::vector<PackedLayer> layers;
+        std::vector<KernelLayer> kernelLayers; ///< Views of layers passed to forward.
+        MLPForwardFn forward = nullptr;
+    };
+
+    bool LoadNetwork(NetworkLayout const& layout, const uint8_t* params, size_t paramsSize, Network& network);
+    void UpdateMaxWidth();
+    void UpdateTileRows();
+
+    ThreadPool* m_threadPool;
+    KernelTable const* m_kernels;
+    InferenceEngineDesc m_desc;
+    std::vector<Network> m_networks;
+    uint32_t m_maxWidth = 0; ///< Row stride of the activation scratch buffers, the widest layer of all networks.
+    uint32_t m_tileRows = 0;
+};
+
+NAMESPACE_END(cpu)
+NAMESPACE_END(fluxel)
@@ -0,0 +1,85 @@
+#include <algorithm>
+
+#include "InputEncoding.h"
+#include "AlignedVector.h"
+
+NAMESPACE_BEGIN(fluxel)
+NAMESPACE_BEGIN(cpu)
+
+namespace
+{
+// Samples encoded by a worker per task. The features of a tile are produced feature major, so every encoder call works on
+// a contiguous run of samples, and transposed into the sample major outputs while they are still in the L1 data cache.
+constexpr size_t s_encodingTileSamples = 256;
+
+// encode(x, features, featureStride, count) writes the featuresPerParameter rows of the features of count values.
+template <typename F>
+void EncodeBatch(EncodingBatch const& batch, uint32_t featuresPerParameter, ThreadPool* threadPool, F const& encode)
+{
+    if (batch.count == 0 || batch.parameterCount == 0)
+    {
+        return;
+    }
+
+    const KernelTable& kernels = GetBestKernels();
+    const size_t parameterStride = batch.parameterStride ? batch.parameterStride : batch.count;
+    const uint32_t features = batch.parameterCount * featuresPerParameter;
+    const size_t tileCount = (batch.count + s_encodingTileSamples - 1) / s_encodingTileSamples;
+    (threadPool ? threadPool : &ThreadPool::GetDefault())->ParallelFor(tileCount, [&](size_t tile, uint32_t) {
+        // Features of the tile as [features][s_encodingTileSamples], reused by the thread across calls.
+        thread_local AlignedVector<float> scratch;
+        if (scratch.size() < features * s_encodingTileSamples)
+        {
+            scratch.resize(features * s_encodingTileSamples);
+        }
+
+        const size_t first = tile * s_encodingTileSamples;
+        const size_t count = std::min(s_encodingTileSamples, batch.count - first);
+        for (uint32_t p = 0; p < batch.parameterCount; p++)
+        {
+            encode(batch.parameters + p * parameterStride + first, scratch.data() + p * featuresPerParameter * s_encodingTileSamples,
+                   s_encodingTileSamples, count);
+        }
+        kernels.transpose(reinterpret_cast<const uint8_t*>(scratch.data()), s_encodingTileSamples,
+                          reinterpret_cast<uint8_t*>(batch.outputs + first * features), features, features, uint32_t(count), sizeof(float));
+    });
+}
+} // namespace
+
+void EncodeFrequency(EncodingBatch const& batch, bool halfPrecision, ThreadPool* threadPool)
+{
+    // The shader stores every scale in the output CoopVec<T> before it is used for the next one
+    const EncodingRounding rounding = halfPrecision ? EncodingRounding::Recurrence : EncodingRounding::None;
+    const KernelTable& kernels = GetBestKernels();
+    EncodeBatch(batch, s_frequencyEncodingCount, threadPool, [&](const float* x, float* features, size_t featureStride, size_t count) {
+        kernels.encodeFrequency(x, features, featureStride, count, s_frequencyEncodingCount / 2, rounding);
+    });
+}
+
+void EncodeFrequencyN(EncodingBatch const& batch, uint32_t numScales, bool halfPrecision, ThreadPool* threadPool)
+{
+    // The shader takes the parameters as CoopVec<T>, runs the recurrence in float and converts the whole vector at the end
+    const EncodingRounding rounding = halfPrecision ? EncodingRounding::Outputs : EncodingRounding::None;
+    const KernelTable& kernels = GetBestKernels();
+    EncodeBatch(batch, 2 * numScales, threadPool, [&](const float* x, float* features, size_t featureStride, size_t count) {
+        thread_local float roundedParameters[s_encodingTileSamples];
+        if (halfPrecision)
+        {
+            std::copy(x, x + count, roundedParameters);
+            kernels.roundToHalf(roundedParameters, count);
+            x = roundedParameters;
+        }
+        kernels.encodeFrequency(x, features, featureStride, count, numScales, rounding);
+    });
+}
+
+void EncodeTriangle(EncodingBatch const& batch, bool halfPrecision, ThreadPool* threadPool)
+{
+    const KernelTable& kernels = GetBestKernels();
+    EncodeBatch(batch, s_triangleEncodingCount, threadPool, [&](const float* x, float* features, size_t featureStride, size_t count) {
+        kernels.encodeTriangle(x, features, featureStride, count, s_triangleEncodingCount, halfPrecision);
+    });
+}
+
+NAMESPACE_END(cpu)
+NAMESPACE_END(fluxel)
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "Fluxel.h"
+#include "Kernels.h"
+#include "ThreadPool.h"
+
+NAMESPACE_BEGIN(fluxel)
+NAMESPACE_BEGIN(cpu)
+
+// Features per parameter of EncodeFrequency and EncodeTriangle, FREQUENCY_ENCODING_COUNT and TRIANGLE_ENCODING_COUNT in Utils.slang.
+constexpr uint32_t s_frequencyEncodingCount = 6;
+constexpr uint32_t s_triangleEncodingCount = 6;
+
+// Samples of parameterCount parameters each, stored structure of arrays.
+struct EncodingBatch
+{
+    const float* parameters = nullptr; ///< parameters[p * parameterStride + s] for p < parameterCount and s < count.
+    size_t parameterStride = 0; ///< 0 packs the parameters with a stride of count.
+    uint32_t parameterCount = 0;
+    size_t count = 0;
+    float* outputs = nullptr; ///< [count][parameterCount * features per parameter] floats, the input layout of InferenceEngine.
+};
+
+// Batched versions of the input encoders of Utils.slang, writing the features of every sample in the order of the shader.
+// The outputs match the shader with T = half when halfPrecision is set and T = float otherwise, except for the sin and cos
+// of the first scale, which come from FastSinCos instead of the GPU intrinsics. Work is split in tiles of samples
+// over the thread pool, the default pool is used when none is provided.
+
+// EncodeFrequency<T, PARAMS_COUNT>, s_frequencyEncodingCount features per parameter.
+void EncodeFrequency(EncodingBatch const& batch, bool halfPrecision, ThreadPool* threadPool = nullptr);
+
+// EncodeFrequencyN<T, PARAMS_COUNT, NUM_SCALES>, 2 * numScales features per parameter. The shader takes the parameters as
+// CoopVec<T>, so with halfPrecision they are rounded to half before the encoding.
+void EncodeFrequencyN(EncodingBatch const& batch, uint32_t numScales, bool halfPrecision, ThreadPool* threadPool = nullptr);
+
+// EncodeTriangle<T, PARAMS_COUNT>, s_triangleEncodingCount features per parameter.
+void EncodeTriangle(EncodingBatch const& batch, bool halfPrecision, ThreadPool* threadPool = nullptr);
+
+NAMESPACE_END(cpu)
+NAMESPACE_END(fluxel)
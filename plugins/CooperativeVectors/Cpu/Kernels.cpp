@@ -0,0 +1,393 @@
+#include <algorithm>
+#include <cmath>
+
+#include <Eigen/Core>
+
+#include "Kernels.h"
+#include "FastMath.h"
+#include "SpecialisedMLP.h"
+
+NAMESPACE_BEGIN(fluxel)
+NAMESPACE_BEGIN(cpu)
+
+namespace
+{
+void LinearScalar(const float* input,
+                  size_t inputStride,
+                  const float* weights,
+                  const float* bias,
+                  float* output,
+                  size_t outputStride,
+                  uint32_t rows,
+                  uint32_t inputs,
+                  uint32_t outputsPadded)
+{
+    for (uint32_t r = 0; r < rows; r++)
+    {
+        const float* x = input + r * inputStride;
+        float* y = output + r * outputStride;
+        for (uint32_t o = 0; o < outputsPadded; o++)
+        {
+            y[o] = bias[o];
+        }
+        for (uint32_t i = 0; i < inputs; i++)
+        {
+            const float xi = x[i];
+            const float* w = weights + size_t(i) * outputsPadded;
+            for (uint32_t o = 0; o < outputsPadded; o++)
+            {
+                y[o] += xi * w[o];
+            }
+        }
+    }
+}
+
+void LinearBackwardScalar(const float* grad,
+                          size_t gradStride,
+                          const float* weights,
+                          float* inputGrad,
+                          size_t inputGradStride,
+                          uint32_t rows,
+                          uint32_t inputs,
+                          uint32_t outputsPadded)
+{
+    for (uint32_t r = 0; r < rows; r++)
+    {
+        const float* g = grad + r * gradStride;
+        float* dx = inputGrad + r * inputGradStride;
+        for (uint32_t i = 0; i < inputs; i++)
+        {
+            const float* w = weights + size_t(i) * outputsPadded;
+            float sum = 0.f;
+            for (uint32_t o = 0; o < outputsPadded; o++)
+            {
+                sum += g[o] * w[o];
+            }
+            dx[i] = sum;
+        }
+    }
+}
+
+void OuterProductAccumulateScalar(const float* input,
+                                  size_t inputStride,
+                                  const float* grad,
+                                  size_t gradStride,
+                                  float* weightGrad,
+                                  float* biasGrad,
+                                  uint32_t rows,
+                                  uint32_t inputs,
+                                  uint32_t outputsPadded)
+{
+    for (uint32_t r = 0; r < rows; r++)
+    {
+        const float* x = input + r * inputStride;
+        const float* g = grad + r * gradStride;
+        for (uint32_t i = 0; i < inputs; i++)
+        {
+            float* dw = weightGrad + size_t(i) * outputsPadded;
+            for (uint32_t o = 0; o < outputsPadded; o++)
+            {
+                dw[o] += x[i] * g[o];
+            }
+        }
+        for (uint32_t o = 0; o < outputsPadded; o++)
+        {
+            biasGrad[o] += g[o];
+        }
+    }
+}
+
+void ActivateScalar(ActivationDesc const& act, float* data, size_t count)
+{
+    if (act.type == Activation::None)
+    {
+        return;
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        data[i] = EvaluateActivation(act, data[i]);
+    }
+}
+
+void ActivateBackwardScalar(ActivationDesc const& act, const float* x, float* grad, size_t count)
+{
+    if (act.type == Activation::None)
+    {
+        return;
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        grad[i] = EvaluateActivationDerivative(act, x[i], grad[i]);
+    }
+}
+
+void HalfToFloatScalar(const uint16_t* src, float* dst, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        dst[i] = float(Eigen::numext::bit_cast<Eigen::half>(src[i]));
+    }
+}
+
+void FloatToHalfScalar(const float* src, uint16_t* dst, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        dst[i] = Eigen::numext::bit_cast<uint16_t>(Eigen::half(src[i]));
+    }
+}
+
+void RoundToHalfScalar(float* data, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        data[i] = float(Eigen::half(data[i]));
+    }
+}
+
+// Transpose in square blocks so both the reads and the writes stay within a few cache lines.
+template <typename T>
+void TransposeBlocked(const T* src, size_t srcStride, T* dst, size_t dstStride, uint32_t rows, uint32_t columns)
+{
+    constexpr uint32_t blockSize = 32;
+    for (uint32_t r0 = 0; r0 < rows; r0 += blockSize)
+    {
+        const uint32_t r1 = std::min(rows, r0 + blockSize);
+        for (uint32_t c0 = 0; c0 < columns; c0 += blockSize)
+        {
+            const uint32_t c1 = std::min(columns, c0 + blockSize);
+            for (uint32_t c = c0; c < c1; c++)
+            {
+                for (uint32_t r = r0; r < r1; r++)
+                {
+                    dst[size_t(c) * dstStride + r] = src[size_t(r) * srcStride + c];
+                }
+            }
+        }
+    }
+}
+
+void TransposeScalar(const uint8_t* src, size_t srcStride, uint8_t* dst, size_t dstStride, uint32_t rows, uint32_t columns, uint32_t elementSize)
+{
+    switch (elementSize)
+    {
+    case 1:
+        TransposeBlocked(src, srcStride, dst, dstStride, rows, columns);
+        break;
+    case 2:
+        TransposeBlocked(reinterpret_cast<const uint16_t*>(src), srcStride, reinterpret_cast<uint16_t*>(dst), dstStride, rows, columns);
+        break;
+    case 4:
+        TransposeBlocked(reinterpret_cast<const uint32_t*>(src), srcStride, reinterpret_cast<uint32_t*>(dst), dstStride, rows, columns);
+        break;
+    }
+}
+
+// One row at a time, the output row is activated and rounded while it is still in L1.
+void LinearActivateScalar(const float* input,
+                          size_t inputStride,
+                          const float* weights,
+                          const float* bias,
+                          float* output,
+                          size_t outputStride,
+                          uint32_t rows,
+                          uint32_t inputs,
+                          uint32_t outputsPadded,
+                          ActivationDesc const& act,
+                          bool roundToHalf)
+{
+    for (uint32_t r = 0; r < rows; r++)
+    {
+        float* y = output + r * outputStride;
+        LinearScalar(input + r * inputStride, inputStride, weights, bias, y, outputStride, 1, inputs, outputsPadded);
+        ActivateScalar(act, y, outputsPadded);
+        if (roundToHalf)
+        {
+            RoundToHalfScalar(y, outputsPadded);
+        }
+    }
+}
+
+// Fused linear layer with the dimensions as template arguments, see LinearActivateScalar.
+template <uint32_t INPUTS, uint32_t OUTPUTS_PADDED>
+void LinearFixedScalar(const float* input, KernelLayer const& layer, float* output, size_t stride, uint32_t rows, ActivationDesc const& act, bool roundToHalf)
+{
+    for (uint32_t r = 0; r < rows; r++)
+    {
+        const float* x = input + r * stride;
+        float* y = output + r * stride;
+        float acc[OUTPUTS_PADDED];
+        for (uint32_t o = 0; o < OUTPUTS_PADDED; o++)
+        {
+            acc[o] = layer.bias[o];
+        }
+        for (uint32_t i = 0; i < INPUTS; i++)
+        {
+            const float xi = x[i];
+            const float* w = layer.weights + size_t(i) * OUTPUTS_PADDED;
+            for (uint32_t o = 0; o < OUTPUTS_PADDED; o++)
+            {
+                acc[o] += xi * w[o];
+            }
+        }
+        for (uint32_t o = 0; o < OUTPUTS_PADDED; o++)
+        {
+            y[o] = acc[o];
+        }
+        ActivateScalar(act, y, OUTPUTS_PADDED);
+        if (roundToHalf)
+        {
+            RoundToHalfScalar(y, OUTPUTS_PADDED);
+        }
+    }
+}
+
+// Forward pass of a network whose dimensions are known at compile time.
+template <uint32_t INPUTS, uint32_t HIDDEN_LAYERS, uint32_t HIDDEN, uint32_t OUTPUTS>
+float* ForwardFixedScalar(const KernelLayer* layers, size_t, MLPTileArgs const& args)
+{
+    constexpr uint32_t hiddenPadded = PadKernelWidth(HIDDEN);
+    constexpr uint32_t outputsPadded = PadKernelWidth(OUTPUTS);
+    float* src = args.buffers[0];
+    float* dst = args.buffers[1];
+
+    LinearFixedScalar<INPUTS, hiddenPadded>(src, layers[0], dst, args.stride, args.rows, args.hiddenActivation, args.roundToHalf);
+    for (uint32_t l = 1; l <= HIDDEN_LAYERS; l++)
+    {
+        float* next = src;
+        src = dst;
+        dst = next;
+        if (l < HIDDEN_LAYERS)
+        {
+            LinearFixedScalar<HIDDEN, hiddenPadded>(src, layers[l], dst, args.stride, args.rows, args.hiddenActivation, args.roundToHalf);
+        }
+        else
+        {
+            LinearFixedScalar<HIDDEN, outputsPadded>(src, layers[l], dst, args.stride, args.rows, args.finalActivation, args.roundToHalf);
+        }
+    }
+    return dst;
+}
+
+inline float RoundToHalf(float value)
+{
+    return float(Eigen::half(value));
+}
+
+void EncodeFrequencyScalar(const float* x, float* features, size_t featureStride, size_t count, uint32_t numScales, EncodingRounding rounding)
+{
+    const bool halfRecurrence = rounding == EncodingRounding::Recurrence;
+    const bool halfOutputs = rounding != EncodingRounding::None;
+    for (size_t i = 0; i < count; i++)
+    {
+        float s, c;
+        FastSinCos(x[i] * s_pi, s, c);
+        if (halfRecurrence)
+        {
+            s = RoundToHalf(s);
+            c = RoundToHalf(c);
+        }
+
+        float* y = features + i;
+        for (uint32_t j = 0; j < numScales; j++, y += 2 * featureStride)
+        {
+            if (j > 0)
+            {
+                const float c2 = c + c;
+                if (halfRecurrence)
+                {
+                    // 2 * sin * cos and 2 * cos * cos are exact in float, so rounding them emulates the half operations
+                    s = RoundToHalf((s + s) * c);
+                    c = RoundToHalf(RoundToHalf(c2 * c) - 1.f);
+                }
+                else
+                {
+                    s = (s + s) * c;
+                    c = std::fma(c2, c, -1.f);
+                }
+            }
+            y[0] = halfOutputs ? RoundToHalf(s) : s;
+            y[featureStride] = halfOutputs ? RoundToHalf(c) : c;
+        }
+    }
+}
+
+void EncodeTriangleScalar(const float* x, float* features, size_t featureStride, size_t count, uint32_t numWaves, bool roundToHalf)
+{
+    float scale = 0.5f;
+    float offset = 0.f;
+    for (uint32_t j = 0; j < numWaves; j++, scale *= 2.f, offset += 0.25f)
+    {
+        float* y = features + j * featureStride;
+        for (size_t i = 0; i < count; i++)
+        {
+            const float r = x[i] * scale + offset;
+            const float value = std::fabs(r - std::floor(r) - 0.5f) * 4.f - 1.f;
+            y[i] = roundToHalf ? RoundToHalf(value) : value;
+        }
+    }
+}
+
+// Elementwise approximations of FastMath.h, dst may alias src.
+template <float (*FUNCTION)(float)>
+void FastMathScalar(const float* src, float* dst, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        dst[i] = FUNCTION(src[i]);
+    }
+}
+} // namespace
+
+const KernelTable& GetScalarKernels()
+{
+    static const KernelTable table = {
+        "Scalar",
+        LinearScalar,
+        LinearBackwardScalar,
+        OuterProductAccumulateScalar,
+        ActivateScalar,
+        ActivateBackwardScalar,
+        HalfToFloatScalar,
+        FloatToHalfScalar,
+        RoundToHalfScalar,
+        TransposeScalar,
+        LinearActivateScalar,
+        FastMathScalar<FastExp>,
+        FastMathScalar<FastSigmoid>,
+        FastMathScalar<FastTanh>,
+        FastMathScalar<FastSoftplus>,
+        EncodeFrequencyScalar,
+        EncodeTriangleScalar,
+    };
+    return table;
+}
+
+const SpecialisedMLP* GetScalarSpecialisedMLPs(size_t& count)
+{
+#define FLUXEL_SPECIALISED_MLP_ENTRY(inputs, hiddenLayers, hidden, outputs) \
+    { inputs, hiddenLayers, hidden, outputs, ForwardFixedScalar<inputs, hiddenLayers, hidden, outputs> },
+    static const SpecialisedMLP mlps[] = { FLUXEL_SPECIALISED_MLP_SHAPES(FLUXEL_SPECIALISED_MLP_ENTRY) };
+#undef FLUXEL_SPECIALISED_MLP_ENTRY
+    count = sizeof(mlps) / sizeof(mlps[0]);
+    return mlps;
+}
+
+const KernelTable& GetBestKernels()
+{
+    static const KernelTable* best = []() {
+        if (const KernelTable* table = GetAvx512Kernels())
+        {
+            return table;
+        }
+        if (const KernelTable* table = GetAvx2Kernels())
+        {
+            return table;
+        }
+        return &GetScalarKernels();
+    }();
+    return *best;
+}
+
+NAMESPACE_END(cpu)
+NAMESPACE_END(fluxel)
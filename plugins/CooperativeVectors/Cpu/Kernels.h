@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Fluxel.h"
+#include "Activation.h"
+
+NAMESPACE_BEGIN(fluxel)
+NAMESPACE_BEGIN(cpu)
+
+// Output widths of the packed layer weights are padded to this many floats so every
+// kernel variant can work on whole SIMD registers without tail handling.
+constexpr uint32_t s_kernelWidthAlignment = 16;
+
+constexpr uint32_t PadKernelWidth(uint32_t width)
+{
+    return (width + s_kernelWidthAlignment - 1) / s_kernelWidthAlignment * s_kernelWidthAlignment;
+}
+
+// Where the input encoders round to half, mirroring the CoopVec<T> of the encoders in Utils.slang.
+enum class EncodingRounding
+{
+    None, ///< T = float.
+    Outputs, ///< T = half with the values computed in float, EncodeFrequencyN and EncodeTriangle.
+    Recurrence, ///< T = half with every step of the double angle recurrence in half, EncodeFrequency.
+};
+
+// Function table of the CPU network kernels for one instruction set.
+// All matrices are row-major float arrays with explicit row strides (in elements).
+struct KernelTable
+{
+    const char* name = nullptr;
+
+    // output[r][o] = bias[o] + sum_i input[r][i] * weights[i][o]
+    // for r < rows and o < outputsPadded. weights is the transposed layer matrix with a row stride of outputsPadded.
+    void (*linear)(const float* input,
+                   size_t inputStride,
+                   const float* weights,
+                   const float* bias,
+                   float* output,
+                   size_t outputStride,
+                   uint32_t rows,
+                   uint32_t inputs,
+                   uint32_t outputsPadded) = nullptr;
+
+    // inputGrad[r][i] = sum_o grad[r][o] * weights[i][o] for r < rows and i < inputs.
+    // Backward of linear with respect to the input, weights as for linear.
+    void (*linearBackward)(const float* grad,
+                           size_t gradStride,
+                           const float* weights,
+                           float* inputGrad,
+                           size_t inputGradStride,
+                           uint32_t rows,
+                           uint32_t inputs,
+                           uint32_t outputsPadded) = nullptr;
+
+    // weightGrad[i][o] += sum_r input[r][i] * grad[r][o] and biasGrad[o] += sum_r grad[r][o].
+    // Backward of linear with respect to the parameters, gradients are in the transposed layout of the weights.
+    void (*outerProductAccumulate)(const float* input,
+                                   size_t inputStride,
+                                   const float* grad,
+                                   size_t gradStride,
+                                   float* weightGrad,
+                                   float* biasGrad,
+                                   uint32_t rows,
+                                   uint32_t inputs,
+                                   uint32_t outputsPadded) = nullptr;
+
+    // Apply an activation function in place to count contiguous values.
+    void (*activate)(ActivationDesc const& act, float* data, size_t count) = nullptr;
+
+    // grad[i] = d act(x[i]) * grad[i], with x the pre-activation values.
+    void (*activateBackward)(ActivationDesc const& act, const float* x, float* grad, size_t count) = nullptr;
+
+    // IEEE half <-> float conversions with round to nearest even.
+    void (*halfToFloat)(const uint16_t* src, float* dst, size_t count) = nullptr;
+    void (*floatToHalf)(const float* src, uint16_t* dst, size_t count) = nullptr;
+
+    // Round values in place to the nearest representable half, mirroring storage in a CoopVec<half>.
+    void (*roundToHalf)(float* data, size_t count) = nullptr;
+
+    // dst[c][r] = src[r][c] for r < rows and c < columns, for elements of 1, 2 or 4 bytes.
+    // Strides are in elements, src and dst must not overlap.
+    void (*transpose)(const uint8_t* src, size_t srcStride, uint8_t* dst, size_t dstStride, uint32_t rows, uint32_t columns, uint32_t elementSize) = nullptr;
+
+    // linear followed by activate and, when roundToHalf is set, roundToHalf on all outputsPadded columns.
+    // The activation is applied to each block of outputs while it is still in registers, so the layer output is written once.
+    // Results match the separate kernels.
+    void (*linearActivate)(const float* input,
+                           size_t inputStride,
+                           const float* weights,
+                           const float* bias,
+                           float* output,
+                           size_t outputStride,
+                           uint32_t rows,
+                           uint32_t inputs,
+                           uint32_t outputsPadded,
+                           ActivationDesc const& act,
+                           bool roundToHalf) = nullptr;
+
+    // dst[i] = f(src[i]) with the approximations of FastMath.h, dst may alias src.
+    // The SIMD kernels also use them for the transcendental activations, the scalar activate uses the C library.
+    void (*fastExp)(const float* src, float* dst, size_t count) = nullptr;
+    void (*fastSigmoid)(const float* src, float* dst, size_t count) = nullptr;
+    void (*fastTanh)(const float* src, float* dst, size_t count) = nullptr;
+    void (*fastSoftplus)(const float* src, float* dst, size_t count) = nullptr;
+
+    // Frequency encoding of count values x in feature major layout, for j < numScales:
+    // features[2j][s] = sin(2^j * pi * x[s]) and features[2j + 1][s] = cos(2^j * pi * x[s]), with a row stride of featureStride.
+    // sin and cos of pi * x come from FastSinCos, the higher scales from the double angle recurrence of Utils.slang,
+    // sin' = 2 * sin * cos and cos' = 2 * cos * cos - 1 with a fused multiply add in float.
+    void (*encodeFrequency)(const float* x, float* features, size_t featureStride, size_t count, uint32_t numScales, EncodingRounding rounding) = nullptr;
+
+    // Triangle wave encoding of Utils.slang in feature major layout, for j < numWaves:
+    // features[j][s] = |r - floor(r) - 0.5| * 4 - 1 with r = x[s] * 2^(j - 1) + j / 4.
+    void (*encodeTriangle)(const float* x, float* features, size_t featureStride, size_t count, uint32_t numWaves, bool roundToHalf) = nullptr;
+};
+
+// Portable C++ implementation, always available.
+const KernelTable& GetScalarKernels();
+
+// SIMD implementations, these return nullptr when not compiled in or not supported by the host CPU.
+const KernelTable* GetAvx2Kernels();
+const KernelTable* GetAvx512Kernels();
+
+// Best kernel table for the host CPU.
+const KernelTable& GetBestKernels();
+
+NAMESPACE_END(cpu)
+NAMESPACE_END(fluxel)
@@ -0,0 +1,861 @@
+// AVX2 + FMA + F16C kernels.
+// This file is compiled with AVX2 code generation enabled (see CMakeLists.txt). It must not instantiate inline
+// functions shared with other translation units (Eigen, std algorithms, Activation.h helpers), otherwise the linker
+// may pick the AVX2 copy for callers on the scalar path. Scalar fallbacks go through GetScalarKernels() instead.
+
+#include <cstring>
+
+#include "Kernels.h"
+#include "CpuFeatures.h"
+#include "FastMath.h"
+#include "SpecialisedMLP.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#include <immintrin.h>
+#define FLUXEL_KERNELS_AVX2 1
+#endif
+
+NAMESPACE_BEGIN(fluxel)
+NAMESPACE_BEGIN(cpu)
+
+#if FLUXEL_KERNELS_AVX2
+namespace
+{
+// Approximations of FastMath.h on 8 lanes, with the same operations as the scalar versions fused into multiply adds.
+inline __m256 ExpAvx2(__m256 x)
+{
+    // max and min return their second operand for NaN inputs, so NaN propagates
+    x = _mm256_min_ps(_mm256_set1_ps(s_expMaxInput), _mm256_max_ps(_mm256_set1_ps(s_expMinInput), x));
+    const __m256 n = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(s_log2e)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256 r = _mm256_fnmadd_ps(n, _mm256_set1_ps(s_ln2Hi), x);
+    r = _mm256_fnmadd_ps(n, _mm256_set1_ps(s_ln2Lo), r);
+
+    __m256 p = _mm256_set1_ps(s_expPolynomial[0]);
+    for (int i = 1; i < 6; i++)
+    {
+        p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(s_expPolynomial[i]));
+    }
+    p = _mm256_add_ps(_mm256_fmadd_ps(p, _mm256_mul_ps(r, r), r), _mm256_set1_ps(1.f));
+
+    // Scale by 2^n in two steps, so both factors are normal numbers over the whole input range
+    const __m256i bias = _mm256_set1_epi32(127);
+    const __m256i ni = _mm256_cvtps_epi32(n);
+    const __m256i a = _mm256_srai_epi32(ni, 1);
+    const __m256i b = _mm256_sub_epi32(ni, a);
+    p = _mm256_mul_ps(p, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(a, bias), 23)));
+    return _mm256_mul_ps(p, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(b, bias), 23)));
+}
+
+inline __m256 SigmoidAvx2(__m256 x)
+{
+    const __m256 one = _mm256_set1_ps(1.f);
+    const __m256 e = ExpAvx2(_mm256_or_ps(x, _mm256_set1_ps(-0.f)));
+    return _mm256_div_ps(_mm256_blendv_ps(one, e, _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_LT_OQ)), _mm256_add_ps(one, e));
+}
+
+inline __m256 TanhAvx2(__m256 x)
+{
+    const __m256 one = _mm256_set1_ps(1.f);
+    const __m256 sign = _mm256_and_ps(x, _mm256_set1_ps(-0.f));
+    const __m256 ax = _mm256_xor_ps(x, sign);
+
+    const __m256 z = _mm256_mul_ps(x, x);
+    __m256 p = _mm256_set1_ps(s_tanhPolynomial[0]);
+    for (int i = 1; i < 5; i++)
+    {
+        p = _mm256_fmadd_ps(p, z, _mm256_set1_ps(s_tanhPolynomial[i]));
+    }
+    const __m256 small = _mm256_fmadd_ps(_mm256_mul_ps(p, z), x, x);
+
+    const __m256 e = ExpAvx2(_mm256_add_ps(ax, ax));
+    const __m256 large = _mm256_or_ps(_mm256_sub_ps(one, _mm256_div_ps(_mm256_set1_ps(2.f), _mm256_add_ps(e, one))), sign);
+    return _mm256_blendv_ps(large, small, _mm256_cmp_ps(ax, _mm256_set1_ps(s_tanhPolynomialRange), _CMP_LT_OQ));
+}
+
+inline __m256 SoftplusAvx2(__m256 x)
+{
+    // log(u) with u = 1 + t in [1, 2], plus the rounding error of u divided by u
+    const __m256 one = _mm256_set1_ps(1.f);
+    const __m256 t = ExpAvx2(_mm256_or_ps(x, _mm256_set1_ps(-0.f)));
+    const __m256 u = _mm256_add_ps(one, t);
+    const __m256 c = _mm256_sub_ps(t, _mm256_sub_ps(u, one));
+    const __m256 upper = _mm256_cmp_ps(u, _mm256_set1_ps(s_sqrt2), _CMP_GT_OQ);
+    const __m256 e = _mm256_and_ps(upper, one);
+    const __m256 f = _mm256_sub_ps(_mm256_blendv_ps(u, _mm256_mul_ps(u, _mm256_set1_ps(0.5f)), upper), one);
+    const __m256 z = _mm256_mul_ps(f, f);
+
+    __m256 p = _mm256_set1_ps(s_logPolynomial[0]);
+    for (int i = 1; i < 9; i++)
+    {
+        p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(s_logPolynomial[i]));
+    }
+    __m256 y = _mm256_mul_ps(_mm256_mul_ps(p, f), z);
+    y = _mm256_fmadd_ps(e, _mm256_set1_ps(s_ln2Lo), y);
+    y = _mm256_fnmadd_ps(_mm256_set1_ps(0.5f), z, y);
+    const __m256 log1p = _mm256_add_ps(_mm256_fmadd_ps(e, _mm256_set1_ps(s_ln2Hi), _mm256_add_ps(f, y)), _mm256_div_ps(c, u));
+    return _mm256_add_ps(_mm256_max_ps(x, _mm256_setzero_ps()), log1p);
+}
+
+// Activation of 8 lanes. param is the slope of the negative lanes for (leaky) ReLU and the scale for Linear.
+template <Activation TYPE>
+inline __m256 ActivateLanes(__m256 x, __m256 param)
+{
+    if constexpr (TYPE == Activation::Linear)
+    {
+        return _mm256_mul_ps(param, x);
+    }
+    else if constexpr (TYPE == Activation::ReLU || TYPE == Activation::LeakyReLU)
+    {
+        return _mm256_blendv_ps(x, _mm256_mul_ps(x, param), _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_LT_OQ));
+    }
+    else if constexpr (TYPE == Activation::Exponential)
+    {
+        return ExpAvx2(x);
+    }
+    else if constexpr (TYPE == Activation::ShiftedExponential)
+    {
+        return _mm256_sub_ps(ExpAvx2(x), _mm256_set1_ps(1.f));
+    }
+    else if constexpr (TYPE == Activation::Sigmoid)
+    {
+        return SigmoidAvx2(x);
+    }
+    else if constexpr (TYPE == Activation::Swish)
+    {
+        return _mm256_mul_ps(x, SigmoidAvx2(x));
+    }
+    else if constexpr (TYPE == Activation::Tanh)
+    {
+        return TanhAvx2(x);
+    }
+    else
+    {
+        return x;
+    }
+}
+
+// grad scaled by the derivative of the activation at the pre-activation values x.
+template <Activation TYPE>
+inline __m256 ActivateBackwardLanes(__m256 x, __m256 grad, __m256 param)
+{
+    const __m256 one = _mm256_set1_ps(1.f);
+    if constexpr (TYPE == Activation::Linear)
+    {
+        return _mm256_mul_ps(param, grad);
+    }
+    else if constexpr (TYPE == Activation::ReLU || TYPE == Activation::LeakyReLU)
+    {
+        return _mm256_blendv_ps(_mm256_mul_ps(grad, param), grad, _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_GT_OQ));
+    }
+    else if constexpr (TYPE == Activation::Exponential || TYPE == Activation::ShiftedExponential)
+    {
+        return _mm256_mul_ps(ExpAvx2(x), grad);
+    }
+    else if constexpr (TYPE == Activation::Sigmoid)
+    {
+        const __m256 s = SigmoidAvx2(x);
+        return _mm256_mul_ps(_mm256_mul_ps(grad, s), _mm256_sub_ps(one, s));
+    }
+    else if constexpr (TYPE == Activation::Swish)
+    {
+        const __m256 s = SigmoidAvx2(x);
+        return _mm256_mul_ps(grad, _mm256_fmadd_ps(_mm256_mul_ps(x, s), _mm256_sub_ps(one, s), s));
+    }
+    else if constexpr (TYPE == Activation::Tanh)
+    {
+        const __m256 t = TanhAvx2(x);
+        return _mm256_mul_ps(grad, _mm256_fnmadd_ps(t, t, one));
+    }
+    else
+    {
+        return grad;
+    }
+}
+
+// Calls function.template operator()<TYPE>() for the activation type, so the activation loops are compiled per type.
+template <typename F>
+inline void DispatchActivation(Activation type, F const& function)
+{
+    switch (type)
+    {
+    case Activation::Linear:
+        return function.template operator()<Activation::Linear>();
+    case Activation::Exponential:
+        return function.template operator()<Activation::Exponential>();
+    case Activation::ShiftedExponential:
+        return function.template operator()<Activation::ShiftedExponential>();
+    case Activation::ReLU:
+        return function.template operator()<Activation::ReLU>();
+    case Activation::LeakyReLU:
+        return function.template operator()<Activation::LeakyReLU>();
+    case Activation::Sigmoid:
+        return function.template operator()<Activation::Sigmoid>();
+    case Activation::Swish:
+        return function.template operator()<Activation::Swish>();
+    case Activation::Tanh:
+        return function.template operator()<Activation::Tanh>();
+    default:
+        return function.template operator()<Activation::None>();
+    }
+}
+
+inline __m256 ActivationParam(ActivationDesc const& act)
+{
+    return _mm256_set1_ps(act.type == Activation::ReLU ? 0.f : act.param);
+}
+
+// Activation and rounding of linearActivate, applied to the accumulators of a block before they are stored.
+struct BlockEpilogue
+{
+    Activation type;
+    __m256 param; ///< See ActivateLanes.
+    bool roundToHalf;
+};
+
+inline BlockEpilogue MakeEpilogue(ActivationDesc const& act, bool roundToHalf)
+{
+    BlockEpilogue epilogue;
+    epilogue.type = act.type;
+    epilogue.param = ActivationParam(act);
+    epilogue.roundToHalf = roundToHalf;
+    return epilogue;
+}
+
+// Same operations as ActivateAvx2 and RoundToHalfAvx2.
+inline __m256 ApplyEpilogue(BlockEpilogue const& epilogue, __m256 x)
+{
+    DispatchActivation(epilogue.type, [&]<Activation TYPE>() { x = ActivateLanes<TYPE>(x, epilogue.param); });
+    return epilogue.roundToHalf ? _mm256_cvtph_ps(_mm256_cvtps_ph(x, _MM_FROUND_TO_NEAREST_INT)) : x;
+}
+
+// Computes a block of rows x 16 outputs, keeping the accumulators in registers for the whole reduction.
+// FUSED blocks apply the epilogue before the store.
+template <uint32_t ROWS, bool FUSED = false>
+inline void LinearBlock(const float* input,
+                        size_t inputStride,
+                        const float* weights,
+                        const float* bias,
+                        float* output,
+                        size_t outputStride,
+                        uint32_t inputs,
+                        uint32_t outputsPadded,
+                        uint32_t o,
+                        const BlockEpilogue* epilogue = nullptr)
+{
+    __m256 acc[ROWS][2];
+    const __m256 b0 = _mm256_loadu_ps(bias + o);
+    const __m256 b1 = _mm256_loadu_ps(bias + o + 8);
+    for (uint32_t r = 0; r < ROWS; r++)
+    {
+        acc[r][0] = b0;
+        acc[r][1] = b1;
+    }
+
+    const float* w = weights + o;
+    for (uint32_t i = 0; i < inputs; i++, w += outputsPadded)
+    {
+        const __m256 w0 = _mm256_loadu_ps(w);
+        const __m256 w1 = _mm256_loadu_ps(w + 8);
+        for (uint32_t r = 0; r < ROWS; r++)
+        {
+            const __m256 x = _mm256_broadcast_ss(input + r * inputStride + i);
+            acc[r][0] = _mm256_fmadd_ps(x, w0, acc[r][0]);
+            acc[r][1] = _mm256_fmadd_ps(x, w1, acc[r][1]);
+        }
+    }
+
+    for (uint32_t r = 0; r < ROWS; r++)
+    {
+        float* y = output + r * outputStride + o;
+        if constexpr (FUSED)
+        {
+            acc[r][0] = ApplyEpilogue(*epilogue, acc[r][0]);
+            acc[r][1] = ApplyEpilogue(*epilogue, acc[r][1]);
+        }
+        _mm256_storeu_ps(y, acc[r][0]);
+        _mm256_storeu_ps(y + 8, acc[r][1]);
+    }
+}
+
+// All rows of a tile in blocks of 4 rows.
+template <bool FUSED>
+void LinearTile(const float* input,
+                size_t inputStride,
+                const float* weights,
+                const float* bias,
+                float* output,
+                size_t outputStride,
+                uint32_t rows,
+                uint32_t inputs,
+                uint32_t outputsPadded,
+                const BlockEpilogue* epilogue)
+{
+    constexpr uint32_t blockRows = 4;
+
+    uint32_t r = 0;
+    for (; r + blockRows <= rows; r += blockRows)
+    {
+        for (uint32_t o = 0; o < outputsPadded; o += 16)
+        {
+            LinearBlock<blockRows, FUSED>(input + r * inputStride, inputStride, weights, bias, output + r * outputStride, outputStride, inputs,
+                                          outputsPadded, o, epilogue);
+        }
+    }
+    for (; r < rows; r++)
+    {
+        for (uint32_t o = 0; o < outputsPadded; o += 16)
+        {
+            LinearBlock<1, FUSED>(input + r * inputStride, inputStride, weights, bias, output + r * outputStride, outputStride, inputs, outputsPadded, o,
+                                  epilogue);
+        }
+    }
+}
+
+void LinearAvx2(const float* input,
+                size_t inputStride,
+                const float* weights,
+                const float* bias,
+                float* output,
+                size_t outputStride,
+                uint32_t rows,
+                uint32_t inputs,
+                uint32_t outputsPadded)
+{
+    LinearTile<false>(input, inputStride, weights, bias, output, outputStride, rows, inputs, outputsPadded, nullptr);
+}
+
+void LinearActivateAvx2(const float* input,
+                        size_t inputStride,
+                        const float* weights,
+                        const float* bias,
+                        float* output,
+                        size_t outputStride,
+                        uint32_t rows,
+                        uint32_t inputs,
+                        uint32_t outputsPadded,
+                        ActivationDesc const& act,
+                        bool roundToHalf)
+{
+    const BlockEpilogue epilogue = MakeEpilogue(act, roundToHalf);
+    LinearTile<true>(input, inputStride, weights, bias, output, outputStride, rows, inputs, outputsPadded, &epilogue);
+}
+
+inline float HorizontalSum(__m256 v)
+{
+    __m128 x = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    x = _mm_add_ps(x, _mm_movehl_ps(x, x));
+    x = _mm_add_ss(x, _mm_movehdup_ps(x));
+    return _mm_cvtss_f32(x);
+}
+
+void LinearBackwardAvx2(const float* grad,
+                        size_t gradStride,
+                        const float* weights,
+                        float* inputGrad,
+                        size_t inputGradStride,
+                        uint32_t rows,
+                        uint32_t inputs,
+                        uint32_t outputsPadded)
+{
+    for (uint32_t r = 0; r < rows; r++)
+    {
+        const float* g = grad + r * gradStride;
+        float* dx = inputGrad + r * inputGradStride;
+
+        // Four dot products at a time to hide the FMA latency
+        uint32_t i = 0;
+        for (; i + 4 <= inputs; i += 4)
+        {
+            const float* w = weights + size_t(i) * outputsPadded;
+            __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps(), acc2 = _mm256_setzero_ps(), acc3 = _mm256_setzero_ps();
+            for (uint32_t o = 0; o < outputsPadded; o += 8)
+            {
+                const __m256 gv = _mm256_loadu_ps(g + o);
+                acc0 = _mm256_fmadd_ps(gv, _mm256_loadu_ps(w + o), acc0);
+                acc1 = _mm256_fmadd_ps(gv, _mm256_loadu_ps(w + outputsPadded + o), acc1);
+                acc2 = _mm256_fmadd_ps(gv, _mm256_loadu_ps(w + 2 * outputsPadded + o), acc2);
+                acc3 = _mm256_fmadd_ps(gv, _mm256_loadu_ps(w + 3 * outputsPadded + o), acc3);
+            }
+            dx[i + 0] = HorizontalSum(acc0);
+            dx[i + 1] = HorizontalSum(acc1);
+            dx[i + 2] = HorizontalSum(acc2);
+            dx[i + 3] = HorizontalSum(acc3);
+        }
+        for (; i < inputs; i++)
+        {
+            const float* w = weights + size_t(i) * outputsPadded;
+            __m256 acc = _mm256_setzero_ps();
+            for (uint32_t o = 0; o < outputsPadded; o += 8)
+            {
+                acc = _mm256_fmadd_ps(_mm256_loadu_ps(g + o), _mm256_loadu_ps(w + o), acc);
+            }
+            dx[i] = HorizontalSum(acc);
+        }
+    }
+}
+
+void OuterProductAccumulateAvx2(const float* input,
+                                size_t inputStride,
+                                const float* grad,
+                                size_t gradStride,
+                                float* weightGrad,
+                                float* biasGrad,
+                                uint32_t rows,
+                                uint32_t inputs,
+                                uint32_t outputsPadded)
+{
+    // Each 16 wide slice of a gradient row stays in registers while all rows of the tile are accumulated.
+    for (uint32_t i = 0; i < inputs; i++)
+    {
+        float* dw = weightGrad + size_t(i) * outputsPadded;
+        for (uint32_t o = 0; o < outputsPadded; o += 16)
+        {
+            __m256 acc0 = _mm256_loadu_ps(dw + o);
+            __m256 acc1 = _mm256_loadu_ps(dw + o + 8);
+            for (uint32_t r = 0; r < rows; r++)
+            {
+                const __m256 x = _mm256_broadcast_ss(input + r * inputStride + i);
+                const float* g = grad + r * gradStride + o;
+                acc0 = _mm256_fmadd_ps(x, _mm256_loadu_ps(g), acc0);
+                acc1 = _mm256_fmadd_ps(x, _mm256_loadu_ps(g + 8), acc1);
+            }
+            _mm256_storeu_ps(dw + o, acc0);
+            _mm256_storeu_ps(dw + o + 8, acc1);
+        }
+    }
+
+    for (uint32_t o = 0; o < outputsPadded; o += 8)
+    {
+        __m256 acc = _mm256_loadu_ps(biasGrad + o);
+        for (uint32_t r = 0; r < rows; r++)
+        {
+            acc = _mm256_add_ps(acc, _mm256_loadu_ps(grad + r * gradStride + o));
+        }
+        _mm256_storeu_ps(biasGrad + o, acc);
+    }
+}
+
+void ActivateAvx2(ActivationDesc const& act, float* data, size_t count)
+{
+    if (act.type == Activation::None)
+    {
+        return;
+    }
+
+    const __m256 param = ActivationParam(act);
+    DispatchActivation(act.type, [&]<Activation TYPE>() {
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            _mm256_storeu_ps(data + i, ActivateLanes<TYPE>(_mm256_loadu_ps(data + i), param));
+        }
+        if (i < count)
+        {
+            // The tail goes through a padded copy, so all values use the same approximations
+            float tail[8] = {};
+            std::memcpy(tail, data + i, (count - i) * sizeof(float));
+            _mm256_storeu_ps(tail, ActivateLanes<TYPE>(_mm256_loadu_ps(tail), param));
+            std::memcpy(data + i, tail, (count - i) * sizeof(float));
+        }
+    });
+}
+
+void ActivateBackwardAvx2(ActivationDesc const& act, const float* x, float* grad, size_t count)
+{
+    if (act.type == Activation::None)
+    {
+        return;
+    }
+
+    const __m256 param = ActivationParam(act);
+    DispatchActivation(act.type, [&]<Activation TYPE>() {
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            _mm256_storeu_ps(grad + i, ActivateBackwardLanes<TYPE>(_mm256_loadu_ps(x + i), _mm256_loadu_ps(grad + i), param));
+        }
+        if (i < count)
+        {
+            float xTail[8] = {};
+            float gradTail[8] = {};
+            std::memcpy(xTail, x + i, (count - i) * sizeof(float));
+            std::memcpy(gradTail, grad + i, (count - i) * sizeof(float));
+            _mm256_storeu_ps(gradTail, ActivateBackwardLanes<TYPE>(_mm256_loadu_ps(xTail), _mm256_loadu_ps(gradTail), param));
+            std::memcpy(grad + i, gradTail, (count - i) * sizeof(float));
+        }
+    });
+}
+
+// Elementwise approximations of FastMath.h, dst may alias src.
+template <__m256 (*FUNCTION)(__m256)>
+void FastMathAvx2(const float* src, float* dst, size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        _mm256_storeu_ps(dst + i, FUNCTION(_mm256_loadu_ps(src + i)));
+    }
+    if (i < count)
+    {
+        float tail[8] = {};
+        std::memcpy(tail, src + i, (count - i) * sizeof(float));
+        _mm256_storeu_ps(tail, FUNCTION(_mm256_loadu_ps(tail)));
+        std::memcpy(dst + i, tail, (count - i) * sizeof(float));
+    }
+}
+
+// FastSinCos on 8 lanes.
+inline void SinCosAvx2(__m256 x, __m256& sinX, __m256& cosX)
+{
+    const __m256 n = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(s_2OverPi)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256 r = _mm256_fnmadd_ps(n, _mm256_set1_ps(s_piOver2Hi), x);
+    r = _mm256_fnmadd_ps(n, _mm256_set1_ps(s_piOver2Mid), r);
+    r = _mm256_fnmadd_ps(n, _mm256_set1_ps(s_piOver2Lo), r);
+
+    const __m256 z = _mm256_mul_ps(r, r);
+    const __m256 p = _mm256_fmadd_ps(_mm256_fmadd_ps(_mm256_set1_ps(s_sinPolynomial[0]), z, _mm256_set1_ps(s_sinPolynomial[1])), z,
+                                     _mm256_set1_ps(s_sinPolynomial[2]));
+    const __m256 q = _mm256_fmadd_ps(_mm256_fmadd_ps(_mm256_set1_ps(s_cosPolynomial[0]), z, _mm256_set1_ps(s_cosPolynomial[1])), z,
+                                     _mm256_set1_ps(s_cosPolynomial[2]));
+    const __m256 s = _mm256_fmadd_ps(p, _mm256_mul_ps(z, r), r);
+    const __m256 c = _mm256_fmadd_ps(q, _mm256_mul_ps(z, z), _mm256_fmadd_ps(_mm256_set1_ps(-0.5f), z, _mm256_set1_ps(1.f)));
+
+    // Quadrant of x, odd quadrants swap sin and cos. Bit 1 of the quadrant, and of the quadrant + 1, moves to the sign bits.
+    const __m256i quadrant = _mm256_cvtps_epi32(n);
+    const __m256 swap = _mm256_castsi256_ps(_mm256_slli_epi32(quadrant, 31));
+    const __m256 sinSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(quadrant, _mm256_set1_epi32(2)), 30));
+    const __m256 cosSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(quadrant, _mm256_set1_epi32(1)), _mm256_set1_epi32(2)), 30));
+    sinX = _mm256_xor_ps(_mm256_blendv_ps(s, c, swap), sinSign);
+    cosX = _mm256_xor_ps(_mm256_blendv_ps(c, s, swap), cosSign);
+}
+
+inline __m256 RoundToHalfLanes(__m256 x)
+{
+    return _mm256_cvtph_ps(_mm256_cvtps_ph(x, _MM_FROUND_TO_NEAREST_INT));
+}
+
+// Stores the first lanes values of v.
+inline void StoreLanes(float* dst, __m256 v, size_t lanes)
+{
+    if (lanes == 8)
+    {
+        _mm256_storeu_ps(dst, v);
+        return;
+    }
+    float values[8];
+    _mm256_storeu_ps(values, v);
+    std::memcpy(dst, values, lanes * sizeof(float));
+}
+
+// Loads lanes values, the other lanes are zero.
+inline __m256 LoadLanes(const float* src, size_t lanes)
+{
+    if (lanes == 8)
+    {
+        return _mm256_loadu_ps(src);
+    }
+    float values[8] = {};
+    std::memcpy(values, src, lanes * sizeof(float));
+    return _mm256_loadu_ps(values);
+}
+
+// Same operations as EncodeFrequencyScalar.
+void EncodeFrequencyAvx2(const float* x, float* features, size_t featureStride, size_t count, uint32_t numScales, EncodingRounding rounding)
+{
+    const bool halfRecurrence = rounding == EncodingRounding::Recurrence;
+    const bool halfOutputs = rounding != EncodingRounding::None;
+    const __m256 one = _mm256_set1_ps(1.f);
+    for (size_t i = 0; i < count; i += 8)
+    {
+        const size_t lanes = count - i < 8 ? count - i : 8;
+        __m256 s, c;
+        SinCosAvx2(_mm256_mul_ps(LoadLanes(x + i, lanes), _mm256_set1_ps(s_pi)), s, c);
+        if (halfRecurrence)
+        {
+            s = RoundToHalfLanes(s);
+            c = RoundToHalfLanes(c);
+        }
+
+        float* y = features + i;
+        for (uint32_t j = 0; j < numScales; j++, y += 2 * featureStride)
+        {
+            if (j > 0)
+            {
+                const __m256 c2 = _mm256_add_ps(c, c);
+                if (halfRecurrence)
+                {
+                    s = RoundToHalfLanes(_mm256_mul_ps(_mm256_add_ps(s, s), c));
+                    c = RoundToHalfLanes(_mm256_sub_ps(RoundToHalfLanes(_mm256_mul_ps(c2, c)), one));
+                }
+                else
+                {
+                    s = _mm256_mul_ps(_mm256_add_ps(s, s), c);
+                    c = _mm256_fmsub_ps(c2, c, one);
+                }
+            }
+            StoreLanes(y, halfOutputs ? RoundToHalfLanes(s) : s, lanes);
+            StoreLanes(y + featureStride, halfOutputs ? RoundToHalfLanes(c) : c, lanes);
+        }
+    }
+}
+
+// Same operations as EncodeTriangleScalar.
+void EncodeTriangleAvx2(const float* x, float* features, size_t featureStride, size_t count, uint32_t numWaves, bool roundToHalf)
+{
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 four = _mm256_set1_ps(4.f);
+    const __m256 one = _mm256_set1_ps(1.f);
+    const __m256 signMask = _mm256_set1_ps(-0.f);
+    float scale = 0.5f;
+    float offset = 0.f;
+    for (uint32_t j = 0; j < numWaves; j++, scale *= 2.f, offset += 0.25f)
+    {
+        const __m256 scaleLanes = _mm256_set1_ps(scale);
+        const __m256 offsetLanes = _mm256_set1_ps(offset);
+        float* y = features + j * featureStride;
+        for (size_t i = 0; i < count; i += 8)
+        {
+            const size_t lanes = count - i < 8 ? count - i : 8;
+            // The scale is a power of two, so the product is exact and the fused multiply add rounds like the scalar version
+            const __m256 r = _mm256_fmadd_ps(LoadLanes(x + i, lanes), scaleLanes, offsetLanes);
+            const __m256 wave = _mm256_andnot_ps(signMask, _mm256_sub_ps(_mm256_sub_ps(r, _mm256_floor_ps(r)), half));
+            const __m256 value = _mm256_sub_ps(_mm256_mul_ps(wave, four), one);
+            StoreLanes(y + i, roundToHalf ? RoundToHalfLanes(value) : value, lanes);
+        }
+    }
+}
+
+void HalfToFloatAvx2(const uint16_t* src, float* dst, size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i))));
+    }
+    GetScalarKernels().halfToFloat(src + i, dst + i, count - i);
+}
+
+void FloatToHalfAvx2(const float* src, uint16_t* dst, size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+    }
+    GetScalarKernels().floatToHalf(src + i, dst + i, count - i);
+}
+
+void RoundToHalfAvx2(float* data, size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(data + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm256_storeu_ps(data + i, _mm256_cvtph_ps(h));
+    }
+    GetScalarKernels().roundToHalf(data + i, count - i);
+}
+
+// 8 x 8 block of 32 bit elements.
+void Transpose8x8x32(const uint8_t* src, size_t srcStride, uint8_t* dst, size_t dstStride)
+{
+    const float* s = reinterpret_cast<const float*>(src);
+    float* d = reinterpret_cast<float*>(dst);
+
+    __m256 r[8];
+    for (int i = 0; i < 8; i++)
+    {
+        r[i] = _mm256_loadu_ps(s + i * srcStride);
+    }
+
+    __m256 t[8];
+    for (int i = 0; i < 8; i += 2)
+    {
+        t[i] = _mm256_unpacklo_ps(r[i], r[i + 1]);
+        t[i + 1] = _mm256_unpackhi_ps(r[i], r[i + 1]);
+    }
+
+    for (int i = 0; i < 8; i += 4)
+    {
+        r[i] = _mm256_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(1, 0, 1, 0));
+        r[i + 1] = _mm256_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(3, 2, 3, 2));
+        r[i + 2] = _mm256_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(1, 0, 1, 0));
+        r[i + 3] = _mm256_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(3, 2, 3, 2));
+    }
+
+    for (int i = 0; i < 4; i++)
+    {
+        _mm256_storeu_ps(d + i * dstStride, _mm256_permute2f128_ps(r[i], r[i + 4], 0x20));
+        _mm256_storeu_ps(d + (i + 4) * dstStride, _mm256_permute2f128_ps(r[i], r[i + 4], 0x31));
+    }
+}
+
+// 8 x 8 block of 16 bit elements.
+void Transpose8x8x16(const uint8_t* src, size_t srcStride, uint8_t* dst, size_t dstStride)
+{
+    const uint16_t* s = reinterpret_cast<const uint16_t*>(src);
+    uint16_t* d = reinterpret_cast<uint16_t*>(dst);
+
+    __m128i a[8];
+    for (int i = 0; i < 8; i++)
+    {
+        a[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i * srcStride));
+    }
+
+    __m128i b[8];
+    for (int i = 0; i < 8; i += 2)
+    {
+        b[i] = _mm_unpacklo_epi16(a[i], a[i + 1]);
+        b[i + 1] = _mm_unpackhi_epi16(a[i], a[i + 1]);
+    }
+
+    // a[0..3] hold columns 0-1, 2-3, 4-5, 6-7 of rows 0-3, a[4..7] the same for rows 4-7
+    for (int i = 0; i < 8; i += 4)
+    {
+        a[i] = _mm_unpacklo_epi32(b[i], b[i + 2]);
+        a[i + 1] = _mm_unpackhi_epi32(b[i], b[i + 2]);
+        a[i + 2] = _mm_unpacklo_epi32(b[i + 1], b[i + 3]);
+        a[i + 3] = _mm_unpackhi_epi32(b[i + 1], b[i + 3]);
+    }
+
+    for (int i = 0; i < 4; i++)
+    {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d + (2 * i) * dstStride), _mm_unpacklo_epi64(a[i], a[i + 4]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d + (2 * i + 1) * dstStride), _mm_unpackhi_epi64(a[i], a[i + 4]));
+    }
+}
+
+void TransposeAvx2(const uint8_t* src, size_t srcStride, uint8_t* dst, size_t dstStride, uint32_t rows, uint32_t columns, uint32_t elementSize)
+{
+    if (elementSize != 2 && elementSize != 4)
+    {
+        GetScalarKernels().transpose(src, srcStride, dst, dstStride, rows, columns, elementSize);
+        return;
+    }
+
+    auto block = elementSize == 4 ? Transpose8x8x32 : Transpose8x8x16;
+    const uint32_t rows8 = rows & ~7u;
+    const uint32_t columns8 = columns & ~7u;
+    for (uint32_t r = 0; r < rows8; r += 8)
+    {
+        for (uint32_t c = 0; c < columns8; c += 8)
+        {
+            block(src + (size_t(r) * srcStride + c) * elementSize, srcStride, dst + (size_t(c) * dstStride + r) * elementSize, dstStride);
+        }
+    }
+
+    // Right and bottom edges
+    if (columns8 < columns)
+    {
+        GetScalarKernels().transpose(src + size_t(columns8) * elementSize, srcStride, dst + size_t(columns8) * dstStride * elementSize, dstStride, rows,
+                                     columns - columns8, elementSize);
+    }
+    if (rows8 < rows)
+    {
+        GetScalarKernels().transpose(src + size_t(rows8) * srcStride * elementSize, srcStride, dst + size_t(rows8) * elementSize, dstStride, rows - rows8,
+                                     columns8, elementSize);
+    }
+}
+
+// Fused linear layer with the dimensions as template arguments, the reduction and the column blocks unroll fully.
+template <uint32_t INPUTS, uint32_t OUTPUTS_PADDED>
+void LinearFixedAvx2(const float* input, KernelLayer const& layer, float* output, size_t stride, uint32_t rows, ActivationDesc const& act, bool roundToHalf)
+{
+    constexpr uint32_t blockRows = 4;
+    const BlockEpilogue epilogue = MakeEpilogue(act, roundToHalf);
+
+    uint32_t r = 0;
+    for (; r + blockRows <= rows; r += blockRows)
+    {
+        for (uint32_t o = 0; o < OUTPUTS_PADDED; o += 16)
+        {
+            LinearBlock<blockRows, true>(input + r * stride, stride, layer.weights, layer.bias, output + r * stride, stride, INPUTS, OUTPUTS_PADDED, o,
+                                         &epilogue);
+        }
+    }
+    for (; r < rows; r++)
+    {
+        for (uint32_t o = 0; o < OUTPUTS_PADDED; o += 16)
+        {
+            LinearBlock<1, true>(input + r * stride, stride, layer.weights, layer.bias, output + r * stride, stride, INPUTS, OUTPUTS_PADDED, o, &epilogue);
+        }
+    }
+}
+
+// Forward pass of a network whose dimensions are known at compile time.
+template <uint32_t INPUTS, uint32_t HIDDEN_LAYERS, uint32_t HIDDEN, uint32_t OUTPUTS>
+float* ForwardFixedAvx2(const KernelLayer* layers, size_t, MLPTileArgs const& args)
+{
+    constexpr uint32_t hiddenPadded = PadKernelWidth(HIDDEN);
+    constexpr uint32_t outputsPadded = PadKernelWidth(OUTPUTS);
+    float* src = args.buffers[0];
+    float* dst = args.buffers[1];
+
+    LinearFixedAvx2<INPUTS, hiddenPadded>(src, layers[0], dst, args.stride, args.rows, args.hiddenActivation, args.roundToHalf);
+    for (uint32_t l = 1; l <= HIDDEN_LAYERS; l++)
+    {
+        float* next = src;
+        src = dst;
+        dst = next;
+        if (l < HIDDEN_LAYERS)
+        {
+            LinearFixedAvx2<HIDDEN, hiddenPadded>(src, layers[l], dst, args.stride, args.rows, args.hiddenActivation, args.roundToHalf);
+        }
+        else
+        {
+            LinearFixedAvx2<HIDDEN, outputsPadded>(src, layers[l], dst, args.stride, args.rows, args.finalActivation, args.roundToHalf);
+        }
+    }
+    return dst;
+}
+} // namespace
+
+const KernelTable* GetAvx2Kernels()
+{
+    static const KernelTable table = {
+        "AVX2",
+        LinearAvx2,
+        LinearBackwardAvx2,
+        OuterProductAccumulateAvx2,
+        ActivateAvx2,
+        ActivateBackwardAvx2,
+        HalfToFloatAvx2,
+        FloatToHalfAvx2,
+        RoundToHalfAvx2,
+        TransposeAvx2,
+        LinearActivateAvx2,
+        FastMathAvx2<ExpAvx2>,
+        FastMathAvx2<SigmoidAvx2>,
+        FastMathAvx2<TanhAvx2>,
+        FastMathAvx2<SoftplusAvx2>,
+        EncodeFrequencyAvx2,
+        EncodeTriangleAvx2,
+    };
+    const CpuFeatures& features = GetCpuFeatures();
+    return (features.avx2 && features.fma && features.f16c) ? &table : nullptr;
+}
+
+const SpecialisedMLP* GetAvx2SpecialisedMLPs(size_t& count)
+{
+#define FLUXEL_SPECIALISED_MLP_ENTRY(inputs, hiddenLayers, hidden, outputs) \
+    { inputs, hiddenLayers, hidden, outputs, ForwardFixedAvx2<inputs, hiddenLayers, hidden, outputs> },
+    static const SpecialisedMLP mlps[] = { FLUXEL_SPECIALISED_MLP_SHAPES(FLUXEL_SPECIALISED_MLP_ENTRY) };
+#undef FLUXEL_SPECIALISED_MLP_ENTRY
+    count = GetAvx2Kernels() ? sizeof(mlps) / sizeof(mlps[0]) : 0;
+    return count ? mlps : nullptr;
+}
+#else
+const KernelTable* GetAvx2Kernels()
+{
+    return nullptr;
+}
+
+const SpecialisedMLP* GetAvx2SpecialisedMLPs(size_t& count)
+{
+    count = 0;
+    return nullptr;
+}
+#endif
+
+NAMESPACE_END(cpu)
+NAMESPACE_END(fluxel)
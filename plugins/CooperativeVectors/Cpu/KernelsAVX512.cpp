@@ -0,0 +1,748 @@
+// AVX-512 (F/BW/VL) kernels.
+// This file is compiled with AVX-512 code generation enabled (see CMakeLists.txt). It must not instantiate inline
+// functions shared with other translation units (Eigen, std algorithms, Activation.h helpers), otherwise the linker
+// may pick the AVX-512 copy for callers on the scalar path. Scalar fallbacks go through GetScalarKernels() instead.
+
+#include "Kernels.h"
+#include "CpuFeatures.h"
+#include "FastMath.h"
+#include "SpecialisedMLP.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#include <immintrin.h>
+#define FLUXEL_KERNELS_AVX512 1
+#endif
+
+NAMESPACE_BEGIN(fluxel)
+NAMESPACE_BEGIN(cpu)
+
+#if FLUXEL_KERNELS_AVX512
+namespace
+{
+// Approximations of FastMath.h on 16 lanes, with the same operations as the scalar versions fused into multiply adds.
+inline __m512 ExpAvx512(__m512 x)
+{
+    // max and min return their second operand for NaN inputs, so NaN propagates
+    x = _mm512_min_ps(_mm512_set1_ps(s_expMaxInput), _mm512_max_ps(_mm512_set1_ps(s_expMinInput), x));
+    const __m512 n = _mm512_roundscale_ps(_mm512_mul_ps(x, _mm512_set1_ps(s_log2e)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m512 r = _mm512_fnmadd_ps(n, _mm512_set1_ps(s_ln2Hi), x);
+    r = _mm512_fnmadd_ps(n, _mm512_set1_ps(s_ln2Lo), r);
+
+    __m512 p = _mm512_set1_ps(s_expPolynomial[0]);
+    for (int i = 1; i < 6; i++)
+    {
+        p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(s_expPolynomial[i]));
+    }
+    p = _mm512_add_ps(_mm512_fmadd_ps(p, _mm512_mul_ps(r, r), r), _mm512_set1_ps(1.f));
+
+    // Scale by 2^n in two steps, so both factors are normal numbers over the whole input range
+    const __m512i bias = _mm512_set1_epi32(127);
+    const __m512i ni = _mm512_cvtps_epi32(n);
+    const __m512i a = _mm512_srai_epi32(ni, 1);
+    const __m512i b = _mm512_sub_epi32(ni, a);
+    p = _mm512_mul_ps(p, _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_add_epi32(a, bias), 23)));
+    return _mm512_mul_ps(p, _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_add_epi32(b, bias), 23)));
+}
+
+inline __m512 NegativeAbs(__m512 x)
+{
+    return _mm512_castsi512_ps(_mm512_or_si512(_mm512_castps_si512(x), _mm512_set1_epi32(int32_t(0x80000000u))));
+}
+
+inline __m512 SigmoidAvx512(__m512 x)
+{
+    const __m512 one = _mm512_set1_ps(1.f);
+    const __m512 e = ExpAvx512(NegativeAbs(x));
+    const __mmask16 negative = _mm512_cmp_ps_mask(x, _mm512_setzero_ps(), _CMP_LT_OQ);
+    return _mm512_div_ps(_mm512_mask_blend_ps(negative, one, e), _mm512_add_ps(one, e));
+}
+
+inline __m512 TanhAvx512(__m512 x)
+{
+    const __m512 one = _mm512_set1_ps(1.f);
+    const __m512i signMask = _mm512_set1_epi32(int32_t(0x80000000u));
+    const __m512i sign = _mm512_and_si512(_mm512_castps_si512(x), signMask);
+    const __m512 ax = _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(x), sign));
+
+    const __m512 z = _mm512_mul_ps(x, x);
+    __m512 p = _mm512_set1_ps(s_tanhPolynomial[0]);
+    for (int i = 1; i < 5; i++)
+    {
+        p = _mm512_fmadd_ps(p, z, _mm512_set1_ps(s_tanhPolynomial[i]));
+    }
+    const __m512 small = _mm512_fmadd_ps(_mm512_mul_ps(p, z), x, x);
+
+    const __m512 e = ExpAvx512(_mm512_add_ps(ax, ax));
+    const __m512 magnitude = _mm512_sub_ps(one, _mm512_div_ps(_mm512_set1_ps(2.f), _mm512_add_ps(e, one)));
+    const __m512 large = _mm512_castsi512_ps(_mm512_or_si512(_mm512_castps_si512(magnitude), sign));
+    return _mm512_mask_blend_ps(_mm512_cmp_ps_mask(ax, _mm512_set1_ps(s_tanhPolynomialRange), _CMP_LT_OQ), large, small);
+}
+
+inline __m512 SoftplusAvx512(__m512 x)
+{
+    // log(u) with u = 1 + t in [1, 2], plus the rounding error of u divided by u
+    const __m512 one = _mm512_set1_ps(1.f);
+    const __m512 t = ExpAvx512(NegativeAbs(x));
+    const __m512 u = _mm512_add_ps(one, t);
+    const __m512 c = _mm512_sub_ps(t, _mm512_sub_ps(u, one));
+    const __mmask16 upper = _mm512_cmp_ps_mask(u, _mm512_set1_ps(s_sqrt2), _CMP_GT_OQ);
+    const __m512 e = _mm512_maskz_mov_ps(upper, one);
+    const __m512 f = _mm512_sub_ps(_mm512_mask_mul_ps(u, upper, u, _mm512_set1_ps(0.5f)), one);
+    const __m512 z = _mm512_mul_ps(f, f);
+
+    __m512 p = _mm512_set1_ps(s_logPolynomial[0]);
+    for (int i = 1; i < 9; i++)
+    {
+        p = _mm512_fmadd_ps(p, f, _mm512_set1_ps(s_logPolynomial[i]));
+    }
+    __m512 y = _mm512_mul_ps(_mm512_mul_ps(p, f), z);
+    y = _mm512_fmadd_ps(e, _mm512_set1_ps(s_ln2Lo), y);
+    y = _mm512_fnmadd_ps(_mm512_set1_ps(0.5f), z, y);
+    const __m512 log1p = _mm512_add_ps(_mm512_fmadd_ps(e, _mm512_set1_ps(s_ln2Hi), _mm512_add_ps(f, y)), _mm512_div_ps(c, u));
+    return _mm512_add_ps(_mm512_max_ps(x, _mm512_setzero_ps()), log1p);
+}
+
+// Activation of 16 lanes. param is the slope of the negative lanes for (leaky) ReLU and the scale for Linear.
+template <Activation TYPE>
+inline __m512 ActivateLanes(__m512 x, __m512 param)
+{
+    if constexpr (TYPE == Activation::Linear)
+    {
+        return _mm512_mul_ps(param, x);
+    }
+    else if constexpr (TYPE == Activation::ReLU || TYPE == Activation::LeakyReLU)
+    {
+        return _mm512_mask_mul_ps(x, _mm512_cmp_ps_mask(x, _mm512_setzero_ps(), _CMP_LT_OQ), x, param);
+    }
+    else if constexpr (TYPE == Activation::Exponential)
+    {
+        return ExpAvx512(x);
+    }
+    else if constexpr (TYPE == Activation::ShiftedExponential)
+    {
+        return _mm512_sub_ps(ExpAvx512(x), _mm512_set1_ps(1.f));
+    }
+    else if constexpr (TYPE == Activation::Sigmoid)
+    {
+        return SigmoidAvx512(x);
+    }
+    else if constexpr (TYPE == Activation::Swish)
+    {
+        return _mm512_mul_ps(x, SigmoidAvx512(x));
+    }
+    else if constexpr (TYPE == Activation::Tanh)
+    {
+        return TanhAvx512(x);
+    }
+    else
+    {
+        return x;
+    }
+}
+
+// grad scaled by the derivative of the activation at the pre-activation values x.
+template <Activation TYPE>
+inline __m512 ActivateBackwardLanes(__m512 x, __m512 grad, __m512 param)
+{
+    const __m512 one = _mm512_set1_ps(1.f);
+    if constexpr (TYPE == Activation::Linear)
+    {
+        return _mm512_mul_ps(param, grad);
+    }
+    else if constexpr (TYPE == Activation::ReLU || TYPE == Activation::LeakyReLU)
+    {
+        return _mm512_mask_mul_ps(grad, _mm512_cmp_ps_mask(x, _mm512_setzero_ps(), _CMP_NGT_UQ), grad, param);
+    }
+    else if constexpr (TYPE == Activation::Exponential || TYPE == Activation::ShiftedExponential)
+    {
+        return _mm512_mul_ps(ExpAvx512(x), grad);
+    }
+    else if constexpr (TYPE == Activation::Sigmoid)
+    {
+        const __m512 s = SigmoidAvx512(x);
+        return _mm512_mul_ps(_mm512_mul_ps(grad, s), _mm512_sub_ps(one, s));
+    }
+    else if constexpr (TYPE == Activation::Swish)
+    {
+        const __m512 s = SigmoidAvx512(x);
+        return _mm512_mul_ps(grad, _mm512_fmadd_ps(_mm512_mul_ps(x, s), _mm512_sub_ps(one, s), s));
+    }
+    else if constexpr (TYPE == Activation::Tanh)
+    {
+        const __m512 t = TanhAvx512(x);
+        return _mm512_mul_ps(grad, _mm512_fnmadd_ps(t, t, one));
+    }
+    else
+    {
+        return grad;
+    }
+}
+
+// Calls function.template operator()<TYPE>() for the activation type, so the activation loops are compiled per type.
+template <typename F>
+inline void DispatchActivation(Activation type, F const& function)
+{
+    switch (type)
+    {
+    case Activation::Linear:
+        return function.template operator()<Activation::Linear>();
+    case Activation::Exponential:
+        return function.template operator()<Activation::Exponential>();
+    case Activation::ShiftedExponential:
+        return function.template operator()<Activation::ShiftedExponential>();
+    case Activation::ReLU:
+        return function.template operator()<Activation::ReLU>();
+    case Activation::LeakyReLU:
+        return function.template operator()<Activation::LeakyReLU>();
+    case Activation::Sigmoid:
+        return function.template operator()<Activation::Sigmoid>();
+    case Activation::Swish:
+        return function.template operator()<Activation::Swish>();
+    case Activation::Tanh:
+        return function.template operator()<Activation::Tanh>();
+    default:
+        return function.template operator()<Activation::None>();
+    }
+}
+
+inline __m512 ActivationParam(ActivationDesc const& act)
+{
+    return _mm512_set1_ps(act.type == Activation::ReLU ? 0.f : act.param);
+}
+
+// Lanes [0, count) of a partial vector at the end of an array.
+inline __mmask16 TailMask(size_t count)
+{
+    return __mmask16((1u << count) - 1);
+}
+
+// Activation and rounding of linearActivate, applied to the accumulators of a block before they are stored.
+struct BlockEpilogue
+{
+    Activation type;
+    __m512 param; ///< See ActivateLanes.
+    bool roundToHalf;
+};
+
+inline BlockEpilogue MakeEpilogue(ActivationDesc const& act, bool roundToHalf)
+{
+    BlockEpilogue epilogue;
+    epilogue.type = act.type;
+    epilogue.param = ActivationParam(act);
+    epilogue.roundToHalf = roundToHalf;
+    return epilogue;
+}
+
+// Same operations as ActivateAvx512 and RoundToHalfAvx512.
+inline __m512 ApplyEpilogue(BlockEpilogue const& epilogue, __m512 x)
+{
+    DispatchActivation(epilogue.type, [&]<Activation TYPE>() { x = ActivateLanes<TYPE>(x, epilogue.param); });
+    return epilogue.roundToHalf ? _mm512_cvtph_ps(_mm512_cvtps_ph(x, _MM_FROUND_TO_NEAREST_INT)) : x;
+}
+
+// Computes a block of rows x (16 * COLS) outputs, keeping the accumulators in registers for the whole reduction.
+// FUSED blocks apply the epilogue before the store.
+template <uint32_t ROWS, uint32_t COLS, bool FUSED = false>
+inline void LinearBlock(const float* input,
+                        size_t inputStride,
+                        const float* weights,
+                        const float* bias,
+                        float* output,
+                        size_t outputStride,
+                        uint32_t inputs,
+                        uint32_t outputsPadded,
+                        uint32_t o,
+                        const BlockEpilogue* epilogue = nullptr)
+{
+    __m512 acc[ROWS][COLS];
+    for (uint32_t c = 0; c < COLS; c++)
+    {
+        const __m512 b = _mm512_loadu_ps(bias + o + c * 16);
+        for (uint32_t r = 0; r < ROWS; r++)
+        {
+            acc[r][c] = b;
+        }
+    }
+
+    const float* w = weights + o;
+    for (uint32_t i = 0; i < inputs; i++, w += outputsPadded)
+    {
+        __m512 wc[COLS];
+        for (uint32_t c = 0; c < COLS; c++)
+        {
+            wc[c] = _mm512_loadu_ps(w + c * 16);
+        }
+        for (uint32_t r = 0; r < ROWS; r++)
+        {
+            const __m512 x = _mm512_set1_ps(input[r * inputStride + i]);
+            for (uint32_t c = 0; c < COLS; c++)
+            {
+                acc[r][c] = _mm512_fmadd_ps(x, wc[c], acc[r][c]);
+            }
+        }
+    }
+
+    for (uint32_t r = 0; r < ROWS; r++)
+    {
+        for (uint32_t c = 0; c < COLS; c++)
+        {
+            float* y = output + r * outputStride + o + c * 16;
+            if constexpr (FUSED)
+            {
+                acc[r][c] = ApplyEpilogue(*epilogue, acc[r][c]);
+            }
+            _mm512_storeu_ps(y, acc[r][c]);
+        }
+    }
+}
+
+template <uint32_t ROWS, bool FUSED = false>
+inline void LinearRows(const float* input,
+                       size_t inputStride,
+                       const float* weights,
+                       const float* bias,
+                       float* output,
+                       size_t outputStride,
+                       uint32_t inputs,
+                       uint32_t outputsPadded,
+                       const BlockEpilogue* epilogue = nullptr)
+{
+    uint32_t o = 0;
+    for (; o + 32 <= outputsPadded; o += 32)
+    {
+        LinearBlock<ROWS, 2, FUSED>(input, inputStride, weights, bias, output, outputStride, inputs, outputsPadded, o, epilogue);
+    }
+    if (o < outputsPadded)
+    {
+        LinearBlock<ROWS, 1, FUSED>(input, inputStride, weights, bias, output, outputStride, inputs, outputsPadded, o, epilogue);
+    }
+}
+
+// All rows of a tile in blocks of 6 rows.
+template <bool FUSED>
+void LinearTile(const float* input,
+                size_t inputStride,
+                const float* weights,
+                const float* bias,
+                float* output,
+                size_t outputStride,
+                uint32_t rows,
+                uint32_t inputs,
+                uint32_t outputsPadded,
+                const BlockEpilogue* epilogue)
+{
+    constexpr uint32_t blockRows = 6;
+
+    uint32_t r = 0;
+    for (; r + blockRows <= rows; r += blockRows)
+    {
+        LinearRows<blockRows, FUSED>(input + r * inputStride, inputStride, weights, bias, output + r * outputStride, outputStride, inputs, outputsPadded,
+                                     epilogue);
+    }
+    for (; r < rows; r++)
+    {
+        LinearRows<1, FUSED>(input + r * inputStride, inputStride, weights, bias, output + r * outputStride, outputStride, inputs, outputsPadded, epilogue);
+    }
+}
+
+void LinearAvx512(const float* input,
+                  size_t inputStride,
+                  const float* weights,
+                  const float* bias,
+                  float* output,
+                  size_t outputStride,
+                  uint32_t rows,
+                  uint32_t inputs,
+                  uint32_t outputsPadded)
+{
+    LinearTile<false>(input, inputStride, weights, bias, output, outputStride, rows, inputs, outputsPadded, nullptr);
+}
+
+void LinearActivateAvx512(const float* input,
+                          size_t inputStride,
+                          const float* weights,
+                          const float* bias,
+                          float* output,
+                          size_t outputStride,
+                          uint32_t rows,
+                          uint32_t inputs,
+                          uint32_t outputsPadded,
+                          ActivationDesc const& act,
+                          bool roundToHalf)
+{
+    const BlockEpilogue epilogue = MakeEpilogue(act, roundToHalf);
+    LinearTile<true>(input, inputStride, weights, bias, output, outputStride, rows, inputs, outputsPadded, &epilogue);
+}
+
+void LinearBackwardAvx512(const float* grad,
+                          size_t gradStride,
+                          const float* weights,
+                          float* inputGrad,
+                          size_t inputGradStride,
+                          uint32_t rows,
+                          uint32_t inputs,
+                          uint32_t outputsPadded)
+{
+    for (uint32_t r = 0; r < rows; r++)
+    {
+        const float* g = grad + r * gradStride;
+        float* dx = inputGrad + r * inputGradStride;
+
+        // Four dot products at a time to hide the FMA latency
+        uint32_t i = 0;
+        for (; i + 4 <= inputs; i += 4)
+        {
+            const float* w = weights + size_t(i) * outputsPadded;
+            __m512 acc0 = _mm512_setzero_ps(), acc1 = _mm512_setzero_ps(), acc2 = _mm512_setzero_ps(), acc3 = _mm512_setzero_ps();
+            for (uint32_t o = 0; o < outputsPadded; o += 16)
+            {
+                const __m512 gv = _mm512_loadu_ps(g + o);
+                acc0 = _mm512_fmadd_ps(gv, _mm512_loadu_ps(w + o), acc0);
+                acc1 = _mm512_fmadd_ps(gv, _mm512_loadu_ps(w + outputsPadded + o), acc1);
+                acc2 = _mm512_fmadd_ps(gv, _mm512_loadu_ps(w + 2 * outputsPadded + o), acc2);
+                acc3 = _mm512_fmadd_ps(gv, _mm512_loadu_ps(w + 3 * outputsPadded + o), acc3);
+            }
+            dx[i + 0] = _mm512_reduce_add_ps(acc0);
+            dx[i + 1] = _mm512_reduce_add_ps(acc1);
+            dx[i + 2] = _mm512_reduce_add_ps(acc2);
+            dx[i + 3] = _mm512_reduce_add_ps(acc3);
+        }
+        for (; i < inputs; i++)
+        {
+            const float* w = weights + size_t(i) * outputsPadded;
+            __m512 acc = _mm512_setzero_ps();
+            for (uint32_t o = 0; o < outputsPadded; o += 16)
+            {
+                acc = _mm512_fmadd_ps(_mm512_loadu_ps(g + o), _mm512_loadu_ps(w + o), acc);
+            }
+            dx[i] = _mm512_reduce_add_ps(acc);
+        }
+    }
+}
+
+void OuterProductAccumulateAvx512(const float* input,
+                                  size_t inputStride,
+                                  const float* grad,
+                                  size_t gradStride,
+                                  float* weightGrad,
+                                  float* biasGrad,
+                                  uint32_t rows,
+                                  uint32_t inputs,
+                                  uint32_t outputsPadded)
+{
+    // Each 16 wide slice of a gradient row stays in a register while all rows of the tile are accumulated.
+    for (uint32_t i = 0; i < inputs; i++)
+    {
+        float* dw = weightGrad + size_t(i) * outputsPadded;
+        for (uint32_t o = 0; o < outputsPadded; o += 16)
+        {
+            __m512 acc = _mm512_loadu_ps(dw + o);
+            for (uint32_t r = 0; r < rows; r++)
+            {
+                acc = _mm512_fmadd_ps(_mm512_set1_ps(input[r * inputStride + i]), _mm512_loadu_ps(grad + r * gradStride + o), acc);
+            }
+            _mm512_storeu_ps(dw + o, acc);
+        }
+    }
+
+    for (uint32_t o = 0; o < outputsPadded; o += 16)
+    {
+        __m512 acc = _mm512_loadu_ps(biasGrad + o);
+        for (uint32_t r = 0; r < rows; r++)
+        {
+            acc = _mm512_add_ps(acc, _mm512_loadu_ps(grad + r * gradStride + o));
+        }
+        _mm512_storeu_ps(biasGrad + o, acc);
+    }
+}
+
+void ActivateAvx512(ActivationDesc const& act, float* data, size_t count)
+{
+    if (act.type == Activation::None)
+    {
+        return;
+    }
+
+    const __m512 param = ActivationParam(act);
+    DispatchActivation(act.type, [&]<Activation TYPE>() {
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+        {
+            _mm512_storeu_ps(data + i, ActivateLanes<TYPE>(_mm512_loadu_ps(data + i), param));
+        }
+        if (i < count)
+        {
+            // Masked tail, so all values use the same approximations
+            const __mmask16 mask = TailMask(count - i);
+            _mm512_mask_storeu_ps(data + i, mask, ActivateLanes<TYPE>(_mm512_maskz_loadu_ps(mask, data + i), param));
+        }
+    });
+}
+
+void ActivateBackwardAvx512(ActivationDesc const& act, const float* x, float* grad, size_t count)
+{
+    if (act.type == Activation::None)
+    {
+        return;
+    }
+
+    const __m512 param = ActivationParam(act);
+    DispatchActivation(act.type, [&]<Activation TYPE>() {
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+        {
+            _mm512_storeu_ps(grad + i, ActivateBackwardLanes<TYPE>(_mm512_loadu_ps(x + i), _mm512_loadu_ps(grad + i), param));
+        }
+        if (i < count)
+        {
+            const __mmask16 mask = TailMask(count - i);
+            const __m512 g = ActivateBackwardLanes<TYPE>(_mm512_maskz_loadu_ps(mask, x + i), _mm512_maskz_loadu_ps(mask, grad + i), param);
+            _mm512_mask_storeu_ps(grad + i, mask, g);
+        }
+    });
+}
+
+// Elementwise approximations of FastMath.h, dst may alias src.
+template <__m512 (*FUNCTION)(__m512)>
+void FastMathAvx512(const float* src, float* dst, size_t count)
+{
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        _mm512_storeu_ps(dst + i, FUNCTION(_mm512_loadu_ps(src + i)));
+    }
+    if (i < count)
+    {
+        const __mmask16 mask = TailMask(count - i);
+        _mm512_mask_storeu_ps(dst + i, mask, FUNCTION(_mm512_maskz_loadu_ps(mask, src + i)));
+    }
+}
+
+// FastSinCos on 16 lanes.
+inline void SinCosAvx512(__m512 x, __m512& sinX, __m512& cosX)
+{
+    const __m512 n = _mm512_roundscale_ps(_mm512_mul_ps(x, _mm512_set1_ps(s_2OverPi)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m512 r = _mm512_fnmadd_ps(n, _mm512_set1_ps(s_piOver2Hi), x);
+    r = _mm512_fnmadd_ps(n, _mm512_set1_ps(s_piOver2Mid), r);
+    r = _mm512_fnmadd_ps(n, _mm512_set1_ps(s_piOver2Lo), r);
+
+    const __m512 z = _mm512_mul_ps(r, r);
+    const __m512 p = _mm512_fmadd_ps(_mm512_fmadd_ps(_mm512_set1_ps(s_sinPolynomial[0]), z, _mm512_set1_ps(s_sinPolynomial[1])), z,
+                                     _mm512_set1_ps(s_sinPolynomial[2]));
+    const __m512 q = _mm512_fmadd_ps(_mm512_fmadd_ps(_mm512_set1_ps(s_cosPolynomial[0]), z, _mm512_set1_ps(s_cosPolynomial[1])), z,
+                                     _mm512_set1_ps(s_cosPolynomial[2]));
+    const __m512 s = _mm512_fmadd_ps(p, _mm512_mul_ps(z, r), r);
+    const __m512 c = _mm512_fmadd_ps(q, _mm512_mul_ps(z, z), _mm512_fmadd_ps(_mm512_set1_ps(-0.5f), z, _mm512_set1_ps(1.f)));
+
+    // Quadrant of x, odd quadrants swap sin and cos. Bit 1 of the quadrant, and of the quadrant + 1, moves to the sign bits.
+    const __m512i quadrant = _mm512_cvtps_epi32(n);
+    const __mmask16 swap = _mm512_test_epi32_mask(quadrant, _mm512_set1_epi32(1));
+    const __m512i sinSign = _mm512_slli_epi32(_mm512_and_si512(quadrant, _mm512_set1_epi32(2)), 30);
+    const __m512i cosSign = _mm512_slli_epi32(_mm512_and_si512(_mm512_add_epi32(quadrant, _mm512_set1_epi32(1)), _mm512_set1_epi32(2)), 30);
+    sinX = _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(_mm512_mask_blend_ps(swap, s, c)), sinSign));
+    cosX = _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(_mm512_mask_blend_ps(swap, c, s)), cosSign));
+}
+
+inline __m512 RoundToHalfLanes(__m512 x)
+{
+    return _mm512_cvtph_ps(_mm512_cvtps_ph(x, _MM_FROUND_TO_NEAREST_INT));
+}
+
+// Same operations as EncodeFrequencyScalar.
+void EncodeFrequencyAvx512(const float* x, float* features, size_t featureStride, size_t count, uint32_t numScales, EncodingRounding rounding)
+{
+    const bool halfRecurrence = rounding == EncodingRounding::Recurrence;
+    const bool halfOutputs = rounding != EncodingRounding::None;
+    const __m512 one = _mm512_set1_ps(1.f);
+    for (size_t i = 0; i < count; i += 16)
+    {
+        const __mmask16 mask = count - i < 16 ? TailMask(count - i) : __mmask16(0xffff);
+        __m512 s, c;
+        SinCosAvx512(_mm512_mul_ps(_mm512_maskz_loadu_ps(mask, x + i), _mm512_set1_ps(s_pi)), s, c);
+        if (halfRecurrence)
+        {
+            s = RoundToHalfLanes(s);
+            c = RoundToHalfLanes(c);
+        }
+
+        float* y = features + i;
+        for (uint32_t j = 0; j < numScales; j++, y += 2 * featureStride)
+        {
+            if (j > 0)
+            {
+                const __m512 c2 = _mm512_add_ps(c, c);
+                if (halfRecurrence)
+                {
+                    s = RoundToHalfLanes(_mm512_mul_ps(_mm512_add_ps(s, s), c));
+                    c = RoundToHalfLanes(_mm512_sub_ps(RoundToHalfLanes(_mm512_mul_ps(c2, c)), one));
+                }
+                else
+                {
+                    s = _mm512_mul_ps(_mm512_add_ps(s, s), c);
+                    c = _mm512_fmsub_ps(c2, c, one);
+                }
+            }
+            _mm512_mask_storeu_ps(y, mask, halfOutputs ? RoundToHalfLanes(s) : s);
+            _mm512_mask_storeu_ps(y + featureStride, mask, halfOutputs ? RoundToHalfLanes(c) : c);
+        }
+    }
+}
+
+// Same operations as EncodeTriangleScalar.
+void EncodeTriangleAvx512(const float* x, float* features, size_t featureStride, size_t count, uint32_t numWaves, bool roundToHalf)
+{
+    const __m512 half = _mm512_set1_ps(0.5f);
+    const __m512 four = _mm512_set1_ps(4.f);
+    const __m512 one = _mm512_set1_ps(1.f);
+    float scale = 0.5f;
+    float offset = 0.f;
+    for (uint32_t j = 0; j < numWaves; j++, scale *= 2.f, offset += 0.25f)
+    {
+        const __m512 scaleLanes = _mm512_set1_ps(scale);
+        const __m512 offsetLanes = _mm512_set1_ps(offset);
+        float* y = features + j * featureStride;
+        for (size_t i = 0; i < count; i += 16)
+        {
+            const __mmask16 mask = count - i < 16 ? TailMask(count - i) : __mmask16(0xffff);
+            // The scale is a power of two, so the product is exact and the fused multiply add rounds like the scalar version
+            const __m512 r = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, x + i), scaleLanes, offsetLanes);
+            const __m512 wave = _mm512_abs_ps(_mm512_sub_ps(_mm512_sub_ps(r, _mm512_roundscale_ps(r, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC)), half));
+            const __m512 value = _mm512_sub_ps(_mm512_mul_ps(wave, four), one);
+            _mm512_mask_storeu_ps(y + i, mask, roundToHalf ? RoundToHalfLanes(value) : value);
+        }
+    }
+}
+
+void HalfToFloatAvx512(const uint16_t* src, float* dst, size_t count)
+{
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        _mm512_storeu_ps(dst + i, _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i))));
+    }
+    GetScalarKernels().halfToFloat(src + i, dst + i, count - i);
+}
+
+void FloatToHalfAvx512(const float* src, uint16_t* dst, size_t count)
+{
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm512_cvtps_ph(_mm512_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+    }
+    GetScalarKernels().floatToHalf(src + i, dst + i, count - i);
+}
+
+void RoundToHalfAvx512(float* data, size_t count)
+{
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        const __m256i h = _mm512_cvtps_ph(_mm512_loadu_ps(data + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm512_storeu_ps(data + i, _mm512_cvtph_ps(h));
+    }
+    GetScalarKernels().roundToHalf(data + i, count - i);
+}
+
+void TransposeAvx512(const uint8_t* src, size_t srcStride, uint8_t* dst, size_t dstStride, uint32_t rows, uint32_t columns, uint32_t elementSize)
+{
+    // Transposes are bound by memory bandwidth, wider blocks than the AVX2 8 x 8 blocks do not pay off
+    const KernelTable* avx2 = GetAvx2Kernels();
+    (avx2 ? avx2->transpose : GetScalarKernels().transpose)(src, srcStride, dst, dstStride, rows, columns, elementSize);
+}
+
+// Fused linear layer with the dimensions as template arguments, the reduction and the column blocks unroll fully.
+template <uint32_t INPUTS, uint32_t OUTPUTS_PADDED>
+void LinearFixedAvx512(const float* input, KernelLayer const& layer, float* output, size_t stride, uint32_t rows, ActivationDesc const& act, bool roundToHalf)
+{
+    constexpr uint32_t blockRows = 6;
+    const BlockEpilogue epilogue = MakeEpilogue(act, roundToHalf);
+
+    uint32_t r = 0;
+    for (; r + blockRows <= rows; r += blockRows)
+    {
+        LinearRows<blockRows, true>(input + r * stride, stride, layer.weights, layer.bias, output + r * stride, stride, INPUTS, OUTPUTS_PADDED, &epilogue);
+    }
+    for (; r < rows; r++)
+    {
+        LinearRows<1, true>(input + r * stride, stride, layer.weights, layer.bias, output + r * stride, stride, INPUTS, OUTPUTS_PADDED, &epilogue);
+    }
+}
+
+// Forward pass of a network whose dimensions are known at compile time.
+template <uint32_t INPUTS, uint32_t HIDDEN_LAYERS, uint32_t HIDDEN, uint32_t OUTPUTS>
+float* ForwardFixedAvx512(const KernelLayer* layers, size_t, MLPTileArgs const& args)
+{
+    constexpr uint32_t hiddenPadded = PadKernelWidth(HIDDEN);
+    constexpr uint32_t outputsPadded = PadKernelWidth(OUTPUTS);
+    float* src = args.buffers[0];
+    float* dst = args.buffers[1];
+
+    LinearFixedAvx512<INPUTS, hiddenPadded>(src, layers[0], dst, args.stride, args.rows, args.hiddenActivation, args.roundToHalf);
+    for (uint32_t l = 1; l <= HIDDEN_LAYERS; l++)
+    {
+        float* next = src;
+        src = dst;
+        dst = next;
+        if (l < HIDDEN_LAYERS)
+        {
+            LinearFixedAvx512<HIDDEN, hiddenPadded>(src, layers[l], dst, args.stride, args.rows, args.hiddenActivation, args.roundToHalf);
+        }
+        else
+        {
+            LinearFixedAvx512<HIDDEN, outputsPadded>(src, layers[l], dst, args.stride, args.rows, args.finalActivation, args.roundToHalf);
+        }
+    }
+    return dst;
+}
+} // namespace
+
+const KernelTable* GetAvx512Kernels()
+{
+    static const KernelTable table = {
+        "AVX-512",
+        LinearAvx512,
+        LinearBackwardAvx512,
+        OuterProductAccumulateAvx512,
+        ActivateAvx512,
+        ActivateBackwardAvx512,
+        HalfToFloatAvx512,
+        FloatToHalfAvx512,
+        RoundToHalfAvx512,
+        TransposeAvx512,
+        LinearActivateAvx512,
+        FastMathAvx512<ExpAvx512>,
+        FastMathAvx512<SigmoidAvx512>,
+        FastMathAvx512<TanhAvx512>,
+        FastMathAvx512<SoftplusAvx512>,
+        EncodeFrequencyAvx512,
+        EncodeTriangleAvx512,
+    };
+    const CpuFeatures& features = GetCpuFeatures();
+    return (features.avx512f && features.avx512bw && features.avx512vl && features.f16c) ? &table : nullptr;
+}
+
+const SpecialisedMLP* GetAvx512SpecialisedMLPs(size_t& count)
+{
+#define FLUXEL_SPECIALISED_MLP_ENTRY(inputs, hiddenLayers, hidden, outputs) \
+    { inputs, hiddenLayers, hidden, outputs, ForwardFixedAvx512<inputs, hiddenLayers, hidden, outputs> },
+    static const SpecialisedMLP mlps[] = { FLUXEL_SPECIALISED_MLP_SHAPES(FLUXEL_SPECIALISED_MLP_ENTRY) };
+#undef FLUXEL_SPECIALISED_MLP_ENTRY
+    count = GetAvx512Kernels() ? sizeof(mlps) / sizeof(mlps[0]) : 0;
+    return count ? mlps : nullptr;
+}
+#else
+const KernelTable* GetAvx512Kernels()
+{
+    return nullptr;
+}
+
+const SpecialisedMLP* GetAvx512SpecialisedMLPs(size_t& count)
+{
+    count = 0;
+    return nullptr;
+}
+#endif
+
+NAMESPACE_END(cpu)
+NAMESPACE_END(fluxel)
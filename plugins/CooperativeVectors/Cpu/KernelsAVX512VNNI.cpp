@@ -0,0 +1,238 @@
+// AVX-512 VNNI quantised kernels.
+// This file is compiled with AVX-512 VNNI code generation enabled (see CMakeLists.txt). It must not instantiate inline
+// functions shared with other translation units (Eigen, std algorithms, Activation.h helpers), otherwise the linker
+// may pick the AVX-512 copy for callers on the scalar path. Scalar fallbacks go through GetScalarQuantisedKernels() instead.
+
+#include <cstring>
+
+#include "QuantisedKernels.h"
+#include "CpuFeatures.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#include <immintrin.h>
+#define FLUXEL_KERNELS_AVX512_VNNI 1
+#endif
+
+NAMESPACE_BEGIN(fluxel)
+NAMESPACE_BEGIN(cpu)
+
+#if FLUXEL_KERNELS_AVX512_VNNI
+namespace
+{
+// One 32 bit lane of consecutive inputs, broadcast to all lanes.
+inline __m512i BroadcastLane(const void* data)
+{
+    int32_t lane;
+    std::memcpy(&lane, data, sizeof(lane));
+    return _mm512_set1_epi32(lane);
+}
+
+// fma(float(acc), scale, bias) for 16 outputs, with the same rounding as the scalar kernels.
+inline void StoreEpilogue(__m512i acc, __m512 scale, __m512 bias, float* output)
+{
+    _mm512_storeu_ps(output, _mm512_fmadd_ps(_mm512_cvtepi32_ps(acc), scale, bias));
+}
+
+// Computes a block of rows x (16 * COLS) outputs, keeping the accumulators in registers for the whole reduction.
+// I16 selects vpdpwssd on 16 bit inputs, vpdpbusd on unsigned 8 bit inputs otherwise.
+template <uint32_t ROWS, uint32_t COLS, bool I16>
+inline void LinearQuantisedBlock(const uint8_t* input,
+                                 size_t inputStride,
+                                 const uint8_t* weights,
+                                 const int32_t* offsets,
+                                 const float* scales,
+                                 const float* bias,
+                                 float* output,
+                                 size_t outputStride,
+                                 uint32_t inputsPadded,
+                                 uint32_t outputsPadded,
+                                 uint32_t o)
+{
+    // Bytes of one input of a row and inputs per 32 bit lane
+    constexpr uint32_t inputSize = I16 ? 2 : 1;
+    constexpr uint32_t group = 4 / inputSize;
+
+    __m512i acc[ROWS][COLS];
+    for (uint32_t c = 0; c < COLS; c++)
+    {
+        const __m512i offset = offsets ? _mm512_loadu_si512(offsets + o + c * 16) : _mm512_setzero_si512();
+        for (uint32_t r = 0; r < ROWS; r++)
+        {
+            acc[r][c] = offset;
+        }
+    }
+
+    const uint8_t* w = weights + size_t(o) * 4;
+    for (uint32_t i = 0; i < inputsPadded; i += group, w += size_t(outputsPadded) * 4)
+    {
+        __m512i wc[COLS];
+        for (uint32_t c = 0; c < COLS; c++)
+        {
+            wc[c] = _mm512_loadu_si512(w + c * 64);
+        }
+        for (uint32_t r = 0; r < ROWS; r++)
+        {
+            const __m512i x = BroadcastLane(input + (r * inputStride + i) * inputSize);
+            for (uint32_t c = 0; c < COLS; c++)
+            {
+                if constexpr (I16)
+                {
+                    acc[r][c] = _mm512_dpwssd_epi32(acc[r][c], x, wc[c]);
+                }
+                else
+                {
+                    acc[r][c] = _mm512_dpbusd_epi32(acc[r][c], x, wc[c]);
+                }
+            }
+        }
+    }
+
+    for (uint32_t c = 0; c < COLS; c++)
+    {
+        const __m512 scale = _mm512_loadu_ps(scales + o + c * 16);
+        const __m512 b = _mm512_loadu_ps(bias + o + c * 16);
+        for (uint32_t r = 0; r < ROWS; r++)
+        {
+            StoreEpilogue(acc[r][c], scale, b, output + r * outputStride + o + c * 16);
+        }
+    }
+}
+
+template <uint32_t ROWS, bool I16>
+inline void LinearQuantisedRows(const uint8_t* input,
+                                size_t inputStride,
+                                const uint8_t* weights,
+                                const int32_t* offsets,
+                                const float* scales,
+                                const float* bias,
+                                float* output,
+                                size_t outputStride,
+                                uint32_t inputsPadded,
+                                uint32_t outputsPadded)
+{
+    uint32_t o = 0;
+    for (; o + 32 <= outputsPadded; o += 32)
+    {
+        LinearQuantisedBlock<ROWS, 2, I16>(input, inputStride, weights, offsets, scales, bias, output, outputStride, inputsPadded, outputsPadded, o);
+    }
+    if (o < outputsPadded)
+    {
+        LinearQuantisedBlock<ROWS, 1, I16>(input, inputStride, weights, offsets, scales, bias, output, outputStride, inputsPadded, outputsPadded, o);
+    }
+}
+
+template <bool I16>
+void LinearQuantised(const uint8_t* input,
+                     size_t inputStride,
+                     const uint8_t* weights,
+                     const int32_t* offsets,
+                     const float* scales,
+                     const float* bias,
+                     float* output,
+                     size_t outputStride,
+                     uint32_t rows,
+                     uint32_t inputsPadded,
+                     uint32_t outputsPadded)
+{
+    constexpr uint32_t blockRows = 6;
+    constexpr uint32_t inputSize = I16 ? 2 : 1;
+
+    uint32_t r = 0;
+    for (; r + blockRows <= rows; r += blockRows)
+    {
+        LinearQuantisedRows<blockRows, I16>(input + r * inputStride * inputSize, inputStride, weights, offsets, scales, bias, output + r * outputStride,
+                                            outputStride, inputsPadded, outputsPadded);
+    }
+    for (; r < rows; r++)
+    {
+        LinearQuantisedRows<1, I16>(input + r * inputStride * inputSize, inputStride, weights, offsets, scales, bias, output + r * outputStride,
+                                    outputStride, inputsPadded, outputsPadded);
+    }
+}
+
+void LinearI8Avx512Vnni(const uint8_t* input,
+                        size_t inputStride,
+                        const int8_t* weights,
+                        const int32_t* offsets,
+                        const float* scales,
+                        const float* bias,
+                        float* output,
+                        size_t outputStride,
+                        uint32_t rows,
+                        uint32_t inputsPadded,
+                        uint32_t outputsPadded)
+{
+    LinearQuantised<false>(input, inputStride, reinterpret_cast<const uint8_t*>(weights), offsets, scales, bias, output, outputStride, rows, inputsPadded,
+                           outputsPadded);
+}
+
+void LinearI16Avx512Vnni(const int16_t* input,
+                         size_t inputStride,
+                         const int16_t* weights,
+                         const float* scales,
+                         const float* bias,
+                         float* output,
+                         size_t outputStride,
+                         uint32_t rows,
+                         uint32_t inputsPadded,
+                         uint32_t outputsPadded)
+{
+    LinearQuantised<true>(reinterpret_cast<const uint8_t*>(input), inputStride, reinterpret_cast<const uint8_t*>(weights), nullptr, scales, bias, output,
+                          outputStride, rows, inputsPadded, outputsPadded);
+}
+
+// clamp(round(x * invScale), -maxValue, maxValue) with the default rounding mode, round to nearest even.
+inline __m512i QuantiseLanes(const float* src, __m512 invScale, __m512 maxValue)
+{
+    const __m512 x = _mm512_mul_ps(_mm512_loadu_ps(src), invScale);
+    return _mm512_cvtps_epi32(_mm512_min_ps(_mm512_max_ps(x, _mm512_sub_ps(_mm512_setzero_ps(), maxValue)), maxValue));
+}
+
+void QuantiseI8Avx512Vnni(const float* src, uint8_t* dst, size_t count, float invScale)
+{
+    const __m512 scale = _mm512_set1_ps(invScale);
+    const __m512 maxValue = _mm512_set1_ps(127.f);
+    const __m512i zeroPoint = _mm512_set1_epi32(s_quantisedActivationZeroPoint);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        const __m512i q = _mm512_add_epi32(QuantiseLanes(src + i, scale, maxValue), zeroPoint);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm512_cvtepi32_epi8(q));
+    }
+    GetScalarQuantisedKernels().quantiseI8(src + i, dst + i, count - i, invScale);
+}
+
+void QuantiseI16Avx512Vnni(const float* src, int16_t* dst, size_t count, float invScale)
+{
+    const __m512 scale = _mm512_set1_ps(invScale);
+    const __m512 maxValue = _mm512_set1_ps(float(s_maxQuantisedI16Activation));
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm512_cvtepi32_epi16(QuantiseLanes(src + i, scale, maxValue)));
+    }
+    GetScalarQuantisedKernels().quantiseI16(src + i, dst + i, count - i, invScale);
+}
+} // namespace
+
+const QuantisedKernelTable* GetAvx512VnniQuantisedKernels()
+{
+    static const QuantisedKernelTable table = {
+        "AVX-512 VNNI",
+        LinearI8Avx512Vnni,
+        LinearI16Avx512Vnni,
+        QuantiseI8Avx512Vnni,
+        QuantiseI16Avx512Vnni,
+    };
+    const CpuFeatures& features = GetCpuFeatures();
+    return (features.avx512f && features.avx512bw && features.avx512vl && features.avx512vnni && features.fma) ? &table : nullptr;
+}
+#else
+const QuantisedKernelTable* GetAvx512VnniQuantisedKernels()
+{
+    return nullptr;
+}
+#endif
+
+NAMESPACE_END(cpu)
+NAMESPACE_END(fluxel)
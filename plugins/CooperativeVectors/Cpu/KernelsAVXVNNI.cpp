@@ -0,0 +1,214 @@
+// AVX-VNNI quantised kernels, the VEX encoded 256 bit dot products of CPUs without AVX-512.
+// This file is compiled with AVX2, FMA and AVX-VNNI code generation enabled (see CMakeLists.txt). It must not instantiate inline
+// functions shared with other translation units (Eigen, std algorithms, Activation.h helpers), otherwise the linker
+// may pick the AVX-VNNI copy for callers on the scalar path. Scalar fallbacks go through GetScalarQuantisedKernels() instead.
+
+#include <cstring>
+
+#include "QuantisedKernels.h"
+#include "CpuFeatures.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#include <immintrin.h>
+#define FLUXEL_KERNELS_AVX_VNNI 1
+#endif
+
+NAMESPACE_BEGIN(fluxel)
+NAMESPACE_BEGIN(cpu)
+
+#if FLUXEL_KERNELS_AVX_VNNI
+namespace
+{
+// One 32 bit lane of consecutive inputs, broadcast to all lanes.
+inline __m256i BroadcastLane(const void* data)
+{
+    int32_t lane;
+    std::memcpy(&lane, data, sizeof(lane));
+    return _mm256_set1_epi32(lane);
+}
+
+// Computes a block of rows x 16 outputs, keeping the accumulators in registers for the whole reduction.
+// I16 selects vpdpwssd on 16 bit inputs, vpdpbusd on unsigned 8 bit inputs otherwise.
+template <uint32_t ROWS, bool I16>
+inline void LinearQuantisedBlock(const uint8_t* input,
+                                 size_t inputStride,
+                                 const uint8_t* weights,
+                                 const int32_t* offsets,
+                                 const float* scales,
+                                 const float* bias,
+                                 float* output,
+                                 size_t outputStride,
+                                 uint32_t inputsPadded,
+                                 uint32_t outputsPadded,
+                                 uint32_t o)
+{
+    // Bytes of one input of a row and inputs per 32 bit lane
+    constexpr uint32_t inputSize = I16 ? 2 : 1;
+    constexpr uint32_t group = 4 / inputSize;
+
+    __m256i acc[ROWS][2];
+    const __m256i offset0 = offsets ? _mm256_loadu_si256(reinterpret_cast<const __m256i*>(offsets + o)) : _mm256_setzero_si256();
+    const __m256i offset1 = offsets ? _mm256_loadu_si256(reinterpret_cast<const __m256i*>(offsets + o + 8)) : _mm256_setzero_si256();
+    for (uint32_t r = 0; r < ROWS; r++)
+    {
+        acc[r][0] = offset0;
+        acc[r][1] = offset1;
+    }
+
+    const uint8_t* w = weights + size_t(o) * 4;
+    for (uint32_t i = 0; i < inputsPadded; i += group, w += size_t(outputsPadded) * 4)
+    {
+        const __m256i w0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w));
+        const __m256i w1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w + 32));
+        for (uint32_t r = 0; r < ROWS; r++)
+        {
+            const __m256i x = BroadcastLane(input + (r * inputStride + i) * inputSize);
+            if constexpr (I16)
+            {
+                acc[r][0] = _mm256_dpwssd_avx_epi32(acc[r][0], x, w0);
+                acc[r][1] = _mm256_dpwssd_avx_epi32(acc[r][1], x, w1);
+            }
+            else
+            {
+                acc[r][0] = _mm256_dpbusd_avx_epi32(acc[r][0], x, w0);
+                acc[r][1] = _mm256_dpbusd_avx_epi32(acc[r][1], x, w1);
+            }
+        }
+    }
+
+    // fma(float(acc), scale, bias), with the same rounding as the scalar kernels
+    const __m256 scale0 = _mm256_loadu_ps(scales + o);
+    const __m256 scale1 = _mm256_loadu_ps(scales + o + 8);
+    const __m256 b0 = _mm256_loadu_ps(bias + o);
+    const __m256 b1 = _mm256_loadu_ps(bias + o + 8);
+    for (uint32_t r = 0; r < ROWS; r++)
+    {
+        float* y = output + r * outputStride + o;
+        _mm256_storeu_ps(y, _mm256_fmadd_ps(_mm256_cvtepi32_ps(acc[r][0]), scale0, b0));
+        _mm256_storeu_ps(y + 8, _mm256_fmadd_ps(_mm256_cvtepi32_ps(acc[r][1]), scale1, b1));
+    }
+}
+
+template <bool I16>
+void LinearQuantised(const uint8_t* input,
+                     size_t inputStride,
+                     const uint8_t* weights,
+                     const int32_t* offsets,
+                     const float* scales,
+                     const float* bias,
+                     float* output,
+                     size_t outputStride,
+                     uint32_t rows,
+                     uint32_t inputsPadded,
+                     uint32_t outputsPadded)
+{
+    constexpr uint32_t blockRows = 4;
+    constexpr uint32_t inputSize = I16 ? 2 : 1;
+
+    uint32_t r = 0;
+    for (; r + blockRows <= rows; r += blockRows)
+    {
+        for (uint32_t o = 0; o < outputsPadded; o += 16)
+        {
+            LinearQuantisedBlock<blockRows, I16>(input + r * inputStride * inputSize, inputStride, weights, offsets, scales, bias, output + r * outputStride,
+                                                 outputStride, inputsPadded, outputsPadded, o);
+        }
+    }
+    for (; r < rows; r++)
+    {
+        for (uint32_t o = 0; o < outputsPadded; o += 16)
+        {
+            LinearQuantisedBlock<1, I16>(input + r * inputStride * inputSize, inputStride, weights, offsets, scales, bias, output + r * outputStride,
+                                         outputStride, inputsPadded, outputsPadded, o);
+        }
+    }
+}
+
+void LinearI8AvxVnni(const uint8_t* input,
+                     size_t inputStride,
+                     const int8_t* weights,
+                     const int32_t* offsets,
+                     const float* scales,
+                     const float* bias,
+                     float* output,
+                     size_t outputStride,
+                     uint32_t rows,
+                     uint32_t inputsPadded,
+                     uint32_t outputsPadded)
+{
+    LinearQuantised<false>(input, inputStride, reinterpret_cast<const uint8_t*>(weights), offsets, scales, bias, output, outputStride, rows, inputsPadded,
+                           outputsPadded);
+}
+
+void LinearI16AvxVnni(const int16_t* input,
+                      size_t inputStride,
+                      const int16_t* weights,
+                      const float* scales,
+                      const float* bias,
+                      float* output,
+                      size_t outputStride,
+                      uint32_t rows,
+                      uint32_t inputsPadded,
+                      uint32_t outputsPadded)
+{
+    LinearQuantised<true>(reinterpret_cast<const uint8_t*>(input), inputStride, reinterpret_cast<const uint8_t*>(weights), nullptr, scales, bias, output,
+                          outputStride, rows, inputsPadded, outputsPadded);
+}
+
+// clamp(round(x * invScale), -maxValue, maxValue) for 8 values packed to 16 bits,
+// with the default rounding mode, round to nearest even.
+inline __m128i QuantiseLanes(const float* src, __m256 invScale, __m256 maxValue, __m256i zeroPoint)
+{
+    const __m256 x = _mm256_mul_ps(_mm256_loadu_ps(src), invScale);
+    const __m256i q = _mm256_add_epi32(_mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(x, _mm256_sub_ps(_mm256_setzero_ps(), maxValue)), maxValue)), zeroPoint);
+    return _mm_packs_epi32(_mm256_castsi256_si128(q), _mm256_extracti128_si256(q, 1));
+}
+
+void QuantiseI8AvxVnni(const float* src, uint8_t* dst, size_t count, float invScale)
+{
+    const __m256 scale = _mm256_set1_ps(invScale);
+    const __m256 maxValue = _mm256_set1_ps(127.f);
+    const __m256i zeroPoint = _mm256_set1_epi32(s_quantisedActivationZeroPoint);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m128i q = QuantiseLanes(src + i, scale, maxValue, zeroPoint);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(q, q));
+    }
+    GetScalarQuantisedKernels().quantiseI8(src + i, dst + i, count - i, invScale);
+}
+
+void QuantiseI16AvxVnni(const float* src, int16_t* dst, size_t count, float invScale)
+{
+    const __m256 scale = _mm256_set1_ps(invScale);
+    const __m256 maxValue = _mm256_set1_ps(float(s_maxQuantisedI16Activation));
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), QuantiseLanes(src + i, scale, maxValue, _mm256_setzero_si256()));
+    }
+    GetScalarQuantisedKernels().quantiseI16(src + i, dst + i, count - i, invScale);
+}
+} // namespace
+
+const QuantisedKernelTable* GetAvxVnniQuantisedKernels()
+{
+    static const QuantisedKernelTable table = {
+        "AVX-VNNI",
+        LinearI8AvxVnni,
+        LinearI16AvxVnni,
+        QuantiseI8AvxVnni,
+        QuantiseI16AvxVnni,
+    };
+    const CpuFeatures& features = GetCpuFeatures();
+    return (features.avx2 && features.fma && features.avxvnni) ? &table : nullptr;
+}
+#else
+const QuantisedKernelTable* GetAvxVnniQuantisedKernels()
+{
+    return nullptr;
+}
+#endif
+
+NAMESPACE_END(cpu)
+NAMESPACE_END(fluxel)
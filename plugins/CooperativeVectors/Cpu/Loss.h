@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+#include "Fluxel.h"
+
+NAMESPACE_BEGIN(fluxel)
+NAMESPACE_BEGIN(cpu)
+
+// Loss functions of the CPU network engines.
+// These mirror the ILoss implementations in Loss.slang, evaluated per output component.
+enum class Loss
+{
+    L1,
+    L1Relative,
+    MAPE,
+    SMAPE,
+    L2,
+    L2Relative,
+};
+
+inline float EvaluateLoss(Loss loss, float target, float predicted, float scale = 1.f)
+{
+    const float diff = predicted - target;
+    switch (loss)
+    {
+    case Loss::L1:
+        return scale * std::abs(diff);
+    case Loss::L1Relative:
+        return scale * std::abs(diff) / (std::abs(predicted) + 0.01f);
+    case Loss::MAPE:
+        return scale * std::abs(diff) / (std::abs(target) + 0.01f);
+    case Loss::SMAPE:
+        return scale * std::abs(diff) / ((std::abs(target) + std::abs(predicted)) * 0.5f + 0.01f);
+    case Loss::L2:
+        return scale * diff * diff;
+    case Loss::L2Relative:
+        return scale * diff * diff / (predicted * predicted + 0.01f);
+    default:
+        return 0.f; // Should not get here
+    }
+}
+
+// Derivative of the loss with respect to the prediction.
+inline float EvaluateLossDerivative(Loss loss, float target, float predicted, float scale = 1.f)
+{
+    const float diff = predicted - target;
+    switch (loss)
+    {
+    case Loss::L1:
+        return std::copysign(scale, diff);
+    case Loss::L1Relative:
+        return std::copysign(scale, diff) / (std::abs(predicted) + 0.01f);
+    case Loss::MAPE:
+        return std::copysign(scale, diff) / (std::abs(target) + 0.01f);
+    case Loss::SMAPE:
+        return std::copysign(scale, diff) / ((std::abs(target) + std::abs(predicted)) * 0.5f + 0.01f);
+    case Loss::L2:
+        return 2.f * scale * diff;
+    case Loss::L2Relative:
+        return 2.f * scale * diff / (predicted * predicted + 0.01f);
+    default:
+        return 0.f; // Should not get here
+    }
+}
+
+// Loss of one sample averaged over its output components, SampleLoss in Metrics.slang.
+inline float EvaluateSampleLoss(Loss loss, const float* target, const float* predicted, uint32_t outputs)
+{
+    float sum = 0.f;
+    for (uint32_t o = 0; o < outputs; o++)
+    {
+        sum += EvaluateLoss(loss, target[o], predicted[o]);
+    }
+    return sum / float(outputs);
+}
+
+NAMESPACE_END(cpu)
+NAMESPACE_END(fluxel)
@@ -0,0 +1,42 @@
+#include <algorithm>
+#include <vector>
+
+#include "LossReduction.h"
+
+NAMESPACE_BEGIN(fluxel)
+NAMESPACE_BEGIN(cpu)
+
+namespace
+{
+// Samples reduced by a worker per task, the counterpart of a thread group.
+constexpr size_t s_reductionTileSamples = 1024;
+} // namespace
+
+TrainingMetrics ReduceLoss(Loss loss, const float* predicted, const float* targets, size_t count, uint32_t outputs, ThreadPool* threadPool)
+{
+    TrainingMetrics metrics;
+    if (count == 0 || outputs == 0)
+    {
+        return metrics;
+    }
+
+    const size_t tileCount = (count + s_reductionTileSamples - 1) / s_reductionTileSamples;
+    std::vector<TrainingMetrics> tileMetrics(tileCount);
+    (threadPool ? threadPool : &ThreadPool::GetDefault())->ParallelFor(tileCount, [&](size_t tile, uint32_t) {
+        const size_t first = tile * s_reductionTileSamples;
+        const size_t last = std::min(first + s_reductionTileSamples, count);
+        for (size_t s = first; s < last; s++)
+        {
+            tileMetrics[tile].AddSample(EvaluateSampleLoss(loss, targets + s * outputs, predicted + s * outputs, outputs));
+        }
+    });
+
+    for (TrainingMetrics const& tile : tileMetrics)
+    {
+        metrics.Merge(tile);
+    }
+    return metrics;
+}
+
+NAMESPACE_END(cpu)
+NAMESPACE_END(fluxel)
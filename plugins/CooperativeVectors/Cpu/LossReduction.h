@@ -0,0 +1,18 @@
+#pragma once
+
+#include "Fluxel.h"
+#include "Loss.h"
+#include "ThreadPool.h"
+#include "TrainingMetrics.h"
+
+NAMESPACE_BEGIN(fluxel)
+NAMESPACE_BEGIN(cpu)
+
+// Loss metrics of count predictions against their targets, both stored as [count][outputs] floats.
+// The CPU counterpart of AccumulateLoss in Metrics.slang: samples are reduced per tile over the thread pool and
+// the tiles are merged in order, so the result does not depend on the number of threads.
+// The default pool is used when none is provided.
+TrainingMetrics ReduceLoss(Loss loss, const float* predicted, const float* targets, size_t count, uint32_t outputs, ThreadPool* threadPool = nullptr);
+
+NAMESPACE_END(cpu)
+NAMESPACE_END(fluxel)
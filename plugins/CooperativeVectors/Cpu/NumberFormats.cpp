@@ -0,0 +1,188 @@
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "NumberFormats.h"
+
+NAMESPACE_BEGIN(fluxel)
+NAMESPACE_BEGIN(cpu)
+
+namespace
+{
+constexpr float s_maxE4M3 = 448.f;
+constexpr float s_maxInt8 = 127.f;
+
+// E4M3 decoding table, there are only 256 encodings.
+const std::array<float, 256>& GetE4M3Table()
+{
+    static const std::array<float, 256> table = []() {
+        std::array<float, 256> values;
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            const uint32_t exponent = (i >> 3) & 0xF;
+            const uint32_t mantissa = i & 0x7;
+            float value;
+            if (exponent == 0)
+            {
+                value = std::ldexp(float(mantissa), -9); // Subnormal, m / 8 * 2^-6
+            }
+            else if (exponent == 0xF && mantissa == 0x7)
+            {
+                value = std::numeric_limits<float>::quiet_NaN();
+            }
+            else
+            {
+                value = std::ldexp(1.f + float(mantissa) / 8.f, int(exponent) - 7);
+            }
+            values[i] = (i & 0x80) ? -value : value;
+        }
+        return values;
+    }();
+    return table;
+}
+} // namespace
+
+uint16_t FloatToBFloat16(float value)
+{
+    const uint32_t bits = std::bit_cast<uint32_t>(value);
+    if (std::isnan(value))
+    {
+        return uint16_t((bits >> 16) | 0x40); // Keep NaN quiet after truncation
+    }
+    return uint16_t((bits + 0x7FFF + ((bits >> 16) & 1)) >> 16);
+}
+
+float BFloat16ToFloat(uint16_t value)
+{
+    return std::bit_cast<float>(uint32_t(value) << 16);
+}
+
+uint8_t FloatToE4M3(float value)
+{
+    const uint32_t bits = std::bit_cast<uint32_t>(value);
+    const uint8_t sign = uint8_t((bits >> 24) & 0x80);
+    const float magnitude = std::fabs(value);
+
+    if (std::isnan(value))
+    {
+        return sign | 0x7F;
+    }
+    if (magnitude >= s_maxE4M3)
+    {
+        return sign | 0x7E;
+    }
+    if (magnitude < 0x1p-6f)
+    {
+        // Subnormal range is evenly spaced in steps of 2^-9, rounding to 8 steps gives the smallest normal
+        return sign | uint8_t(std::nearbyint(magnitude * 512.f));
+    }
+
+    // Round the mantissa to 3 bits, a carry moves into the exponent
+    const uint32_t magnitudeBits = bits & 0x7FFFFFFF;
+    const uint32_t rounded = (magnitudeBits + 0x7FFFF + ((magnitudeBits >> 20) & 1)) & 0xFFF00000;
+    const uint32_t exponent = (rounded >> 23) - 127 + 7;
+    const uint32_t mantissa = (rounded >> 20) & 0x7;
+    const uint32_t encoded = (exponent << 3) | mantissa;
+    return sign | uint8_t(encoded > 0x7E ? 0x7E : encoded);
+}
+
+float E4M3ToFloat(uint8_t value)
+{
+    return GetE4M3Table()[value];
+}
+
+int8_t FloatToInt8(float value)
+{
+    const float rounded = std::nearbyint(value);
+    return int8_t(rounded > s_maxInt8 ? s_maxInt8 : (rounded < -s_maxInt8 ? -s_maxInt8 : rounded));
+}
+
+float GetMaxValue(Precision precision)
+{
+    switch (precision)
+    {
+    case Precision::F16:
+        return 65504.f;
+    case Precision::F32:
+        return std::numeric_limits<float>::max();
+    case Precision::BF16:
+        return BFloat16ToFloat(0x7F7F);
+    case Precision::F8E4M3:
+        return s_maxE4M3;
+    case Precision::I8:
+        return s_maxInt8;
+    default:
+        return 0.f; // Should not get here
+    }
+}
+
+void DecodeParams(Precision precision, const uint8_t* src, float* dst, size_t count, float scale, KernelTable const& kernels)
+{
+    switch (precision)
+    {
+    case Precision::F16:
+        kernels.halfToFloat(reinterpret_cast<const uint16_t*>(src), dst, count);
+        break;
+    case Precision::F32:
+        std::memcpy(dst, src, count * sizeof(float));
+        break;
+    case Precision::BF16:
+        for (size_t i = 0; i < count; i++)
+        {
+            dst[i] = BFloat16ToFloat(reinterpret_cast<const uint16_t*>(src)[i]);
+        }
+        break;
+    case Precision::F8E4M3:
+    {
+        const std::array<float, 256>& table = GetE4M3Table();
+        for (size_t i = 0; i < count; i++)
+        {
+            dst[i] = table[src[i]] * scale;
+        }
+        break;
+    }
+    case Precision::I8:
+        for (size_t i = 0; i < count; i++)
+        {
+            dst[i] = float(int8_t(src[i])) * scale;
+        }
+        break;
+    }
+}
+
+void EncodeParams(Precision precision, const float* src, uint8_t* dst, size_t count, float scale, KernelTable const& kernels)
+{
+    const float invScale = 1.f / scale;
+    switch (precision)
+    {
+    case Precision::F16:
+        kernels.floatToHalf(src, reinterpret_cast<uint16_t*>(dst), count);
+        break;
+    case Precision::F32:
+        std::memcpy(dst, src, count * sizeof(float));
+        break;
+    case Precision::BF16:
+        for (size_t i = 0; i < count; i++)
+        {
+            reinterpret_cast<uint16_t*>(dst)[i] = FloatToBFloat16(src[i]);
+        }
+        break;
+    case Precision::F8E4M3:
+        for (size_t i = 0; i < count; i++)
+        {
+            dst[i] = FloatToE4M3(src[i] * invScale);
+        }
+        break;
+    case Precision::I8:
+        for (size_t i = 0; i < count; i++)
+        {
+            dst[i] = uint8_t(FloatToInt8(src[i] * invScale));
+        }
+        break;
+    }
+}
+
+NAMESPACE_END(cpu)
+NAMESPACE_END(fluxel)
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+
+#include "Fluxel.h"
+#include "Network.h"
+#include "Kernels.h"
+
+NAMESPACE_BEGIN(fluxel)
+NAMESPACE_BEGIN(cpu)
+
+// Scalar conversions of the reduced precision storage formats, all rounding to nearest even.
+uint16_t FloatToBFloat16(float value);
+float BFloat16ToFloat(uint16_t value);
+
+// Values beyond the E4M3 range saturate to +-448, NaN is kept.
+uint8_t FloatToE4M3(float value);
+float E4M3ToFloat(uint8_t value);
+
+// Values are clamped to the symmetric range [-127, 127].
+int8_t FloatToInt8(float value);
+
+// Largest finite magnitude of a precision, used to derive the scale of quantised layers.
+float GetMaxValue(Precision precision);
+
+// Decode count values stored in precision to float, quantised values are multiplied by scale.
+void DecodeParams(Precision precision, const uint8_t* src, float* dst, size_t count, float scale, KernelTable const& kernels);
+
+// Encode count floats in precision, quantised values are divided by scale first.
+void EncodeParams(Precision precision, const float* src, uint8_t* dst, size_t count, float scale, KernelTable const& kernels);
+
+NAMESPACE_END(cpu)
+NAMESPACE_END(fluxel)
@@ -0,0 +1,114 @@
+#include <cstring>
+
+#include "PackedNetwork.h"
+#include "NumberFormats.h"
+#include "Logger.h"
+
+NAMESPACE_BEGIN(fluxel)
+NAMESPACE_BEGIN(cpu)
+
+bool ValidateCpuNetworkLayout(NetworkLayout const& layout, size_t paramsSize)
+{
+    if (layout.networkLayers.empty())
+    {
+        Log(Error, "CPU network: layout has no layers.");
+        return false;
+    }
+
+    if (layout.matrixLayout != MatrixLayout::RowMajor && layout.matrixLayout != MatrixLayout::ColumnMajor && layout.matrixLayout != MatrixLayout::HostPanel)
+    {
+        Log(Error, "CPU network: device optimal matrix layouts are opaque, convert to a host matrix layout first.");
+        return false;
+    }
+
+    const size_t biasElementSize = GetSize(layout.biasPrecision);
+    if (IsQuantised(layout.biasPrecision) || biasElementSize == 0)
+    {
+        Log(Error, "CPU network: unsupported bias precision.");
+        return false;
+    }
+
+    for (size_t i = 0; i < layout.networkLayers.size(); i++)
+    {
+        const NetworkLayer& layer = layout.networkLayers[i];
+        if (i > 0 && layer.inputs != layout.networkLayers[i - 1].outputs)
+        {
+            Log(Error, "CPU network: layer %d has %d inputs but the previous layer has %d outputs.", int(i), layer.inputs, layout.networkLayers[i - 1].outputs);
+            return false;
+        }
+        const size_t elementSize = GetSize(layer.weightPrecision);
+        if (elementSize == 0)
+        {
+            Log(Error, "CPU network: layer %d has an unsupported weight precision.", int(i));
+            return false;
+        }
+        if (layer.weightSize < GetHostMatrixSize(layer.weightPrecision, layout.matrixLayout, layer.outputs, layer.inputs) || layer.biasSize < layer.outputs * biasElementSize ||
+            layer.weightOffset + layer.weightSize > paramsSize || layer.biasOffset + layer.biasSize > paramsSize)
+        {
+            Log(Error, "CPU network: layer %d parameters are out of range.", int(i));
+            return false;
+        }
+    }
+    return true;
+}
+
+bool PackNetworkLayers(NetworkLayout const& layout, const uint8_t* params, size_t paramsSize, KernelTable const& kernels, std::vector<PackedLayer>& layers)
+{
+    if (!ValidateCpuNetworkLayout(layout, paramsSize))
+    {
+        return false;
+    }
+
+    layers.resize(layout.networkLayers.size());
+
+    std::vector<float> matrix;
+    for (size_t l = 0; l < layout.networkLayers.size(); l++)
+    {
+        const NetworkLayer& src = layout.networkLayers[l];
+        PackedLayer& dst = layers[l];
+
+        dst.inputs = src.inputs;
+        dst.outputs = src.outputs;
+        dst.outputsPadded = PadKernelWidth(src.outputs);
+        dst.weights.assign(size_t(dst.inputs) * dst.outputsPadded, 0.f);
+        dst.bias.assign(dst.outputsPadded, 0.f);
+
+        // Decode to float in the source matrix layout, quantised weights are scaled back
+        const size_t elementCount = GetHostMatrixSize(src.weightPrecision, layout.matrixLayout, src.outputs, src.inputs) / GetSize(src.weightPrecision);
+        matrix.resize(elementCount);
+        DecodeParams(src.weightPrecision, params + src.weightOffset, matrix.data(), elementCount, src.weightScale, kernels);
+        DecodeParams(layout.biasPrecision, params + src.biasOffset, dst.bias.data(), src.outputs, 1.f, kernels);
+
+        // Rearrange into [inputs][outputsPadded]
+        const uint8_t* matrixBytes = reinterpret_cast<const uint8_t*>(matrix.data());
+        uint8_t* weightBytes = reinterpret_cast<uint8_t*>(dst.weights.data());
+        switch (layout.matrixLayout)
+        {
+        case MatrixLayout::RowMajor:
+            kernels.transpose(matrixBytes, src.inputs, weightBytes, dst.outputsPadded, src.outputs, src.inputs, sizeof(float));
+            break;
+        case MatrixLayout::ColumnMajor:
+            for (uint32_t i = 0; i < src.inputs; i++)
+            {
+                std::memcpy(&dst.weights[size_t(i) * dst.outputsPadded], &matrix[size_t(i) * src.outputs], src.outputs * sizeof(float));
+            }
+            break;
+        default:
+            // Panels are already [inputs][s_hostPanelRows] slices of the packed matrix, padding included
+            static_assert(s_kernelWidthAlignment % s_hostPanelRows == 0);
+            for (uint32_t o = 0; o < src.outputs; o += s_hostPanelRows)
+            {
+                const float* panel = &matrix[size_t(o) * src.inputs];
+                for (uint32_t i = 0; i < src.inputs; i++)
+                {
+                    std::memcpy(&dst.weights[size_t(i) * dst.outputsPadded + o], panel + size_t(i) * s_hostPanelRows, s_hostPanelRows * sizeof(float));
+                }
+            }
+            break;
+        }
+    }
+    return true;
+}
+
+NAMESPACE_END(cpu)
+NAMESPACE_END(fluxel)
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Fluxel.h"
+#include "Network.h"
+#include "AlignedVector.h"
+#include "Kernels.h"
+
+NAMESPACE_BEGIN(fluxel)
+NAMESPACE_BEGIN(cpu)
+
+// One layer of a network unpacked into the format consumed by the CPU kernels:
+// the weight matrix is transposed to [inputs][outputsPadded] and stored as float, zero padded to the kernel width.
+struct PackedLayer
+{
+    uint32_t inputs = 0;
+    uint32_t outputs = 0;
+    uint32_t outputsPadded = 0;
+    AlignedVector<float> weights; ///< inputs x outputsPadded, weights[i * outputsPadded + o] = W[o][i].
+    AlignedVector<float> bias; ///< outputsPadded entries.
+};
+
+// Check a host network layout can be consumed by the CPU engines.
+// Requires a host matrix layout, parameters in range and matching layer widths.
+// HostPanel matches the packed format and unpacks with plain copies.
+// Weights may use any precision, quantised layers are decoded with their scale.
+bool ValidateCpuNetworkLayout(NetworkLayout const& layout, size_t paramsSize);
+
+// Unpack the weights and biases of every layer from the raw parameter buffer described by layout.
+bool PackNetworkLayers(NetworkLayout const& layout, const uint8_t* params, size_t paramsSize, KernelTable const& kernels, std::vector<PackedLayer>& layers);
+
+NAMESPACE_END(cpu)
+NAMESPACE_END(fluxel)
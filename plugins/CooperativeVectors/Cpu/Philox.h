@@ -0,0 +1,60 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "Fluxel.h"
+
+NAMESPACE_BEGIN(fluxel)
+NAMESPACE_BEGIN(cpu)
+
+// Philox4x32-10 counter based random number generator, see Salmon et al. "Parallel Random Numbers: As Easy as 1, 2, 3".
+// Every (counter, key) pair maps to 4 independent 32 bit values, so any element of a random stream can be
+// generated without the ones before it. This makes parallel generation independent of the work distribution.
+class Philox4x32
+{
+public:
+    using Counter = std::array<uint32_t, 4>;
+    using Key = std::array<uint32_t, 2>;
+
+    static Counter Generate(Counter counter, Key key)
+    {
+        for (int round = 0; round < 10; round++)
+        {
+            if (round > 0)
+            {
+                key[0] += s_weyl0;
+                key[1] += s_weyl1;
+            }
+            const uint64_t product0 = uint64_t(s_multiplier0) * counter[0];
+            const uint64_t product1 = uint64_t(s_multiplier1) * counter[2];
+            counter = {
+                uint32_t(product1 >> 32) ^ counter[1] ^ key[0],
+                uint32_t(product1),
+                uint32_t(product0 >> 32) ^ counter[3] ^ key[1],
+                uint32_t(product0),
+            };
+        }
+        return counter;
+    }
+
+    static Key MakeKey(uint64_t seed)
+    {
+        return { uint32_t(seed), uint32_t(seed >> 32) };
+    }
+
+private:
+    static constexpr uint32_t s_multiplier0 = 0xD2511F53;
+    static constexpr uint32_t s_multiplier1 = 0xCD9E8D57;
+    static constexpr uint32_t s_weyl0 = 0x9E3779B9;
+    static constexpr uint32_t s_weyl1 = 0xBB67AE85;
+};
+
+// Map 32 random bits to a float uniformly distributed in [-1, 1).
+inline float UniformSignedFloat(uint32_t bits)
+{
+    return float(bits >> 8) * (2.f / 16777216.f) - 1.f;
+}
+
+NAMESPACE_END(cpu)
+NAMESPACE_END(fluxel)
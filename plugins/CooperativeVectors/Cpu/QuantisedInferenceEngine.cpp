@@ -0,0 +1,315 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "QuantisedInferenceEngine.h"
+#include "Logger.h"
+
+NAMESPACE_BEGIN(fluxel)
+NAMESPACE_BEGIN(cpu)
+
+QuantisedInferenceEngine::QuantisedInferenceEngine(ThreadPool* threadPool)
+    : m_threadPool(threadPool ? threadPool : &ThreadPool::GetDefault())
+    , m_quantisedKernels(&GetBestQuantisedKernels())
+    , m_kernels(&GetBestKernels())
+    , m_reference(threadPool)
+{
+}
+
+bool QuantisedInferenceEngine::Initialise(HostNetwork const& network, const float* samples, size_t sampleCount, QuantisedInferenceEngineDesc const& desc)
+{
+    m_layers.clear();
+    m_desc = desc;
+
+    if (!samples || sampleCount == 0)
+    {
+        Log(Error, "QuantisedInferenceEngine: calibration samples are required to quantise the activations.");
+        return false;
+    }
+
+    const auto& params = network.GetNetworkParams();
+    std::vector<PackedLayer> layers;
+    if (!PackNetworkLayers(network.GetNetworkLayout(), params.data(), params.size(), *m_kernels, layers))
+    {
+        Log(Error, "QuantisedInferenceEngine: Failed to load network.");
+        return false;
+    }
+
+    const bool i16 = m_desc.activations == QuantisedActivations::I16;
+    for (const PackedLayer& layer : layers)
+    {
+        if (i16 && PadQuantisedInputs(layer.inputs) > s_maxQuantisedI16Inputs)
+        {
+            Log(Error, "QuantisedInferenceEngine: 16 bit activations support up to %d inputs per layer, got %d.", int(s_maxQuantisedI16Inputs),
+                int(layer.inputs));
+            return false;
+        }
+    }
+
+    InferenceEngineDesc referenceDesc;
+    referenceDesc.hiddenActivation = m_desc.hiddenActivation;
+    referenceDesc.finalActivation = m_desc.finalActivation;
+    referenceDesc.halfPrecisionActivations = true;
+    referenceDesc.tileRows = m_desc.tileRows;
+    if (!m_reference.Initialise(network, referenceDesc))
+    {
+        return false;
+    }
+
+    std::vector<float> inputScales;
+    CalibrateInputScales(layers, samples, sampleCount, inputScales);
+
+    // Symmetric weights with one scale per output, interleaved for the dot product instructions
+    const uint32_t group = i16 ? 2 : 4;
+    m_maxInputsPadded = 0;
+    m_maxOutputsPadded = 0;
+    m_layers.resize(layers.size());
+    for (size_t l = 0; l < layers.size(); l++)
+    {
+        const PackedLayer& src = layers[l];
+        Layer& dst = m_layers[l];
+        dst.inputs = src.inputs;
+        dst.inputsPadded = PadQuantisedInputs(src.inputs);
+        dst.outputs = src.outputs;
+        dst.outputsPadded = src.outputsPadded;
+        dst.inputScale = inputScales[l];
+        dst.offsets.assign(dst.outputsPadded, 0);
+        dst.scales.assign(dst.outputsPadded, 0.f);
+        dst.bias.assign(src.bias.begin(), src.bias.end());
+        if (i16)
+        {
+            dst.weightsI16.assign(size_t(dst.inputsPadded) * dst.outputsPadded, 0);
+        }
+        else
+        {
+            dst.weightsI8.assign(size_t(dst.inputsPadded) * dst.outputsPadded, 0);
+        }
+
+        for (uint32_t o = 0; o < src.outputs; o++)
+        {
+            float maxAbs = 0.f;
+            for (uint32_t i = 0; i < src.inputs; i++)
+            {
+                maxAbs = std::max(maxAbs, std::fabs(src.weights[size_t(i) * src.outputsPadded + o]));
+            }
+            const float weightScale = maxAbs > 0.f ? maxAbs / 127.f : 1.f;
+
+            int32_t sum = 0;
+            for (uint32_t i = 0; i < src.inputs; i++)
+            {
+                const float w = src.weights[size_t(i) * src.outputsPadded + o] / weightScale;
+                const int32_t q = int32_t(std::nearbyint(std::clamp(w, -127.f, 127.f)));
+                const size_t index = size_t(i / group) * dst.outputsPadded * group + size_t(o) * group + i % group;
+                if (i16)
+                {
+                    dst.weightsI16[index] = int16_t(q);
+                }
+                else
+                {
+                    dst.weightsI8[index] = int8_t(q);
+                }
+                sum += q;
+            }
+            dst.offsets[o] = -s_quantisedActivationZeroPoint * sum;
+            dst.scales[o] = dst.inputScale * weightScale;
+        }
+
+        m_maxInputsPadded = std::max(m_maxInputsPadded, dst.inputsPadded);
+        m_maxOutputsPadded = std::max(m_maxOutputsPadded, dst.outputsPadded);
+    }
+
+    // The float outputs are the larger of the two scratch buffers
+    m_tileRows = m_desc.tileRows ? m_desc.tileRows : ChooseTileRows(m_maxOutputsPadded);
+
+    m_calibrationError = MeasureError(samples, sampleCount);
+    return true;
+}
+
+void QuantisedInferenceEngine::CalibrateInputScales(std::vector<PackedLayer> const& layers,
+                                                    const float* samples,
+                                                    size_t sampleCount,
+                                                    std::vector<float>& inputScales) const
+{
+    const float maxValue = m_desc.activations == QuantisedActivations::I16 ? float(s_maxQuantisedI16Activation) : 127.f;
+    const float percentile = std::clamp(m_desc.calibrationPercentile, 0.f, 1.f);
+
+    // Magnitudes of the inputs of every layer over all samples
+    std::vector<std::vector<float>> magnitudes(layers.size());
+    for (size_t l = 0; l < layers.size(); l++)
+    {
+        magnitudes[l].reserve(sampleCount * layers[l].inputs);
+    }
+
+    // Propagate the samples through the FP16 path one tile at a time
+    uint32_t stride = PadKernelWidth(layers.front().inputs);
+    for (const PackedLayer& layer : layers)
+    {
+        stride = std::max(stride, layer.outputsPadded);
+    }
+    const uint32_t tileRows = ChooseTileRows(stride);
+    AlignedVector<float> scratch(2 * size_t(tileRows) * stride, 0.f);
+    const uint32_t numInputs = layers.front().inputs;
+
+    for (size_t firstRow = 0; firstRow < sampleCount; firstRow += tileRows)
+    {
+        const uint32_t rows = uint32_t(std::min<size_t>(tileRows, sampleCount - firstRow));
+        float* src = scratch.data();
+        float* dst = src + size_t(tileRows) * stride;
+        for (uint32_t r = 0; r < rows; r++)
+        {
+            std::memcpy(src + r * stride, samples + (firstRow + r) * numInputs, numInputs * sizeof(float));
+            m_kernels->roundToHalf(src + r * stride, numInputs);
+        }
+
+        for (size_t l = 0; l < layers.size(); l++)
+        {
+            const PackedLayer& layer = layers[l];
+            for (uint32_t r = 0; r < rows; r++)
+            {
+                for (uint32_t i = 0; i < layer.inputs; i++)
+                {
+                    magnitudes[l].push_back(std::fabs(src[r * stride + i]));
+                }
+            }
+            if (l + 1 < layers.size())
+            {
+                m_kernels->linearActivate(src, stride, layer.weights.data(), layer.bias.data(), dst, stride, rows, layer.inputs, layer.outputsPadded,
+                                          m_desc.hiddenActivation, true);
+                std::swap(src, dst);
+            }
+        }
+    }
+
+    inputScales.resize(layers.size());
+    for (size_t l = 0; l < layers.size(); l++)
+    {
+        std::vector<float>& values = magnitudes[l];
+        float range = 0.f;
+        if (!values.empty())
+        {
+            const size_t index = size_t(double(percentile) * double(values.size() - 1));
+            std::nth_element(values.begin(), values.begin() + index, values.end());
+            range = values[index];
+        }
+        inputScales[l] = range > 0.f ? range / maxValue : 1.f;
+    }
+}
+
+void QuantisedInferenceEngine::Evaluate(const float* inputs, size_t count, float* outputs) const
+{
+    if (m_layers.empty() || count == 0)
+    {
+        return;
+    }
+
+    const QuantisedKernelTable& quantisedKernels = *m_quantisedKernels;
+    const KernelTable& kernels = *m_kernels;
+    const bool i16 = m_desc.activations == QuantisedActivations::I16;
+    const uint32_t tileRows = m_tileRows;
+    const size_t quantisedStride = m_maxInputsPadded;
+    const size_t stride = m_maxOutputsPadded;
+    const uint32_t numInputs = GetInputCount();
+    const uint32_t numOutputs = GetOutputCount();
+
+    const size_t tileCount = (count + tileRows - 1) / tileRows;
+    m_threadPool->ParallelFor(tileCount, [&](size_t tile, uint32_t) {
+        // Quantised layer inputs and float layer outputs, reused by the thread across calls.
+        thread_local AlignedVector<int16_t> quantisedScratch;
+        thread_local AlignedVector<float> scratch;
+        if (quantisedScratch.size() < tileRows * quantisedStride)
+        {
+            quantisedScratch.resize(tileRows * quantisedStride);
+        }
+        if (scratch.size() < tileRows * stride)
+        {
+            scratch.resize(tileRows * stride);
+        }
+        int16_t* xI16 = quantisedScratch.data();
+        uint8_t* xI8 = reinterpret_cast<uint8_t*>(quantisedScratch.data());
+        float* y = scratch.data();
+
+        const size_t firstRow = tile * tileRows;
+        const uint32_t rows = uint32_t(std::min<size_t>(tileRows, count - firstRow));
+
+        // Quantise the first inputsPadded columns of every row of a float tile, padding the rows with zeros
+        auto quantise = [&](const float* src, size_t srcStride, uint32_t columns, Layer const& layer) {
+            const float invScale = 1.f / layer.inputScale;
+            for (uint32_t r = 0; r < rows; r++)
+            {
+                if (i16)
+                {
+                    int16_t* q = xI16 + r * quantisedStride;
+                    quantisedKernels.quantiseI16(src + r * srcStride, q, columns, invScale);
+                    std::fill(q + columns, q + layer.inputsPadded, int16_t(0));
+                }
+                else
+                {
+                    uint8_t* q = xI8 + r * quantisedStride;
+                    quantisedKernels.quantiseI8(src + r * srcStride, q, columns, invScale);
+                    std::fill(q + columns, q + layer.inputsPadded, uint8_t(s_quantisedActivationZeroPoint));
+                }
+            }
+        };
+
+        quantise(inputs + firstRow * numInputs, numInputs, numInputs, m_layers.front());
+        for (size_t l = 0; l < m_layers.size(); l++)
+        {
+            const Layer& layer = m_layers[l];
+            if (i16)
+            {
+                quantisedKernels.linearI16(xI16, quantisedStride, layer.weightsI16.data(), layer.scales.data(), layer.bias.data(), y, stride, rows,
+                                           layer.inputsPadded, layer.outputsPadded);
+            }
+            else
+            {
+                quantisedKernels.linearI8(xI8, quantisedStride, layer.weightsI8.data(), layer.offsets.data(), layer.scales.data(), layer.bias.data(), y,
+                                          stride, rows, layer.inputsPadded, layer.outputsPadded);
+            }
+
+            const bool last = l + 1 == m_layers.size();
+            const ActivationDesc& act = last ? m_desc.finalActivation : m_desc.hiddenActivation;
+            for (uint32_t r = 0; r < rows; r++)
+            {
+                kernels.activate(act, y + r * stride, layer.outputs);
+            }
+            if (!last)
+            {
+                quantise(y, stride, layer.outputs, m_layers[l + 1]);
+            }
+        }
+
+        for (uint32_t r = 0; r < rows; r++)
+        {
+            std::memcpy(outputs + (firstRow + r) * numOutputs, y + r * stride, numOutputs * sizeof(float));
+        }
+    });
+}
+
+QuantisationError QuantisedInferenceEngine::MeasureError(const float* inputs, size_t count) const
+{
+    QuantisationError error;
+    const size_t size = count * GetOutputCount();
+    if (size == 0)
+    {
+        return error;
+    }
+
+    std::vector<float> outputs(size), reference(size);
+    Evaluate(inputs, count, outputs.data());
+    m_reference.Evaluate(inputs, count, reference.data());
+
+    double sum = 0.0, sumSquares = 0.0;
+    for (size_t i = 0; i < size; i++)
+    {
+        const double delta = std::fabs(double(outputs[i]) - double(reference[i]));
+        error.maxAbsError = std::max(error.maxAbsError, float(delta));
+        sum += delta;
+        sumSquares += delta * delta;
+    }
+    error.meanAbsError = float(sum / double(size));
+    error.rmsError = float(std::sqrt(sumSquares / double(size)));
+    return error;
+}
+
+NAMESPACE_END(cpu)
+NAMESPACE_END(fluxel)
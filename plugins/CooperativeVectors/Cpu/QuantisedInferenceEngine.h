@@ -0,0 +1,122 @@
+#pragma once
+
+#include <vector>
+
+#include "Fluxel.h"
+#include "Network.h"
+#include "Activation.h"
+#include "AlignedVector.h"
+#include "InferenceEngine.h"
+#include "PackedNetwork.h"
+#include "QuantisedKernels.h"
+#include "ThreadPool.h"
+
+NAMESPACE_BEGIN(fluxel)
+NAMESPACE_BEGIN(cpu)
+
+// Storage of the activations between the layers of a QuantisedInferenceEngine.
+enum class QuantisedActivations
+{
+    I8, ///< Unsigned 8 bit with a zero point, vpdpbusd.
+    I16, ///< Signed 16 bit, vpdpwssd. Half the throughput of I8 with 256 times finer steps.
+};
+
+struct QuantisedInferenceEngineDesc
+{
+    // Defaults match InferenceEngineDesc.
+    ActivationDesc hiddenActivation = { Activation::LeakyReLU, 0.01f };
+    ActivationDesc finalActivation = { Activation::Sigmoid, 0.f };
+
+    QuantisedActivations activations = QuantisedActivations::I8;
+
+    // The activation scale of every layer input covers this fraction of the calibration values,
+    // larger values are clipped. Below 1 trades the error of rare outliers for finer steps.
+    float calibrationPercentile = 1.f;
+
+    // Number of input vectors processed by a worker per task, 0 sizes the tiles from the L1 data cache.
+    uint32_t tileRows = 0;
+};
+
+// Error of the quantised outputs against the FP16 path, InferenceEngine with half precision activations.
+struct QuantisationError
+{
+    float maxAbsError = 0.f; ///< Bound of the output error over the measured inputs.
+    float meanAbsError = 0.f;
+    float rmsError = 0.f;
+};
+
+// Batched, multi-threaded CPU evaluation of a host side network with 8 bit integer weights.
+// Weights are quantised symmetrically with one scale per output channel, activations to 8 or 16 bit integers with one
+// scale per layer input calibrated on representative inputs (post-training quantisation). The dot products accumulate
+// exactly in 32 bit integers with the VNNI instructions when available, biases and activation functions stay in float.
+class QuantisedInferenceEngine
+{
+public:
+    // Uses the default thread pool when none is provided.
+    explicit QuantisedInferenceEngine(ThreadPool* threadPool = nullptr);
+
+    // Quantise a network, calibrating the activation scales on sampleCount input vectors stored as [sampleCount][inputs] floats.
+    // The calibration error against the FP16 path is measured on the same samples.
+    bool Initialise(HostNetwork const& network, const float* samples, size_t sampleCount, QuantisedInferenceEngineDesc const& desc = {});
+
+    // Evaluate count input vectors stored contiguously as [count][GetInputCount()] floats.
+    // Writes [count][GetOutputCount()] floats to outputs.
+    void Evaluate(const float* inputs, size_t count, float* outputs) const;
+
+    // Evaluate count input vectors with both this engine and the FP16 path and compare the outputs.
+    QuantisationError MeasureError(const float* inputs, size_t count) const;
+
+    // Error over the calibration samples, measured by Initialise.
+    const QuantisationError& GetCalibrationError() const
+    {
+        return m_calibrationError;
+    }
+
+    uint32_t GetInputCount() const
+    {
+        return m_layers.empty() ? 0 : m_layers.front().inputs;
+    }
+
+    uint32_t GetOutputCount() const
+    {
+        return m_layers.empty() ? 0 : m_layers.back().outputs;
+    }
+
+    // Name of the instruction set the integer kernels were selected for.
+    const char* GetKernelName() const
+    {
+        return m_quantisedKernels->name;
+    }
+
+private:
+    struct Layer
+    {
+        uint32_t inputs = 0;
+        uint32_t inputsPadded = 0; ///< Multiple of s_quantisedInputAlignment.
+        uint32_t outputs = 0;
+        uint32_t outputsPadded = 0;
+        float inputScale = 1.f; ///< Value of one step of the quantised inputs.
+        AlignedVector<int8_t> weightsI8; ///< Interleaved weights, see QuantisedKernelTable.
+        AlignedVector<int16_t> weightsI16;
+        AlignedVector<int32_t> offsets; ///< Zero point correction of the I8 activations.
+        AlignedVector<float> scales; ///< inputScale times the weight scale of every output.
+        AlignedVector<float> bias;
+    };
+
+    // Scale of the quantised inputs of every layer from the activations of the samples in the FP16 path.
+    void CalibrateInputScales(std::vector<PackedLayer> const& layers, const float* samples, size_t sampleCount, std::vector<float>& inputScales) const;
+
+    ThreadPool* m_threadPool;
+    QuantisedKernelTable const* m_quantisedKernels;
+    KernelTable const* m_kernels; ///< Activation functions.
+    QuantisedInferenceEngineDesc m_desc;
+    std::vector<Layer> m_layers;
+    uint32_t m_maxInputsPadded = 0; ///< Row stride of the quantised activation scratch buffer.
+    uint32_t m_maxOutputsPadded = 0; ///< Row stride of the float scratch buffer.
+    uint32_t m_tileRows = 0;
+    InferenceEngine m_reference; ///< FP16 path of the source network, for MeasureError.
+    QuantisationError m_calibrationError;
+};
+
+NAMESPACE_END(cpu)
+NAMESPACE_END(fluxel)
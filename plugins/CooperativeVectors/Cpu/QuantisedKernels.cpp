@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <cmath>
+
+#include "QuantisedKernels.h"
+
+NAMESPACE_BEGIN(fluxel)
+NAMESPACE_BEGIN(cpu)
+
+namespace
+{
+template <typename TInput, typename TWeight>
+void LinearQuantisedScalar(const TInput* input,
+                           size_t inputStride,
+                           const TWeight* weights,
+                           const int32_t* offsets,
+                           const float* scales,
+                           const float* bias,
+                           float* output,
+                           size_t outputStride,
+                           uint32_t rows,
+                           uint32_t inputsPadded,
+                           uint32_t outputsPadded)
+{
+    // Inputs per 32 bit lane of the interleaved weights
+    constexpr uint32_t group = 4 / sizeof(TWeight);
+
+    for (uint32_t r = 0; r < rows; r++)
+    {
+        const TInput* x = input + r * inputStride;
+        float* y = output + r * outputStride;
+        for (uint32_t o = 0; o < outputsPadded; o++)
+        {
+            int32_t acc = offsets ? offsets[o] : 0;
+            for (uint32_t i = 0; i < inputsPadded; i++)
+            {
+                const TWeight* w = weights + size_t(i / group) * outputsPadded * group;
+                acc += int32_t(x[i]) * int32_t(w[o * group + i % group]);
+            }
+            y[o] = std::fma(float(acc), scales[o], bias[o]);
+        }
+    }
+}
+
+void LinearI8Scalar(const uint8_t* input,
+                    size_t inputStride,
+                    const int8_t* weights,
+                    const int32_t* offsets,
+                    const float* scales,
+                    const float* bias,
+                    float* output,
+                    size_t outputStride,
+                    uint32_t rows,
+                    uint32_t inputsPadded,
+                    uint32_t outputsPadded)
+{
+    LinearQuantisedScalar(input, inputStride, weights, offsets, scales, bias, output, outputStride, rows, inputsPadded, outputsPadded);
+}
+
+void LinearI16Scalar(const int16_t* input,
+                     size_t inputStride,
+                     const int16_t* weights,
+                     const float* scales,
+                     const float* bias,
+                     float* output,
+                     size_t outputStride,
+                     uint32_t rows,
+                     uint32_t inputsPadded,
+                     uint32_t outputsPadded)
+{
+    LinearQuantisedScalar(input, inputStride, weights, nullptr, scales, bias, output, outputStride, rows, inputsPadded, outputsPadded);
+}
+
+void QuantiseI8Scalar(const float* src, uint8_t* dst, size_t count, float invScale)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        const float q = std::nearbyint(std::clamp(src[i] * invScale, -127.f, 127.f));
+        dst[i] = uint8_t(int32_t(q) + s_quantisedActivationZeroPoint);
+    }
+}
+
+void QuantiseI16Scalar(const float* src, int16_t* dst, size_t count, float invScale)
+{
+    const float maxValue = float(s_maxQuantisedI16Activation);
+    for (size_t i = 0; i < count; i++)
+    {
+        dst[i] = int16_t(std::nearbyint(std::clamp(src[i] * invScale, -maxValue, maxValue)));
+    }
+}
+} // namespace
+
+const QuantisedKernelTable& GetScalarQuantisedKernels()
+{
+    static const QuantisedKernelTable table = {
+        "Scalar",
+        LinearI8Scalar,
+        LinearI16Scalar,
+        QuantiseI8Scalar,
+        QuantiseI16Scalar,
+    };
+    return table;
+}
+
+const QuantisedKernelTable& GetBestQuantisedKernels()
+{
+    static const QuantisedKernelTable* best = []() {
+        if (const QuantisedKernelTable* table = GetAvx512VnniQuantisedKernels())
+        {
+            return table;
+        }
+        if (const QuantisedKernelTable* table = GetAvxVnniQuantisedKernels())
+        {
+            return table;
+        }
+        return &GetScalarQuantisedKernels();
+    }();
+    return *best;
+}
+
+NAMESPACE_END(cpu)
+NAMESPACE_END(fluxel)
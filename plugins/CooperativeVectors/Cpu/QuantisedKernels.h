@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Fluxel.h"
+
+NAMESPACE_BEGIN(fluxel)
+NAMESPACE_BEGIN(cpu)
+
+// Inputs of the quantised layers are padded to this many values, the group size of the 8 bit dot products.
+constexpr uint32_t s_quantisedInputAlignment = 4;
+
+constexpr uint32_t PadQuantisedInputs(uint32_t inputs)
+{
+    return (inputs + s_quantisedInputAlignment - 1) / s_quantisedInputAlignment * s_quantisedInputAlignment;
+}
+
+// Zero point of the unsigned 8 bit activations, the VNNI byte dot products take unsigned activations and signed weights.
+constexpr int32_t s_quantisedActivationZeroPoint = 128;
+
+// Largest magnitude of the 16 bit activations. With 8 bit weights the 32 bit accumulators of up to
+// s_maxQuantisedI16Inputs inputs cannot overflow.
+constexpr int32_t s_maxQuantisedI16Activation = 32767;
+constexpr uint32_t s_maxQuantisedI16Inputs = 512;
+
+// Function table of the integer network kernels for one instruction set.
+// Weights are 8 bit integers in [-127, 127] with one float scale per output. They are interleaved so every 32 bit
+// lane holds the consecutive inputs of one output, the operand layout of vpdpbusd and vpdpwssd: with g = 4 / sizeof(weight),
+// weights[(i / g) * outputsPadded * g + o * g + i % g] = W[o][i]. The 16 bit kernels store the 8 bit values in 16 bits.
+// Accumulation is exact in 32 bit integers, the float epilogue is the fused multiply add
+// output = fma(float(acc), scales[o], bias[o]), so all instruction sets return the same values.
+struct QuantisedKernelTable
+{
+    const char* name = nullptr;
+
+    // output[r][o] = float(offsets[o] + sum_i input[r][i] * weights[i][o]) * scales[o] + bias[o]
+    // for r < rows and o < outputsPadded. Inputs are unsigned with a zero point of s_quantisedActivationZeroPoint,
+    // offsets[o] = -s_quantisedActivationZeroPoint * sum_i W[o][i] removes it. Strides are in elements.
+    void (*linearI8)(const uint8_t* input,
+                     size_t inputStride,
+                     const int8_t* weights,
+                     const int32_t* offsets,
+                     const float* scales,
+                     const float* bias,
+                     float* output,
+                     size_t outputStride,
+                     uint32_t rows,
+                     uint32_t inputsPadded,
+                     uint32_t outputsPadded) = nullptr;
+
+    // output[r][o] = float(sum_i input[r][i] * weights[i][o]) * scales[o] + bias[o] with signed 16 bit inputs.
+    void (*linearI16)(const int16_t* input,
+                      size_t inputStride,
+                      const int16_t* weights,
+                      const float* scales,
+                      const float* bias,
+                      float* output,
+                      size_t outputStride,
+                      uint32_t rows,
+                      uint32_t inputsPadded,
+                      uint32_t outputsPadded) = nullptr;
+
+    // dst[i] = clamp(round(src[i] * invScale), -127, 127) + s_quantisedActivationZeroPoint, rounding to nearest even.
+    void (*quantiseI8)(const float* src, uint8_t* dst, size_t count, float invScale) = nullptr;
+
+    // dst[i] = clamp(round(src[i] * invScale), -s_maxQuantisedI16Activation, s_maxQuantisedI16Activation).
+    void (*quantiseI16)(const float* src, int16_t* dst, size_t count, float invScale) = nullptr;
+};
+
+// Portable C++ implementation, always available.
+const QuantisedKernelTable& GetScalarQuantisedKernels();
+
+// VNNI implementations, these return nullptr when not compiled in or not supported by the host CPU.
+// AVX-512 VNNI uses 512 bit registers, AVX-VNNI the VEX encoded 256 bit forms.
+const QuantisedKernelTable* GetAvx512VnniQuantisedKernels();
+const QuantisedKernelTable* GetAvxVnniQuantisedKernels();
+
+// Best quantised kernel table for the host CPU.
+const QuantisedKernelTable& GetBestQuantisedKernels();
+
+NAMESPACE_END(cpu)
+NAMESPACE_END(fluxel)
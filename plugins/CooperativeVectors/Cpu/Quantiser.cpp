@@ -0,0 +1,200 @@
+#include <algorithm>
+#include <cmath>
+
+#include "Quantiser.h"
+#include "NumberFormats.h"
+#include "PackedNetwork.h"
+#include "Logger.h"
+
+NAMESPACE_BEGIN(fluxel)
+NAMESPACE_BEGIN(cpu)
+
+namespace
+{
+// Sum over the rows d of delta of d^T * gram * d, the squared output error summed over the calibration batch.
+double GetOutputError(std::vector<float> const& delta, std::vector<double> const& gram, uint32_t rows, uint32_t columns)
+{
+    double error = 0.0;
+    for (uint32_t r = 0; r < rows; r++)
+    {
+        const float* d = delta.data() + size_t(r) * columns;
+        for (uint32_t i = 0; i < columns; i++)
+        {
+            if (d[i] == 0.f)
+            {
+                continue;
+            }
+            const double* g = gram.data() + size_t(i) * columns;
+            double sum = 0.0;
+            for (uint32_t j = 0; j < columns; j++)
+            {
+                sum += g[j] * d[j];
+            }
+            error += sum * d[i];
+        }
+    }
+    return error;
+}
+
+// Pick the scale of a quantised weight matrix, weights are row-major [outputs][inputs].
+float CalibrateScale(Precision precision,
+                     std::vector<float> const& weights,
+                     std::vector<double> const& gram,
+                     uint32_t outputs,
+                     uint32_t inputs,
+                     QuantiserDesc const& desc,
+                     KernelTable const& kernels)
+{
+    float maxAbs = 0.f;
+    for (float w : weights)
+    {
+        maxAbs = std::max(maxAbs, std::fabs(w));
+    }
+    if (maxAbs == 0.f)
+    {
+        return 1.f;
+    }
+
+    std::vector<uint8_t> encoded(weights.size() * GetSize(precision));
+    std::vector<float> delta(weights.size());
+
+    const uint32_t steps = std::max(1u, desc.calibrationSteps);
+    float bestScale = maxAbs / GetMaxValue(precision);
+    double bestError = INFINITY;
+    for (uint32_t step = 0; step < steps; step++)
+    {
+        const float ratio = steps == 1 ? 1.f : 1.f - (1.f - desc.minClipRatio) * float(step) / float(steps - 1);
+        const float scale = maxAbs * ratio / GetMaxValue(precision);
+
+        EncodeParams(precision, weights.data(), encoded.data(), weights.size(), scale, kernels);
+        DecodeParams(precision, encoded.data(), delta.data(), weights.size(), scale, kernels);
+        for (size_t i = 0; i < weights.size(); i++)
+        {
+            delta[i] = weights[i] - delta[i];
+        }
+
+        const double error = GetOutputError(delta, gram, outputs, inputs);
+        if (error < bestError)
+        {
+            bestError = error;
+            bestScale = scale;
+        }
+    }
+    return bestScale;
+}
+} // namespace
+
+bool QuantiseNetwork(HostNetwork const& network, QuantiserDesc const& desc, const float* samples, size_t sampleCount, HostNetwork& result)
+{
+    if (!samples && sampleCount > 0)
+    {
+        Log(Error, "QuantiseNetwork: %zu calibration samples without sample data.", sampleCount);
+        return false;
+    }
+
+    const KernelTable& kernels = GetBestKernels();
+    const auto& srcParams = network.GetNetworkParams();
+
+    std::vector<PackedLayer> layers;
+    if (!PackNetworkLayers(network.GetNetworkLayout(), srcParams.data(), srcParams.size(), kernels, layers))
+    {
+        Log(Error, "QuantiseNetwork: Failed to load network.");
+        return false;
+    }
+
+    NetworkArchitecture netArch = network.GetNetworkArchitecture();
+    netArch.weightPrecision = desc.weightPrecision;
+    netArch.layerWeightPrecisions = desc.layerWeightPrecisions;
+
+    // Host layouts are RowMajor, their sizes do not depend on a device
+    NetworkUtilities networkUtils;
+    if (!networkUtils.ValidateNetworkArchitecture(netArch))
+    {
+        Log(Error, "QuantiseNetwork: Failed to validate network.");
+        return false;
+    }
+    NetworkLayout layout = networkUtils.CreateHostNetworkLayout(netArch);
+    if (layout.networkLayers.empty())
+    {
+        return false;
+    }
+    std::vector<uint8_t> params(layout.networkSize, 0);
+
+    // Calibration batch, replaced by the activations of each layer in turn
+    const uint32_t inputs = layers.front().inputs;
+    std::vector<float> activations(samples, samples + sampleCount * inputs);
+    std::vector<float> nextActivations;
+
+    std::vector<float> weights;
+    std::vector<double> gram;
+    for (size_t l = 0; l < layers.size(); l++)
+    {
+        const PackedLayer& src = layers[l];
+        NetworkLayer& dst = layout.networkLayers[l];
+
+        // Back to row-major [outputs][inputs]
+        weights.resize(size_t(src.outputs) * src.inputs);
+        for (uint32_t o = 0; o < src.outputs; o++)
+        {
+            for (uint32_t i = 0; i < src.inputs; i++)
+            {
+                weights[size_t(o) * src.inputs + i] = src.weights[size_t(i) * src.outputsPadded + o];
+            }
+        }
+
+        if (IsQuantised(dst.weightPrecision))
+        {
+            // Second moment of the layer inputs, the identity without samples
+            gram.assign(size_t(src.inputs) * src.inputs, 0.0);
+            for (size_t n = 0; n < sampleCount; n++)
+            {
+                const float* x = activations.data() + n * src.inputs;
+                for (uint32_t i = 0; i < src.inputs; i++)
+                {
+                    for (uint32_t j = 0; j < src.inputs; j++)
+                    {
+                        gram[size_t(i) * src.inputs + j] += double(x[i]) * x[j];
+                    }
+                }
+            }
+            if (sampleCount == 0)
+            {
+                for (uint32_t i = 0; i < src.inputs; i++)
+                {
+                    gram[size_t(i) * src.inputs + i] = 1.0;
+                }
+            }
+            dst.weightScale = CalibrateScale(dst.weightPrecision, weights, gram, src.outputs, src.inputs, desc, kernels);
+        }
+
+        EncodeParams(dst.weightPrecision, weights.data(), params.data() + dst.weightOffset, weights.size(), dst.weightScale, kernels);
+        EncodeParams(layout.biasPrecision, src.bias.data(), params.data() + dst.biasOffset, src.outputs, 1.f, kernels);
+
+        // Propagate the batch through the source layer
+        if (sampleCount > 0 && l + 1 < layers.size())
+        {
+            nextActivations.resize(sampleCount * src.outputs);
+            for (size_t n = 0; n < sampleCount; n++)
+            {
+                const float* x = activations.data() + n * src.inputs;
+                float* y = nextActivations.data() + n * src.outputs;
+                for (uint32_t o = 0; o < src.outputs; o++)
+                {
+                    const float* w = weights.data() + size_t(o) * src.inputs;
+                    float sum = src.bias[o];
+                    for (uint32_t i = 0; i < src.inputs; i++)
+                    {
+                        sum += w[i] * x[i];
+                    }
+                    y[o] = EvaluateActivation(desc.hiddenActivation, sum);
+                }
+            }
+            activations.swap(nextActivations);
+        }
+    }
+
+    return result.InitialiseFromParams(netArch, layout, params.data(), params.size());
+}
+
+NAMESPACE_END(cpu)
+NAMESPACE_END(fluxel)
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vector>
+
+#include "Fluxel.h"
+#include "Network.h"
+#include "Activation.h"
+
+NAMESPACE_BEGIN(fluxel)
+NAMESPACE_BEGIN(cpu)
+
+struct QuantiserDesc
+{
+    // Target weight precision, every layer uses weightPrecision when layerWeightPrecisions is empty.
+    Precision weightPrecision = Precision::I8;
+    std::vector<Precision> layerWeightPrecisions;
+
+    // Activation of the hidden layers, used to propagate the calibration batch. Matches the InferenceEngine default.
+    ActivationDesc hiddenActivation = { Activation::LeakyReLU, 0.01f };
+
+    // Quantised layers clip the largest weight magnitude to calibrationSteps ratios between 1 and minClipRatio
+    // and keep the scale with the lowest error.
+    uint32_t calibrationSteps = 16;
+    float minClipRatio = 0.5f;
+};
+
+// Convert the weights of a host network to the precisions in desc, biases keep their precision.
+// The scale of every quantised layer is calibrated to minimise the error of the layer output over a sample batch
+// of sampleCount input vectors ([sampleCount][inputs] floats), propagated through the source network.
+// Without samples the error of the weights themselves is minimised.
+bool QuantiseNetwork(HostNetwork const& network, QuantiserDesc const& desc, const float* samples, size_t sampleCount, HostNetwork& result);
+
+NAMESPACE_END(cpu)
+NAMESPACE_END(fluxel)
@@ -0,0 +1,112 @@
+#include <algorithm>
+#include <utility>
+
+#include "SpecialisedMLP.h"
+#include "CpuFeatures.h"
+#include "Network.h"
+#include "PackedNetwork.h"
+
+NAMESPACE_BEGIN(fluxel)
+NAMESPACE_BEGIN(cpu)
+
+float* ForwardGenericMLP(const KernelLayer* layers, size_t layerCount, MLPTileArgs const& args)
+{
+    float* src = args.buffers[0];
+    float* dst = args.buffers[1];
+    for (size_t l = 0; l < layerCount; l++)
+    {
+        const KernelLayer& layer = layers[l];
+        const ActivationDesc& act = (l + 1 == layerCount) ? args.finalActivation : args.hiddenActivation;
+
+        args.kernels->linearActivate(src, args.stride, layer.weights, layer.bias, dst, args.stride, args.rows, layer.inputs, layer.outputsPadded, act,
+                                     args.roundToHalf);
+        std::swap(src, dst);
+    }
+    return src;
+}
+
+MLPForwardFn FindSpecialisedMLP(uint32_t inputs, uint32_t hiddenLayers, uint32_t hidden, uint32_t outputs, KernelTable const& kernels)
+{
+    size_t count = 0;
+    const SpecialisedMLP* mlps = nullptr;
+    if (&kernels == GetAvx512Kernels())
+    {
+        mlps = GetAvx512SpecialisedMLPs(count);
+    }
+    else if (&kernels == GetAvx2Kernels())
+    {
+        mlps = GetAvx2SpecialisedMLPs(count);
+    }
+    else if (&kernels == &GetScalarKernels())
+    {
+        mlps = GetScalarSpecialisedMLPs(count);
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const SpecialisedMLP& mlp = mlps[i];
+        if (mlp.inputs == inputs && mlp.hiddenLayers == hiddenLayers && mlp.hidden == hidden && mlp.outputs == outputs)
+        {
+            return mlp.forward;
+        }
+    }
+    return ForwardGenericMLP;
+}
+
+MLPForwardFn FindSpecialisedMLP(NetworkArchitecture const& netArch, KernelTable const& kernels)
+{
+    for (uint32_t i = 0; i < netArch.numHiddenLayers; i++)
+    {
+        if (netArch.GetHiddenNeurons(i) != netArch.GetHiddenNeurons(0))
+        {
+            return ForwardGenericMLP;
+        }
+    }
+    const uint32_t hidden = netArch.numHiddenLayers ? netArch.GetHiddenNeurons(0) : 0;
+    return FindSpecialisedMLP(netArch.inputNeurons, netArch.numHiddenLayers, hidden, netArch.outputNeurons, kernels);
+}
+
+MLPForwardFn FindSpecialisedMLP(std::vector<PackedLayer> const& layers, KernelTable const& kernels)
+{
+    if (layers.size() < 2)
+    {
+        return ForwardGenericMLP;
+    }
+    const uint32_t hidden = layers.front().outputs;
+    for (size_t l = 1; l + 1 < layers.size(); l++)
+    {
+        if (layers[l].outputs != hidden)
+        {
+            return ForwardGenericMLP;
+        }
+    }
+    return FindSpecialisedMLP(layers.front().inputs, uint32_t(layers.size() - 1), hidden, layers.back().outputs, kernels);
+}
+
+uint32_t ChooseTileRows(size_t stride)
+{
+    // Least common multiple of the 4 and 6 row blocks of the AVX2 and AVX-512 kernels
+    constexpr size_t rowMultiple = 12;
+    constexpr size_t maxRows = 1024;
+    constexpr size_t defaultL1Size = 32 * 1024;
+
+    const size_t l1Size = GetCpuFeatures().l1DataCacheSize ? GetCpuFeatures().l1DataCacheSize : defaultL1Size;
+    const size_t rows = l1Size / 2 / (2 * std::max<size_t>(stride, 1) * sizeof(float));
+    return uint32_t(std::clamp(rows / rowMultiple * rowMultiple, rowMultiple, maxRows));
+}
+
+void GetKernelLayers(std::vector<PackedLayer> const& layers, std::vector<KernelLayer>& result)
+{
+    result.resize(layers.size());
+    for (size_t l = 0; l < layers.size(); l++)
+    {
+        result[l].weights = layers[l].weights.data();
+        result[l].bias = layers[l].bias.data();
+        result[l].inputs = layers[l].inputs;
+        result[l].outputs = layers[l].outputs;
+        result[l].outputsPadded = layers[l].outputsPadded;
+    }
+}
+
+NAMESPACE_END(cpu)
+NAMESPACE_END(fluxel)
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Fluxel.h"
+#include "Activation.h"
+#include "Kernels.h"
+
+// Only plain declarations, this header is included by the translation units compiled for each instruction set.
+
+NAMESPACE_BEGIN(fluxel)
+
+struct NetworkArchitecture;
+
+NAMESPACE_BEGIN(cpu)
+
+struct PackedLayer;
+
+// Network shapes with a forward pass specialised at compile time, as X(inputs, hidden layers, hidden neurons, outputs).
+// The dimensions are template arguments, like the generics of rtxns::mlp::InferenceMLP, so the layer loops fully unroll
+// and the accumulators stay in registers. Every instruction set instantiates all shapes.
+#define FLUXEL_SPECIALISED_MLP_SHAPES(X) \
+    X(12, 4, 64, 3)                      \
+    X(32, 3, 128, 4)                     \
+    X(16, 2, 64, 3)                      \
+    X(32, 2, 32, 1)                      \
+    X(64, 3, 64, 16)
+
+// View of a PackedLayer.
+struct KernelLayer
+{
+    const float* weights = nullptr; ///< inputs x outputsPadded.
+    const float* bias = nullptr; ///< outputsPadded entries.
+    uint32_t inputs = 0;
+    uint32_t outputs = 0;
+    uint32_t outputsPadded = 0;
+};
+
+// One tile of the forward pass.
+struct MLPTileArgs
+{
+    KernelTable const* kernels = nullptr; ///< Fused linear and activation kernels.
+    ActivationDesc hiddenActivation;
+    ActivationDesc finalActivation;
+    bool roundToHalf = true; ///< Round the output of every layer to half precision.
+    float* buffers[2] = {}; ///< Ping-pong activation buffers of rows x stride floats, the inputs are in buffers[0].
+    size_t stride = 0;
+    uint32_t rows = 0;
+};
+
+// Forward pass of a whole network over one tile. Returns the buffer holding the outputs, rows x stride floats.
+using MLPForwardFn = float* (*)(const KernelLayer* layers, size_t layerCount, MLPTileArgs const& args);
+
+struct SpecialisedMLP
+{
+    uint32_t inputs = 0;
+    uint32_t hiddenLayers = 0;
+    uint32_t hidden = 0;
+    uint32_t outputs = 0;
+    MLPForwardFn forward = nullptr;
+};
+
+// Instantiated shapes of one instruction set, these return nullptr and a count of 0 when not compiled in or not supported.
+const SpecialisedMLP* GetScalarSpecialisedMLPs(size_t& count);
+const SpecialisedMLP* GetAvx2SpecialisedMLPs(size_t& count);
+const SpecialisedMLP* GetAvx512SpecialisedMLPs(size_t& count);
+
+// Forward pass for any shape, the fallback of the specialised passes.
+float* ForwardGenericMLP(const KernelLayer* layers, size_t layerCount, MLPTileArgs const& args);
+
+// Find the forward pass instantiated for a network shape with the instruction set of kernels,
+// falling back to ForwardGenericMLP. Hidden layers of different widths are never specialised.
+MLPForwardFn FindSpecialisedMLP(uint32_t inputs, uint32_t hiddenLayers, uint32_t hidden, uint32_t outputs, KernelTable const& kernels);
+MLPForwardFn FindSpecialisedMLP(NetworkArchitecture const& netArch, KernelTable const& kernels);
+MLPForwardFn FindSpecialisedMLP(std::vector<PackedLayer> const& layers, KernelTable const& kernels);
+
+// Rows of a tile whose ping-pong activation buffers of stride floats per row fill half of the L1 data cache, leaving
+// the other half to the weight rows streamed through the linear kernels. The tile then runs through all layers without
+// its activations leaving L1. Rounded down to a multiple of the row blocks of all kernels and clamped to [12, 1024].
+uint32_t ChooseTileRows(size_t stride);
+
+// Views of packed layers, valid until the layers are modified.
+void GetKernelLayers(std::vector<PackedLayer> const& layers, std::vector<KernelLayer>& result);
+
+NAMESPACE_END(cpu)
+NAMESPACE_END(fluxel)
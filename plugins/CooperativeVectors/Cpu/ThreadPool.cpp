@@ -0,0 +1,133 @@
+#include <algorithm>
+
+#include "ThreadPool.h"
+
+NAMESPACE_BEGIN(fluxel)
+NAMESPACE_BEGIN(cpu)
+
+namespace
+{
+thread_local bool t_insideTask = false;
+thread_local uint32_t t_workerIndex = 0;
+} // namespace
+
+ThreadPool::ThreadPool(uint32_t numThreads)
+{
+    if (numThreads == 0)
+    {
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    m_workers.reserve(numThreads - 1);
+    for (uint32_t i = 1; i < numThreads; i++)
+    {
+        m_workers.emplace_back([this, i]() { WorkerLoop(i); });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_shutdown = true;
+    }
+    m_workAvailable.notify_all();
+
+    for (auto& worker : m_workers)
+    {
+        worker.join();
+    }
+}
+
+ThreadPool& ThreadPool::GetDefault()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::ParallelFor(size_t taskCount, const std::function<void(size_t, uint32_t)>& func)
+{
+    if (taskCount == 0)
+    {
+        return;
+    }
+
+    // Run serially when there is nothing to distribute or when called from inside another task.
+    if (t_insideTask || m_workers.empty() || taskCount == 1)
+    {
+        const bool wasInsideTask = t_insideTask;
+        t_insideTask = true;
+        for (size_t task = 0; task < taskCount; task++)
+        {
+            func(task, t_workerIndex);
+        }
+        t_insideTask = wasInsideTask;
+        return;
+    }
+
+    std::lock_guard<std::mutex> submitLock(m_submitMutex);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_func = &func;
+        m_taskCount = taskCount;
+        m_nextTask = 0;
+        m_generation++;
+    }
+    m_workAvailable.notify_all();
+
+    RunTasks(0);
+
+    // Workers that picked up this job keep a reference to func, wait until all of them are done.
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_workDone.wait(lock, [this]() { return m_activeWorkers == 0; });
+    m_func = nullptr;
+    m_taskCount = 0;
+}
+
+void ThreadPool::RunTasks(uint32_t workerIndex)
+{
+    t_insideTask = true;
+    t_workerIndex = workerIndex;
+    for (size_t task = m_nextTask.fetch_add(1); task < m_taskCount; task = m_nextTask.fetch_add(1))
+    {
+        (*m_func)(task, workerIndex);
+    }
+    t_insideTask = false;
+    t_workerIndex = 0;
+}
+
+void ThreadPool::WorkerLoop(uint32_t workerIndex)
+{
+    uint64_t seenGeneration = 0;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        m_workAvailable.wait(lock, [&]() { return m_shutdown || m_generation != seenGeneration; });
+        if (m_shutdown)
+        {
+            return;
+        }
+        seenGeneration = m_generation;
+
+        // The job may already have been completed by the other threads.
+        if (!m_func)
+        {
+            continue;
+        }
+
+        // While this worker is active the submitting thread cannot retire the job.
+        m_activeWorkers++;
+        lock.unlock();
+
+        RunTasks(workerIndex);
+
+        lock.lock();
+        if (--m_activeWorkers == 0)
+        {
+            m_workDone.notify_all();
+        }
+    }
+}
+
+NAMESPACE_END(cpu)
+NAMESPACE_END(fluxel)
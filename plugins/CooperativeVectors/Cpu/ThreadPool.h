@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Fluxel.h"
+
+NAMESPACE_BEGIN(fluxel)
+NAMESPACE_BEGIN(cpu)
+
+// Persistent pool of worker threads used by the CPU network engines.
+// Work is submitted as a range of independent tasks which are claimed dynamically by the workers.
+// The calling thread participates in the work as worker 0.
+class ThreadPool
+{
+public:
+    // Create a pool with the given total thread count (including the calling thread).
+    // A count of 0 uses the number of hardware threads.
+    explicit ThreadPool(uint32_t numThreads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Number of threads that may execute tasks, including the calling thread.
+    uint32_t GetThreadCount() const
+    {
+        return uint32_t(m_workers.size()) + 1;
+    }
+
+    // Invoke func(taskIndex, workerIndex) for every task in [0, taskCount) and block until all have completed.
+    // workerIndex is in [0, GetThreadCount()) and is unique among concurrently running tasks, so it can be
+    // used to index per-thread scratch storage. Nested calls from inside a task are executed serially.
+    void ParallelFor(size_t taskCount, const std::function<void(size_t taskIndex, uint32_t workerIndex)>& func);
+
+    // Process wide pool sized to the hardware concurrency.
+    static ThreadPool& GetDefault();
+
+private:
+    void WorkerLoop(uint32_t workerIndex);
+    void RunTasks(uint32_t workerIndex);
+
+    std::vector<std::thread> m_workers;
+
+    std::mutex m_submitMutex; ///< Serialises ParallelFor calls from different external threads.
+    std::mutex m_mutex;
+    std::condition_variable m_workAvailable;
+    std::condition_variable m_workDone;
+
+    const std::function<void(size_t, uint32_t)>* m_func = nullptr;
+    size_t m_taskCount = 0;
+    std::atomic<size_t> m_nextTask = 0;
+    uint32_t m_activeWorkers = 0;
+    uint64_t m_generation = 0;
+    bool m_shutdown = false;
+};
+
+NAMESPACE_END(cpu)
+NAMESPACE_END(fluxel)
@@ -0,0 +1,772 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#include "TrainingEngine.h"
+#include "HashGridEncoding.h"
+#include "Logger.h"
+
+NAMESPACE_BEGIN(fluxel)
+NAMESPACE_BEGIN(cpu)
+
+namespace
+{
+// Number of parameters updated by one optimizer task.
+constexpr size_t s_optimiserChunkSize = 4096;
+static_assert(s_optimiserChunkSize % s_quantisedStateBlockSize == 0, "Optimizer chunks must hold whole blocks of the 8-bit moments");
+
+// Smallest magnitude rounded to infinity in half precision.
+constexpr float s_halfOverflow = 65520.f;
+
+// Calls fn(offset, count) over the first width columns of rows rows with the given stride,
+// merging the rows into a single span when they are contiguous.
+template <typename Fn>
+void ForEachRowSpan(size_t stride, uint32_t rows, uint32_t width, Fn&& fn)
+{
+    if (width == stride)
+    {
+        fn(size_t(0), rows * stride);
+        return;
+    }
+    for (uint32_t r = 0; r < rows; r++)
+    {
+        fn(r * stride, size_t(width));
+    }
+}
+} // namespace
+
+TrainingEngine::TrainingEngine(ThreadPool* threadPool) : m_threadPool(threadPool ? threadPool : &ThreadPool::GetDefault()), m_kernels(&GetBestKernels())
+{
+}
+
+bool TrainingEngine::Initialise(HostNetwork const& network, TrainingEngineDesc const& desc)
+{
+    const auto& params = network.GetNetworkParams();
+    return Initialise(network.GetNetworkLayout(), params.data(), params.size(), desc);
+}
+
+bool TrainingEngine::Initialise(NetworkLayout const& layout, const uint8_t* params, size_t paramsSize, TrainingEngineDesc const& desc)
+{
+    std::vector<Network> networks(1);
+    networks[0].layout = layout;
+    return InitialiseNetworks(networks, params, paramsSize, desc);
+}
+
+bool TrainingEngine::Initialise(NetworkPack const& pack, TrainingEngineDesc const& desc)
+{
+    std::vector<Network> networks(pack.GetNetworkCount());
+    for (uint32_t i = 0; i < pack.GetNetworkCount(); i++)
+    {
+        networks[i].layout = pack.GetNetworkLayout(i);
+        networks[i].paramOffset = pack.GetNetworkOffset(i);
+    }
+    return InitialiseNetworks(networks, pack.GetParams().data(), pack.GetParamsSize(), desc);
+}
+
+bool TrainingEngine::Initialise(HostNetwork const& network, HashGrid const& grid, TrainingEngineDesc const& desc)
+{
+    const NetworkLayout& layout = network.GetNetworkLayout();
+    if (grid.GetLevels().empty() || layout.networkLayers.empty() || layout.networkLayers.front().inputs != grid.GetOutputCount())
+    {
+        Log(Error, "TrainingEngine: the network inputs do not match the hash grid outputs.");
+        return false;
+    }
+
+    const size_t gridOffset = HashGrid::GetOffsetAfter(layout.networkSize);
+    std::vector<uint8_t> params(gridOffset + grid.GetSize(), 0);
+    std::memcpy(params.data(), network.GetNetworkParams().data(), layout.networkSize);
+    std::memcpy(params.data() + gridOffset, grid.GetParams().data(), grid.GetSize());
+
+    std::vector<Network> networks(1);
+    networks[0].layout = layout;
+    return InitialiseNetworks(networks, params.data(), params.size(), desc, &grid, gridOffset);
+}
+
+bool TrainingEngine::InitialiseNetworks(
+    const std::vector<Network>& networks, const uint8_t* params, size_t paramsSize, TrainingEngineDesc const& desc, HashGrid const* grid, size_t gridOffset)
+{
+    m_networks.clear();
+    m_partitions.clear();
+    m_hashGrid = HashGrid();
+    m_hashGridParams.clear();
+
+    if (networks.empty())
+    {
+        Log(Error, "TrainingEngine: no network to train.");
+        return false;
+    }
+
+    m_networks = networks;
+    for (size_t n = 0; n < m_networks.size(); n++)
+    {
+        Network& network = m_networks[n];
+        const NetworkLayout& layout = network.layout;
+        const bool halfPrecision = layout.matrixPrecision == Precision::F16 && layout.biasPrecision == Precision::F16 &&
+                                   std::all_of(layout.networkLayers.begin(), layout.networkLayers.end(),
+                                               [](NetworkLayer const& layer) { return layer.weightPrecision == Precision::F16; });
+        if (!halfPrecision)
+        {
+            Log(Error, "TrainingEngine: only F16 networks can be trained.");
+            m_networks.clear();
+            return false;
+        }
+
+        if (network.paramOffset % sizeof(uint16_t) != 0 || network.paramOffset > paramsSize ||
+            !PackNetworkLayers(layout, params + network.paramOffset, paramsSize - network.paramOffset, *m_kernels, network.layers))
+        {
+            Log(Error, "TrainingEngine: Failed to load network %d.", int(n));
+            m_networks.clear();
+            return false;
+        }
+    }
+
+    m_desc = desc;
+    m_desc.tileRows = std::max(1u, desc.tileRows);
+    m_currentStep = 1;
+    m_lossScaler = LossScaler(m_desc.lossScaleSchedule);
+    ResetMetrics();
+
+    // FP32 master copy of the FP16 parameters, like the first step of optimizer_cs
+    const size_t paramCount = paramsSize / sizeof(uint16_t);
+    m_networkParams.assign(params, params + paramsSize);
+    m_masterParams.resize(paramCount);
+    m_kernels->halfToFloat(reinterpret_cast<const uint16_t*>(params), m_masterParams.data(), paramCount);
+    m_moments1.assign(paramCount, 0.f);
+    m_moments2.assign(GetOptimizerMomentCount(m_desc.optimizer.type) > 1 ? paramCount : 0, 0.f);
+    m_emaParams.clear();
+    m_emaNetworkParams.clear();
+    if (m_desc.optimizer.emaDecay > 0.f)
+    {
+        m_emaParams = m_masterParams;
+        m_emaNetworkParams = m_networkParams;
+    }
+    m_quantisationMaps.clear();
+    if (m_desc.optimizer.quantisedState)
+    {
+        m_quantisationMaps = CreateDynamicQuantisationMap(true);
+        const std::vector<float> unsignedMap = CreateDynamicQuantisationMap(false);
+        m_quantisationMaps.insert(m_quantisationMaps.end(), unsignedMap.begin(), unsignedMap.end());
+    }
+    const size_t blockCount = m_quantisationMaps.empty() ? 0 : (paramCount + s_quantisedStateBlockSize - 1) / s_quantisedStateBlockSize;
+    m_momentScales1.assign(blockCount, 0.f);
+    m_momentScales2.assign(m_moments2.empty() ? 0 : blockCount, 0.f);
+
+    // Map every parameter to its gradient in the packed layer layout.
+    // Parameters not mapped are alignment padding and are left untouched by the optimizer.
+    m_gradientIndex.assign(paramCount, s_noGradient);
+    m_gradientSize = 0;
+    m_maxWidth = 0;
+    m_maxLayers = 0;
+    for (Network& network : m_networks)
+    {
+        const NetworkLayout& layout = network.layout;
+        network.gradientOffsets.resize(network.layers.size());
+        for (size_t l = 0; l < network.layers.size(); l++)
+        {
+            const NetworkLayer& src = layout.networkLayers[l];
+            const PackedLayer& layer = network.layers[l];
+            const size_t offset = m_gradientSize;
+            const size_t weightBase = (network.paramOffset + src.weightOffset) / sizeof(uint16_t);
+            const size_t biasBase = (network.paramOffset + src.biasOffset) / sizeof(uint16_t);
+
+            for (uint32_t o = 0; o < layer.outputs; o++)
+            {
+                for (uint32_t i = 0; i < layer.inputs; i++)
+                {
+                    const size_t paramIndex = weightBase + GetHostMatrixIndex(layout.matrixLayout, layer.outputs, layer.inputs, o, i);
+                    m_gradientIndex[paramIndex] = uint32_t(offset + size_t(i) * layer.outputsPadded + o);
+                }
+                m_gradientIndex[biasBase + o] = uint32_t(offset + size_t(layer.inputs) * layer.outputsPadded + o);
+            }
+
+            network.gradientOffsets[l] = offset;
+            m_gradientSize += size_t(layer.inputs + 1) * layer.outputsPadded;
+        }
+
+        m_maxWidth = std::max(m_maxWidth, PadKernelWidth(network.layers.front().inputs));
+        for (const PackedLayer& layer : network.layers)
+        {
+            m_maxWidth = std::max(m_maxWidth, layer.outputsPadded);
+        }
+        m_maxLayers = std::max(m_maxLayers, network.layers.size());
+    }
+
+    // Every feature of a hash grid has a gradient, including the alignment padding between the levels, which stays zero
+    if (grid)
+    {
+        const size_t gridBase = gridOffset / sizeof(uint16_t);
+        m_hashGrid = *grid;
+        m_hashGridOffset = gridOffset;
+        m_hashGridGradientOffset = m_gradientSize;
+        for (size_t i = 0; i < grid->GetParamCount(); i++)
+        {
+            m_gradientIndex[gridBase + i] = uint32_t(m_gradientSize + i);
+        }
+        m_gradientSize += grid->GetParamCount();
+        m_hashGridParams.assign(m_masterParams.begin() + gridBase, m_masterParams.begin() + gridBase + grid->GetParamCount());
+    }
+
+    // Inputs and activations of every layer, pre-activations of every layer and two gradient buffers
+    const size_t scratchSize = (2 * m_maxLayers + 3) * size_t(m_desc.tileRows) * m_maxWidth;
+    const uint32_t numPartitions = m_desc.numPartitions ? m_desc.numPartitions : m_threadPool->GetThreadCount();
+    m_partitions.resize(numPartitions);
+    for (Partition& partition : m_partitions)
+    {
+        partition.scratch.assign(scratchSize, 0.f);
+        partition.gradients.assign(m_gradientSize, 0.f);
+    }
+    return true;
+}
+
+float TrainingEngine::Step(const float* inputs, const float* targets, size_t batchSize, float learningRate)
+{
+    TrainingBatch batch;
+    batch.inputs = inputs;
+    batch.targets = targets;
+    batch.count = batchSize;
+    return Step(&batch, 1, learningRate);
+}
+
+float TrainingEngine::Step(const TrainingBatch* batches, size_t batchCount, float learningRate)
+{
+    if (m_networks.empty())
+    {
+        return 0.f;
+    }
+
+    // Tiles of all batches are numbered consecutively, firstTiles[b] is the first tile of batch b
+    std::vector<size_t> firstTiles(batchCount + 1, 0);
+    for (size_t b = 0; b < batchCount; b++)
+    {
+        assert(batches[b].networkIndex < m_networks.size() && "Network index out of range");
+        firstTiles[b + 1] = firstTiles[b] + (batches[b].count + m_desc.tileRows - 1) / m_desc.tileRows;
+    }
+    const size_t numTiles = firstTiles.back();
+    if (numTiles == 0)
+    {
+        return 0.f;
+    }
+
+    const size_t numPartitions = m_partitions.size();
+    m_tileLoss.assign(numTiles, 0.0);
+    m_tileMetrics.assign(numTiles, {});
+
+    m_threadPool->ParallelFor(numPartitions, [&](size_t p, uint32_t) {
+        Partition& partition = m_partitions[p];
+        std::fill(partition.gradients.begin(), partition.gradients.end(), 0.f);
+        TrainTiles(partition, batches, firstTiles, numTiles * p / numPartitions, numTiles * (p + 1) / numPartitions);
+    });
+
+    TrainingMetrics stepMetrics;
+    stepMetrics.firstStep = m_currentStep;
+    stepMetrics.stepCount = 1;
+    const bool skipped = Optimise(learningRate);
+    if (m_desc.dynamicLossScale)
+    {
+        stepMetrics.lossScale = m_lossScaler.GetScale();
+        stepMetrics.skippedSteps = skipped ? 1 : 0;
+    }
+
+    // Sum in tile order so the reported loss does not depend on the partitioning
+    for (TrainingMetrics const& tileMetrics : m_tileMetrics)
+    {
+        stepMetrics.Merge(tileMetrics);
+    }
+    m_metrics.Merge(stepMetrics);
+
+    double loss = 0.0;
+    uint32_t lossCount = 0;
+    for (size_t b = 0; b < batchCount; b++)
+    {
+        if (batches[b].count == 0)
+        {
+            continue;
+        }
+        double batchLoss = 0.0;
+        for (size_t tile = firstTiles[b]; tile < firstTiles[b + 1]; tile++)
+        {
+            batchLoss += m_tileLoss[tile];
+        }
+        loss += batchLoss / (double(batches[b].count) * GetOutputCount(batches[b].networkIndex));
+        lossCount++;
+    }
+    return float(loss / lossCount);
+}
+
+void TrainingEngine::TrainTiles(Partition& partition, const TrainingBatch* batches, std::vector<size_t> const& firstTiles, size_t firstTile, size_t lastTile)
+{
+    const KernelTable& kernels = *m_kernels;
+    const bool roundToHalf = m_desc.halfPrecisionActivations;
+    const float lossScale = GetLossScale();
+    const uint32_t tileRows = m_desc.tileRows;
+    const size_t stride = m_maxWidth;
+    const size_t bufferSize = tileRows * stride;
+
+    for (size_t tile = firstTile; tile < lastTile; tile++)
+    {
+        const size_t b = size_t(std::upper_bound(firstTiles.begin(), firstTiles.end(), tile) - firstTiles.begin()) - 1;
+        const TrainingBatch& batch = batches[b];
+        const Network& network = m_networks[batch.networkIndex];
+        const std::vector<PackedLayer>& layers = network.layers;
+        const size_t numLayers = layers.size();
+        const uint32_t numInputs = GetInputCount(batch.networkIndex);
+        const uint32_t numOutputs = layers.back().outputs;
+        const size_t batchSize = batch.count;
+        const float* targets = batch.targets;
+
+        // activations[0] holds the inputs, activations[l + 1] the output of layer l.
+        float* scratch = partition.scratch.data();
+        auto activations = [&](size_t l) { return scratch + l * bufferSize; };
+        auto preActivations = [&](size_t l) { return scratch + (numLayers + 1 + l) * bufferSize; };
+        float* grad = scratch + (2 * numLayers + 1) * bufferSize;
+        float* gradPrev = grad + bufferSize;
+
+        const size_t firstRow = (tile - firstTiles[b]) * tileRows;
+        const uint32_t rows = uint32_t(std::min<size_t>(tileRows, batchSize - firstRow));
+
+        // The features of a hash grid are the inputs of the first layer
+        const float* inputs = batch.inputs + firstRow * numInputs;
+        const uint32_t firstLayerInputs = layers.front().inputs;
+        float* x = activations(0);
+        if (HasHashGrid())
+        {
+            EncodeHashGrid(m_hashGrid, m_hashGridParams.data(), inputs, rows, x, stride);
+        }
+        for (uint32_t r = 0; r < rows; r++)
+        {
+            if (!HasHashGrid())
+            {
+                std::memcpy(x + r * stride, inputs + r * numInputs, numInputs * sizeof(float));
+            }
+            if (roundToHalf)
+            {
+                kernels.roundToHalf(x + r * stride, firstLayerInputs);
+            }
+        }
+
+        // Forward pass, caching the pre-activations (hiddenParams) and activations (hiddenActivated) of every layer
+        for (size_t l = 0; l < numLayers; l++)
+        {
+            const PackedLayer& layer = layers[l];
+            const ActivationDesc& act = (l + 1 == numLayers) ? m_desc.finalActivation : m_desc.hiddenActivation;
+            float* z = preActivations(l);
+            float* a = activations(l + 1);
+
+            kernels.linear(activations(l), stride, layer.weights.data(), layer.bias.data(), z, stride, rows, layer.inputs, layer.outputsPadded);
+            ForEachRowSpan(stride, rows, layer.outputsPadded, [&](size_t offset, size_t count) {
+                if (roundToHalf)
+                {
+                    kernels.roundToHalf(z + offset, count);
+                }
+                std::memcpy(a + offset, z + offset, count * sizeof(float));
+                kernels.activate(act, a + offset, count);
+                if (roundToHalf)
+                {
+                    kernels.roundToHalf(a + offset, count);
+                }
+            });
+        }
+
+        // Loss gradient, scaled by the batch size and the loss scale in the same order as training_cs
+        const float* predicted = activations(numLayers);
+        const uint32_t outputsPadded = layers.back().outputsPadded;
+        double loss = 0.0;
+        for (uint32_t r = 0; r < rows; r++)
+        {
+            const float* target = targets + (firstRow + r) * numOutputs;
+            float* g = grad + r * stride;
+            float sampleLoss = 0.f;
+            for (uint32_t o = 0; o < numOutputs; o++)
+            {
+                const float p = predicted[r * stride + o];
+                const float outputLoss = EvaluateLoss(m_desc.loss, target[o], p);
+                loss += outputLoss;
+                sampleLoss += outputLoss;
+                g[o] = EvaluateLossDerivative(m_desc.loss, target[o], p) / float(batchSize) * lossScale;
+            }
+            m_tileMetrics[tile].AddSample(sampleLoss / float(numOutputs));
+            std::fill(g + numOutputs, g + outputsPadded, 0.f);
+            if (roundToHalf)
+            {
+                kernels.roundToHalf(g, numOutputs);
+            }
+        }
+        m_tileLoss[tile] = loss;
+
+        // Backward pass, the counterpart of LinearOp_Backward for every layer
+        for (size_t l = numLayers; l-- > 0;)
+        {
+            const PackedLayer& layer = layers[l];
+            const ActivationDesc& act = (l + 1 == numLayers) ? m_desc.finalActivation : m_desc.hiddenActivation;
+            const float* z = preActivations(l);
+
+            ForEachRowSpan(stride, rows, layer.outputsPadded, [&](size_t offset, size_t count) {
+                kernels.activateBackward(act, z + offset, grad + offset, count);
+                if (roundToHalf)
+                {
+                    kernels.roundToHalf(grad + offset, count);
+                }
+            });
+
+            float* weightGrad = partition.gradients.data() + network.gradientOffsets[l];
+            float* biasGrad = weightGrad + size_t(layer.inputs) * layer.outputsPadded;
+            kernels.outerProductAccumulate(activations(l), stride, grad, stride, weightGrad, biasGrad, rows, layer.inputs, layer.outputsPadded);
+
+            if (l > 0)
+            {
+                // The padding columns feed the next backward step and must be zero
+                const uint32_t inputsPadded = layers[l - 1].outputsPadded;
+                kernels.linearBackward(grad, stride, layer.weights.data(), gradPrev, stride, rows, layer.inputs, layer.outputsPadded);
+                for (uint32_t r = 0; r < rows; r++)
+                {
+                    float* g = gradPrev + r * stride;
+                    std::fill(g + layer.inputs, g + inputsPadded, 0.f);
+                    if (roundToHalf)
+                    {
+                        kernels.roundToHalf(g, layer.inputs);
+                    }
+                }
+                std::swap(grad, gradPrev);
+            }
+            else if (HasHashGrid())
+            {
+                kernels.linearBackward(grad, stride, layer.weights.data(), gradPrev, stride, rows, layer.inputs, layer.outputsPadded);
+                if (roundToHalf)
+                {
+                    for (uint32_t r = 0; r < rows; r++)
+                    {
+                        kernels.roundToHalf(gradPrev + r * stride, layer.inputs);
+                    }
+                }
+                EncodeHashGridBackward(m_hashGrid, inputs, rows, gradPrev, stride, partition.gradients.data() + m_hashGridGradientOffset);
+            }
+        }
+    }
+}
+
+// Reduce the partition gradients and apply the update of the optimizer of Optimizers.slang to every parameter,
+// then refresh the FP16 mirror and the packed compute layers. Returns true when the update was skipped after an overflow.
+bool TrainingEngine::Optimise(float learningRate)
+{
+    const KernelTable& kernels = *m_kernels;
+    const size_t paramCount = m_masterParams.size();
+    const size_t numChunks = (paramCount + s_optimiserChunkSize - 1) / s_optimiserChunkSize;
+
+    const OptimizerStepConstants constants = GetOptimizerStepConstants(m_desc.optimizer, learningRate, m_currentStep);
+    const bool hasMoments2 = !m_moments2.empty();
+    const bool hasEma = !m_emaParams.empty();
+    const float lossScale = GetLossScale();
+
+    // With dynamic loss scaling the gradients are reduced into the first partition before the update, like
+    // check_gradients_cs runs before optimizer_cs, so the update of every parameter can be skipped after an overflow
+    const bool reduced = m_desc.dynamicLossScale;
+    bool overflow = false;
+    if (reduced)
+    {
+        const bool halfGradients = m_desc.halfPrecisionActivations;
+        m_chunkOverflow.assign(numChunks, 0);
+        m_threadPool->ParallelFor(numChunks, [&](size_t chunk, uint32_t) {
+            const size_t begin = chunk * s_optimiserChunkSize;
+            const size_t end = std::min(paramCount, begin + s_optimiserChunkSize);
+
+            // Non-finite gradients turn the sum of their products with zero into NaN, which keeps the loop free of branches
+            float nonFinite = 0.f;
+            float maxGradient = 0.f;
+            for (size_t i = begin; i < end; i++)
+            {
+                const uint32_t index = m_gradientIndex[i];
+                if (index == s_noGradient)
+                {
+                    continue;
+                }
+
+                float gradient = 0.f;
+                for (const Partition& partition : m_partitions)
+                {
+                    gradient += partition.gradients[index];
+                }
+                if (m_partitions.size() > 1)
+                {
+                    m_partitions.front().gradients[index] = gradient;
+                }
+                nonFinite += gradient * 0.f;
+                maxGradient = std::max(maxGradient, std::abs(gradient));
+            }
+            m_chunkOverflow[chunk] = !std::isfinite(nonFinite) || (halfGradients && maxGradient >= s_halfOverflow);
+        });
+        if (std::find(m_chunkOverflow.begin(), m_chunkOverflow.end(), 1) != m_chunkOverflow.end())
+        {
+            m_lossScaler.ReportGradientOverflow();
+        }
+        overflow = m_lossScaler.HasGradientOverflow();
+    }
+
+    // Skipped steps leave the parameters and moments untouched but count towards the bias correction,
+    // as the step number of the training shaders is advanced by the host
+    if (!overflow)
+    {
+        m_threadPool->ParallelFor(numChunks, [&](size_t chunk, uint32_t) {
+            const size_t begin = chunk * s_optimiserChunkSize;
+            const size_t end = std::min(paramCount, begin + s_optimiserChunkSize);
+
+            for (size_t i = begin; i < end; i++)
+            {
+                const uint32_t index = m_gradientIndex[i];
+                if (index == s_noGradient)
+                {
+                    continue;
+                }
+
+                float gradient = 0.f;
+                if (reduced)
+                {
+                    gradient = m_partitions.front().gradients[index];
+                }
+                else
+                {
+                    for (const Partition& partition : m_partitions)
+                    {
+                        gradient += partition.gradients[index];
+                    }
+                }
+                gradient /= lossScale;
+                gradient = std::isfinite(gradient) ? gradient : 0.f;
+
+                float moment1 = m_moments1[i];
+                float moment2 = hasMoments2 ? m_moments2[i] : 0.f;
+                m_masterParams[i] = OptimizerStep(m_desc.optimizer, constants, m_masterParams[i], gradient, moment1, moment2);
+                m_moments1[i] = moment1;
+                if (hasMoments2)
+                {
+                    m_moments2[i] = moment2;
+                }
+                if (hasEma)
+                {
+                    m_emaParams[i] = UpdateEma(constants, m_emaParams[i], m_masterParams[i]);
+                }
+            }
+
+            // Keep the moments at the values of their 8-bit codes, the first moment can be negative
+            if (!m_quantisationMaps.empty())
+            {
+                for (size_t block = begin; block < end; block += s_quantisedStateBlockSize)
+                {
+                    const size_t count = std::min<size_t>(s_quantisedStateBlockSize, end - block);
+                    const size_t blockIndex = block / s_quantisedStateBlockSize;
+                    m_momentScales1[blockIndex] = QuantiseBlock(m_quantisationMaps.data(), m_moments1.data() + block, count);
+                    if (hasMoments2)
+                    {
+                        m_momentScales2[blockIndex] = QuantiseBlock(m_quantisationMaps.data() + s_quantisationMapSize, m_moments2.data() + block, count);
+                    }
+                }
+            }
+
+            kernels.floatToHalf(m_masterParams.data() + begin, reinterpret_cast<uint16_t*>(m_networkParams.data()) + begin, end - begin);
+            if (hasEma)
+            {
+                kernels.floatToHalf(m_emaParams.data() + begin, reinterpret_cast<uint16_t*>(m_emaNetworkParams.data()) + begin, end - begin);
+            }
+        });
+
+        UpdateComputeParams();
+    }
+    m_currentStep++;
+
+    if (m_desc.dynamicLossScale)
+    {
+        m_lossScaler.Update();
+    }
+    return overflow;
+}
+
+// Repack the compute copies of the layers and the hash grid features after the FP16 parameters changed
+void TrainingEngine::UpdateComputeParams()
+{
+    for (Network& network : m_networks)
+    {
+        PackNetworkLayers(network.layout, m_networkParams.data() + network.paramOffset, m_networkParams.size() - network.paramOffset, *m_kernels, network.layers);
+    }
+    if (HasHashGrid())
+    {
+        m_kernels->halfToFloat(reinterpret_cast<const uint16_t*>(m_networkParams.data() + m_hashGridOffset), m_hashGridParams.data(), m_hashGridParams.size());
+    }
+}
+
+TrainingStateDesc TrainingEngine::GetTrainingStateDesc() const
+{
+    TrainingStateDesc desc;
+    desc.optimizer = m_desc.optimizer.type;
+    desc.quantisedState = m_desc.optimizer.quantisedState;
+    desc.matrixLayout = m_networks.empty() ? MatrixLayout::RowMajor : m_networks.front().layout.matrixLayout;
+    desc.paramCount = m_masterParams.size();
+
+    const size_t paramCount = m_masterParams.size();
+    const size_t momentsSize = desc.quantisedState ? GetQuantisedStateSize(paramCount) : paramCount * sizeof(float);
+    desc.sections.push_back({ TrainingStateSection::Progress, sizeof(TrainingProgress) });
+    desc.sections.push_back({ TrainingStateSection::NetworkParams, m_networkParams.size() });
+    desc.sections.push_back({ TrainingStateSection::MasterParams, paramCount * sizeof(float) });
+    desc.sections.push_back({ TrainingStateSection::Moments1, momentsSize });
+    if (!m_moments2.empty())
+    {
+        desc.sections.push_back({ TrainingStateSection::Moments2, momentsSize });
+    }
+    if (!m_emaParams.empty())
+    {
+        desc.sections.push_back({ TrainingStateSection::EmaParams, paramCount * sizeof(float) });
+        desc.sections.push_back({ TrainingStateSection::EmaNetworkParams, m_emaNetworkParams.size() });
+    }
+    desc.sections.push_back({ TrainingStateSection::LossScale, sizeof(LossScaleState) });
+    return desc;
+}
+
+void TrainingEngine::SaveTrainingState(TrainingStateSection section, uint8_t* dst) const
+{
+    const size_t paramCount = m_masterParams.size();
+    auto SaveMoments = [&](std::vector<float> const& moments, std::vector<float> const& scales, const float* map) {
+        if (m_quantisationMaps.empty())
+        {
+            std::memcpy(dst, moments.data(), paramCount * sizeof(float));
+        }
+        else
+        {
+            EncodeQuantisedState(map, moments.data(), scales.data(), paramCount, dst);
+        }
+    };
+
+    switch (section)
+    {
+    case TrainingStateSection::Progress:
+    {
+        TrainingProgress progress;
+        progress.currentStep = m_currentStep;
+        std::memcpy(dst, &progress, sizeof(progress));
+        break;
+    }
+    case TrainingStateSection::NetworkParams:
+        std::memcpy(dst, m_networkParams.data(), m_networkParams.size());
+        break;
+    case TrainingStateSection::MasterParams:
+        std::memcpy(dst, m_masterParams.data(), paramCount * sizeof(float));
+        break;
+    case TrainingStateSection::Moments1:
+        SaveMoments(m_moments1, m_momentScales1, m_quantisationMaps.data());
+        break;
+    case TrainingStateSection::Moments2:
+        SaveMoments(m_moments2, m_momentScales2, m_quantisationMaps.data() + s_quantisationMapSize);
+        break;
+    case TrainingStateSection::EmaParams:
+        std::memcpy(dst, m_emaParams.data(), m_emaParams.size() * sizeof(float));
+        break;
+    case TrainingStateSection::EmaNetworkParams:
+        std::memcpy(dst, m_emaNetworkParams.data(), m_emaNetworkParams.size());
+        break;
+    case TrainingStateSection::LossScale:
+        std::memcpy(dst, &m_lossScaler.GetState(), sizeof(LossScaleState));
+        break;
+    default:
+        assert(false && "Section not kept by the engine");
+        break;
+    }
+}
+
+bool TrainingEngine::RestoreTrainingState(TrainingStateDesc const& desc, const uint8_t* data)
+{
+    const TrainingStateDesc expected = GetTrainingStateDesc();
+    if (m_networks.empty() || !IsTrainingStateCompatible(expected, desc))
+    {
+        Log(Error, "TrainingEngine: the training state does not match the engine.");
+        return false;
+    }
+
+    const size_t paramCount = m_masterParams.size();
+    auto Section = [&](TrainingStateSection id) {
+        size_t offset, size;
+        desc.FindSection(id, offset, size);
+        return data + offset;
+    };
+    auto RestoreMoments = [&](std::vector<float>& moments, std::vector<float>& scales, TrainingStateSection id, const float* map) {
+        if (m_quantisationMaps.empty())
+        {
+            std::memcpy(moments.data(), Section(id), paramCount * sizeof(float));
+        }
+        else
+        {
+            DecodeQuantisedState(map, Section(id), paramCount, moments.data(), scales.data());
+        }
+    };
+
+    TrainingProgress progress;
+    std::memcpy(&progress, Section(TrainingStateSection::Progress), sizeof(progress));
+    LossScaleState lossScaleState;
+    std::memcpy(&lossScaleState, Section(TrainingStateSection::LossScale), sizeof(lossScaleState));
+
+    std::memcpy(m_networkParams.data(), Section(TrainingStateSection::NetworkParams), m_networkParams.size());
+    std::memcpy(m_masterParams.data(), Section(TrainingStateSection::MasterParams), paramCount * sizeof(float));
+    if (progress.convertWeights)
+    {
+        m_kernels->halfToFloat(reinterpret_cast<const uint16_t*>(m_networkParams.data()), m_masterParams.data(), paramCount);
+    }
+    RestoreMoments(m_moments1, m_momentScales1, TrainingStateSection::Moments1, m_quantisationMaps.data());
+    if (!m_moments2.empty())
+    {
+        RestoreMoments(m_moments2, m_momentScales2, TrainingStateSection::Moments2, m_quantisationMaps.data() + s_quantisationMapSize);
+    }
+    if (!m_emaParams.empty())
+    {
+        std::memcpy(m_emaParams.data(), Section(TrainingStateSection::EmaParams), paramCount * sizeof(float));
+        std::memcpy(m_emaNetworkParams.data(), Section(TrainingStateSection::EmaNetworkParams), m_emaNetworkParams.size());
+        if (progress.convertWeights)
+        {
+            m_emaParams = m_masterParams;
+            m_emaNetworkParams = m_networkParams;
+        }
+    }
+    UpdateComputeParams();
+
+    m_currentStep = progress.currentStep;
+    m_lossScaler.SetState(lossScaleState);
+    ResetMetrics();
+    return true;
+}
+
+bool TrainingEngine::UpdateNetwork(HostNetwork& network, uint32_t networkIndex) const
+{
+    const NetworkLayout& layout = network.GetNetworkLayout();
+    if (networkIndex >= m_networks.size())
+    {
+        Log(Error, "TrainingEngine: network %d out of range.", networkIndex);
+        return false;
+    }
+    const Network& trained = m_networks[networkIndex];
+    if (layout.matrixLayout != trained.layout.matrixLayout || layout.matrixPrecision != trained.layout.matrixPrecision ||
+        layout.networkLayers.size() != trained.layout.networkLayers.size() || layout.networkSize != trained.layout.networkSize)
+    {
+        Log(Error, "TrainingEngine: network layout does not match the trained layout.");
+        return false;
+    }
+    return network.UpdateNetworkParams(m_networkParams.data() + trained.paramOffset, trained.layout.networkSize);
+}
+
+bool TrainingEngine::UpdatePack(NetworkPack& pack) const
+{
+    if (pack.GetNetworkCount() != m_networks.size() || pack.GetParamsSize() != m_networkParams.size())
+    {
+        Log(Error, "TrainingEngine: pack does not match the trained networks.");
+        return false;
+    }
+    return pack.UpdateParams(m_networkParams.data(), m_networkParams.size());
+}
+
+bool TrainingEngine::UpdateHashGrid(HashGrid& grid) const
+{
+    if (!HasHashGrid() || grid.GetSize() != m_hashGrid.GetSize() || grid.GetLevels().size() != m_hashGrid.GetLevels().size())
+    {
+        Log(Error, "TrainingEngine: hash grid does not match the trained grid.");
+        return false;
+    }
+    return grid.UpdateParams(m_networkParams.data() + m_hashGridOffset, m_hashGrid.GetSize());
+}
+
+NAMESPACE_END(cpu)
+NAMESPACE_END(fluxel)
@@ -0,0 +1,268 @@
+#pragma once
+
+#include <vector>
+
+#include "Fluxel.h"
+#include "Network.h"
+#include "HashGrid.h"
+#include "LossScaling.h"
+#include "Optimizers.h"
+#include "NetworkPack.h"
+#include "TrainingMetrics.h"
+#include "TrainingState.h"
+#include "Activation.h"
+#include "AlignedVector.h"
+#include "Kernels.h"
+#include "Loss.h"
+#include "PackedNetwork.h"
+#include "ThreadPool.h"
+
+NAMESPACE_BEGIN(fluxel)
+NAMESPACE_BEGIN(cpu)
+
+struct TrainingEngineDesc
+{
+    // Defaults match training_cs in SimpleTraining_Training.slang and optimizer_cs in SimpleTraining_Optimizer.slang.
+    ActivationDesc hiddenActivation = { Activation::LeakyReLU, 0.01f };
+    ActivationDesc finalActivation = { Activation::Sigmoid, 0.f };
+    Loss loss = Loss::L2;
+
+    // Loss gradients are scaled up before the backward pass and scaled down by the optimizer, see LOSS_SCALE.
+    float lossScale = 1024.f;
+
+    // Adjust the loss scale after every step with lossScaleSchedule instead of using lossScale, see LossScaler.
+    // Steps with a NaN or infinite gradient are skipped. With halfPrecisionActivations, gradients beyond the half range
+    // count as overflows too, as they would in the half precision gradient buffer of the training shaders.
+    bool dynamicLossScale = false;
+    LossScaleSchedule lossScaleSchedule;
+
+    // Adam by default, see GetDefaultOptimizerDesc for the defaults of the other optimizers.
+    // With optimizer.quantisedState the moments are rounded to their 8-bit values after every update, in blocks of
+    // consecutive parameters of the source layout. The optimizer pass blocks the device layout instead, see
+    // s_quantisedStateBlockSize.
+    OptimizerDesc optimizer;
+
+    // Round the inputs, cached activations and backward gradients to half precision, like the CoopVec<half> shader path.
+    bool halfPrecisionActivations = true;
+
+    // Number of samples processed together by the forward and backward kernels.
+    uint32_t tileRows = 32;
+
+    // Number of gradient buffers the batch is split across, 0 uses one per thread of the pool.
+    // Gradients are summed in a fixed order, so results are reproducible for a given partition count
+    // regardless of the number of threads.
+    uint32_t numPartitions = 0;
+};
+
+// Training samples of one network of an engine.
+struct TrainingBatch
+{
+    uint32_t networkIndex = 0;
+    const float* inputs = nullptr; ///< [count][GetInputCount(networkIndex)] floats.
+    const float* targets = nullptr; ///< [count][GetOutputCount(networkIndex)] floats.
+    size_t count = 0;
+};
+
+// Multi-threaded CPU training of a host side network.
+// Runs the same forward and backward pass as training_cs and the same update as optimizer_cs, with FP32 master
+// parameters and an FP16 mirror in the layout of the source network. Instead of accumulating the parameter gradients
+// atomically every partition of the batch accumulates into its own buffer and the buffers are reduced by the optimizer pass.
+class TrainingEngine
+{
+public:
+    // Uses the default thread pool when none is provided.
+    explicit TrainingEngine(ThreadPool* threadPool = nullptr);
+
+    bool Initialise(HostNetwork const& network, TrainingEngineDesc const& desc = {});
+    // Initialise from raw parameters, the matrix precision must be F16.
+    bool Initialise(NetworkLayout const& layout, const uint8_t* params, size_t paramsSize, TrainingEngineDesc const& desc = {});
+    // Initialise every network of a pack, networks are selected by their index in the pack.
+    // The parameters of all networks are optimised together, in the layout of the pack.
+    bool Initialise(NetworkPack const& pack, TrainingEngineDesc const& desc = {});
+    // Initialise a network with a hash grid encoding of its inputs, the features of the grid are trained with the network.
+    // The inputs of Step are positions of grid.GetDesc().inputDimensions floats, the network takes the grid outputs.
+    // The features follow the network parameters at HashGrid::GetOffsetAfter(networkSize), as in the device buffers.
+    bool Initialise(HostNetwork const& network, HashGrid const& grid, TrainingEngineDesc const& desc = {});
+
+    // Run one training step over batchSize samples and update the parameters.
+    // inputs are stored as [batchSize][GetInputCount()] floats, targets as [batchSize][GetOutputCount()] floats.
+    // Returns the loss averaged over the batch and output components.
+    float Step(const float* inputs, const float* targets, size_t batchSize, float learningRate);
+
+    // Run one training step over several batches, each with its own network, and update the parameters of all networks.
+    // The loss gradient of every batch is averaged over its own samples, as if each network had been trained alone.
+    // Returns the mean of the batch losses.
+    float Step(const TrainingBatch* batches, size_t batchCount, float learningRate);
+
+    // Copy the FP16 parameters of a network into a network of the same layout.
+    bool UpdateNetwork(HostNetwork& network, uint32_t networkIndex = 0) const;
+
+    // Copy the FP16 parameters into the pack passed to Initialise.
+    bool UpdatePack(NetworkPack& pack) const;
+
+    // Copy the FP16 features into the grid passed to Initialise.
+    bool UpdateHashGrid(HashGrid& grid) const;
+
+    // FP16 parameters in the layout passed to Initialise, the complete pack when initialised from one.
+    // The features of a hash grid follow the network.
+    const std::vector<uint8_t>& GetNetworkParams() const
+    {
+        return m_networkParams;
+    }
+
+    // FP16 exponential moving average of the parameters, in the layout of GetNetworkParams(). Empty unless the
+    // optimizer of the engine has an EMA decay.
+    const std::vector<uint8_t>& GetEmaNetworkParams() const
+    {
+        return m_emaNetworkParams;
+    }
+
+    uint32_t GetNetworkCount() const
+    {
+        return uint32_t(m_networks.size());
+    }
+
+    const NetworkLayout& GetNetworkLayout(uint32_t networkIndex = 0) const
+    {
+        return m_networks[networkIndex].layout;
+    }
+
+    // FP32 master parameters, indexed like the FP16 parameters.
+    const std::vector<float>& GetMasterParams() const
+    {
+        return m_masterParams;
+    }
+
+    // Loss metrics of the steps since the last ResetMetrics, reduced like the metrics buffer of the training shaders.
+    const TrainingMetrics& GetMetrics() const
+    {
+        return m_metrics;
+    }
+
+    // Start a new range of metrics at the next step.
+    void ResetMetrics()
+    {
+        m_metrics = {};
+        m_metrics.firstStep = m_currentStep;
+    }
+
+    // Scale of the loss gradients of the next step.
+    float GetLossScale() const
+    {
+        return m_desc.dynamicLossScale ? m_lossScaler.GetScale() : m_desc.lossScale;
+    }
+
+    LossScaler const& GetLossScaler() const
+    {
+        return m_lossScaler;
+    }
+
+    // Step number used for the bias correction of the next update, starts at 1.
+    uint32_t GetCurrentStep() const
+    {
+        return m_currentStep;
+    }
+
+    // Sections of the training state of the engine, see TrainingState.h. The samples and their random states belong
+    // to the caller, which adds them to the state. 8-bit moments are stored in the layout of the optimizer shaders.
+    TrainingStateDesc GetTrainingStateDesc() const;
+
+    // Copy a section of GetTrainingStateDesc() to dst.
+    void SaveTrainingState(TrainingStateSection section, uint8_t* dst) const;
+
+    // Continue training from a state with the sections of GetTrainingStateDesc(), written by an engine initialised
+    // with the same networks and desc. Other sections of the state are ignored. Training continues as if it had not
+    // been interrupted, up to the partitioning of the batch.
+    bool RestoreTrainingState(TrainingStateDesc const& desc, const uint8_t* data);
+
+    // Floats per input of Step, the position dimensions when the inputs are encoded by a hash grid.
+    uint32_t GetInputCount(uint32_t networkIndex = 0) const
+    {
+        if (networkIndex >= m_networks.size())
+        {
+            return 0;
+        }
+        return HasHashGrid() ? m_hashGrid.GetDesc().inputDimensions : m_networks[networkIndex].layers.front().inputs;
+    }
+
+    uint32_t GetOutputCount(uint32_t networkIndex = 0) const
+    {
+        return networkIndex < m_networks.size() ? m_networks[networkIndex].layers.back().outputs : 0;
+    }
+
+    // Name of the instruction set the kernels were selected for.
+    const char* GetKernelName() const
+    {
+        return m_kernels->name;
+    }
+
+    bool HasHashGrid() const
+    {
+        return !m_hashGrid.GetLevels().empty();
+    }
+
+private:
+    // Scratch and gradient storage of one batch partition.
+    struct Partition
+    {
+        AlignedVector<float> scratch; ///< Forward cache and backward gradients of one tile.
+        AlignedVector<float> gradients; ///< Parameter gradients in the packed layer layout.
+    };
+
+    // One network of the engine, its parameters start at paramOffset bytes into the parameter buffer.
+    struct Network
+    {
+        NetworkLayout layout;
+        size_t paramOffset = 0;
+        std::vector<PackedLayer> layers; ///< Compute copy of the FP16 parameters.
+        std::vector<size_t> gradientOffsets; ///< Offset of each layer in the packed gradients, weights followed by bias.
+    };
+
+    bool InitialiseNetworks(const std::vector<Network>& networks,
+                            const uint8_t* params,
+                            size_t paramsSize,
+                            TrainingEngineDesc const& desc,
+                            HashGrid const* grid = nullptr,
+                            size_t gridOffset = 0);
+    void TrainTiles(Partition& partition, const TrainingBatch* batches, std::vector<size_t> const& firstTiles, size_t firstTile, size_t lastTile);
+    bool Optimise(float learningRate);
+    void UpdateComputeParams();
+
+    ThreadPool* m_threadPool;
+    KernelTable const* m_kernels;
+    TrainingEngineDesc m_desc;
+    std::vector<Network> m_networks;
+
+    std::vector<uint8_t> m_networkParams; ///< FP16 mirror of the master parameters.
+    std::vector<float> m_masterParams;
+    std::vector<float> m_moments1;
+    std::vector<float> m_moments2;
+    std::vector<float> m_quantisationMaps; ///< Signed and unsigned dynamic maps of the 8-bit moments.
+    std::vector<float> m_momentScales1; ///< Scale of every block of the 8-bit first moments.
+    std::vector<float> m_momentScales2;
+    std::vector<float> m_emaParams; ///< FP32 moving average of the master parameters.
+    std::vector<uint8_t> m_emaNetworkParams; ///< FP16 mirror of the moving average.
+    uint32_t m_currentStep = 1;
+    LossScaler m_lossScaler;
+    std::vector<uint8_t> m_chunkOverflow; ///< Overflow of the gradients of every optimizer chunk.
+
+    HashGrid m_hashGrid; ///< Levels of the input encoding, no levels without one.
+    size_t m_hashGridOffset = 0; ///< Byte offset of the features in the parameters.
+    size_t m_hashGridGradientOffset = 0; ///< Offset of the features in the packed gradients.
+    std::vector<float> m_hashGridParams; ///< Compute copy of the FP16 features.
+
+    std::vector<uint32_t> m_gradientIndex; ///< Packed gradient index of every parameter, s_noGradient for padding.
+    size_t m_gradientSize = 0;
+    uint32_t m_maxWidth = 0; ///< Row stride of the scratch buffers.
+    size_t m_maxLayers = 0; ///< Largest layer count of the networks.
+
+    std::vector<Partition> m_partitions;
+    std::vector<double> m_tileLoss;
+    std::vector<TrainingMetrics> m_tileMetrics;
+    TrainingMetrics m_metrics;
+
+    static constexpr uint32_t s_noGradient = ~0u;
+};
+
+NAMESPACE_END(cpu)
+NAMESPACE_END(fluxel)
@@ -0,0 +1,102 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "HashGrid.h"
+#include "Logger.h"
+#include "Cpu/Kernels.h"
+#include "Cpu/Philox.h"
+
+NAMESPACE_BEGIN(fluxel)
+
+bool HashGrid::Initialise(HashGridDesc const& desc, uint64_t seed)
+{
+    m_levels.clear();
+    m_params.clear();
+
+    if (desc.inputDimensions < 2 || desc.inputDimensions > 3 || desc.numLevels == 0 || desc.featuresPerLevel == 0 || desc.log2TableSize > 24 ||
+        desc.baseResolution == 0 || desc.finestResolution < desc.baseResolution)
+    {
+        Log(Error, "HashGrid: invalid grid description.");
+        return false;
+    }
+    m_desc = desc;
+
+    // Resolutions grow by a constant factor per level, computed in double so every platform creates the same levels
+    const double growth =
+        desc.numLevels > 1 ? std::exp((std::log(double(desc.finestResolution)) - std::log(double(desc.baseResolution))) / (desc.numLevels - 1)) : 1.0;
+    const uint64_t maxTableSize = uint64_t(1) << desc.log2TableSize;
+    size_t offset = 0;
+    for (uint32_t l = 0; l < desc.numLevels; l++)
+    {
+        HashGridLevel level;
+        level.resolution = uint32_t(std::floor(double(desc.baseResolution) * std::pow(growth, double(l)) + 1e-6));
+
+        uint64_t vertices = 1;
+        for (uint32_t d = 0; d < desc.inputDimensions; d++)
+        {
+            vertices = std::min(vertices * (level.resolution + 1), maxTableSize + 1);
+        }
+        level.hashed = vertices > maxTableSize;
+        level.tableSize = uint32_t(level.hashed ? maxTableSize : vertices);
+        level.offset = offset;
+        m_levels.push_back(level);
+
+        offset = GetOffsetAfter(offset + size_t(level.tableSize) * desc.featuresPerLevel * sizeof(uint16_t));
+    }
+    if (offset > UINT32_MAX)
+    {
+        Log(Error, "HashGrid: grid exceeds 4GB, the offsets are 32 bit.");
+        m_levels.clear();
+        return false;
+    }
+
+    // Every level draws from its own Philox counters, so the features only depend on the seed
+    m_params.resize(offset, 0);
+    const cpu::KernelTable& kernels = cpu::GetBestKernels();
+    const cpu::Philox4x32::Key key = cpu::Philox4x32::MakeKey(seed);
+    std::vector<float> values;
+    for (uint32_t l = 0; l < desc.numLevels; l++)
+    {
+        const size_t count = size_t(m_levels[l].tableSize) * desc.featuresPerLevel;
+        values.resize((count + 3) & ~size_t(3));
+        for (size_t j = 0; j < count; j += 4)
+        {
+            const uint64_t block = j / 4;
+            const cpu::Philox4x32::Counter bits = cpu::Philox4x32::Generate({ uint32_t(block), uint32_t(block >> 32), l, 0 }, key);
+            for (size_t b = 0; b < 4; b++)
+            {
+                values[j + b] = cpu::UniformSignedFloat(bits[b]) * desc.initialRange;
+            }
+        }
+        kernels.floatToHalf(values.data(), reinterpret_cast<uint16_t*>(m_params.data() + m_levels[l].offset), count);
+    }
+    return true;
+}
+
+bool HashGrid::UpdateParams(const uint8_t* data, size_t size)
+{
+    if (size != m_params.size())
+    {
+        Log(Error, "HashGrid: parameter size does not match the grid.");
+        return false;
+    }
+    std::memcpy(m_params.data(), data, size);
+    return true;
+}
+
+std::vector<uint32_t> HashGrid::CreateLevelTable(size_t gridOffset) const
+{
+    std::vector<uint32_t> table;
+    table.reserve(m_levels.size() * s_hashGridLevelStride);
+    for (const HashGridLevel& level : m_levels)
+    {
+        table.push_back(level.resolution);
+        table.push_back(level.tableSize);
+        table.push_back(uint32_t(gridOffset + level.offset));
+        table.push_back(level.hashed ? 1 : 0);
+    }
+    return table;
+}
+
+NAMESPACE_END(fluxel)
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <vector>
+
+#include "Fluxel.h"
+#include "Network.h"
+
+NAMESPACE_BEGIN(fluxel)
+
+// Byte alignment of a hash grid placed after a network in one parameter buffer, see HashGrid::GetOffsetAfter.
+constexpr size_t s_hashGridAlignment = 64;
+
+// Number of uint32_t entries per level in the table returned by HashGrid::CreateLevelTable, one uint4 in HashGrid.slang.
+constexpr uint32_t s_hashGridLevelStride = 4;
+
+struct HashGridDesc
+{
+    uint32_t inputDimensions = 2; ///< 2 or 3.
+    uint32_t numLevels = 16;
+    uint32_t featuresPerLevel = 2;
+    uint32_t log2TableSize = 16; ///< Entries of the hashed levels, coarser levels are stored densely when they fit.
+    uint32_t baseResolution = 16; ///< Cells per dimension of the coarsest level.
+    uint32_t finestResolution = 1024; ///< Cells per dimension of the finest level, the levels in between grow geometrically.
+    float initialRange = 1e-4f; ///< Features are initialised uniformly in [-initialRange, initialRange].
+};
+
+struct HashGridLevel
+{
+    uint32_t resolution = 0; ///< Cells per dimension, the level has resolution + 1 vertices per dimension.
+    uint32_t tableSize = 0; ///< Entries of the level, a power of two for hashed levels.
+    size_t offset = 0; ///< Byte offset of the features of the level from the start of the grid.
+    bool hashed = false; ///< Vertices are hashed into the table, dense levels index the vertices directly.
+};
+
+// Trainable multiresolution hash grid encoding, see HashGrid.slang.
+// Features are stored as F16, [tableSize][featuresPerLevel] per level. The grid has its own parameter region,
+// usually placed after the network at GetOffsetAfter(networkSize) in the same buffer, so the optimizer passes
+// update the features together with the network parameters.
+class HashGrid
+{
+public:
+    HashGrid(){};
+    ~HashGrid(){};
+
+    // Create the levels of a grid and initialise the features from a seed.
+    bool Initialise(HashGridDesc const& desc, uint64_t seed);
+
+    // Replace the features with data laid out as the grid.
+    bool UpdateParams(const uint8_t* data, size_t size);
+
+    // One s_hashGridLevelStride entry per level (resolution, table size, byte offset, hashed) for the shader constants.
+    // gridOffset is the byte offset of the grid in the parameter buffer bound to the shaders.
+    std::vector<uint32_t> CreateLevelTable(size_t gridOffset) const;
+
+    // Byte offset of a grid placed after size bytes of other parameters.
+    static size_t GetOffsetAfter(size_t size)
+    {
+        return (size + s_hashGridAlignment - 1) / s_hashGridAlignment * s_hashGridAlignment;
+    }
+
+    const HashGridDesc& GetDesc() const
+    {
+        return m_desc;
+    }
+
+    const std::vector<HashGridLevel>& GetLevels() const
+    {
+        return m_levels;
+    }
+
+    // Encoded features per position, the input count of the network that follows the grid.
+    uint32_t GetOutputCount() const
+    {
+        return m_desc.numLevels * m_desc.featuresPerLevel;
+    }
+
+    const std::vector<uint8_t>& GetParams() const
+    {
+        return m_params;
+    }
+
+    size_t GetSize() const
+    {
+        return m_params.size();
+    }
+
+    size_t GetParamCount() const
+    {
+        return m_params.size() / sizeof(uint16_t);
+    }
+
+private:
+    HashGridDesc m_desc;
+    std::vector<HashGridLevel> m_levels;
+    std::vector<uint8_t> m_params;
+};
+
+NAMESPACE_END(fluxel)
@@ -1,48 +1,149 @@
 #include "LearningRateScheduler.h"
 #include <algorithm>
 #include <cmath>
+#include <cstring>
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
 
+namespace
+{
+// Cosine interpolation from 1 at ratio 0 to 0 at ratio 1
+float CosineRatio(float ratio)
+{
+    return 0.5f * (1.f + float(std::cos(std::min(1.0f, ratio) * M_PI)));
+}
+} // namespace
+
 LearningRateScheduler::LearningRateScheduler()
 {
 }
 
 LearningRateScheduler::LearningRateScheduler(float baseRate, float minRate, int warmupSteps, int flatSteps, int decaySteps)
-    : m_baseRate(baseRate), m_minRate(minRate), m_warmupSteps(warmupSteps), m_flatSteps(flatSteps), m_decaySteps(decaySteps)
 {
+    m_desc.baseRate = baseRate;
+    m_desc.minRate = minRate;
+    m_desc.warmupSteps = warmupSteps;
+    m_desc.flatSteps = flatSteps;
+    m_desc.decaySteps = decaySteps;
+}
+
+LearningRateScheduler::LearningRateScheduler(LearningRateScheduleDesc const& desc) : m_desc(desc)
+{
+}
+
+void LearningRateScheduler::SetDesc(LearningRateScheduleDesc const& desc)
+{
+    m_desc = desc;
+    m_plateau = {};
 }
 
 float LearningRateScheduler::GetLearningRate(int step) const
 {
+    // Plateau reductions stop at the minimum rate, the warm-up below it is left as scheduled
+    const float scheduledRate = GetScheduledRate(step);
+    return std::max(scheduledRate * m_plateau.scale, std::min(scheduledRate, m_desc.minRate));
+}
+
+float LearningRateScheduler::GetScheduledRate(int step) const
+{
+    const float baseRate = m_desc.baseRate;
+    const float minRate = m_desc.minRate;
+    const int warmupSteps = m_desc.warmupSteps;
+    const int decaySteps = m_desc.decaySteps;
+
     if (step <= 0)
     {
         // Guard against zero or negative steps, should not get here.
-        return m_warmupSteps > 0 ? 0.f : m_baseRate;
+        return warmupSteps > 0 ? 0.f : baseRate;
     }
-    else if (step < m_warmupSteps)
+    else if (step < warmupSteps)
     {
+        const float progress = static_cast<float>(step) / warmupSteps;
+        if (m_desc.schedule == LearningRateSchedule::OneCycle)
+        {
+            // Cosine rise from the minimum rate to the base rate
+            return baseRate + (minRate - baseRate) * CosineRatio(progress);
+        }
         // Linear warm-up from 0 to the base rate
-        float progress = static_cast<float>(step) / m_warmupSteps;
-        return m_baseRate * progress;
+        return baseRate * progress;
+    }
+    else if (step < warmupSteps + m_desc.flatSteps)
+    {
+        return baseRate;
     }
-    else if (step < m_warmupSteps + m_flatSteps)
+
+    const int decayStep = step - (warmupSteps + m_desc.flatSteps);
+    if (decaySteps <= 0)
+    {
+        return minRate;
+    }
+
+    switch (m_desc.schedule)
     {
-        return m_baseRate;
+    case LearningRateSchedule::Exponential:
+        return std::max(minRate, baseRate * float(std::pow(double(m_desc.decayFactor), double(decayStep) / decaySteps)));
+    case LearningRateSchedule::Step:
+        return std::max(minRate, baseRate * float(std::pow(double(m_desc.decayFactor), double(decayStep / decaySteps))));
+    case LearningRateSchedule::CosineRestarts:
+    {
+        // Find the period containing the step, every period is periodFactor times longer than the previous one
+        double periodStep = decayStep;
+        double period = decaySteps;
+        if (m_desc.periodFactor <= 1.f)
+        {
+            periodStep = std::fmod(periodStep, period);
+        }
+        else
+        {
+            while (periodStep >= period)
+            {
+                periodStep -= period;
+                period *= m_desc.periodFactor;
+            }
+        }
+        return minRate + (baseRate - minRate) * CosineRatio(float(periodStep / period));
+    }
+    default:
+        // Cosine decay from base rate to minimum learning rate, OneCycle decays the same way
+        return minRate + (baseRate - minRate) * CosineRatio(static_cast<float>(decayStep) / decaySteps);
     }
-    else if (step < m_warmupSteps + m_flatSteps + m_decaySteps)
+}
+
+void LearningRateScheduler::ReportLoss(uint32_t lastStep, double loss)
+{
+    if (!m_desc.reduceOnPlateau || !std::isfinite(loss))
     {
-        // Cosine decay from base rate to minimum learning rate
-        int decayStep = step - (m_warmupSteps + m_flatSteps);
-        float decayRatio = std::min(1.0f, static_cast<float>(decayStep) / m_decaySteps);
+        return;
+    }
 
-        float cosineDecay = 0.5f * (1.f + float(std::cos(decayRatio * M_PI)));
-        return m_minRate + (m_baseRate - m_minRate) * cosineDecay;
+    if (loss < m_plateau.bestLoss * (1.0 - m_desc.plateauThreshold))
+    {
+        m_plateau.bestLoss = float(loss);
+        m_plateau.bestStep = lastStep;
+    }
+    else if (lastStep >= m_plateau.cooldownStep && lastStep - m_plateau.bestStep >= uint32_t(std::max(m_desc.plateauPatience, 0)))
+    {
+        // Wait the patience again before the next reduction. Below minRate / baseRate GetLearningRate() returns the
+        // minimum rate for every step, so the scale stops there instead of decaying towards zero.
+        const float minScale = m_desc.baseRate > 0.f ? m_desc.minRate / m_desc.baseRate : 0.f;
+        m_plateau.scale = std::max(m_plateau.scale * m_desc.plateauFactor, minScale);
+        m_plateau.bestStep = lastStep;
+        m_plateau.cooldownStep = lastStep + uint32_t(std::max(m_desc.plateauCooldown, 0));
     }
-    else
+}
+
+bool ParseLearningRateSchedule(const char* name, LearningRateSchedule& schedule)
+{
+    static const char* const names[] = { "cosine", "onecycle", "exponential", "step", "restarts" };
+    for (uint32_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
     {
-        return m_minRate;
+        if (!std::strcmp(name, names[i]))
+        {
+            schedule = LearningRateSchedule(i);
+            return true;
+        }
     }
+    return false;
 }
@@ -1,16 +1,90 @@
 #pragma once
 
+#include <cstdint>
+#include <limits>
+
+// Shape of the learning rate after the warm-up and flat steps
+enum class LearningRateSchedule : uint32_t
+{
+    Cosine = 0, // Cosine decay from the base rate to the minimum rate over the decay steps
+    OneCycle = 1, // Cosine rise from the minimum rate during the warm-up, then cosine decay
+    Exponential = 2, // Multiplied by the decay factor every decay steps, continuously
+    Step = 3, // Multiplied by the decay factor at every multiple of the decay steps
+    CosineRestarts = 4, // Cosine decays restarting at the base rate, the first lasting the decay steps
+};
+
+struct LearningRateScheduleDesc
+{
+    LearningRateSchedule schedule = LearningRateSchedule::Cosine;
+    float baseRate = 1e-3f; // Initial peak learning rate
+    float minRate = 1e-4f; // Floor learning rate of every schedule
+    int warmupSteps = 10000; // Linear warm-up from 0 to the base rate, from the minimum rate for OneCycle
+    int flatSteps = 100000; // Steps at the base rate after the warm-up
+    int decaySteps = 100000;
+    float decayFactor = 0.5f; // Exponential and Step
+    float periodFactor = 2.f; // CosineRestarts, growth of the period at every restart
+
+    // Reduce on plateau, the scheduled rate is multiplied by a factor that drops when the loss reported with
+    // ReportLoss has not improved by the relative threshold for the patience steps
+    bool reduceOnPlateau = false;
+    float plateauFactor = 0.5f;
+    int plateauPatience = 5000;
+    float plateauThreshold = 1e-3f;
+    int plateauCooldown = 0; // Steps after a reduction before the next one
+};
+
+// Progress of the reduce on plateau mode, stored with the training state
+struct LearningRatePlateauState
+{
+    float scale = 1.f; // Factor applied to the scheduled rate, not below minRate / baseRate where the rate is at its floor
+    float bestLoss = std::numeric_limits<float>::infinity(); // Lowest reported loss, infinite before the first report
+    uint32_t bestStep = 0; // Last step of the lowest loss or of the last reduction
+    uint32_t cooldownStep = 0; // No reduction before this step
+};
+static_assert(sizeof(LearningRatePlateauState) == 16, "LearningRatePlateauState is stored as 4 words");
+
 class LearningRateScheduler
 {
 public:
     LearningRateScheduler();
     LearningRateScheduler(float baseRate, float minRate, int warmupSteps, int flatSteps, int decaySteps);
+    explicit LearningRateScheduler(LearningRateScheduleDesc const& desc);
+
+    // Rate of a step, evaluated once per step on the host
     float GetLearningRate(int step) const;
 
+    // Feed the mean loss of the steps up to lastStep to the reduce on plateau mode. Non-finite losses are ignored.
+    void ReportLoss(uint32_t lastStep, double loss);
+
+    // Restart the schedule, clears the plateau state
+    void SetDesc(LearningRateScheduleDesc const& desc);
+
+    LearningRateScheduleDesc const& GetDesc() const
+    {
+        return m_desc;
+    }
+
+    LearningRatePlateauState const& GetPlateauState() const
+    {
+        return m_plateau;
+    }
+
+    void SetPlateauState(LearningRatePlateauState const& state)
+    {
+        m_plateau = state;
+    }
+
+    void ResetPlateauState()
+    {
+        m_plateau = {};
+    }
+
 private:
-    float m_baseRate = 1e-3f; // Initial peak learning rate
-    float m_minRate = 1e-4f; // Floor learning rate at end of schedule
-    int m_warmupSteps = 10000;
-    int m_flatSteps = 100000;
-    int m_decaySteps = 100000;
+    float GetScheduledRate(int step) const;
+
+    LearningRateScheduleDesc m_desc;
+    LearningRatePlateauState m_plateau;
 };
+
+// Parse a schedule name, cosine, onecycle, exponential, step or restarts. Returns false for an unknown name.
+bool ParseLearningRateSchedule(const char* name, LearningRateSchedule& schedule);
@@ -0,0 +1,35 @@
+#include <algorithm>
+
+#include "LossScaling.h"
+
+NAMESPACE_BEGIN(fluxel)
+
+LossScaler::LossScaler(LossScaleSchedule const& schedule) : m_schedule(schedule)
+{
+    Reset();
+}
+
+bool LossScaler::Update()
+{
+    const bool overflow = HasGradientOverflow();
+    if (overflow)
+    {
+        m_state.scale = std::max(m_state.scale * m_schedule.backoffFactor, m_schedule.minScale);
+        m_state.goodSteps = 0;
+    }
+    else if (++m_state.goodSteps >= m_schedule.growthInterval)
+    {
+        m_state.scale = std::min(m_state.scale * m_schedule.growthFactor, m_schedule.maxScale);
+        m_state.goodSteps = 0;
+    }
+    m_state.overflow = 0;
+    return overflow;
+}
+
+void LossScaler::Reset()
+{
+    m_state = {};
+    m_state.scale = m_schedule.initialScale;
+}
+
+NAMESPACE_END(fluxel)
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+
+#include "Fluxel.h"
+
+NAMESPACE_BEGIN(fluxel)
+
+// State buffer of the dynamic loss scale in LossScaling.slang.
+struct LossScaleState
+{
+    float scale = 0.f;
+    uint32_t goodSteps = 0; ///< Steps since the last overflow or growth of the scale.
+    uint32_t overflow = 0; ///< Non-zero when a gradient of the current step is NaN or infinite.
+    uint32_t padding = 0;
+};
+static_assert(sizeof(LossScaleState) == 16, "LossScaleState must match LOSS_SCALE_STATE_SIZE in LossScaling.slang");
+
+// Schedule of the dynamic loss scale, the parameters of UpdateLossScale in LossScaling.slang.
+struct LossScaleSchedule
+{
+    float initialScale = 1024.f;
+    float growthFactor = 2.f;
+    float backoffFactor = 0.5f;
+    uint32_t growthInterval = 2000; ///< Steps without an overflow before the scale grows.
+    float minScale = 1.f;
+    float maxScale = 65536.f;
+};
+
+// CPU reference of UpdateLossScale in LossScaling.slang.
+// Gradients are computed with the loss multiplied by GetScale(). A step with a NaN or infinite gradient is skipped
+// and the scale is reduced by the backoff factor, the scale grows by the growth factor after growthInterval steps
+// without an overflow.
+class LossScaler
+{
+public:
+    explicit LossScaler(LossScaleSchedule const& schedule = {});
+
+    float GetScale() const
+    {
+        return m_state.scale;
+    }
+
+    LossScaleState const& GetState() const
+    {
+        return m_state;
+    }
+
+    LossScaleSchedule const& GetSchedule() const
+    {
+        return m_schedule;
+    }
+
+    bool HasGradientOverflow() const
+    {
+        return m_state.overflow != 0;
+    }
+
+    // Flag the current step after a NaN or infinite gradient, like DetectGradientOverflow.
+    void ReportGradientOverflow()
+    {
+        m_state.overflow = 1;
+    }
+
+    // Adjust the scale after the step and clear the overflow flag for the next one.
+    // Returns true when the step overflowed, in which case its update has to be skipped.
+    bool Update();
+
+    // Restart at the initial scale.
+    void Reset();
+
+    // Continue from a state of GetState() or of the state buffer of LossScaling.slang.
+    void SetState(LossScaleState const& state)
+    {
+        m_state = state;
+    }
+
+private:
+    LossScaleSchedule m_schedule;
+    LossScaleState m_state;
+};
+
+NAMESPACE_END(fluxel)
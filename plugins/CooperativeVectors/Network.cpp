@@ -1,13 +1,20 @@
+#include <algorithm>
+#include <cstring>
 #include <fstream>
 #include <sstream>
 #include <random>
 #include "Network.h"
+#include "NetworkFile.h"
+#include "NetworkJson.h"
+#include "Cpu/Kernels.h"
+#include "Cpu/NumberFormats.h"
+#include "Cpu/Philox.h"
+#include "Cpu/ThreadPool.h"
 #include "Logger.h"
 
 #include "krrmath/math.h"
 
 #include <donut/core/log.h>
-#include <donut/core/json.h>
 
 NAMESPACE_BEGIN(fluxel)
 
@@ -23,11 +30,33 @@ constexpr typename std::enable_if<std::is_integral<T>::value, T>::type align_to(
 const uint32_t HEADER_VERSION = 0xA1C0DE01;
 const uint32_t MAX_SUPPORTED_LAYERS = 8;
 
+// Network architecture as stored in version 1 files, all hidden layers have the same width.
+struct NetworkArchitectureV1
+{
+    uint32_t numHiddenLayers = 0;
+    uint32_t inputNeurons = 0;
+    uint32_t hiddenNeurons = 0;
+    uint32_t outputNeurons = 0;
+    Precision weightPrecision = Precision::F16;
+    Precision biasPrecision = Precision::F16;
+};
+
+// Network layer as stored in version 1 files, all weights use the network precision.
+struct NetworkLayerV1
+{
+    uint32_t inputs = 0;
+    uint32_t outputs = 0;
+    size_t weightSize = 0;
+    size_t biasSize = 0;
+    uint32_t weightOffset = 0;
+    uint32_t biasOffset = 0;
+};
+
 struct NetworkFileHeader
 {
     uint32_t version = HEADER_VERSION;
-    NetworkArchitecture netArch;
-    NetworkLayer layers[MAX_SUPPORTED_LAYERS];
+    NetworkArchitectureV1 netArch;
+    NetworkLayerV1 layers[MAX_SUPPORTED_LAYERS];
     MatrixLayout layout;
     size_t dataSize;
 };
@@ -42,6 +71,12 @@ static nvrhi::coopvec::DataType GetNvrhiDataType(Precision precision)
         return nvrhi::coopvec::DataType::Float16;
     case Precision::F32:
         return nvrhi::coopvec::DataType::Float32;
+    case Precision::BF16:
+        return nvrhi::coopvec::DataType::BFloat16;
+    case Precision::F8E4M3:
+        return nvrhi::coopvec::DataType::FloatE4M3;
+    case Precision::I8:
+        return nvrhi::coopvec::DataType::SInt8;
     default:
         assert(false && "Unsupported precision");
         return nvrhi::coopvec::DataType::Float16; // Default to F16
@@ -69,8 +104,82 @@ static nvrhi::coopvec::MatrixLayout GetNvrhiMatrixLayout(MatrixLayout layout)
 constexpr size_t s_matrixAlignment = 64; ///< Minimum byte alignment according to spec.
 constexpr size_t s_vectorAlignment = 16; ///< Minimum byte alignment according to spec.
 
-NetworkUtilities::NetworkUtilities(nvrhi::DeviceHandle device) : m_device(device)
+size_t HostMatrixSizeProvider::GetMatrixSize(Precision precision, MatrixLayout layout, uint32_t rows, uint32_t columns)
+{
+    switch (layout)
+    {
+    case MatrixLayout::RowMajor:
+    case MatrixLayout::ColumnMajor:
+    case MatrixLayout::HostPanel:
+        return GetHostMatrixSize(precision, layout, rows, columns);
+    default:
+        break;
+    }
+
+    auto it = m_optimalSizes.find({ precision, layout, rows, columns });
+    if (it == m_optimalSizes.end())
+    {
+        Log(Error, "HostMatrixSizeProvider: no size registered for a %d x %d optimal layout matrix.", rows, columns);
+        return 0;
+    }
+    return it->second;
+}
+
+void HostMatrixSizeProvider::SetOptimalMatrixSize(Precision precision, MatrixLayout layout, uint32_t rows, uint32_t columns, size_t size)
+{
+    m_optimalSizes[{ precision, layout, rows, columns }] = size;
+}
+
+void HostMatrixSizeProvider::SetOptimalMatrixSizes(NetworkLayout const& layout)
 {
+    if (layout.matrixLayout != MatrixLayout::InferencingOptimal && layout.matrixLayout != MatrixLayout::TrainingOptimal)
+    {
+        return;
+    }
+    for (const NetworkLayer& layer : layout.networkLayers)
+    {
+        SetOptimalMatrixSize(layer.weightPrecision, layout.matrixLayout, layer.outputs, layer.inputs, layer.weightSize);
+    }
+}
+
+DeviceMatrixSizeProvider::DeviceMatrixSizeProvider(nvrhi::DeviceHandle device) : m_device(device)
+{
+    assert(m_device && "Device not present");
+}
+
+size_t DeviceMatrixSizeProvider::GetMatrixSize(Precision precision, MatrixLayout layout, uint32_t rows, uint32_t columns)
+{
+    // Host only layout, the device knows nothing about it
+    if (layout == MatrixLayout::HostPanel)
+    {
+        return GetHostMatrixSize(precision, layout, rows, columns);
+    }
+
+    auto [it, inserted] = m_sizes.try_emplace({ precision, layout, rows, columns }, 0);
+    if (inserted)
+    {
+        it->second = m_device->getCoopVecMatrixSize(GetNvrhiDataType(precision), GetNvrhiMatrixLayout(layout), rows, columns);
+    }
+    return it->second;
+}
+
+NetworkUtilities::NetworkUtilities(nvrhi::DeviceHandle device)
+    : m_matrixSizeProvider(device ? std::shared_ptr<IMatrixSizeProvider>(std::make_shared<DeviceMatrixSizeProvider>(device))
+                                  : std::shared_ptr<IMatrixSizeProvider>(std::make_shared<HostMatrixSizeProvider>()))
+{
+}
+
+NetworkUtilities::NetworkUtilities(std::nullptr_t) : NetworkUtilities()
+{
+}
+
+NetworkUtilities::NetworkUtilities() : m_matrixSizeProvider(std::make_shared<HostMatrixSizeProvider>())
+{
+}
+
+NetworkUtilities::NetworkUtilities(std::shared_ptr<IMatrixSizeProvider> matrixSizeProvider) : m_matrixSizeProvider(matrixSizeProvider)
+{
+    assert(m_matrixSizeProvider && "Matrix size provider not present");
 }
 
 bool NetworkUtilities::ValidateNetworkArchitecture(NetworkArchitecture const& netArch)
@@ -81,22 +190,46 @@ bool NetworkUtilities::ValidateNetworkArchitecture(NetworkArchitecture const& ne
         return false;
     }
 
-    if (netArch.inputNeurons * netArch.outputNeurons * netArch.hiddenNeurons == 0)
+    if (!netArch.hiddenLayerNeurons.empty() && netArch.hiddenLayerNeurons.size() != netArch.numHiddenLayers)
     {
-        Log(Error, "Neuron counts must all be positive - (%d, %d, %d)", netArch.inputNeurons, netArch.outputNeurons, netArch.hiddenNeurons);
+        Log(Error, "Hidden layer widths must be given for all hidden layers - %d != %d", int(netArch.hiddenLayerNeurons.size()), netArch.numHiddenLayers);
         return false;
     }
 
-    // Only Float16 weights are supported in the SDK
-    if (netArch.weightPrecision != Precision::F16)
+    if (netArch.inputNeurons * netArch.outputNeurons == 0)
     {
-        Log(Error, "Weight precision not supported - must be f16.");
+        Log(Error, "Neuron counts must all be positive - (%d, %d)", netArch.inputNeurons, netArch.outputNeurons);
         return false;
     }
 
-    if (netArch.biasPrecision != Precision::F16)
+    for (uint32_t i = 0; i < netArch.numHiddenLayers; i++)
+    {
+        if (netArch.GetHiddenNeurons(i) == 0)
+        {
+            Log(Error, "Neuron counts must all be positive - hidden layer %d", i);
+            return false;
+        }
+    }
+
+    if (!netArch.layerWeightPrecisions.empty() && netArch.layerWeightPrecisions.size() != netArch.numHiddenLayers + 1)
     {
-        Log(Error, "Bias precision not supported - must be f16.");
+        Log(Error, "Weight precisions must be given for all layers - %d != %d", int(netArch.layerWeightPrecisions.size()), netArch.numHiddenLayers + 1);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < netArch.numHiddenLayers + 1; i++)
+    {
+        if (GetSize(netArch.GetWeightPrecision(i)) == 0)
+        {
+            Log(Error, "Weight precision not supported - layer %d", i);
+            return false;
+        }
+    }
+
+    // Biases are never quantised, they are added after the scaled matrix product
+    if (netArch.biasPrecision != Precision::F16 && netArch.biasPrecision != Precision::F32)
+    {
+        Log(Error, "Bias precision not supported - must be f16 or f32.");
         return false;
     }
 
@@ -108,41 +241,48 @@ NetworkLayout NetworkUtilities::CreateHostNetworkLayout(NetworkArchitecture cons
 {
     NetworkLayout layout;
     layout.matrixPrecision = netArch.weightPrecision;
+    layout.biasPrecision = netArch.biasPrecision;
     layout.matrixLayout = MatrixLayout::RowMajor; // Host side matrix layout
 
     const uint32_t numLayers = netArch.numHiddenLayers + 1; // hidden layers + input
-    size_t offset = 0;
 
     layout.networkLayers.clear();
 
     // Create a network layout from the provides architecture
     for (uint32_t i = 0; i < numLayers; i++)
     {
-        uint32_t inputs = (i == 0) ? netArch.inputNeurons : netArch.hiddenNeurons;
-        uint32_t outputs = (i == numLayers - 1) ? netArch.outputNeurons : netArch.hiddenNeurons;
+        uint32_t inputs = (i == 0) ? netArch.inputNeurons : netArch.GetHiddenNeurons(i - 1);
+        uint32_t outputs = (i == numLayers - 1) ? netArch.outputNeurons : netArch.GetHiddenNeurons(i);
 
         NetworkLayer layer = {};
         layer.inputs = inputs;
         layer.outputs = outputs;
+        layer.weightPrecision = netArch.GetWeightPrecision(i);
 
         layout.networkLayers.push_back(layer);
     }
 
-    SetNetworkLayerSizes(layout);
+    if (!SetNetworkLayerSizes(layout))
+    {
+        Log(Error, "CreateHostNetworkLayout: Failed to compute the matrix sizes.");
+        return {};
+    }
 
     return layout;
 }
 
 // Set the weight and bias size / offsets for each layer in the network.
-void NetworkUtilities::SetNetworkLayerSizes(NetworkLayout& layout)
+bool NetworkUtilities::SetNetworkLayerSizes(NetworkLayout& layout)
 {
+    bool result = true;
     size_t offset = 0;
     // Calculate size and offsets for the new layout
     for (int i = 0; i < layout.networkLayers.size(); i++)
     {
         NetworkLayer& layer = layout.networkLayers[i];
-        layer.weightSize = m_device->getCoopVecMatrixSize(GetNvrhiDataType(layout.matrixPrecision), GetNvrhiMatrixLayout(layout.matrixLayout), layer.outputs, layer.inputs);
-        layer.biasSize = layer.outputs * GetSize(layout.matrixPrecision);
+        layer.weightSize = m_matrixSizeProvider->GetMatrixSize(layer.weightPrecision, layout.matrixLayout, layer.outputs, layer.inputs);
+        result &= layer.weightSize != 0;
+        layer.biasSize = layer.outputs * GetSize(layout.biasPrecision);
 
         offset = align_to(s_matrixAlignment, offset);
         layer.weightOffset = (uint32_t)offset;
@@ -154,11 +294,12 @@ void NetworkUtilities::SetNetworkLayerSizes(NetworkLayout& layout)
     }
     offset = align_to(s_matrixAlignment, offset);
     layout.networkSize = offset;
+    return result;
 }
 
 // Returns an updated network layout where the weights and bias size / offsets have been update
 // for the new matrix layout..
-// Can be device optimal matrix layout
+// Can be device optimal matrix layout, an empty layout is returned when a matrix size is not known.
 NetworkLayout NetworkUtilities::GetNewMatrixLayout(NetworkLayout const& srcLayout, MatrixLayout newMatrixLayout)
 {
     NetworkLayout newLayout = srcLayout;
@@ -169,14 +310,20 @@ NetworkLayout NetworkUtilities::GetNewMatrixLayout(NetworkLayout const& srcLayou
         return newLayout;
     }
     newLayout.matrixLayout = newMatrixLayout;
-    SetNetworkLayerSizes(newLayout);
+    if (!SetNetworkLayerSizes(newLayout))
+    {
+        Log(Error, "GetNewMatrixLayout: Failed to compute the matrix sizes.");
+        return {};
+    }
     return newLayout;
 }
 
 // Converts weights and bias buffers from src layout to the dst layout.
 // Both buffers must be device side.
 // Both networks must be of the same network layout, only differing in MatrixLayout
-void NetworkUtilities::ConvertWeights(NetworkLayout const& srcLayout,
+// Each layer is converted with its own dimensions and precision, so layers may have different widths.
+// Quantised layers keep their precision and scale, only the floating point precisions can be converted.
+bool NetworkUtilities::ConvertWeights(NetworkLayout const& srcLayout,
                                       NetworkLayout const& dstLayout,
                                       nvrhi::BufferHandle srcBuffer,
                                       uint64_t srcBufferOffset,
@@ -185,7 +332,13 @@ void NetworkUtilities::ConvertWeights(NetworkLayout const& srcLayout,
                                       nvrhi::DeviceHandle device,
                                       nvrhi::CommandListHandle commandList)
 {
-    assert(srcLayout.networkLayers.size() == dstLayout.networkLayers.size());
+    // Empty layouts come from failed layout computations, converting into them would write zero-sized regions
+    if (srcLayout.networkLayers.empty() || srcLayout.networkLayers.size() != dstLayout.networkLayers.size())
+    {
+        Log(Error, "ConvertWeights: network layouts do not match.");
+        return false;
+    }
+    assert(srcLayout.matrixLayout != MatrixLayout::HostPanel && dstLayout.matrixLayout != MatrixLayout::HostPanel && "Use ConvertWeightsHost");
 
     std::vector<nvrhi::coopvec::ConvertMatrixLayoutDesc> convertDescs;
     convertDescs.reserve(srcLayout.networkLayers.size() * 2); // Each layer has weights and biases
@@ -198,6 +351,8 @@ void NetworkUtilities::ConvertWeights(NetworkLayout const& srcLayout,
         assert(srcLayer.inputs == dstLayer.inputs);
         assert(srcLayer.outputs == dstLayer.outputs);
         assert(srcLayer.biasSize == dstLayer.biasSize);
+        assert(srcLayer.weightScale == dstLayer.weightScale);
+        assert(!IsQuantised(srcLayer.weightPrecision) || srcLayer.weightPrecision == dstLayer.weightPrecision);
 
         nvrhi::coopvec::ConvertMatrixLayoutDesc& weightDesc = convertDescs.emplace_back();
 
@@ -206,35 +361,164 @@ void NetworkUtilities::ConvertWeights(NetworkLayout const& srcLayout,
 
         weightDesc.src.buffer = srcBuffer;
         weightDesc.src.offset = srcBufferOffset + srcLayer.weightOffset;
-        weightDesc.src.type = GetNvrhiDataType(srcLayout.matrixPrecision);
+        weightDesc.src.type = GetNvrhiDataType(srcLayer.weightPrecision);
         weightDesc.src.layout = GetNvrhiMatrixLayout(srcLayout.matrixLayout);
         weightDesc.src.size = srcLayer.weightSize;
 
         weightDesc.dst.buffer = dstBuffer;
         weightDesc.dst.offset = dstBufferOffset + dstLayer.weightOffset;
-        weightDesc.dst.type = GetNvrhiDataType(dstLayout.matrixPrecision);
+        weightDesc.dst.type = GetNvrhiDataType(dstLayer.weightPrecision);
         weightDesc.dst.layout = GetNvrhiMatrixLayout(dstLayout.matrixLayout);
         weightDesc.dst.size = dstLayer.weightSize;
 
         nvrhi::coopvec::ConvertMatrixLayoutDesc& biasDesc = convertDescs.emplace_back();
 
         biasDesc.numRows = 1;
-        biasDesc.numColumns = uint32_t(srcLayer.biasSize / GetSize(srcLayout.matrixPrecision));
+        biasDesc.numColumns = uint32_t(srcLayer.biasSize / GetSize(srcLayout.biasPrecision));
 
         biasDesc.src.buffer = srcBuffer;
         biasDesc.src.offset = srcBufferOffset + srcLayer.biasOffset;
-        biasDesc.src.type = GetNvrhiDataType(srcLayout.matrixPrecision);
+        biasDesc.src.type = GetNvrhiDataType(srcLayout.biasPrecision);
         biasDesc.src.layout = nvrhi::coopvec::MatrixLayout::RowMajor;
         biasDesc.src.size = srcLayer.biasSize;
 
         biasDesc.dst.buffer = dstBuffer;
         biasDesc.dst.offset = dstBufferOffset + dstLayer.biasOffset;
-        biasDesc.dst.type = GetNvrhiDataType(dstLayout.matrixPrecision);
+        biasDesc.dst.type = GetNvrhiDataType(dstLayout.biasPrecision);
         biasDesc.dst.layout = nvrhi::coopvec::MatrixLayout::RowMajor;
         biasDesc.dst.size = dstLayer.biasSize;
     }
 
     commandList->convertCoopVecMatrices(convertDescs.data(), convertDescs.size());
+    return true;
+}
+
+// Copy a rows x columns matrix between two host layouts.
+static void ConvertHostMatrix(MatrixLayout srcLayout,
+                              MatrixLayout dstLayout,
+                              const uint8_t* src,
+                              uint8_t* dst,
+                              size_t size,
+                              uint32_t rows,
+                              uint32_t columns,
+                              uint32_t elementSize,
+                              cpu::KernelTable const& kernels)
+{
+    const size_t panelSize = size_t(s_hostPanelRows) * columns * elementSize;
+
+    if (srcLayout == dstLayout)
+    {
+        std::memcpy(dst, src, size);
+    }
+    else if (srcLayout == MatrixLayout::RowMajor && dstLayout == MatrixLayout::ColumnMajor)
+    {
+        kernels.transpose(src, columns, dst, rows, rows, columns, elementSize);
+    }
+    else if (srcLayout == MatrixLayout::ColumnMajor && dstLayout == MatrixLayout::RowMajor)
+    {
+        kernels.transpose(src, rows, dst, columns, columns, rows, elementSize);
+    }
+    else if (srcLayout == MatrixLayout::RowMajor && dstLayout == MatrixLayout::HostPanel)
+    {
+        // Each panel is the transpose of s_hostPanelRows consecutive rows
+        for (uint32_t r = 0; r < rows; r += s_hostPanelRows)
+        {
+            const uint32_t panelRows = std::min(s_hostPanelRows, rows - r);
+            kernels.transpose(src + size_t(r) * columns * elementSize, columns, dst + r / s_hostPanelRows * panelSize, s_hostPanelRows, panelRows, columns, elementSize);
+        }
+    }
+    else if (srcLayout == MatrixLayout::HostPanel && dstLayout == MatrixLayout::RowMajor)
+    {
+        for (uint32_t r = 0; r < rows; r += s_hostPanelRows)
+        {
+            const uint32_t panelRows = std::min(s_hostPanelRows, rows - r);
+            kernels.transpose(src + r / s_hostPanelRows * panelSize, s_hostPanelRows, dst + size_t(r) * columns * elementSize, columns, columns, panelRows, elementSize);
+        }
+    }
+    else
+    {
+        // ColumnMajor <-> HostPanel, every column of a panel is a contiguous run of the column-major matrix
+        const bool toPanel = dstLayout == MatrixLayout::HostPanel;
+        for (uint32_t r = 0; r < rows; r += s_hostPanelRows)
+        {
+            const size_t runSize = size_t(std::min(s_hostPanelRows, rows - r)) * elementSize;
+            for (uint32_t c = 0; c < columns; c++)
+            {
+                const size_t columnMajorOffset = (size_t(c) * rows + r) * elementSize;
+                const size_t panelOffset = r / s_hostPanelRows * panelSize + size_t(c) * s_hostPanelRows * elementSize;
+                if (toPanel)
+                {
+                    std::memcpy(dst + panelOffset, src + columnMajorOffset, runSize);
+                }
+                else
+                {
+                    std::memcpy(dst + columnMajorOffset, src + panelOffset, runSize);
+                }
+            }
+        }
+    }
+}
+
+// Converts weights and bias buffers between host matrix layouts on the CPU.
+// Only the layout of the weights changes, precisions and scales must match. Padding in dst is zeroed.
+bool NetworkUtilities::ConvertWeightsHost(NetworkLayout const& srcLayout, NetworkLayout const& dstLayout, const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize)
+{
+    auto isHostLayout = [](MatrixLayout layout) {
+        return layout == MatrixLayout::RowMajor || layout == MatrixLayout::ColumnMajor || layout == MatrixLayout::HostPanel;
+    };
+    if (!isHostLayout(srcLayout.matrixLayout) || !isHostLayout(dstLayout.matrixLayout))
+    {
+        Log(Error, "ConvertWeightsHost: optimal matrix layouts are opaque and need a device.");
+        return false;
+    }
+
+    if (srcLayout.networkLayers.empty() || srcLayout.networkLayers.size() != dstLayout.networkLayers.size() ||
+        srcLayout.biasPrecision != dstLayout.biasPrecision)
+    {
+        Log(Error, "ConvertWeightsHost: network layouts do not match.");
+        return false;
+    }
+
+    if (srcSize < srcLayout.networkSize || dstSize < dstLayout.networkSize)
+    {
+        Log(Error, "ConvertWeightsHost: parameter buffers are smaller than the network - %d, %d.", int(srcSize), int(dstSize));
+        return false;
+    }
+
+    for (size_t i = 0; i < srcLayout.networkLayers.size(); i++)
+    {
+        const NetworkLayer& srcLayer = srcLayout.networkLayers[i];
+        const NetworkLayer& dstLayer = dstLayout.networkLayers[i];
+        if (srcLayer.inputs != dstLayer.inputs || srcLayer.outputs != dstLayer.outputs || srcLayer.weightPrecision != dstLayer.weightPrecision ||
+            srcLayer.weightScale != dstLayer.weightScale || srcLayer.biasSize != dstLayer.biasSize)
+        {
+            Log(Error, "ConvertWeightsHost: layer %d does not match.", int(i));
+            return false;
+        }
+
+        const auto fits = [](NetworkLayer const& layer, NetworkLayout const& layout) {
+            return layer.weightSize == GetHostMatrixSize(layer.weightPrecision, layout.matrixLayout, layer.outputs, layer.inputs) &&
+                   size_t(layer.weightOffset) + layer.weightSize <= layout.networkSize && size_t(layer.biasOffset) + layer.biasSize <= layout.networkSize;
+        };
+        if (!fits(srcLayer, srcLayout) || !fits(dstLayer, dstLayout))
+        {
+            Log(Error, "ConvertWeightsHost: layer %d sizes do not match the matrix layout.", int(i));
+            return false;
+        }
+    }
+
+    const cpu::KernelTable& kernels = cpu::GetBestKernels();
+    std::memset(dst, 0, dstLayout.networkSize);
+    for (size_t i = 0; i < srcLayout.networkLayers.size(); i++)
+    {
+        const NetworkLayer& srcLayer = srcLayout.networkLayers[i];
+        const NetworkLayer& dstLayer = dstLayout.networkLayers[i];
+
+        ConvertHostMatrix(srcLayout.matrixLayout, dstLayout.matrixLayout, src + srcLayer.weightOffset, dst + dstLayer.weightOffset, srcLayer.weightSize,
+                          srcLayer.outputs, srcLayer.inputs, uint32_t(GetSize(srcLayer.weightPrecision)), kernels);
+        std::memcpy(dst + dstLayer.biasOffset, src + srcLayer.biasOffset, srcLayer.biasSize);
+    }
+    return true;
 }
 
 HostNetwork::HostNetwork(std::shared_ptr<NetworkUtilities> networkUtils) : m_networkUtils(networkUtils)
@@ -244,6 +528,13 @@ HostNetwork::HostNetwork(std::shared_ptr<NetworkUtilities> networkUtils) : m_net
 
 // Create host side network with initial values.
 bool HostNetwork::Initialise(const NetworkArchitecture& netArch)
+{
+    static std::random_device rd;
+    return Initialise(netArch, (uint64_t(rd()) << 32) | rd());
+}
+
+// Create host side network with initial values generated from a seed.
+bool HostNetwork::Initialise(const NetworkArchitecture& netArch, uint64_t seed, cpu::ThreadPool* threadPool)
 {
     m_networkArchitecture = netArch;
     if (!m_networkUtils->ValidateNetworkArchitecture(m_networkArchitecture))
@@ -255,54 +546,120 @@ bool HostNetwork::Initialise(const NetworkArchitecture& netArch)
     // Compute size and offset of each weight matrix and bias vector.
     // These are placed after each other in memory with padding to fulfill the alignment requirements.
     m_networkLayout = m_networkUtils->CreateHostNetworkLayout(m_networkArchitecture);
+    if (m_networkLayout.networkLayers.empty())
+    {
+        return false;
+    }
 
     // Initialize the weight and bias
+    m_mappedFile.reset();
     m_networkParams.clear();
     m_networkParams.resize(m_networkLayout.networkSize, 0);
 
-    static std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_real_distribution<float> dist(-1.0, 1.0); 
-
+    // Every value is drawn from its own Philox counter (element, layer, tensor), so the result only depends on the seed
+    // and not on how the work is split. Weights use a Xavier uniform distribution, quantised layers are scaled so the
+    // distribution bound maps to the largest stored value.
+    struct InitTask
+    {
+        uint32_t layer;
+        uint32_t tensor; ///< 0 for the weights, 1 for the bias.
+        size_t begin;
+        size_t count;
+    };
+    constexpr size_t chunkSize = 4096;
+
+    std::vector<InitTask> tasks;
     for (uint32_t i = 0; i < m_networkLayout.networkLayers.size(); i++)
     {
-        const auto& layer = m_networkLayout.networkLayers[i];
-        std::vector<Eigen::half> weights;
-        weights.resize(size_t(layer.inputs * layer.outputs), Eigen::half(0));
-        std::generate(weights.begin(), weights.end(), [&, k = std::sqrt(6.f / (layer.inputs + layer.outputs))]() { return Eigen::half(dist(gen) * k); });
-        std::memcpy(m_networkParams.data() + layer.weightOffset, weights.data(), layer.weightSize);
+        auto& layer = m_networkLayout.networkLayers[i];
+        if (IsQuantised(layer.weightPrecision))
+        {
+            layer.weightScale = std::sqrt(6.f / (layer.inputs + layer.outputs)) / cpu::GetMaxValue(layer.weightPrecision);
+        }
 
-        std::vector<Eigen::half> bias(layer.outputs);
-        std::generate(bias.begin(), bias.end(), [&, k = std::sqrt(6.f / bias.size())]() { return Eigen::half(dist(gen) * k); });
-        std::memcpy(m_networkParams.data() + layer.biasOffset, bias.data(), layer.biasSize);
+        const size_t counts[2] = { size_t(layer.inputs) * layer.outputs, layer.outputs };
+        for (uint32_t tensor = 0; tensor < 2; tensor++)
+        {
+            for (size_t begin = 0; begin < counts[tensor]; begin += chunkSize)
+            {
+                tasks.push_back({ i, tensor, begin, std::min(chunkSize, counts[tensor] - begin) });
+            }
+        }
+    }
+
+    const cpu::KernelTable& kernels = cpu::GetBestKernels();
+    const cpu::Philox4x32::Key key = cpu::Philox4x32::MakeKey(seed);
+    auto initialise = [&](size_t taskIndex, uint32_t) {
+        const InitTask& task = tasks[taskIndex];
+        const auto& layer = m_networkLayout.networkLayers[task.layer];
+        const float k = task.tensor == 0 ? std::sqrt(6.f / (layer.inputs + layer.outputs)) : std::sqrt(6.f / layer.outputs);
+
+        // chunkSize is a multiple of 4, so every task starts on a counter boundary
+        float values[chunkSize];
+        for (size_t j = 0; j < task.count; j += 4)
+        {
+            const uint64_t block = (task.begin + j) / 4;
+            const cpu::Philox4x32::Counter bits = cpu::Philox4x32::Generate({ uint32_t(block), uint32_t(block >> 32), task.layer, task.tensor }, key);
+            for (size_t b = 0; b < 4 && j + b < task.count; b++)
+            {
+                values[j + b] = cpu::UniformSignedFloat(bits[b]) * k;
+            }
+        }
+
+        const Precision precision = task.tensor == 0 ? layer.weightPrecision : m_networkLayout.biasPrecision;
+        const size_t offset = (task.tensor == 0 ? layer.weightOffset : layer.biasOffset) + task.begin * GetSize(precision);
+        cpu::EncodeParams(precision, values, m_networkParams.data() + offset, task.count, task.tensor == 0 ? layer.weightScale : 1.f, kernels);
+    };
+
+    if (threadPool)
+    {
+        threadPool->ParallelFor(tasks.size(), initialise);
+    }
+    else
+    {
+        for (size_t taskIndex = 0; taskIndex < tasks.size(); taskIndex++)
+        {
+            initialise(taskIndex, 0);
+        }
     }
     return true;
 }
 
 // Create host side network of provided architecture and initial values from a json file.
-bool HostNetwork::InitialiseFromJson(donut::vfs::IFileSystem& fs, const std::string& fileName)
+bool HostNetwork::InitialiseFromJson(donut::vfs::IFileSystem& fs, const std::string& fileName, cpu::ThreadPool* threadPool)
 {
     // loads an inference data set
-    Json::Value js;
-    if (!donut::json::LoadFromFile(fs, fileName, js))
+    std::shared_ptr<donut::vfs::IBlob> blob = fs.readFile(fileName);
+    if (!blob)
     {
         Log(Error, "LoadFromJson: Failed to load input file.");
         return false;
     }
 
-    Json::Value jsonLayers = js["layers"];
+    // Scan the structure first, the parameters are converted straight into the final buffer below.
+    std::vector<NetworkJsonLayer> jsonLayers;
+    if (!ParseNetworkJson(std::string_view(static_cast<const char*>(blob->data()), blob->size()), jsonLayers))
+    {
+        Log(Error, "LoadFromJson: Failed to parse input file.");
+        return false;
+    }
 
     std::vector<int> channels;
     for (const auto& layer : jsonLayers)
     {
         if (channels.empty())
         {
-            channels.push_back(layer["num_inputs"].asInt());
+            channels.push_back(layer.inputs);
         }
-        channels.push_back(layer["num_outputs"].asInt());
+        else if (channels.back() != int(layer.inputs))
+        {
+            Log(Error, "LoadFromJson: layer %d has %d inputs, the previous layer has %d outputs.", int(channels.size() - 1), layer.inputs, channels.back());
+            return false;
+        }
+        channels.push_back(layer.outputs);
     }
 
-    uint32_t numLayers = (uint32_t)channels.size() - 1;
+    uint32_t numLayers = channels.empty() ? 0 : (uint32_t)channels.size() - 1;
 
     if (numLayers > MAX_SUPPORTED_LAYERS)
     {
@@ -319,44 +676,40 @@ bool HostNetwork::InitialiseFromJson(donut::vfs::IFileSystem& fs, const std::str
     m_networkArchitecture.biasPrecision = Precision::F16;
     m_networkArchitecture.weightPrecision = Precision::F16;
     m_networkArchitecture.inputNeurons = channels[0];
-    m_networkArchitecture.hiddenNeurons = channels[1]; // TOD0 Validate - we currently only support same size hidden layers
+    m_networkArchitecture.hiddenNeurons = channels[1];
     m_networkArchitecture.outputNeurons = channels[channels.size() - 1];
     m_networkArchitecture.numHiddenLayers = numLayers - 1;
+    m_networkArchitecture.hiddenLayerNeurons.clear();
+    m_networkArchitecture.layerWeightPrecisions.clear();
+    if (std::any_of(channels.begin() + 2, channels.end() - 1, [&](int width) { return width != channels[1]; }))
+    {
+        m_networkArchitecture.hiddenLayerNeurons.assign(channels.begin() + 1, channels.end() - 1);
+    }
 
     m_networkLayout = m_networkUtils->CreateHostNetworkLayout(m_networkArchitecture);
+    if (m_networkLayout.networkLayers.empty())
+    {
+        return false;
+    }
 
-    // Copy weights and biases into host side format, stored contiguously in one buffer.
+    // Convert weights and biases into host side format, stored contiguously in one buffer.
+    m_mappedFile.reset();
     m_networkParams.clear();
     m_networkParams.resize(m_networkLayout.networkSize, 0);
 
-    for (uint32_t ii = 0; ii < numLayers; ii++)
-    {
-        const NetworkLayer& layer = m_networkLayout.networkLayers[ii];
-
-        // Copy weights into host layout.
-        Json::Value jWeights = jsonLayers[ii]["weights"];
-
-        assert(jWeights.size() == layer.inputs * layer.outputs && "Unexpected number of weights");
-
-        std::vector<Eigen::half> weights16(jWeights.size());
-        transform(jWeights.begin(), jWeights.end(), weights16.begin(), [](const auto& e) { return Eigen::half(e.asFloat()); });
-        std::memcpy(m_networkParams.data() + layer.weightOffset, weights16.data(), layer.weightSize);
-
-        // Copy biases into host layout.
-        Json::Value jBiases = jsonLayers[ii]["biases"];
-        assert(jBiases.size() == layer.outputs && "Unexpected number of biases");
-
-        std::vector<Eigen::half> bias16(jBiases.size());
-        transform(jBiases.begin(), jBiases.end(), bias16.begin(), [](const auto& e) { return Eigen::half(e.asFloat()); });
-        std::memcpy(m_networkParams.data() + layer.biasOffset, bias16.data(), layer.biasSize);
-    }
-
-    return true;
+    return LoadNetworkJsonParams(jsonLayers, m_networkLayout, m_networkParams.data(), threadPool);
 }
 
 // Create host side network of provided architecture and initial values from a json file.
 bool HostNetwork::InitialiseFromFile(const std::string& fileName)
 {
+    if (IsNetworkFileV2(fileName))
+    {
+        auto mappedFile = std::make_shared<MappedNetworkFile>();
+        return mappedFile->Open(fileName) && InitialiseFromMappedFile(mappedFile);
+    }
+
+    // Version 1 file, raw header followed by the parameters
     std::ifstream file(fileName, std::ios::binary);
     if (file.is_open())
     {
@@ -367,22 +720,41 @@ bool HostNetwork::InitialiseFromFile(const std::string& fileName)
             Log(Error, "Invalid file header");
             return false;
         }
-        if (!m_networkUtils->ValidateNetworkArchitecture(header.netArch))
+        NetworkArchitecture netArch;
+        netArch.numHiddenLayers = header.netArch.numHiddenLayers;
+        netArch.inputNeurons = header.netArch.inputNeurons;
+        netArch.hiddenNeurons = header.netArch.hiddenNeurons;
+        netArch.outputNeurons = header.netArch.outputNeurons;
+        netArch.weightPrecision = header.netArch.weightPrecision;
+        netArch.biasPrecision = header.netArch.biasPrecision;
+
+        if (!m_networkUtils->ValidateNetworkArchitecture(netArch))
         {
             Log(Error, "LoadFromFile: Failed to validate network.");
             return false;
         }
 
-        m_networkArchitecture = header.netArch;
+        m_networkArchitecture = netArch;
         m_networkLayout.matrixLayout = header.layout;
         m_networkLayout.matrixPrecision = header.netArch.weightPrecision;
+        m_networkLayout.biasPrecision = header.netArch.biasPrecision;
 
         m_networkLayout.networkLayers.clear();
         for (uint32_t ii = 0; ii < m_networkArchitecture.numHiddenLayers + 1; ii++)
         {
-            m_networkLayout.networkLayers.push_back(header.layers[ii]);
+            const NetworkLayerV1& src = header.layers[ii];
+            NetworkLayer& layer = m_networkLayout.networkLayers.emplace_back();
+            layer.inputs = src.inputs;
+            layer.outputs = src.outputs;
+            layer.weightSize = src.weightSize;
+            layer.biasSize = src.biasSize;
+            layer.weightOffset = src.weightOffset;
+            layer.biasOffset = src.biasOffset;
+            layer.weightPrecision = header.netArch.weightPrecision;
         }
 
+        m_networkLayout.networkSize = header.dataSize;
+        m_mappedFile.reset();
         m_networkParams.resize(header.dataSize);
 
         file.read(reinterpret_cast<char*>(m_networkParams.data()), header.dataSize);
@@ -393,6 +765,27 @@ bool HostNetwork::InitialiseFromFile(const std::string& fileName)
     return false;
 }
 
+// Create host side network from a memory mapped network file.
+bool HostNetwork::InitialiseFromMappedFile(std::shared_ptr<const MappedNetworkFile> file)
+{
+    if (!file || !file->IsOpen())
+    {
+        Log(Error, "LoadFromFile: file is not open.");
+        return false;
+    }
+    if (!m_networkUtils->ValidateNetworkArchitecture(file->GetNetworkArchitecture()))
+    {
+        Log(Error, "LoadFromFile: Failed to validate network.");
+        return false;
+    }
+
+    m_networkArchitecture = file->GetNetworkArchitecture();
+    m_networkLayout = file->GetNetworkLayout();
+    m_networkParams.clear();
+    m_mappedFile = std::move(file);
+    return true;
+}
+
 // Create host side network from an existing network.
 bool HostNetwork::InitialiseFromNetwork(HostNetwork const& network)
 {
@@ -406,30 +799,61 @@ bool HostNetwork::InitialiseFromNetwork(HostNetwork const& network)
     return true;
 }
 
+// Create host side network from parameters laid out as layout.
+bool HostNetwork::InitialiseFromParams(const NetworkArchitecture& netArch, NetworkLayout const& layout, const uint8_t* params, size_t size)
+{
+    if (!m_networkUtils->ValidateNetworkArchitecture(netArch))
+    {
+        Log(Error, "InitialiseFromParams: Failed to validate network.");
+        return false;
+    }
+    if (layout.networkLayers.size() != netArch.numHiddenLayers + 1 || size != layout.networkSize)
+    {
+        Log(Error, "InitialiseFromParams: layout does not match the network architecture.");
+        return false;
+    }
+
+    m_networkArchitecture = netArch;
+    m_networkLayout = layout;
+    m_mappedFile.reset();
+    m_networkParams.assign(params, params + size);
+    return true;
+}
+
+std::span<const uint8_t> HostNetwork::GetNetworkParams() const
+{
+    if (m_mappedFile)
+    {
+        return { m_mappedFile->GetNetworkParams(), m_mappedFile->GetNetworkParamsSize() };
+    }
+    return m_networkParams;
+}
+
+// Replace the parameters with data laid out as the current network layout.
+bool HostNetwork::UpdateNetworkParams(const uint8_t* data, size_t size)
+{
+    const size_t paramsSize = GetNetworkParams().size();
+    if (size != paramsSize)
+    {
+        Log(Error, "UpdateNetworkParams: expected %d bytes of parameters, got %d.", int(paramsSize), int(size));
+        return false;
+    }
+    m_mappedFile.reset();
+    m_networkParams.assign(data, data + size);
+    return true;
+}
+
 // Write the current network and parameters to file.
 bool HostNetwork::WriteToFile(const std::string& fileName)
 {
-    // Write the buffer data to a file
-    std::ofstream file(fileName, std::ios::binary);
-    if (file.is_open())
+    // Writing may truncate the mapped file, take the parameters out of it first
+    if (m_mappedFile)
     {
-        NetworkFileHeader header;
-        header.version = HEADER_VERSION;
-        header.netArch = m_networkArchitecture;
-        header.layout = m_networkLayout.matrixLayout;
-
-        for (uint32_t ii = 0; ii < m_networkLayout.networkLayers.size(); ii++)
-        {
-            header.layers[ii] = m_networkLayout.networkLayers[ii];
-        }
-        header.dataSize = m_networkParams.size();
-        file.write(reinterpret_cast<char*>(&header), sizeof(header));
-        file.write(reinterpret_cast<char*>(m_networkParams.data()), m_networkParams.size());
-        file.close();
-        return true;
+        const std::span<const uint8_t> params = GetNetworkParams();
+        m_networkParams.assign(params.begin(), params.end());
+        m_mappedFile.reset();
     }
-    Log(Error, "Failed to open the file for writing!");
-    return false;
+    return WriteNetworkFile(fileName, m_networkArchitecture, m_networkLayout, m_networkParams.data(), m_networkParams.size());
 }
 
 // Convert device layout to host layout and update the host side parameters.
@@ -480,6 +904,7 @@ void HostNetwork::UpdateFromBufferToFile(nvrhi::BufferHandle hostLayoutBuffer,
 
     // The buffer size should match the current parameters size
     // if not the layout may have changed
+    m_mappedFile.reset();
     if (m_networkParams.size() != bufferSize)
     {
         m_networkParams.resize(bufferSize);
@@ -1,5 +1,10 @@
 #pragma once
 
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <span>
+#include <tuple>
 #include <vector>
 #include <nvrhi/utils.h>
 
@@ -8,18 +13,28 @@
 
 NAMESPACE_BEGIN(fluxel)
 
+class MappedNetworkFile;
+
+NAMESPACE_BEGIN(cpu)
+class ThreadPool;
+NAMESPACE_END(cpu)
+
 enum class MatrixLayout
 {
     RowMajor,
     ColumnMajor,
     InferencingOptimal,
     TrainingOptimal,
+    HostPanel, ///< Cache blocked host layout, see s_hostPanelRows. Not understood by devices.
 };
 
 enum class Precision
 {
     F16,
-    F32
+    F32,
+    BF16,
+    F8E4M3, ///< FP8 with 4 exponent and 3 mantissa bits, finite only with a maximum of 448.
+    I8, ///< Signed 8 bit integers in [-127, 127].
 };
 
 struct NetworkArchitecture
@@ -30,6 +45,18 @@ struct NetworkArchitecture
     uint32_t outputNeurons = 0;
     Precision weightPrecision = Precision::F16;
     Precision biasPrecision = Precision::F16;
+    std::vector<uint32_t> hiddenLayerNeurons; ///< Width of each hidden layer, every hidden layer is hiddenNeurons wide when empty.
+    std::vector<Precision> layerWeightPrecisions; ///< Weight precision of each layer, every layer uses weightPrecision when empty.
+
+    uint32_t GetHiddenNeurons(uint32_t hiddenLayer) const
+    {
+        return hiddenLayerNeurons.empty() ? hiddenNeurons : hiddenLayerNeurons[hiddenLayer];
+    }
+
+    Precision GetWeightPrecision(uint32_t layer) const
+    {
+        return layerWeightPrecisions.empty() ? weightPrecision : layerWeightPrecisions[layer];
+    }
 };
 
 struct NetworkLayer
@@ -40,12 +67,15 @@ struct NetworkLayer
     size_t biasSize = 0; ///< Size of the bias vector in bytes.
     uint32_t weightOffset = 0; ///< Offset to the weights in bytes.
     uint32_t biasOffset = 0; ///< Offset to the biases in bytes.
+    Precision weightPrecision = Precision::F16; ///< Precision of the weight matrix.
+    float weightScale = 1.f; ///< Stored weights are multiplied by this to get the real weights, only used by quantised precisions.
 };
 
 struct NetworkLayout
 {
     MatrixLayout matrixLayout = MatrixLayout::RowMajor;
-    Precision matrixPrecision = Precision::F16;
+    Precision matrixPrecision = Precision::F16; ///< Network weight precision, layers may override it in NetworkLayer::weightPrecision.
+    Precision biasPrecision = Precision::F16;
     size_t networkSize = 0;
     std::vector<NetworkLayer> networkLayers;
 };
@@ -58,36 +88,129 @@ constexpr size_t GetSize(Precision precision)
         return sizeof(uint16_t); // 2 bytes
     case Precision::F32:
         return sizeof(float);
+    case Precision::BF16:
+        return sizeof(uint16_t);
+    case Precision::F8E4M3:
+    case Precision::I8:
+        return sizeof(uint8_t);
     default:
         return 0; // Should not get here
     }
 }
 
+// Rows per panel of MatrixLayout::HostPanel. Each panel stores its rows transposed as [columns][s_hostPanelRows],
+// the last panel is zero padded. This is the block of weights the CPU kernels consume per step.
+constexpr uint32_t s_hostPanelRows = 16;
+
+// Size in bytes of a matrix in one of the host layouts, 0 for the device optimal layouts.
+constexpr size_t GetHostMatrixSize(Precision precision, MatrixLayout layout, uint32_t rows, uint32_t columns)
+{
+    switch (layout)
+    {
+    case MatrixLayout::RowMajor:
+    case MatrixLayout::ColumnMajor:
+        return size_t(rows) * columns * GetSize(precision);
+    case MatrixLayout::HostPanel:
+        return size_t(rows + s_hostPanelRows - 1) / s_hostPanelRows * s_hostPanelRows * columns * GetSize(precision);
+    default:
+        return 0;
+    }
+}
+
+// Index of the element (row, column) of a matrix in one of the host layouts.
+constexpr size_t GetHostMatrixIndex(MatrixLayout layout, uint32_t rows, uint32_t columns, uint32_t row, uint32_t column)
+{
+    switch (layout)
+    {
+    case MatrixLayout::ColumnMajor:
+        return size_t(column) * rows + row;
+    case MatrixLayout::HostPanel:
+        return (size_t(row / s_hostPanelRows) * columns + column) * s_hostPanelRows + row % s_hostPanelRows;
+    default:
+        return size_t(row) * columns + column;
+    }
+}
+
+// Quantised precisions store the weights divided by a per layer scale, see NetworkLayer::weightScale.
+constexpr bool IsQuantised(Precision precision)
+{
+    return precision == Precision::F8E4M3 || precision == Precision::I8;
+}
+
+// Provides the size in bytes of weight matrices.
+// The size of the optimal layouts is implementation defined, the other layouts are tightly packed.
+class IMatrixSizeProvider
+{
+public:
+    virtual ~IMatrixSizeProvider() = default;
+
+    // Size of a rows x columns matrix, 0 when it is not known.
+    virtual size_t GetMatrixSize(Precision precision, MatrixLayout layout, uint32_t rows, uint32_t columns) = 0;
+};
+
+// Device independent matrix sizes.
+// RowMajor and ColumnMajor sizes are computed, the optimal layout sizes are looked up in a table
+// that has to be filled beforehand, for example from sizes recorded on a device.
+class HostMatrixSizeProvider : public IMatrixSizeProvider
+{
+public:
+    size_t GetMatrixSize(Precision precision, MatrixLayout layout, uint32_t rows, uint32_t columns) override;
+
+    // Register the size of a matrix in one of the optimal layouts.
+    void SetOptimalMatrixSize(Precision precision, MatrixLayout layout, uint32_t rows, uint32_t columns, size_t size);
+
+    // Register the optimal sizes of every layer of a layout.
+    void SetOptimalMatrixSizes(NetworkLayout const& layout);
+
+private:
+    std::map<std::tuple<Precision, MatrixLayout, uint32_t, uint32_t>, size_t> m_optimalSizes;
+};
+
+// Matrix sizes queried from a device, queries are cached.
+class DeviceMatrixSizeProvider : public IMatrixSizeProvider
+{
+public:
+    DeviceMatrixSizeProvider(nvrhi::DeviceHandle device);
+
+    size_t GetMatrixSize(Precision precision, MatrixLayout layout, uint32_t rows, uint32_t columns) override;
+
+private:
+    nvrhi::DeviceHandle m_device;
+    std::map<std::tuple<Precision, MatrixLayout, uint32_t, uint32_t>, size_t> m_sizes;
+};
+
 class NetworkUtilities
 {
 public:
+    // Matrix sizes are queried from the device, a null device uses a HostMatrixSizeProvider.
     NetworkUtilities(nvrhi::DeviceHandle device);
+    NetworkUtilities(std::nullptr_t);
+    // Device independent, layouts can be created and networks loaded without a device.
+    NetworkUtilities();
+    explicit NetworkUtilities(std::shared_ptr<IMatrixSizeProvider> matrixSizeProvider);
     ~NetworkUtilities()
     {
     }
 
     bool ValidateNetworkArchitecture(NetworkArchitecture const& netArch);
 
-    // Create host side network layout.
+    // Create host side network layout, empty when the size of a matrix is not known.
     NetworkLayout CreateHostNetworkLayout(NetworkArchitecture const& netArch);
 
     // Set the weights and bias size / offsets for each layer in the network.
-    void SetNetworkLayerSizes(NetworkLayout& layout);
+    // Fails when the size of a matrix in the layout is not known.
+    bool SetNetworkLayerSizes(NetworkLayout& layout);
 
     // Returns a updated network layout where the weights and bias size / offsets have been update
     // for the new matrix layout
-    // Can be device optimal matrix layout
+    // Can be device optimal matrix layout, the layout is empty when the size of a matrix is not known.
     NetworkLayout GetNewMatrixLayout(NetworkLayout const& srcLayout, MatrixLayout newMatrixLayout);
 
     // Converts weights and bias buffers from src layout to the dst layout.
     // Both buffers must be device side.
     // Both networks must be of the same network layout, only differing in MatrixLayout
-    void ConvertWeights(NetworkLayout const& srcLayout,
+    // Fails without recording any conversion for empty or mismatching layouts.
+    bool ConvertWeights(NetworkLayout const& srcLayout,
                         NetworkLayout const& dstLayout,
                         nvrhi::BufferHandle srcBuffer,
                         uint64_t srcBufferOffset,
@@ -96,8 +219,18 @@ public:
                         nvrhi::DeviceHandle device,
                         nvrhi::CommandListHandle commandList);
 
+    // Converts weights and bias buffers between the host matrix layouts (RowMajor, ColumnMajor and HostPanel) without a device.
+    // Both networks must be of the same network layout and precisions, only differing in MatrixLayout.
+    // src and dst hold the complete parameter buffers of srcLayout and dstLayout.
+    bool ConvertWeightsHost(NetworkLayout const& srcLayout, NetworkLayout const& dstLayout, const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize);
+
+    IMatrixSizeProvider& GetMatrixSizeProvider() const
+    {
+        return *m_matrixSizeProvider;
+    }
+
 private:
-    nvrhi::DeviceHandle m_device;
+    std::shared_ptr<IMatrixSizeProvider> m_matrixSizeProvider;
 };
 
 // Represent a host side neural network.
@@ -112,16 +245,31 @@ public:
 
     // Create host side network from provided architecture with initial values.
     bool Initialise(const NetworkArchitecture& netArch);
+    // Create host side network from provided architecture with initial values generated from seed.
+    // The values are bitwise identical for a given seed, with or without a thread pool.
+    bool Initialise(const NetworkArchitecture& netArch, uint64_t seed, cpu::ThreadPool* threadPool = nullptr);
 
     // Create host side network of provided architecture and initial values from a json file.
-    bool InitialiseFromJson(donut::vfs::IFileSystem& fs, const std::string& fileName);
+    // The parameters are converted in a single pass into the parameter buffer, layers are converted in parallel
+    // when a thread pool is provided.
+    bool InitialiseFromJson(donut::vfs::IFileSystem& fs, const std::string& fileName, cpu::ThreadPool* threadPool = nullptr);
     // Create host side network of provided architecture and initial values from a file.
+    // Reads both the version 2 format written by WriteToFile and the legacy version 1 format.
+    // Version 2 files are memory mapped, the network keeps the mapping and uses the parameters in place.
     bool InitialiseFromFile(const std::string& fileName);
+    // Create host side network from a memory mapped network file without copying the parameters.
+    // The network shares the mapping until its parameters are replaced.
+    bool InitialiseFromMappedFile(std::shared_ptr<const MappedNetworkFile> file);
     // Create host side network from an existing network.
     bool InitialiseFromNetwork(HostNetwork const& network);
-    // Write the current network and parameters to file.
+    // Create host side network from parameters laid out as layout, for example the output of a conversion.
+    bool InitialiseFromParams(const NetworkArchitecture& netArch, NetworkLayout const& layout, const uint8_t* params, size_t size);
+    // Replace the parameters with data laid out as the current network layout.
+    bool UpdateNetworkParams(const uint8_t* data, size_t size);
+    // Write the current network and parameters to file in the version 2 format, see NetworkFile.h.
     bool WriteToFile(const std::string& fileName);
     // Convert device layout to host layout and update the host side parameters.
+    // Waits for the device and the file write, use a CheckpointWriter for periodic checkpoints.
     void UpdateFromBufferToFile(nvrhi::BufferHandle hostLayoutBuffer,
                                 nvrhi::BufferHandle deviceLayoutBuffer,
                                 NetworkLayout const& hostLayout,
@@ -135,10 +283,8 @@ public:
         return m_networkArchitecture;
     }
 
-    const std::vector<uint8_t>& GetNetworkParams() const
-    {
-        return m_networkParams;
-    }
+    // Parameters laid out as GetNetworkLayout(), in the mapped file for networks initialised from one.
+    std::span<const uint8_t> GetNetworkParams() const;
 
     const NetworkLayout& GetNetworkLayout() const
     {
@@ -149,6 +295,7 @@ private:
     std::shared_ptr<NetworkUtilities> m_networkUtils;
     NetworkArchitecture m_networkArchitecture;
     std::vector<uint8_t> m_networkParams;
+    std::shared_ptr<const MappedNetworkFile> m_mappedFile; ///< Holds the parameters instead of m_networkParams when set.
     NetworkLayout m_networkLayout;
 };
 
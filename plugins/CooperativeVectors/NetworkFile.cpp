@@ -0,0 +1,363 @@
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "NetworkFile.h"
+#include "Logger.h"
+
+NAMESPACE_BEGIN(fluxel)
+
+namespace
+{
+constexpr uint8_t s_magic[4] = { 'F', 'X', 'N', 'W' };
+constexpr uint32_t s_headerSize = 64;
+constexpr uint32_t s_tensorEntrySize = 48;
+constexpr uint32_t s_tensorEntrySizeNoPrecision = 40; ///< Entries written before per layer precisions, all layers use the header precision.
+constexpr uint32_t s_maxLayers = 1024; ///< Sanity limit for the tensor table, not a format limit.
+
+void WriteU32(uint8_t* dst, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        dst[i] = uint8_t(value >> (8 * i));
+    }
+}
+
+void WriteU64(uint8_t* dst, uint64_t value)
+{
+    for (int i = 0; i < 8; i++)
+    {
+        dst[i] = uint8_t(value >> (8 * i));
+    }
+}
+
+uint32_t ReadU32(const uint8_t* src)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        value |= uint32_t(src[i]) << (8 * i);
+    }
+    return value;
+}
+
+uint64_t ReadU64(const uint8_t* src)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        value |= uint64_t(src[i]) << (8 * i);
+    }
+    return value;
+}
+
+size_t GetPayloadOffset(size_t layerCount, size_t entrySize = s_tensorEntrySize)
+{
+    const size_t tableEnd = s_headerSize + layerCount * entrySize;
+    return (tableEnd + s_networkFilePayloadAlignment - 1) / s_networkFilePayloadAlignment * s_networkFilePayloadAlignment;
+}
+} // namespace
+
+bool WriteNetworkFile(const std::string& fileName, NetworkArchitecture const& netArch, NetworkLayout const& layout, const uint8_t* params, size_t paramsSize)
+{
+    if constexpr (std::endian::native != std::endian::little)
+    {
+        Log(Error, "WriteNetworkFile: parameters are stored little-endian, big-endian hosts are not supported.");
+        return false;
+    }
+
+    const size_t layerCount = layout.networkLayers.size();
+    const size_t payloadOffset = GetPayloadOffset(layerCount);
+
+    // Header, tensor table and padding up to the payload
+    std::vector<uint8_t> header(payloadOffset, 0);
+    uint8_t* h = header.data();
+    std::memcpy(h, s_magic, sizeof(s_magic));
+    WriteU32(h + 4, s_networkFileVersion);
+    WriteU32(h + 8, s_headerSize);
+    WriteU32(h + 12, s_tensorEntrySize);
+    WriteU32(h + 16, uint32_t(layerCount));
+    WriteU32(h + 20, uint32_t(layout.matrixLayout));
+    WriteU32(h + 24, uint32_t(layout.matrixPrecision));
+    WriteU32(h + 28, uint32_t(netArch.weightPrecision));
+    WriteU32(h + 32, uint32_t(netArch.biasPrecision));
+    WriteU32(h + 36, netArch.numHiddenLayers);
+    WriteU32(h + 40, netArch.inputNeurons);
+    WriteU32(h + 44, netArch.hiddenNeurons);
+    WriteU32(h + 48, netArch.outputNeurons);
+    WriteU32(h + 52, 0); // Reserved
+    WriteU64(h + 56, paramsSize);
+
+    for (size_t i = 0; i < layerCount; i++)
+    {
+        const NetworkLayer& layer = layout.networkLayers[i];
+        uint8_t* entry = h + s_headerSize + i * s_tensorEntrySize;
+        WriteU32(entry, layer.inputs);
+        WriteU32(entry + 4, layer.outputs);
+        WriteU64(entry + 8, layer.weightOffset);
+        WriteU64(entry + 16, layer.weightSize);
+        WriteU64(entry + 24, layer.biasOffset);
+        WriteU64(entry + 32, layer.biasSize);
+        WriteU32(entry + 40, uint32_t(layer.weightPrecision));
+        WriteU32(entry + 44, std::bit_cast<uint32_t>(layer.weightScale));
+    }
+
+    std::ofstream file(fileName, std::ios::binary);
+    if (!file.is_open())
+    {
+        Log(Error, "WriteNetworkFile: Failed to open %s for writing.", fileName.c_str());
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(header.data()), header.size());
+    file.write(reinterpret_cast<const char*>(params), paramsSize);
+    return file.good();
+}
+
+bool IsNetworkFileV2(const std::string& fileName)
+{
+    std::ifstream file(fileName, std::ios::binary);
+    uint8_t magic[sizeof(s_magic)] = {};
+    file.read(reinterpret_cast<char*>(magic), sizeof(magic));
+    return file.good() && std::memcmp(magic, s_magic, sizeof(s_magic)) == 0;
+}
+
+MappedNetworkFile::~MappedNetworkFile()
+{
+    Close();
+}
+
+bool MappedNetworkFile::Open(const std::string& fileName)
+{
+    Close();
+
+    if constexpr (std::endian::native != std::endian::little)
+    {
+        Log(Error, "MappedNetworkFile: parameters are stored little-endian, big-endian hosts are not supported.");
+        return false;
+    }
+
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        Log(Error, "MappedNetworkFile: File not found %s", fileName.c_str());
+        return false;
+    }
+    m_fileHandle = file;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+    {
+        Log(Error, "MappedNetworkFile: Failed to read the size of %s", fileName.c_str());
+        Close();
+        return false;
+    }
+
+    m_mappingHandle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    const void* view = m_mappingHandle ? MapViewOfFile(m_mappingHandle, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!view)
+    {
+        Log(Error, "MappedNetworkFile: Failed to map %s", fileName.c_str());
+        Close();
+        return false;
+    }
+    m_data = static_cast<const uint8_t*>(view);
+    m_size = size_t(fileSize.QuadPart);
+#else
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        Log(Error, "MappedNetworkFile: File not found %s", fileName.c_str());
+        return false;
+    }
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0)
+    {
+        Log(Error, "MappedNetworkFile: Failed to read the size of %s", fileName.c_str());
+        close(fd);
+        return false;
+    }
+
+    // The mapping keeps its own reference to the file
+    void* view = mmap(nullptr, size_t(fileStat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED)
+    {
+        Log(Error, "MappedNetworkFile: Failed to map %s", fileName.c_str());
+        return false;
+    }
+    m_data = static_cast<const uint8_t*>(view);
+    m_size = size_t(fileStat.st_size);
+#endif
+
+    if (!ParseHeader(fileName))
+    {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void MappedNetworkFile::Close()
+{
+#if defined(_WIN32)
+    if (m_data)
+    {
+        UnmapViewOfFile(m_data);
+    }
+    if (m_mappingHandle)
+    {
+        CloseHandle(m_mappingHandle);
+    }
+    if (m_fileHandle)
+    {
+        CloseHandle(m_fileHandle);
+    }
+    m_mappingHandle = nullptr;
+    m_fileHandle = nullptr;
+#else
+    if (m_data)
+    {
+        munmap(const_cast<uint8_t*>(m_data), m_size);
+    }
+#endif
+    m_data = nullptr;
+    m_size = 0;
+    m_params = nullptr;
+    m_networkArchitecture = {};
+    m_networkLayout = {};
+}
+
+bool MappedNetworkFile::ParseHeader(const std::string& fileName)
+{
+    if (m_size < s_headerSize || std::memcmp(m_data, s_magic, sizeof(s_magic)) != 0)
+    {
+        Log(Error, "MappedNetworkFile: %s is not a network file.", fileName.c_str());
+        return false;
+    }
+
+    const uint8_t* h = m_data;
+    const uint32_t version = ReadU32(h + 4);
+    const uint32_t headerSize = ReadU32(h + 8);
+    const uint32_t entrySize = ReadU32(h + 12);
+    const uint32_t layerCount = ReadU32(h + 16);
+    const uint32_t matrixLayout = ReadU32(h + 20);
+    const uint32_t matrixPrecision = ReadU32(h + 24);
+    const uint32_t weightPrecision = ReadU32(h + 28);
+    const uint32_t biasPrecision = ReadU32(h + 32);
+    const uint64_t payloadSize = ReadU64(h + 56);
+
+    if (version != s_networkFileVersion || headerSize != s_headerSize || (entrySize != s_tensorEntrySize && entrySize != s_tensorEntrySizeNoPrecision))
+    {
+        Log(Error, "MappedNetworkFile: unsupported file version %d in %s.", version, fileName.c_str());
+        return false;
+    }
+
+    const uint32_t numHiddenLayers = ReadU32(h + 36);
+    if (layerCount == 0 || layerCount > s_maxLayers || numHiddenLayers + 1 != layerCount || matrixLayout > uint32_t(MatrixLayout::HostPanel) ||
+        matrixPrecision > uint32_t(Precision::I8) || weightPrecision > uint32_t(Precision::I8) || biasPrecision > uint32_t(Precision::I8))
+    {
+        Log(Error, "MappedNetworkFile: invalid header in %s.", fileName.c_str());
+        return false;
+    }
+
+    const size_t payloadOffset = GetPayloadOffset(layerCount, entrySize);
+    if (payloadOffset > m_size || payloadSize > m_size - payloadOffset)
+    {
+        Log(Error, "MappedNetworkFile: %s is truncated.", fileName.c_str());
+        return false;
+    }
+
+    m_networkArchitecture.numHiddenLayers = numHiddenLayers;
+    m_networkArchitecture.inputNeurons = ReadU32(h + 40);
+    m_networkArchitecture.hiddenNeurons = ReadU32(h + 44);
+    m_networkArchitecture.outputNeurons = ReadU32(h + 48);
+    m_networkArchitecture.weightPrecision = Precision(weightPrecision);
+    m_networkArchitecture.biasPrecision = Precision(biasPrecision);
+
+    m_networkLayout.matrixLayout = MatrixLayout(matrixLayout);
+    m_networkLayout.matrixPrecision = Precision(matrixPrecision);
+    m_networkLayout.biasPrecision = Precision(biasPrecision);
+    m_networkLayout.networkSize = size_t(payloadSize);
+    m_networkLayout.networkLayers.resize(layerCount);
+
+    for (uint32_t i = 0; i < layerCount; i++)
+    {
+        const uint8_t* entry = h + s_headerSize + size_t(i) * entrySize;
+        const uint64_t weightOffset = ReadU64(entry + 8);
+        const uint64_t weightSize = ReadU64(entry + 16);
+        const uint64_t biasOffset = ReadU64(entry + 24);
+        const uint64_t biasSize = ReadU64(entry + 32);
+
+        if (weightOffset > payloadSize || weightSize > payloadSize - weightOffset || biasOffset > payloadSize || biasSize > payloadSize - biasOffset)
+        {
+            Log(Error, "MappedNetworkFile: layer %d is out of range in %s.", i, fileName.c_str());
+            return false;
+        }
+
+        NetworkLayer& layer = m_networkLayout.networkLayers[i];
+        layer.inputs = ReadU32(entry);
+        layer.outputs = ReadU32(entry + 4);
+        layer.weightOffset = uint32_t(weightOffset);
+        layer.weightSize = size_t(weightSize);
+        layer.biasOffset = uint32_t(biasOffset);
+        layer.biasSize = size_t(biasSize);
+        layer.weightPrecision = Precision(matrixPrecision);
+
+        if (entrySize >= s_tensorEntrySize)
+        {
+            const uint32_t layerPrecision = ReadU32(entry + 40);
+            const float weightScale = std::bit_cast<float>(ReadU32(entry + 44));
+            if (layerPrecision > uint32_t(Precision::I8) || !(weightScale > 0.f))
+            {
+                Log(Error, "MappedNetworkFile: layer %d has an invalid precision in %s.", i, fileName.c_str());
+                return false;
+            }
+            layer.weightPrecision = Precision(layerPrecision);
+            layer.weightScale = weightScale;
+        }
+
+        if (layer.weightPrecision != m_networkArchitecture.weightPrecision)
+        {
+            m_networkArchitecture.layerWeightPrecisions.resize(layerCount, m_networkArchitecture.weightPrecision);
+        }
+    }
+
+    // Per layer weight precisions are recovered from the tensor table
+    for (uint32_t i = 0; i < m_networkArchitecture.layerWeightPrecisions.size(); i++)
+    {
+        m_networkArchitecture.layerWeightPrecisions[i] = m_networkLayout.networkLayers[i].weightPrecision;
+    }
+
+    // Per layer hidden widths are recovered from the tensor table
+    for (uint32_t i = 0; i + 1 < layerCount; i++)
+    {
+        if (m_networkLayout.networkLayers[i].outputs != m_networkArchitecture.hiddenNeurons)
+        {
+            m_networkArchitecture.hiddenLayerNeurons.resize(layerCount - 1);
+            for (uint32_t j = 0; j + 1 < layerCount; j++)
+            {
+                m_networkArchitecture.hiddenLayerNeurons[j] = m_networkLayout.networkLayers[j].outputs;
+            }
+            break;
+        }
+    }
+
+    m_params = m_data + payloadOffset;
+    return true;
+}
+
+NAMESPACE_END(fluxel)
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <string>
+
+#include "Fluxel.h"
+#include "Network.h"
+
+NAMESPACE_BEGIN(fluxel)
+
+// Version 2 network file format.
+// All header fields are little-endian fixed width integers, independent of the compiler and platform:
+//
+//   FileHeader      64 bytes   magic "FXNW", version, header and table sizes, architecture, layout and payload range
+//   TensorTable     48 bytes   per layer: inputs, outputs, weight offset / size, bias offset / size, weight precision and scale
+//   Payload                    the network parameters exactly as laid out in the NetworkLayout
+//
+// Tensor offsets are relative to the payload, which starts at a multiple of s_networkFilePayloadAlignment
+// so a memory mapped payload can be used in place as an upload source or by the CPU engines.
+// Tables with the earlier 40 byte entries are still read, their layers use the header weight precision.
+constexpr uint32_t s_networkFileVersion = 2;
+constexpr size_t s_networkFilePayloadAlignment = 256;
+
+// Write a network in the version 2 format.
+bool WriteNetworkFile(const std::string& fileName, NetworkArchitecture const& netArch, NetworkLayout const& layout, const uint8_t* params, size_t paramsSize);
+
+// Check whether a file starts with the version 2 header magic.
+bool IsNetworkFileV2(const std::string& fileName);
+
+// Read only memory mapping of a version 2 network file.
+// The parameters are not copied, they stay valid until the file is closed or the object is destroyed.
+class MappedNetworkFile
+{
+public:
+    MappedNetworkFile(){};
+    ~MappedNetworkFile();
+
+    MappedNetworkFile(const MappedNetworkFile&) = delete;
+    MappedNetworkFile& operator=(const MappedNetworkFile&) = delete;
+
+    // Map the file and validate the header and tensor table.
+    bool Open(const std::string& fileName);
+    void Close();
+
+    bool IsOpen() const
+    {
+        return m_data != nullptr;
+    }
+
+    const NetworkArchitecture& GetNetworkArchitecture() const
+    {
+        return m_networkArchitecture;
+    }
+
+    const NetworkLayout& GetNetworkLayout() const
+    {
+        return m_networkLayout;
+    }
+
+    // Parameters laid out as GetNetworkLayout(), aligned to s_networkFilePayloadAlignment.
+    const uint8_t* GetNetworkParams() const
+    {
+        return m_params;
+    }
+
+    size_t GetNetworkParamsSize() const
+    {
+        return m_networkLayout.networkSize;
+    }
+
+private:
+    bool ParseHeader(const std::string& fileName);
+
+    const uint8_t* m_data = nullptr; ///< Start of the mapping.
+    size_t m_size = 0; ///< Size of the mapping in bytes.
+    const uint8_t* m_params = nullptr;
+#if defined(_WIN32)
+    void* m_fileHandle = nullptr;
+    void* m_mappingHandle = nullptr;
+#endif
+
+    NetworkArchitecture m_networkArchitecture;
+    NetworkLayout m_networkLayout;
+};
+
+NAMESPACE_END(fluxel)
@@ -0,0 +1,380 @@
+#include <atomic>
+#include <charconv>
+#include <cstring>
+
+#include "NetworkJson.h"
+#include "Cpu/Kernels.h"
+#include "Cpu/ThreadPool.h"
+#include "Logger.h"
+
+NAMESPACE_BEGIN(fluxel)
+
+namespace
+{
+constexpr int s_maxJsonDepth = 256;
+constexpr size_t s_conversionChunkSize = 256; ///< Numbers parsed before a batched float to half conversion.
+
+// Minimal forward-only json scanner, strings are not unescaped.
+class JsonScanner
+{
+public:
+    JsonScanner(const char* begin, const char* end) : m_cur(begin), m_end(end)
+    {
+    }
+
+    void SkipWhitespace()
+    {
+        while (m_cur < m_end && (*m_cur == ' ' || *m_cur == '\n' || *m_cur == '\r' || *m_cur == '\t'))
+        {
+            m_cur++;
+        }
+    }
+
+    // Skip whitespace and return the next character without consuming it, 0 at the end of the input.
+    char Peek()
+    {
+        SkipWhitespace();
+        return m_cur < m_end ? *m_cur : 0;
+    }
+
+    bool Consume(char c)
+    {
+        if (Peek() != c)
+        {
+            return false;
+        }
+        m_cur++;
+        return true;
+    }
+
+    bool ParseString(std::string_view& str)
+    {
+        if (!Consume('"'))
+        {
+            return false;
+        }
+        const char* begin = m_cur;
+        while (m_cur < m_end && *m_cur != '"')
+        {
+            m_cur += (*m_cur == '\\') ? 2 : 1;
+        }
+        if (m_cur >= m_end)
+        {
+            return false;
+        }
+        str = std::string_view(begin, m_cur - begin);
+        m_cur++;
+        return true;
+    }
+
+    bool ParseUInt(uint32_t& value)
+    {
+        SkipWhitespace();
+        double number = 0.0;
+        auto [ptr, ec] = std::from_chars(m_cur, m_end, number);
+        if (ec != std::errc() || number < 0.0 || number > double(UINT32_MAX) || number != double(uint32_t(number)))
+        {
+            return false;
+        }
+        m_cur = ptr;
+        value = uint32_t(number);
+        return true;
+    }
+
+    // Capture the text of an array of numbers, without the brackets.
+    bool ParseNumberArray(std::string_view& contents)
+    {
+        if (!Consume('['))
+        {
+            return false;
+        }
+        const char* begin = m_cur;
+        const char* close = static_cast<const char*>(std::memchr(m_cur, ']', m_end - m_cur));
+        if (!close || std::memchr(begin, '[', close - begin) || std::memchr(begin, '"', close - begin) || std::memchr(begin, '{', close - begin))
+        {
+            return false;
+        }
+        contents = std::string_view(begin, close - begin);
+        m_cur = close + 1;
+        return true;
+    }
+
+    bool SkipValue(int depth = 0)
+    {
+        if (depth > s_maxJsonDepth)
+        {
+            return false;
+        }
+
+        std::string_view str;
+        switch (Peek())
+        {
+        case '"':
+            return ParseString(str);
+        case '{':
+            m_cur++;
+            if (Consume('}'))
+            {
+                return true;
+            }
+            do
+            {
+                if (!ParseString(str) || !Consume(':') || !SkipValue(depth + 1))
+                {
+                    return false;
+                }
+            } while (Consume(','));
+            return Consume('}');
+        case '[':
+            m_cur++;
+            if (Consume(']'))
+            {
+                return true;
+            }
+            do
+            {
+                if (!SkipValue(depth + 1))
+                {
+                    return false;
+                }
+            } while (Consume(','));
+            return Consume(']');
+        case 0:
+            return false;
+        default:
+        {
+            // Numbers and literals
+            const char* begin = m_cur;
+            while (m_cur < m_end && *m_cur != ',' && *m_cur != '}' && *m_cur != ']' && *m_cur != ' ' && *m_cur != '\n' && *m_cur != '\r' && *m_cur != '\t')
+            {
+                m_cur++;
+            }
+            return m_cur != begin;
+        }
+        }
+    }
+
+private:
+    const char* m_cur;
+    const char* m_end;
+};
+
+bool ParseLayer(JsonScanner& scanner, NetworkJsonLayer& layer)
+{
+    if (!scanner.Consume('{'))
+    {
+        return false;
+    }
+    if (scanner.Consume('}'))
+    {
+        return true;
+    }
+
+    do
+    {
+        std::string_view key;
+        if (!scanner.ParseString(key) || !scanner.Consume(':'))
+        {
+            return false;
+        }
+
+        bool result;
+        if (key == "num_inputs")
+        {
+            result = scanner.ParseUInt(layer.inputs);
+        }
+        else if (key == "num_outputs")
+        {
+            result = scanner.ParseUInt(layer.outputs);
+        }
+        else if (key == "weights")
+        {
+            result = scanner.ParseNumberArray(layer.weights);
+        }
+        else if (key == "biases")
+        {
+            result = scanner.ParseNumberArray(layer.biases);
+        }
+        else
+        {
+            result = scanner.SkipValue();
+        }
+
+        if (!result)
+        {
+            Log(Error, "LoadFromJson: invalid value for \"%.*s\".", int(key.size()), key.data());
+            return false;
+        }
+    } while (scanner.Consume(','));
+
+    return scanner.Consume('}');
+}
+
+// Parse a comma separated list of exactly count numbers into half precision values.
+bool ParseHalfArray(std::string_view text, uint16_t* dst, size_t count, cpu::KernelTable const& kernels)
+{
+    float chunk[s_conversionChunkSize];
+    size_t chunkSize = 0;
+    size_t parsed = 0;
+
+    const char* cur = text.data();
+    const char* end = cur + text.size();
+    auto skipWhitespace = [&]() {
+        while (cur < end && (*cur == ' ' || *cur == '\n' || *cur == '\r' || *cur == '\t'))
+        {
+            cur++;
+        }
+    };
+
+    skipWhitespace();
+    while (cur < end)
+    {
+        if (parsed > 0)
+        {
+            if (*cur != ',')
+            {
+                return false;
+            }
+            cur++;
+            skipWhitespace();
+        }
+
+        float value;
+        auto [ptr, ec] = std::from_chars(cur, end, value);
+        if (ec != std::errc() || parsed >= count)
+        {
+            return false;
+        }
+        cur = ptr;
+        skipWhitespace();
+
+        chunk[chunkSize++] = value;
+        parsed++;
+        if (chunkSize == s_conversionChunkSize)
+        {
+            kernels.floatToHalf(chunk, dst + parsed - chunkSize, chunkSize);
+            chunkSize = 0;
+        }
+    }
+    kernels.floatToHalf(chunk, dst + parsed - chunkSize, chunkSize);
+    return parsed == count;
+}
+} // namespace
+
+bool ParseNetworkJson(std::string_view json, std::vector<NetworkJsonLayer>& layers)
+{
+    layers.clear();
+
+    JsonScanner scanner(json.data(), json.data() + json.size());
+    if (!scanner.Consume('{'))
+    {
+        Log(Error, "LoadFromJson: expected an object.");
+        return false;
+    }
+    if (scanner.Consume('}'))
+    {
+        return true;
+    }
+
+    do
+    {
+        std::string_view key;
+        if (!scanner.ParseString(key) || !scanner.Consume(':'))
+        {
+            Log(Error, "LoadFromJson: invalid object key.");
+            return false;
+        }
+
+        if (key != "layers")
+        {
+            if (!scanner.SkipValue())
+            {
+                Log(Error, "LoadFromJson: invalid value for \"%.*s\".", int(key.size()), key.data());
+                return false;
+            }
+            continue;
+        }
+
+        if (!scanner.Consume('['))
+        {
+            Log(Error, "LoadFromJson: \"layers\" must be an array.");
+            return false;
+        }
+        if (scanner.Consume(']'))
+        {
+            continue;
+        }
+        do
+        {
+            if (!ParseLayer(scanner, layers.emplace_back()))
+            {
+                Log(Error, "LoadFromJson: invalid layer %d.", int(layers.size() - 1));
+                return false;
+            }
+        } while (scanner.Consume(','));
+        if (!scanner.Consume(']'))
+        {
+            Log(Error, "LoadFromJson: unterminated \"layers\" array.");
+            return false;
+        }
+    } while (scanner.Consume(','));
+
+    if (!scanner.Consume('}'))
+    {
+        Log(Error, "LoadFromJson: unterminated object.");
+        return false;
+    }
+    return true;
+}
+
+bool LoadNetworkJsonParams(std::vector<NetworkJsonLayer> const& layers, NetworkLayout const& layout, uint8_t* params, cpu::ThreadPool* threadPool)
+{
+    if (layout.matrixLayout != MatrixLayout::RowMajor || layout.matrixPrecision != Precision::F16 || layout.networkLayers.size() != layers.size())
+    {
+        Log(Error, "LoadFromJson: the parameters can only be loaded into a matching F16 RowMajor layout.");
+        return false;
+    }
+
+    for (size_t i = 0; i < layers.size(); i++)
+    {
+        const NetworkLayer& layer = layout.networkLayers[i];
+        if (layers[i].inputs != layer.inputs || layers[i].outputs != layer.outputs)
+        {
+            Log(Error, "LoadFromJson: layer %d is %d x %d, expected %d x %d.", int(i), layers[i].outputs, layers[i].inputs, layer.outputs, layer.inputs);
+            return false;
+        }
+    }
+
+    // One task per weight matrix and per bias vector, each writes to its own range of the buffer.
+    const cpu::KernelTable& kernels = cpu::GetBestKernels();
+    std::atomic<bool> result = true;
+    auto loadArray = [&](size_t task, uint32_t) {
+        const size_t l = task / 2;
+        const bool weights = task % 2 == 0;
+        const NetworkLayer& layer = layout.networkLayers[l];
+        uint16_t* dst = reinterpret_cast<uint16_t*>(params + (weights ? layer.weightOffset : layer.biasOffset));
+        const size_t count = weights ? size_t(layer.inputs) * layer.outputs : layer.outputs;
+
+        if (!ParseHalfArray(weights ? layers[l].weights : layers[l].biases, dst, count, kernels))
+        {
+            Log(Error, "LoadFromJson: layer %d %s must be %d numbers.", int(l), weights ? "weights" : "biases", int(count));
+            result = false;
+        }
+    };
+
+    const size_t taskCount = 2 * layers.size();
+    if (threadPool)
+    {
+        threadPool->ParallelFor(taskCount, loadArray);
+    }
+    else
+    {
+        for (size_t task = 0; task < taskCount; task++)
+        {
+            loadArray(task, 0);
+        }
+    }
+    return result;
+}
+
+NAMESPACE_END(fluxel)
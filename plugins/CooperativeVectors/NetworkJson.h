@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+
+#include "Fluxel.h"
+#include "Network.h"
+
+NAMESPACE_BEGIN(fluxel)
+
+NAMESPACE_BEGIN(cpu)
+class ThreadPool;
+NAMESPACE_END(cpu)
+
+// One entry of the "layers" array of a network json file.
+// The weights and biases are kept as the unparsed text between the array brackets.
+struct NetworkJsonLayer
+{
+    uint32_t inputs = 0;
+    uint32_t outputs = 0;
+    std::string_view weights;
+    std::string_view biases;
+};
+
+// Scan the structure of a network json file without converting the parameters.
+// Only the "layers" array is interpreted, other values are skipped.
+bool ParseNetworkJson(std::string_view json, std::vector<NetworkJsonLayer>& layers);
+
+// Convert the weights and biases of every layer straight into a host layout parameter buffer.
+// The layout must be F16 RowMajor with layers matching the json layers, and params must hold layout.networkSize bytes.
+// Arrays are converted in parallel when a thread pool is provided.
+bool LoadNetworkJsonParams(std::vector<NetworkJsonLayer> const& layers, NetworkLayout const& layout, uint8_t* params, cpu::ThreadPool* threadPool = nullptr);
+
+NAMESPACE_END(fluxel)
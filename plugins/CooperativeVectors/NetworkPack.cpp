@@ -0,0 +1,153 @@
+#include <cassert>
+#include <cstring>
+
+#include "NetworkPack.h"
+#include "Logger.h"
+
+NAMESPACE_BEGIN(fluxel)
+
+NetworkPack::NetworkPack(std::shared_ptr<NetworkUtilities> networkUtils) : m_networkUtils(networkUtils)
+{
+    assert(m_networkUtils && "Network Utilities not present");
+}
+
+bool NetworkPack::AddNetwork(HostNetwork const& network)
+{
+    const auto& params = network.GetNetworkParams();
+    return AddNetwork(network.GetNetworkArchitecture(), network.GetNetworkLayout(), params.data(), params.size());
+}
+
+bool NetworkPack::AddNetwork(NetworkArchitecture const& netArch, NetworkLayout const& layout, const uint8_t* params, size_t size)
+{
+    if (!m_networkUtils->ValidateNetworkArchitecture(netArch))
+    {
+        Log(Error, "NetworkPack: Failed to validate network.");
+        return false;
+    }
+    if (layout.networkLayers.size() != netArch.numHiddenLayers + 1 || layout.networkLayers.size() > s_networkPackTableStride ||
+        size != layout.networkSize)
+    {
+        Log(Error, "NetworkPack: layout does not match the network architecture.");
+        return false;
+    }
+    if (!m_networks.empty() && layout.matrixLayout != m_matrixLayout)
+    {
+        Log(Error, "NetworkPack: all networks of a pack must use the same matrix layout.");
+        return false;
+    }
+
+    const size_t offset = (m_params.size() + s_networkPackAlignment - 1) / s_networkPackAlignment * s_networkPackAlignment;
+    if (offset + size > UINT32_MAX)
+    {
+        Log(Error, "NetworkPack: pack exceeds 4GB, the offsets are 32 bit.");
+        return false;
+    }
+
+    m_matrixLayout = layout.matrixLayout;
+    m_networks.push_back({ netArch, layout, offset });
+    m_params.resize(offset + size, 0);
+    std::memcpy(m_params.data() + offset, params, size);
+    return true;
+}
+
+void NetworkPack::Clear()
+{
+    m_networks.clear();
+    m_params.clear();
+}
+
+bool NetworkPack::CreateMatrixLayoutPack(MatrixLayout matrixLayout, NetworkPack& result) const
+{
+    const bool hostLayout = matrixLayout == MatrixLayout::RowMajor || matrixLayout == MatrixLayout::ColumnMajor || matrixLayout == MatrixLayout::HostPanel;
+
+    NetworkPack pack(m_networkUtils);
+    std::vector<uint8_t> params;
+    for (const Entry& entry : m_networks)
+    {
+        const NetworkLayout layout = m_networkUtils->GetNewMatrixLayout(entry.layout, matrixLayout);
+        if (layout.networkLayers.empty())
+        {
+            Log(Error, "NetworkPack: matrix size of the new layout is not known.");
+            return false;
+        }
+
+        params.assign(layout.networkSize, 0);
+        if (hostLayout &&
+            !m_networkUtils->ConvertWeightsHost(entry.layout, layout, m_params.data() + entry.offset, entry.layout.networkSize, params.data(), params.size()))
+        {
+            return false;
+        }
+        if (!pack.AddNetwork(entry.architecture, layout, params.data(), params.size()))
+        {
+            return false;
+        }
+    }
+    pack.m_matrixLayout = matrixLayout;
+
+    result = std::move(pack);
+    return true;
+}
+
+bool NetworkPack::ConvertWeights(NetworkPack const& dstPack,
+                                 nvrhi::BufferHandle srcBuffer,
+                                 uint64_t srcBufferOffset,
+                                 nvrhi::BufferHandle dstBuffer,
+                                 uint64_t dstBufferOffset,
+                                 nvrhi::DeviceHandle device,
+                                 nvrhi::CommandListHandle commandList) const
+{
+    assert(m_networks.size() == dstPack.m_networks.size());
+
+    for (size_t i = 0; i < m_networks.size(); i++)
+    {
+        const Entry& src = m_networks[i];
+        const Entry& dst = dstPack.m_networks[i];
+        if (!m_networkUtils->ConvertWeights(src.layout, dst.layout, srcBuffer, srcBufferOffset + src.offset, dstBuffer, dstBufferOffset + dst.offset, device,
+                                            commandList))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<uint32_t> NetworkPack::CreateOffsetTable() const
+{
+    std::vector<uint32_t> table(m_networks.size() * s_networkPackTableStride * 2, 0);
+    for (size_t i = 0; i < m_networks.size(); i++)
+    {
+        const Entry& entry = m_networks[i];
+        uint32_t* offsets = table.data() + i * s_networkPackTableStride * 2;
+        for (size_t l = 0; l < entry.layout.networkLayers.size(); l++)
+        {
+            const NetworkLayer& layer = entry.layout.networkLayers[l];
+            offsets[2 * l] = uint32_t(entry.offset + layer.weightOffset);
+            offsets[2 * l + 1] = uint32_t(entry.offset + layer.biasOffset);
+        }
+    }
+    return table;
+}
+
+bool NetworkPack::ExtractNetwork(uint32_t index, HostNetwork& network) const
+{
+    if (index >= m_networks.size())
+    {
+        Log(Error, "NetworkPack: network %d out of range, the pack has %d networks.", index, int(m_networks.size()));
+        return false;
+    }
+    const Entry& entry = m_networks[index];
+    return network.InitialiseFromParams(entry.architecture, entry.layout, m_params.data() + entry.offset, entry.layout.networkSize);
+}
+
+bool NetworkPack::UpdateParams(const uint8_t* data, size_t size)
+{
+    if (size != m_params.size())
+    {
+        Log(Error, "NetworkPack: expected %d bytes of parameters, got %d.", int(m_params.size()), int(size));
+        return false;
+    }
+    std::memcpy(m_params.data(), data, size);
+    return true;
+}
+
+NAMESPACE_END(fluxel)
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "Fluxel.h"
+#include "Network.h"
+
+NAMESPACE_BEGIN(fluxel)
+
+// Number of (weight offset, bias offset) entries per network in the table returned by NetworkPack::CreateOffsetTable.
+// Matches NETWORK_PACK_TABLE_STRIDE in MLP.slang.
+constexpr uint32_t s_networkPackTableStride = 8;
+
+// Byte alignment of every network in a pack, the matrix alignment of the layouts.
+constexpr size_t s_networkPackAlignment = 64;
+
+// Many small networks laid out contiguously in one parameter buffer.
+// Every network keeps its own architecture and layout, offsets in the layouts are relative to the start of the network,
+// which is at GetNetworkOffset(). All networks of a pack share a matrix layout.
+// Shaders select a network by index through the offset table, the CPU engines through the network index of a batch.
+class NetworkPack
+{
+public:
+    NetworkPack(std::shared_ptr<NetworkUtilities> networkUtils);
+
+    // Append a network, it is selected by the index GetNetworkCount() had before the call.
+    bool AddNetwork(HostNetwork const& network);
+    // Append a network from parameters laid out as layout.
+    bool AddNetwork(NetworkArchitecture const& netArch, NetworkLayout const& layout, const uint8_t* params, size_t size);
+
+    void Clear();
+
+    // Create a pack of the same networks in another matrix layout.
+    // Host layouts are converted on the host, the parameters of device optimal layouts are left zeroed and are filled by ConvertWeights.
+    bool CreateMatrixLayoutPack(MatrixLayout matrixLayout, NetworkPack& result) const;
+
+    // Converts the device side parameters of every network from the layout of this pack to the layout of dstPack.
+    // Both buffers must be device side and hold complete packs.
+    bool ConvertWeights(NetworkPack const& dstPack,
+                        nvrhi::BufferHandle srcBuffer,
+                        uint64_t srcBufferOffset,
+                        nvrhi::BufferHandle dstBuffer,
+                        uint64_t dstBufferOffset,
+                        nvrhi::DeviceHandle device,
+                        nvrhi::CommandListHandle commandList) const;
+
+    // Absolute byte offsets into the pack, s_networkPackTableStride (weight offset, bias offset) pairs per network.
+    // Unused entries are zero.
+    std::vector<uint32_t> CreateOffsetTable() const;
+
+    // Copy one network out of the pack, for example to write it to a file.
+    bool ExtractNetwork(uint32_t index, HostNetwork& network) const;
+
+    // Replace the parameters of every network with data laid out as the pack.
+    bool UpdateParams(const uint8_t* data, size_t size);
+
+    uint32_t GetNetworkCount() const
+    {
+        return uint32_t(m_networks.size());
+    }
+
+    const NetworkArchitecture& GetNetworkArchitecture(uint32_t index) const
+    {
+        return m_networks[index].architecture;
+    }
+
+    const NetworkLayout& GetNetworkLayout(uint32_t index) const
+    {
+        return m_networks[index].layout;
+    }
+
+    size_t GetNetworkOffset(uint32_t index) const
+    {
+        return m_networks[index].offset;
+    }
+
+    MatrixLayout GetMatrixLayout() const
+    {
+        return m_matrixLayout;
+    }
+
+    // Parameters of all networks, networks are aligned to s_networkPackAlignment.
+    const std::vector<uint8_t>& GetParams() const
+    {
+        return m_params;
+    }
+
+    size_t GetParamsSize() const
+    {
+        return m_params.size();
+    }
+
+private:
+    struct Entry
+    {
+        NetworkArchitecture architecture;
+        NetworkLayout layout;
+        size_t offset = 0;
+    };
+
+    std::shared_ptr<NetworkUtilities> m_networkUtils;
+    MatrixLayout m_matrixLayout = MatrixLayout::RowMajor;
+    std::vector<Entry> m_networks;
+    std::vector<uint8_t> m_params;
+};
+
+NAMESPACE_END(fluxel)
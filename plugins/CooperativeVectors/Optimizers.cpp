@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "Optimizers.h"
+
+NAMESPACE_BEGIN(fluxel)
+
+OptimizerDesc GetDefaultOptimizerDesc(OptimizerType type)
+{
+    OptimizerDesc desc;
+    desc.type = type;
+    switch (type)
+    {
+    case OptimizerType::Adam:
+        break;
+    case OptimizerType::AdamW:
+        desc.weightDecay = 0.01f;
+        break;
+    case OptimizerType::Lion:
+        desc.beta1 = 0.9f;
+        desc.beta2 = 0.99f;
+        break;
+    case OptimizerType::SgdNesterov:
+        desc.beta1 = 0.9f;
+        break;
+    }
+    return desc;
+}
+
+uint32_t GetOptimizerMomentCount(OptimizerType type)
+{
+    return type == OptimizerType::Adam || type == OptimizerType::AdamW ? 2 : 1;
+}
+
+std::vector<float> CreateDynamicQuantisationMap(bool isSigned)
+{
+    // 7 exponent bits for decades of 1e-6 to 1, every decade splits [0.1, 1] into twice as many fractions as the previous
+    constexpr int maxExponentBits = 7;
+    std::vector<float> map;
+    map.reserve(s_quantisationMapSize);
+    for (int i = 0; i < maxExponentBits; i++)
+    {
+        const int fractionItems = isSigned ? (1 << i) : (2 << i);
+        const double exponent = std::pow(10.0, double(i - (maxExponentBits - 1)));
+        for (int j = 0; j < fractionItems; j++)
+        {
+            // Midpoint of every interval of fractionItems between 0.1 and 1
+            const double mean = 0.1 + 0.9 * (double(j) + 0.5) / fractionItems;
+            map.push_back(float(exponent * mean));
+            if (isSigned)
+            {
+                map.push_back(float(-exponent * mean));
+            }
+        }
+    }
+    // 127 values of each sign or 254 positive values, zero and one complete the 256 codes
+    map.push_back(0.f);
+    map.push_back(1.f);
+    std::sort(map.begin(), map.end());
+    return map;
+}
+
+uint8_t QuantiseDynamic(const float* map, float value)
+{
+    // Largest code at or below the value, then the nearer of it and the next code
+    uint32_t code = 0;
+    for (uint32_t step = s_quantisationMapSize / 2; step > 0; step >>= 1)
+    {
+        if (map[code + step] <= value)
+        {
+            code += step;
+        }
+    }
+    if (code + 1 < s_quantisationMapSize && map[code + 1] - value < value - map[code])
+    {
+        code++;
+    }
+    return uint8_t(code);
+}
+
+float QuantiseBlock(const float* map, float* values, size_t count)
+{
+    float scale = 0.f;
+    for (size_t i = 0; i < count; i++)
+    {
+        scale = std::max(scale, std::abs(values[i]));
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        const float normalised = scale > 0.f ? values[i] / scale : 0.f;
+        values[i] = map[QuantiseDynamic(map, normalised)] * scale;
+    }
+    return scale;
+}
+
+size_t GetQuantisedStateSize(size_t paramCount)
+{
+    const size_t blockCount = (paramCount + s_quantisedStateBlockSize - 1) / s_quantisedStateBlockSize;
+    return blockCount * s_quantisedStateBlockSize + blockCount * sizeof(float);
+}
+
+void EncodeQuantisedState(const float* map, const float* values, const float* scales, size_t count, uint8_t* state)
+{
+    // The scale of a block is not always the largest rounded moment, the signed map does not reach -1
+    const size_t blockCount = (count + s_quantisedStateBlockSize - 1) / s_quantisedStateBlockSize;
+    std::memset(state, 0, GetQuantisedStateSize(count));
+    for (size_t i = 0; i < count; i++)
+    {
+        const float scale = scales[i / s_quantisedStateBlockSize];
+        state[i] = QuantiseDynamic(map, scale > 0.f ? values[i] / scale : 0.f);
+    }
+    std::memcpy(state + blockCount * s_quantisedStateBlockSize, scales, blockCount * sizeof(float));
+}
+
+void DecodeQuantisedState(const float* map, const uint8_t* state, size_t count, float* values, float* scales)
+{
+    const size_t blockCount = (count + s_quantisedStateBlockSize - 1) / s_quantisedStateBlockSize;
+    std::memcpy(scales, state + blockCount * s_quantisedStateBlockSize, blockCount * sizeof(float));
+    for (size_t i = 0; i < count; i++)
+    {
+        values[i] = map[state[i]] * scales[i / s_quantisedStateBlockSize];
+    }
+}
+
+OptimizerStepConstants GetOptimizerStepConstants(OptimizerDesc const& desc, float learningRate, uint32_t step)
+{
+    OptimizerStepConstants constants;
+    constants.stepSize = learningRate;
+    if (desc.type != OptimizerType::Adam)
+    {
+        constants.decayFactor = 1.f - learningRate * desc.weightDecay;
+    }
+
+    // The bias corrections only depend on the step, the shaders used to recompute them for every parameter
+    if (desc.type == OptimizerType::Adam || desc.type == OptimizerType::AdamW)
+    {
+        const float biasCorrection1 = 1.f - std::pow(desc.beta1, float(step));
+        const float biasCorrection2 = 1.f - std::pow(desc.beta2, float(step));
+        constants.stepSize = learningRate / biasCorrection1;
+        constants.rsqrtBiasCorrection2 = 1.f / std::sqrt(biasCorrection2);
+    }
+
+    // Early averages follow the parameters closely, so the average does not keep the initialisation for long
+    if (desc.emaDecay > 0.f)
+    {
+        constants.emaDecay = std::min(desc.emaDecay, float(1 + step) / float(desc.emaWarmupSteps + step));
+    }
+    return constants;
+}
+
+NAMESPACE_END(fluxel)
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Fluxel.h"
+
+NAMESPACE_BEGIN(fluxel)
+
+// Optimizers of Optimizers.slang, the values of OPTIMIZER in the NetworkConfig.h of the samples.
+enum class OptimizerType : uint32_t
+{
+    Adam = 0,
+    AdamW = 1, ///< Adam with decoupled weight decay.
+    Lion = 2, ///< Sign of the interpolated momentum, a single moment buffer.
+    SgdNesterov = 3, ///< SGD with Nesterov momentum, a single velocity buffer.
+};
+
+struct OptimizerDesc
+{
+    OptimizerType type = OptimizerType::Adam;
+    float beta1 = 0.9f; ///< First moment decay of Adam and AdamW, update interpolation of Lion, momentum of SGD.
+    float beta2 = 0.999f; ///< Second moment decay of Adam and AdamW, momentum decay of Lion.
+    float epsilon = 1e-8f;
+    float weightDecay = 0.f; ///< Decoupled weight decay of AdamW, Lion and SGD, ignored by Adam.
+    bool quantisedState = false; ///< Keep the moments in 8 bits with blockwise dynamic quantisation.
+    float emaDecay = 0.f; ///< Decay of the exponential moving average of the parameters, no average at 0.
+    uint32_t emaWarmupSteps = 10; ///< The decay of step t is limited to (1 + t) / (emaWarmupSteps + t).
+};
+
+// Defaults of the optimizer, matching the ADAM_, LION_ and SGD_ defines of Optimizers.slang.
+OptimizerDesc GetDefaultOptimizerDesc(OptimizerType type);
+
+// Number of FP32 state buffers of the size of the parameters.
+uint32_t GetOptimizerMomentCount(OptimizerType type);
+
+// Parameters sharing the scale of their 8-bit moments, a thread group of the optimizer pass.
+// Blocks are consecutive parameters of the layout the trainer updates, the source layout for cpu::TrainingEngine and the
+// device layout for the optimizer pass, so the blocks and their scales differ between the two. They agree on the
+// training loss to convergence level, not step for step.
+constexpr uint32_t s_quantisedStateBlockSize = 32;
+constexpr uint32_t s_quantisationMapSize = 256;
+
+// Sorted values of the 256 codes of the 8-bit moments, in [-1, 1] for signed and [0, 1] for unsigned moments.
+// The dynamic map spends the bits after the leading zero bits of a code on the fraction, so small values keep
+// their relative precision down to 1e-7 of the block scale. Adam keeps its second moment in the unsigned map.
+std::vector<float> CreateDynamicQuantisationMap(bool isSigned);
+
+// Code of the map value nearest to value, see QuantiseDynamic in Optimizers.slang.
+uint8_t QuantiseDynamic(const float* map, float value);
+
+// Round a block of moments to the values stored by the 8-bit state. Returns the scale of the block, the largest magnitude.
+float QuantiseBlock(const float* map, float* values, size_t count);
+
+// Bytes of one 8-bit moment buffer, the codes of all parameters followed by the scales of the blocks.
+size_t GetQuantisedStateSize(size_t paramCount);
+
+// Store moments in the 8-bit buffer layout of BlockwiseQuantisedAccessor, GetQuantisedStateSize(count) bytes.
+// Moments rounded by QuantiseBlock are stored without loss with the scales it returned, one per block.
+void EncodeQuantisedState(const float* map, const float* values, const float* scales, size_t count, uint8_t* state);
+
+// Moments and block scales of an 8-bit buffer of count parameters.
+void DecodeQuantisedState(const float* map, const uint8_t* state, size_t count, float* values, float* scales);
+
+// Constants of one optimizer step, the same for every parameter, see OptimizerStep in Optimizers.slang.
+struct OptimizerStepConstants
+{
+    float stepSize = 0.f; ///< Learning rate, divided by the first bias correction for Adam and AdamW.
+    float rsqrtBiasCorrection2 = 1.f; ///< Inverse square root of the second bias correction of Adam and AdamW.
+    float decayFactor = 1.f; ///< Parameters are multiplied by 1 - learningRate * weightDecay before the update.
+    float emaDecay = 0.f; ///< Decay of the average of the parameters in this step, after the warmup limit.
+};
+
+// step starts at 1.
+OptimizerStepConstants GetOptimizerStepConstants(OptimizerDesc const& desc, float learningRate, uint32_t step);
+
+// CPU reference of the step of one parameter in Optimizers.slang, with the gradient already divided by the loss scale.
+// Updates the moments and returns the new parameter, moment2 is only used by Adam and AdamW.
+inline float OptimizerStep(OptimizerDesc const& desc, OptimizerStepConstants const& constants, float weightBias, float gradient, float& moment1, float& moment2)
+{
+    switch (desc.type)
+    {
+    case OptimizerType::Adam:
+    case OptimizerType::AdamW:
+    {
+        moment1 = moment1 * desc.beta1 + gradient * (1.f - desc.beta1);
+        moment2 = moment2 * desc.beta2 + gradient * gradient * (1.f - desc.beta2);
+        const float denom = std::sqrt(moment2) * constants.rsqrtBiasCorrection2 + desc.epsilon;
+        return weightBias * constants.decayFactor - (moment1 / denom) * constants.stepSize;
+    }
+    case OptimizerType::Lion:
+    {
+        const float interpolated = moment1 * desc.beta1 + gradient * (1.f - desc.beta1);
+        const float update = interpolated > 0.f ? 1.f : (interpolated < 0.f ? -1.f : 0.f);
+        moment1 = moment1 * desc.beta2 + gradient * (1.f - desc.beta2);
+        return weightBias * constants.decayFactor - update * constants.stepSize;
+    }
+    case OptimizerType::SgdNesterov:
+    {
+        moment1 = moment1 * desc.beta1 + gradient;
+        return weightBias * constants.decayFactor - (gradient + moment1 * desc.beta1) * constants.stepSize;
+    }
+    }
+    return weightBias;
+}
+
+// CPU reference of updateEma in Optimizers.slang, the average after the update of a parameter to weightBias.
+inline float UpdateEma(OptimizerStepConstants const& constants, float ema, float weightBias)
+{
+    return ema * constants.emaDecay + weightBias * (1.f - constants.emaDecay);
+}
+
+NAMESPACE_END(fluxel)
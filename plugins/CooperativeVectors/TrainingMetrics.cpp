@@ -0,0 +1,181 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#include "TrainingMetrics.h"
+#include "Logger.h"
+
+NAMESPACE_BEGIN(fluxel)
+
+void TrainingMetrics::AddSample(float loss)
+{
+    if (!std::isfinite(loss))
+    {
+        nonFiniteCount++;
+        return;
+    }
+    lossSum += loss;
+    sampleCount++;
+    maxLoss = std::max(maxLoss, loss);
+}
+
+void TrainingMetrics::Merge(TrainingMetrics const& other)
+{
+    if (stepCount == 0)
+    {
+        firstStep = other.firstStep;
+    }
+    stepCount += other.stepCount;
+    lossSum += other.lossSum;
+    sampleCount += other.sampleCount;
+    nonFiniteCount += other.nonFiniteCount;
+    maxLoss = std::max(maxLoss, other.maxLoss);
+    if (other.stepCount)
+    {
+        lossScale = other.lossScale;
+    }
+    skippedSteps += other.skippedSteps;
+}
+
+MetricsReadback::MetricsReadback(nvrhi::DeviceHandle device, uint32_t interval, uint32_t slotCount)
+    : m_device(device), m_interval(std::max(1u, interval))
+{
+    assert(m_device && "Device not present");
+
+    m_commandList = m_device->createCommandList();
+
+    nvrhi::BufferDesc bufferDesc;
+    bufferDesc.byteSize = s_metricsBufferSize;
+    bufferDesc.canHaveRawViews = true;
+    bufferDesc.canHaveUAVs = true;
+    bufferDesc.debugName = "MetricsBuffer";
+    bufferDesc.initialState = nvrhi::ResourceStates::UnorderedAccess;
+    bufferDesc.keepInitialState = true;
+    m_metricsBuffer = m_device->createBuffer(bufferDesc);
+
+    // Staging buffers are created once and reused for every readback
+    nvrhi::BufferDesc stagingDesc;
+    stagingDesc.byteSize = s_metricsBufferSize;
+    stagingDesc.cpuAccess = nvrhi::CpuAccessMode::Read;
+    stagingDesc.debugName = "Metrics Staging Buffer";
+
+    m_slots.resize(std::max(1u, slotCount));
+    for (Slot& slot : m_slots)
+    {
+        slot.stagingBuffer = m_device->createBuffer(stagingDesc);
+        slot.query = m_device->createEventQuery();
+    }
+
+    m_commandList->open();
+    m_commandList->clearBufferUInt(m_metricsBuffer, 0);
+    m_commandList->close();
+    m_device->executeCommandList(m_commandList);
+}
+
+void MetricsReadback::Reset(nvrhi::ICommandList* commandList, uint32_t firstStep)
+{
+    commandList->clearBufferUInt(m_metricsBuffer, 0);
+    m_firstStep = firstStep;
+    m_generation++;
+    m_results.clear();
+}
+
+void MetricsReadback::Update(uint32_t step)
+{
+    // Start a readback of the steps since the last one into a free slot
+    if (step >= m_firstStep + m_interval && m_readbackQueue.size() < m_slots.size())
+    {
+        uint32_t slotIndex = 0;
+        while (std::find(m_readbackQueue.begin(), m_readbackQueue.end(), slotIndex) != m_readbackQueue.end())
+        {
+            slotIndex++;
+        }
+        Slot& slot = m_slots[slotIndex];
+        if (!slot.stagingBuffer || !slot.query)
+        {
+            Log(Error, "MetricsReadback: Failed to create a staging buffer!");
+            return;
+        }
+
+        m_commandList->open();
+        m_commandList->copyBuffer(slot.stagingBuffer, 0, m_metricsBuffer, 0, s_metricsBufferSize);
+        m_commandList->clearBufferUInt(m_metricsBuffer, 0);
+        m_commandList->close();
+
+        m_device->resetEventQuery(slot.query);
+        m_device->executeCommandList(m_commandList);
+        m_device->setEventQuery(slot.query, nvrhi::CommandQueue::Graphics);
+
+        slot.metrics = {};
+        slot.metrics.firstStep = m_firstStep;
+        slot.metrics.stepCount = step - m_firstStep;
+        slot.generation = m_generation;
+        m_readbackQueue.push_back(slotIndex);
+        m_firstStep = step;
+    }
+
+    CollectReadbacks(false);
+}
+
+void MetricsReadback::Flush()
+{
+    CollectReadbacks(true);
+}
+
+void MetricsReadback::CollectReadbacks(bool wait)
+{
+    // Collect the completed readbacks in order
+    while (!m_readbackQueue.empty())
+    {
+        nvrhi::IEventQuery* query = m_slots[m_readbackQueue.front()].query.Get();
+        if (wait)
+        {
+            m_device->waitEventQuery(query);
+        }
+        else if (!m_device->pollEventQuery(query))
+        {
+            break;
+        }
+
+        Slot& slot = m_slots[m_readbackQueue.front()];
+        m_readbackQueue.pop_front();
+        if (slot.generation != m_generation)
+        {
+            continue;
+        }
+
+        const uint32_t* words = static_cast<const uint32_t*>(m_device->mapBuffer(slot.stagingBuffer, nvrhi::CpuAccessMode::Read));
+        if (!words)
+        {
+            Log(Error, "MetricsReadback: Failed to map the staging buffer!");
+            continue;
+        }
+        TrainingMetrics metrics = slot.metrics;
+        float lossSum, maxLoss, lossScale;
+        std::memcpy(&lossSum, words + 0, sizeof(float));
+        std::memcpy(&maxLoss, words + 3, sizeof(float));
+        std::memcpy(&lossScale, words + 4, sizeof(float));
+        metrics.lossSum = lossSum;
+        metrics.sampleCount = words[1];
+        metrics.nonFiniteCount = words[2];
+        metrics.maxLoss = maxLoss;
+        metrics.lossScale = lossScale;
+        metrics.skippedSteps = words[5];
+        m_device->unmapBuffer(slot.stagingBuffer);
+        m_results.push_back(metrics);
+    }
+}
+
+bool MetricsReadback::PopMetrics(TrainingMetrics& metrics)
+{
+    if (m_results.empty())
+    {
+        return false;
+    }
+    metrics = m_results.front();
+    m_results.pop_front();
+    return true;
+}
+
+NAMESPACE_END(fluxel)
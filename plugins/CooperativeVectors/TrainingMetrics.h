@@ -0,0 +1,90 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+
+#include "Fluxel.h"
+#include "Network.h"
+
+NAMESPACE_BEGIN(fluxel)
+
+// Size of the metrics buffer written by AccumulateLoss in Metrics.slang.
+constexpr size_t s_metricsBufferSize = 24;
+
+// Loss statistics of a range of training steps.
+// Every sample contributes its loss averaged over the output components, see SampleLoss in Metrics.slang.
+struct TrainingMetrics
+{
+    uint32_t firstStep = 0; ///< First training step of the range.
+    uint32_t stepCount = 0;
+    double lossSum = 0.0; ///< Sum of the finite sample losses.
+    uint64_t sampleCount = 0; ///< Samples with a finite loss.
+    uint64_t nonFiniteCount = 0; ///< Samples with a NaN or infinite loss, not part of the sum.
+    float maxLoss = 0.f; ///< Largest finite sample loss.
+    float lossScale = 0.f; ///< Loss scale after the last step, 0 without dynamic loss scaling.
+    uint64_t skippedSteps = 0; ///< Steps whose update was skipped after a gradient overflow.
+
+    double GetMeanLoss() const
+    {
+        return sampleCount ? lossSum / double(sampleCount) : 0.0;
+    }
+
+    void AddSample(float loss);
+
+    // Append the metrics of the steps that follow this range.
+    void Merge(TrainingMetrics const& other);
+};
+
+// Reads back the metrics buffer of the training shaders every interval steps without stalling.
+// Each readback copies the buffer to the staging buffer of a free slot and clears it, so the next readback holds
+// the following steps only. When every slot is in flight the readback is postponed and the steps are merged into
+// the next one, so no samples are lost.
+class MetricsReadback
+{
+public:
+    MetricsReadback(nvrhi::DeviceHandle device, uint32_t interval, uint32_t slotCount = 3);
+
+    // Metrics buffer to bind as the RWByteAddressBuffer of AccumulateLoss.
+    nvrhi::BufferHandle GetBuffer() const
+    {
+        return m_metricsBuffer;
+    }
+
+    // Clear the metrics and drop the readbacks in flight, for example when training restarts at firstStep.
+    // Expects an open command list.
+    void Reset(nvrhi::ICommandList* commandList, uint32_t firstStep = 1);
+
+    // Start a readback when interval steps have passed and collect the completed ones, never waits for the device.
+    // step is the next step to run, the command lists of the previous steps have to be executed already.
+    void Update(uint32_t step);
+
+    // Wait for the readbacks in flight and collect them, the steps since the last readback are not read back.
+    void Flush();
+
+    // Oldest completed readback, in step order.
+    bool PopMetrics(TrainingMetrics& metrics);
+
+private:
+    void CollectReadbacks(bool wait);
+
+    struct Slot
+    {
+        nvrhi::BufferHandle stagingBuffer;
+        nvrhi::EventQueryHandle query;
+        TrainingMetrics metrics; ///< Steps of the readback in flight.
+        uint32_t generation = 0;
+    };
+
+    nvrhi::DeviceHandle m_device;
+    nvrhi::CommandListHandle m_commandList;
+    nvrhi::BufferHandle m_metricsBuffer;
+    uint32_t m_interval;
+    uint32_t m_firstStep = 1; ///< First step not yet read back.
+    uint32_t m_generation = 0; ///< Incremented by Reset, older readbacks are dropped.
+
+    std::vector<Slot> m_slots;
+    std::deque<uint32_t> m_readbackQueue; ///< Slots in flight, in step order.
+    std::deque<TrainingMetrics> m_results;
+};
+
+NAMESPACE_END(fluxel)
@@ -0,0 +1,402 @@
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include "TrainingState.h"
+#include "Logger.h"
+
+NAMESPACE_BEGIN(fluxel)
+
+namespace
+{
+constexpr uint8_t s_magic[4] = { 'F', 'X', 'T', 'S' };
+constexpr uint32_t s_headerSize = 64;
+constexpr uint32_t s_sectionEntrySize = 24;
+constexpr uint32_t s_maxSections = 64; ///< Sanity limit for the section table, not a format limit.
+
+void WriteU32(uint8_t* dst, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        dst[i] = uint8_t(value >> (8 * i));
+    }
+}
+
+void WriteU64(uint8_t* dst, uint64_t value)
+{
+    for (int i = 0; i < 8; i++)
+    {
+        dst[i] = uint8_t(value >> (8 * i));
+    }
+}
+
+uint32_t ReadU32(const uint8_t* src)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        value |= uint32_t(src[i]) << (8 * i);
+    }
+    return value;
+}
+
+uint64_t ReadU64(const uint8_t* src)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        value |= uint64_t(src[i]) << (8 * i);
+    }
+    return value;
+}
+
+size_t AlignSection(size_t offset)
+{
+    return (offset + s_trainingStateSectionAlignment - 1) / s_trainingStateSectionAlignment * s_trainingStateSectionAlignment;
+}
+} // namespace
+
+size_t TrainingStateDesc::GetSize() const
+{
+    size_t size = 0;
+    for (TrainingStateSectionDesc const& section : sections)
+    {
+        size += section.size;
+    }
+    return size;
+}
+
+bool TrainingStateDesc::FindSection(TrainingStateSection id, size_t& offset, size_t& size) const
+{
+    offset = 0;
+    for (TrainingStateSectionDesc const& section : sections)
+    {
+        if (section.id == id)
+        {
+            size = section.size;
+            return true;
+        }
+        offset += section.size;
+    }
+    size = 0;
+    return false;
+}
+
+bool IsTrainingStateCompatible(TrainingStateDesc const& expected, TrainingStateDesc const& desc)
+{
+    if (desc.optimizer != expected.optimizer || desc.quantisedState != expected.quantisedState)
+    {
+        Log(Error, "TrainingState: optimizer %d (8-bit moments %d) does not match the trainer, %d (8-bit moments %d).", int(desc.optimizer),
+            int(desc.quantisedState), int(expected.optimizer), int(expected.quantisedState));
+        return false;
+    }
+    if (desc.matrixLayout != expected.matrixLayout || desc.paramCount != expected.paramCount)
+    {
+        Log(Error, "TrainingState: %d parameters in matrix layout %d do not match the trainer, %d parameters in layout %d.", int(desc.paramCount),
+            int(desc.matrixLayout), int(expected.paramCount), int(expected.matrixLayout));
+        return false;
+    }
+    for (TrainingStateSectionDesc const& section : expected.sections)
+    {
+        size_t offset, size;
+        if (!desc.FindSection(section.id, offset, size) || size != section.size)
+        {
+            Log(Error, "TrainingState: section %d is missing or has %d bytes instead of %d.", int(section.id), int(size), int(section.size));
+            return false;
+        }
+    }
+    return true;
+}
+
+bool WriteTrainingStateFile(const std::string& fileName, TrainingStateDesc const& desc, const uint8_t* data, size_t size)
+{
+    if constexpr (std::endian::native != std::endian::little)
+    {
+        Log(Error, "WriteTrainingStateFile: sections are stored little-endian, big-endian hosts are not supported.");
+        return false;
+    }
+    if (size != desc.GetSize())
+    {
+        Log(Error, "WriteTrainingStateFile: %d bytes do not match the %d bytes of the sections.", int(size), int(desc.GetSize()));
+        return false;
+    }
+
+    // Header and section table, the sections follow at aligned offsets
+    const size_t sectionCount = desc.sections.size();
+    std::vector<uint8_t> header(AlignSection(s_headerSize + sectionCount * s_sectionEntrySize), 0);
+    uint8_t* h = header.data();
+    std::memcpy(h, s_magic, sizeof(s_magic));
+    WriteU32(h + 4, s_trainingStateVersion);
+    WriteU32(h + 8, s_headerSize);
+    WriteU32(h + 12, s_sectionEntrySize);
+    WriteU32(h + 16, uint32_t(sectionCount));
+    WriteU32(h + 20, uint32_t(desc.optimizer));
+    WriteU32(h + 24, desc.quantisedState ? 1 : 0);
+    WriteU32(h + 28, uint32_t(desc.matrixLayout));
+    WriteU64(h + 32, desc.paramCount);
+
+    size_t fileOffset = header.size();
+    for (size_t i = 0; i < sectionCount; i++)
+    {
+        uint8_t* entry = h + s_headerSize + i * s_sectionEntrySize;
+        WriteU32(entry, uint32_t(desc.sections[i].id));
+        WriteU64(entry + 8, fileOffset);
+        WriteU64(entry + 16, desc.sections[i].size);
+        fileOffset = AlignSection(fileOffset + desc.sections[i].size);
+    }
+
+    const std::string tempFileName = fileName + ".tmp";
+    {
+        std::ofstream file(tempFileName, std::ios::binary);
+        if (!file.is_open())
+        {
+            Log(Error, "WriteTrainingStateFile: Failed to open %s for writing.", tempFileName.c_str());
+            return false;
+        }
+        file.write(reinterpret_cast<const char*>(header.data()), header.size());
+
+        // Sections are written one at a time from the snapshot, padded to the next aligned offset
+        const char padding[s_trainingStateSectionAlignment] = {};
+        size_t dataOffset = 0;
+        for (TrainingStateSectionDesc const& section : desc.sections)
+        {
+            file.write(reinterpret_cast<const char*>(data) + dataOffset, section.size);
+            file.write(padding, AlignSection(section.size) - section.size);
+            dataOffset += section.size;
+        }
+        if (!file.good())
+        {
+            Log(Error, "WriteTrainingStateFile: Failed to write %s.", tempFileName.c_str());
+            return false;
+        }
+    }
+
+    // Replaces an earlier state of the same name
+    std::error_code error;
+    std::filesystem::rename(tempFileName, fileName, error);
+    if (error)
+    {
+        Log(Error, "WriteTrainingStateFile: Failed to rename %s to %s.", tempFileName.c_str(), fileName.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool ReadTrainingStateFile(const std::string& fileName, TrainingStateDesc& desc, std::vector<uint8_t>& data)
+{
+    if constexpr (std::endian::native != std::endian::little)
+    {
+        Log(Error, "ReadTrainingStateFile: sections are stored little-endian, big-endian hosts are not supported.");
+        return false;
+    }
+
+    std::ifstream file(fileName, std::ios::binary | std::ios::ate);
+    if (!file.is_open())
+    {
+        Log(Error, "ReadTrainingStateFile: File not found %s", fileName.c_str());
+        return false;
+    }
+    const uint64_t fileSize = uint64_t(file.tellg());
+    file.seekg(0);
+
+    uint8_t h[s_headerSize] = {};
+    file.read(reinterpret_cast<char*>(h), sizeof(h));
+    if (!file.good() || std::memcmp(h, s_magic, sizeof(s_magic)) != 0)
+    {
+        Log(Error, "ReadTrainingStateFile: %s is not a training state.", fileName.c_str());
+        return false;
+    }
+
+    const uint32_t version = ReadU32(h + 4);
+    const uint32_t headerSize = ReadU32(h + 8);
+    const uint32_t entrySize = ReadU32(h + 12);
+    const uint32_t sectionCount = ReadU32(h + 16);
+    if (version != s_trainingStateVersion || headerSize != s_headerSize || entrySize != s_sectionEntrySize || sectionCount > s_maxSections)
+    {
+        Log(Error, "ReadTrainingStateFile: Unsupported version %d or header of %s.", int(version), fileName.c_str());
+        return false;
+    }
+
+    desc = {};
+    desc.optimizer = OptimizerType(ReadU32(h + 20));
+    desc.quantisedState = ReadU32(h + 24) != 0;
+    desc.matrixLayout = MatrixLayout(ReadU32(h + 28));
+    desc.paramCount = ReadU64(h + 32);
+
+    std::vector<uint8_t> table(size_t(sectionCount) * s_sectionEntrySize);
+    file.read(reinterpret_cast<char*>(table.data()), table.size());
+    if (!file.good())
+    {
+        Log(Error, "ReadTrainingStateFile: Failed to read the section table of %s.", fileName.c_str());
+        return false;
+    }
+
+    std::vector<uint64_t> offsets(sectionCount);
+    desc.sections.resize(sectionCount);
+    for (uint32_t i = 0; i < sectionCount; i++)
+    {
+        const uint8_t* entry = table.data() + i * s_sectionEntrySize;
+        desc.sections[i].id = TrainingStateSection(ReadU32(entry));
+        offsets[i] = ReadU64(entry + 8);
+        const uint64_t size = ReadU64(entry + 16);
+        if (offsets[i] > fileSize || size > fileSize - offsets[i])
+        {
+            Log(Error, "ReadTrainingStateFile: Section %d of %s is out of range.", int(i), fileName.c_str());
+            return false;
+        }
+        desc.sections[i].size = size_t(size);
+    }
+
+    data.resize(desc.GetSize());
+    size_t dataOffset = 0;
+    for (uint32_t i = 0; i < sectionCount; i++)
+    {
+        file.seekg(std::streamoff(offsets[i]));
+        file.read(reinterpret_cast<char*>(data.data() + dataOffset), desc.sections[i].size);
+        dataOffset += desc.sections[i].size;
+    }
+    if (!file.good())
+    {
+        Log(Error, "ReadTrainingStateFile: Failed to read the sections of %s.", fileName.c_str());
+        return false;
+    }
+    return true;
+}
+
+TrainingStateSource::TrainingStateSource(nvrhi::DeviceHandle device, TrainingStateDesc const& desc, std::vector<Section> const& sections, uint32_t slotCount)
+    : m_device(device), m_desc(desc), m_sections(sections)
+{
+    assert(m_sections.size() == m_desc.sections.size() && "Every section needs a buffer or a host copy");
+
+    for (size_t i = 0; i < m_sections.size(); i++)
+    {
+        assert((m_sections[i].buffer || m_sections[i].read) && "Every section needs a buffer or a host copy");
+        if (m_sections[i].buffer)
+        {
+            m_deviceSize += m_desc.sections[i].size;
+        }
+    }
+    assert((m_device || m_deviceSize == 0) && "Device not present");
+
+    // Staging buffers are created once and reused for every snapshot
+    nvrhi::BufferDesc stagingDesc;
+    stagingDesc.byteSize = m_deviceSize;
+    stagingDesc.cpuAccess = nvrhi::CpuAccessMode::Read;
+    stagingDesc.debugName = "Training State Staging Buffer";
+
+    if (m_deviceSize)
+    {
+        m_commandList = m_device->createCommandList();
+    }
+    m_slots.resize(std::max(1u, slotCount));
+    for (Slot& slot : m_slots)
+    {
+        slot.hostData.resize(m_desc.GetSize());
+        if (m_deviceSize)
+        {
+            slot.stagingBuffer = m_device->createBuffer(stagingDesc);
+            slot.query = m_device->createEventQuery();
+        }
+    }
+}
+
+bool TrainingStateSource::BeginReadback(uint32_t slot)
+{
+    Slot& staging = m_slots[slot];
+    if (m_deviceSize && (!staging.stagingBuffer || !staging.query))
+    {
+        Log(Error, "TrainingStateSource: Failed to create a staging buffer!");
+        return false;
+    }
+
+    if (m_deviceSize)
+    {
+        m_commandList->open();
+    }
+
+    size_t offset = 0;
+    size_t stagingOffset = 0;
+    for (size_t i = 0; i < m_sections.size(); i++)
+    {
+        const size_t size = m_desc.sections[i].size;
+        if (m_sections[i].buffer)
+        {
+            m_commandList->setBufferState(m_sections[i].buffer, nvrhi::ResourceStates::CopySource);
+            m_commandList->commitBarriers();
+            m_commandList->copyBuffer(staging.stagingBuffer, stagingOffset, m_sections[i].buffer, 0, size);
+            m_commandList->setBufferState(m_sections[i].buffer, nvrhi::ResourceStates::UnorderedAccess);
+            stagingOffset += size;
+        }
+        else
+        {
+            m_sections[i].read(staging.hostData.data() + offset);
+        }
+        offset += size;
+    }
+
+    if (m_deviceSize)
+    {
+        m_commandList->commitBarriers();
+        m_commandList->close();
+        m_device->resetEventQuery(staging.query);
+        m_device->executeCommandList(m_commandList);
+        m_device->setEventQuery(staging.query, nvrhi::CommandQueue::Graphics);
+    }
+    return true;
+}
+
+bool TrainingStateSource::IsReadbackComplete(uint32_t slot)
+{
+    return !m_deviceSize || m_device->pollEventQuery(m_slots[slot].query);
+}
+
+bool TrainingStateSource::ReadSlot(uint32_t slot, uint8_t* dst)
+{
+    const Slot& staging = m_slots[slot];
+    const uint8_t* mappedData = nullptr;
+    if (m_deviceSize)
+    {
+        mappedData = static_cast<const uint8_t*>(m_device->mapBuffer(staging.stagingBuffer, nvrhi::CpuAccessMode::Read));
+        if (!mappedData)
+        {
+            Log(Error, "TrainingStateSource: Failed to map the staging buffer!");
+            return false;
+        }
+    }
+
+    size_t offset = 0;
+    size_t stagingOffset = 0;
+    for (size_t i = 0; i < m_sections.size(); i++)
+    {
+        const size_t size = m_desc.sections[i].size;
+        if (m_sections[i].buffer)
+        {
+            std::memcpy(dst + offset, mappedData + stagingOffset, size);
+            stagingOffset += size;
+        }
+        else
+        {
+            std::memcpy(dst + offset, staging.hostData.data() + offset, size);
+        }
+        offset += size;
+    }
+
+    if (m_deviceSize)
+    {
+        m_device->unmapBuffer(staging.stagingBuffer);
+    }
+    return true;
+}
+
+std::unique_ptr<CheckpointWriter> CreateTrainingStateWriter(std::shared_ptr<TrainingStateSource> source)
+{
+    const TrainingStateDesc desc = source->GetDesc();
+    return std::make_unique<CheckpointWriter>(source, [desc](const std::string& fileName, const uint8_t* data, size_t size) {
+        return WriteTrainingStateFile(fileName, desc, data, size);
+    });
+}
+
+NAMESPACE_END(fluxel)
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "Fluxel.h"
+#include "Network.h"
+#include "CheckpointWriter.h"
+#include "Optimizers.h"
+
+NAMESPACE_BEGIN(fluxel)
+
+// Training state file format, everything needed to continue training with bit identical results.
+// All header fields are little-endian fixed width integers, independent of the compiler and platform:
+//
+//   FileHeader      64 bytes   magic "FXTS", version, header and table sizes, optimizer, matrix layout, parameter count
+//   SectionTable    24 bytes   per section: id, offset from the start of the file, size
+//   Sections                   the arrays of the training state, each at a multiple of s_trainingStateSectionAlignment
+//
+// Parameter sized sections are indexed like the parameter buffer of the trainer, in the matrix layout of the header,
+// so a state is only restored by a trainer with the same network, layout and optimizer. Writers that do not keep a
+// section, for example the second moments of Lion, leave it out. Version 2 added the Scheduler section.
+constexpr uint32_t s_trainingStateVersion = 2;
+constexpr size_t s_trainingStateSectionAlignment = 256;
+
+enum class TrainingStateSection : uint32_t
+{
+    Progress = 0, ///< TrainingProgress.
+    NetworkParams = 1, ///< FP16 parameters, with the hash grid features of the trainer.
+    MasterParams = 2, ///< FP32 master parameters.
+    Moments1 = 3, ///< First optimizer moments, FP32 or the 8-bit layout of GetQuantisedStateSize().
+    Moments2 = 4, ///< Second moments of Adam and AdamW.
+    EmaParams = 5, ///< FP32 moving average of the parameters.
+    EmaNetworkParams = 6, ///< FP16 mirror of the moving average.
+    RandState = 7, ///< Random state of every sample of the training batch.
+    LossScale = 8, ///< LossScaleState of the dynamic loss scale.
+    Scheduler = 9, ///< LearningRatePlateauState of the learning rate schedule.
+};
+
+// Host side counters of a training state.
+struct TrainingProgress
+{
+    uint32_t currentStep = 1; ///< Step number of the next training step.
+    uint32_t convertWeights = 0; ///< Non-zero when the FP32 parameters still have to be converted from the FP16 parameters.
+    uint32_t reserved[2] = {};
+};
+static_assert(sizeof(TrainingProgress) == 16, "TrainingProgress is stored as 4 words");
+
+struct TrainingStateSectionDesc
+{
+    TrainingStateSection id = TrainingStateSection::Progress;
+    size_t size = 0; ///< Bytes of the section.
+};
+
+// Contents of a training state. In memory the sections are stored back to back in the order of sections.
+struct TrainingStateDesc
+{
+    OptimizerType optimizer = OptimizerType::Adam;
+    bool quantisedState = false; ///< The moments are stored in 8 bits.
+    MatrixLayout matrixLayout = MatrixLayout::RowMajor; ///< Layout of the parameter sized sections.
+    uint64_t paramCount = 0;
+    std::vector<TrainingStateSectionDesc> sections;
+
+    // Bytes of all sections.
+    size_t GetSize() const;
+
+    // Byte offset of a section in memory, false when the state does not have it.
+    bool FindSection(TrainingStateSection id, size_t& offset, size_t& size) const;
+};
+
+// Check that a training state can be restored by a trainer whose own state is expected. Logs the first difference.
+bool IsTrainingStateCompatible(TrainingStateDesc const& expected, TrainingStateDesc const& desc);
+
+// Write a training state, data holds the sections of desc back to back.
+// The file is written under a temporary name and renamed when complete, so an interrupted write keeps the previous file.
+bool WriteTrainingStateFile(const std::string& fileName, TrainingStateDesc const& desc, const uint8_t* data, size_t size);
+
+// Read a training state, data receives the sections of desc back to back.
+bool ReadTrainingStateFile(const std::string& fileName, TrainingStateDesc& desc, std::vector<uint8_t>& data);
+
+// Snapshots a training state for a CheckpointWriter created with CreateTrainingStateWriter.
+// Every section is copied from a device buffer or by a host callback. When the readback starts the device sections
+// are copied to the staging buffer of the slot on the graphics queue, after the command lists executed before, and the
+// host sections are copied into the slot, so training continues while the state is written.
+class TrainingStateSource : public ICheckpointSource
+{
+public:
+    struct Section
+    {
+        nvrhi::BufferHandle buffer; ///< Device buffer holding the section at offset 0.
+        std::function<void(uint8_t* dst)> read; ///< Host copy of the section, when there is no buffer.
+    };
+
+    // sections are in the order of desc.sections. The device can be null when every section is on the host.
+    TrainingStateSource(nvrhi::DeviceHandle device, TrainingStateDesc const& desc, std::vector<Section> const& sections, uint32_t slotCount = 2);
+
+    uint32_t GetSlotCount() const override
+    {
+        return uint32_t(m_slots.size());
+    }
+
+    size_t GetSize() const override
+    {
+        return m_desc.GetSize();
+    }
+
+    TrainingStateDesc const& GetDesc() const
+    {
+        return m_desc;
+    }
+
+    bool BeginReadback(uint32_t slot) override;
+    bool IsReadbackComplete(uint32_t slot) override;
+    bool ReadSlot(uint32_t slot, uint8_t* dst) override;
+
+private:
+    struct Slot
+    {
+        std::vector<uint8_t> hostData; ///< Host sections at their offsets, device sections are left empty.
+        nvrhi::BufferHandle stagingBuffer; ///< Device sections back to back.
+        nvrhi::EventQueryHandle query;
+    };
+
+    nvrhi::DeviceHandle m_device;
+    TrainingStateDesc m_desc;
+    std::vector<Section> m_sections;
+    size_t m_deviceSize = 0; ///< Bytes of the device sections.
+    nvrhi::CommandListHandle m_commandList;
+    std::vector<Slot> m_slots;
+};
+
+// Writer of the training states of a source, the files are written on the background thread of the writer.
+std::unique_ptr<CheckpointWriter> CreateTrainingStateWriter(std::shared_ptr<TrainingStateSource> source);
+
+NAMESPACE_END(fluxel)
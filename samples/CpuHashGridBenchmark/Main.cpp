@@ -0,0 +1,189 @@
+// Trains the HelloCoopVec image fitting task on the CPU with the frequency encoding and the 4x64 MLP of NetworkConfig.h,
+// and with a hash grid encoding and a smaller MLP, reporting the image error against the number of training steps.
+// The checker texture is replaced by a procedural checker board of the same scale, so the benchmark needs no image loader.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include "Core/Logger.h"
+#include "HashGrid.h"
+#include "Network.h"
+#include "Cpu/HashGridEncoding.h"
+#include "Cpu/InferenceEngine.h"
+#include "Cpu/InputEncoding.h"
+#include "Cpu/LossReduction.h"
+#include "Cpu/TrainingEngine.h"
+
+using namespace fluxel;
+
+namespace
+{
+// Samples per training step, BATCH_SIZE_X * BATCH_SIZE_Y in NetworkConfig.h.
+constexpr size_t s_batchSize = 32 * 32;
+constexpr uint32_t s_reportSteps[] = { 250, 500, 1000, 2000, 4000 };
+constexpr uint32_t s_evaluationSize = 256;
+
+// Squares per side of assets/data/checker.png, which alternates about every 100 of its 4096 pixels.
+constexpr float s_checkerSquares = 42.f;
+
+// Colour of the training image at uv, alternating squares over a colour gradient.
+void Target(float u, float v, float* rgb)
+{
+    const bool dark = ((int(u * s_checkerSquares) + int(v * s_checkerSquares)) & 1) != 0;
+    const float shade = dark ? 0.2f : 0.9f;
+    rgb[0] = shade * (0.5f + 0.5f * u);
+    rgb[1] = shade * (0.5f + 0.5f * v);
+    rgb[2] = shade;
+}
+
+// Same generator as training_cs, one state per sample of the batch.
+float NextRandom(uint32_t& state)
+{
+    const float r = float(state >> 8) * 0x1p-24f;
+    state = state * 2739110765u + 2739110765u;
+    return r;
+}
+
+// Encoding of the network inputs of one configuration, uvs are stored as [count][2] floats.
+struct Encoder
+{
+    const char* name;
+    uint32_t features;
+    void (*encode)(Encoder const& encoder, const float* uvs, size_t count, std::vector<float>& inputs);
+    HashGrid const* grid = nullptr;
+    std::vector<float> gridParams; ///< Trained features of the grid as floats.
+};
+
+void EncodeFrequencyInputs(Encoder const&, const float* uvs, size_t count, std::vector<float>& inputs)
+{
+    std::vector<float> parameters(2 * count);
+    for (size_t s = 0; s < count; s++)
+    {
+        parameters[s] = uvs[2 * s];
+        parameters[count + s] = uvs[2 * s + 1];
+    }
+    cpu::EncodingBatch batch;
+    batch.parameters = parameters.data();
+    batch.parameterCount = 2;
+    batch.count = count;
+    batch.outputs = inputs.data();
+    cpu::EncodeFrequency(batch, true);
+}
+
+void EncodeHashGridInputs(Encoder const& encoder, const float* uvs, size_t count, std::vector<float>& inputs)
+{
+    cpu::EncodeHashGrid(*encoder.grid, encoder.gridParams.data(), uvs, count, inputs.data(), encoder.features);
+}
+
+// Peak signal to noise ratio of the network over an s_evaluationSize^2 grid of pixel centres.
+double EvaluatePsnr(HostNetwork const& network, Encoder const& encoder)
+{
+    const size_t count = size_t(s_evaluationSize) * s_evaluationSize;
+    std::vector<float> uvs(2 * count), inputs(count * encoder.features), outputs(3 * count);
+    for (size_t s = 0; s < count; s++)
+    {
+        uvs[2 * s] = (float(s % s_evaluationSize) + 0.5f) / s_evaluationSize;
+        uvs[2 * s + 1] = (float(s / s_evaluationSize) + 0.5f) / s_evaluationSize;
+    }
+    encoder.encode(encoder, uvs.data(), count, inputs);
+
+    cpu::InferenceEngine engine;
+    if (!engine.Initialise(network))
+    {
+        return 0.0;
+    }
+    engine.Evaluate(inputs.data(), count, outputs.data());
+
+    std::vector<float> targets(3 * count);
+    for (size_t s = 0; s < count; s++)
+    {
+        Target(uvs[2 * s], uvs[2 * s + 1], targets.data() + 3 * s);
+    }
+    const TrainingMetrics metrics = cpu::ReduceLoss(cpu::Loss::L2, outputs.data(), targets.data(), count, 3);
+    return 10.0 * std::log10(1.0 / metrics.GetMeanLoss());
+}
+
+void Train(Encoder& encoder, HashGrid* grid, uint32_t hiddenLayers, uint32_t hidden, float learningRate)
+{
+    NetworkArchitecture netArch;
+    netArch.numHiddenLayers = hiddenLayers;
+    netArch.inputNeurons = encoder.features;
+    netArch.hiddenNeurons = hidden;
+    netArch.outputNeurons = 3;
+
+    HostNetwork network(std::make_shared<NetworkUtilities>());
+    cpu::TrainingEngine engine;
+    if (!network.Initialise(netArch, 1337) || !(grid ? engine.Initialise(network, *grid) : engine.Initialise(network)))
+    {
+        Log(Error, "Failed to create the %s network.", encoder.name);
+        return;
+    }
+
+    std::vector<uint32_t> randState(s_batchSize);
+    for (size_t s = 0; s < s_batchSize; s++)
+    {
+        randState[s] = uint32_t(s) * 2654435761u + 1u;
+    }
+
+    const uint32_t inputCount = engine.GetInputCount();
+    std::vector<float> uvs(2 * s_batchSize), inputs(s_batchSize * encoder.features), targets(3 * s_batchSize);
+    double trainingTime = 0.0;
+    uint32_t step = 0;
+    for (uint32_t reportStep : s_reportSteps)
+    {
+        for (; step < reportStep; step++)
+        {
+            for (size_t s = 0; s < s_batchSize; s++)
+            {
+                uvs[2 * s] = NextRandom(randState[s]);
+                uvs[2 * s + 1] = NextRandom(randState[s]);
+                Target(uvs[2 * s], uvs[2 * s + 1], targets.data() + 3 * s);
+            }
+
+            // The hash grid is encoded inside the training step, the frequency encoding is part of the step time too
+            const auto start = std::chrono::high_resolution_clock::now();
+            if (!grid)
+            {
+                encoder.encode(encoder, uvs.data(), s_batchSize, inputs);
+            }
+            engine.Step(grid ? uvs.data() : inputs.data(), targets.data(), s_batchSize, learningRate);
+            const auto end = std::chrono::high_resolution_clock::now();
+            trainingTime += std::chrono::duration<double, std::milli>(end - start).count();
+        }
+
+        engine.UpdateNetwork(network);
+        if (grid)
+        {
+            engine.UpdateHashGrid(*grid);
+            encoder.gridParams.resize(grid->GetParamCount());
+            cpu::GetBestKernels().halfToFloat(reinterpret_cast<const uint16_t*>(grid->GetParams().data()), encoder.gridParams.data(), grid->GetParamCount());
+        }
+        Log(Info, "%-10s %d->%dx%d->3 (%d inputs)  step %5d  PSNR %6.2f dB  %7.3f ms/step", encoder.name, int(encoder.features), int(hidden),
+            int(hiddenLayers), int(inputCount), int(step), EvaluatePsnr(network, encoder), trainingTime / step);
+    }
+}
+} // namespace
+
+int main()
+{
+    Log(Info, "HelloCoopVec image fitting on the CPU, %d samples per step, %s kernels", int(s_batchSize), cpu::GetBestKernels().name);
+
+    // NetworkConfig.h with the frequency encoding
+    Encoder frequency = { "frequency", 2 * cpu::s_frequencyEncodingCount, EncodeFrequencyInputs };
+    Train(frequency, nullptr, 4, 64, 1e-3f);
+
+    // NetworkConfig.h with HASH_GRID_ENCODING
+    HashGridDesc gridDesc;
+    HashGrid grid;
+    if (!grid.Initialise(gridDesc, 1337))
+    {
+        return 1;
+    }
+    Encoder hashGrid = { "hash grid", grid.GetOutputCount(), EncodeHashGridInputs, &grid };
+    Train(hashGrid, &grid, 2, 32, 1e-2f);
+
+    return 0;
+}
@@ -0,0 +1,122 @@
+// Compares the CPU forward passes specialised at compile time against the generic path
+// for every shape in FLUXEL_SPECIALISED_MLP_SHAPES, and the tiles sized for L1 against tiles that spill out of it.
+// Also compares the quantised 8 and 16 bit activation paths against the FP16 path they approximate.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include "Core/Logger.h"
+#include "Network.h"
+#include "Cpu/CpuFeatures.h"
+#include "Cpu/InferenceEngine.h"
+#include "Cpu/QuantisedInferenceEngine.h"
+#include "Cpu/SpecialisedMLP.h"
+
+using namespace fluxel;
+
+namespace
+{
+constexpr size_t s_sampleCount = 1 << 16;
+constexpr int s_repetitions = 20;
+constexpr uint32_t s_largeTileRows = 4096;
+
+// Best of s_repetitions evaluations, in milliseconds.
+template <typename TEngine>
+double Benchmark(TEngine const& engine, std::vector<float> const& inputs, std::vector<float>& outputs)
+{
+    double best = INFINITY;
+    for (int i = 0; i < s_repetitions; i++)
+    {
+        const auto start = std::chrono::high_resolution_clock::now();
+        engine.Evaluate(inputs.data(), s_sampleCount, outputs.data());
+        const auto end = std::chrono::high_resolution_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    return best;
+}
+
+void BenchmarkShape(uint32_t inputs, uint32_t hiddenLayers, uint32_t hidden, uint32_t outputs)
+{
+    NetworkArchitecture netArch;
+    netArch.numHiddenLayers = hiddenLayers;
+    netArch.inputNeurons = inputs;
+    netArch.hiddenNeurons = hidden;
+    netArch.outputNeurons = outputs;
+
+    HostNetwork network(std::make_shared<NetworkUtilities>());
+    if (!network.Initialise(netArch, 1))
+    {
+        Log(Error, "Failed to create a %d->%dx%d->%d network.", inputs, hidden, hiddenLayers, outputs);
+        return;
+    }
+
+    std::vector<float> samples(s_sampleCount * inputs);
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        samples[i] = std::sin(float(i) * 0.731f);
+    }
+
+    cpu::InferenceEngineDesc genericDesc;
+    genericDesc.specialisedKernels = false;
+    cpu::InferenceEngineDesc largeTileDesc;
+    largeTileDesc.tileRows = s_largeTileRows;
+    cpu::InferenceEngine generic, specialised, largeTiles;
+    if (!generic.Initialise(network, genericDesc) || !specialised.Initialise(network) || !largeTiles.Initialise(network, largeTileDesc))
+    {
+        Log(Error, "Failed to initialise the inference engines.");
+        return;
+    }
+
+    std::vector<float> genericOutputs(s_sampleCount * outputs), specialisedOutputs(s_sampleCount * outputs), largeTileOutputs(s_sampleCount * outputs);
+    const double genericTime = Benchmark(generic, samples, genericOutputs);
+    const double specialisedTime = Benchmark(specialised, samples, specialisedOutputs);
+    const double largeTileTime = Benchmark(largeTiles, samples, largeTileOutputs);
+
+    float maxError = 0.f;
+    for (size_t i = 0; i < genericOutputs.size(); i++)
+    {
+        maxError = std::max(maxError, std::fabs(genericOutputs[i] - specialisedOutputs[i]));
+        maxError = std::max(maxError, std::fabs(genericOutputs[i] - largeTileOutputs[i]));
+    }
+
+    Log(Info, "%3d->%3dx%d->%2d  generic %7.3f ms  specialised %7.3f ms  speedup %.2fx  %d row tiles %7.3f ms  max error %g%s", inputs, hidden,
+        hiddenLayers, outputs, genericTime, specialisedTime, genericTime / specialisedTime, int(s_largeTileRows), largeTileTime, maxError,
+        specialised.IsSpecialised() ? "" : "  (not specialised)");
+
+    cpu::InferenceEngineDesc halfDesc;
+    halfDesc.halfPrecisionActivations = true;
+    cpu::QuantisedInferenceEngineDesc i16Desc;
+    i16Desc.activations = cpu::QuantisedActivations::I16;
+    cpu::InferenceEngine half;
+    cpu::QuantisedInferenceEngine i8, i16;
+    if (!half.Initialise(network, halfDesc) || !i8.Initialise(network, samples.data(), s_sampleCount) ||
+        !i16.Initialise(network, samples.data(), s_sampleCount, i16Desc))
+    {
+        Log(Error, "Failed to initialise the quantised inference engines.");
+        return;
+    }
+
+    const double halfTime = Benchmark(half, samples, genericOutputs);
+    const double i8Time = Benchmark(i8, samples, genericOutputs);
+    const double i16Time = Benchmark(i16, samples, genericOutputs);
+    Log(Info, "%3d->%3dx%d->%2d  fp16 %7.3f ms  int8 %7.3f ms  speedup %.2fx  max error %g  int16 %7.3f ms  speedup %.2fx  max error %g", inputs,
+        hidden, hiddenLayers, outputs, halfTime, i8Time, halfTime / i8Time, i8.GetCalibrationError().maxAbsError, i16Time, halfTime / i16Time,
+        i16.GetCalibrationError().maxAbsError);
+}
+} // namespace
+
+int main()
+{
+    Log(Info, "CPU MLP forward pass, %d samples, %s kernels, %d KB L1 data cache", int(s_sampleCount), cpu::GetBestKernels().name,
+        int(cpu::GetCpuFeatures().l1DataCacheSize / 1024));
+    Log(Info, "Quantised paths use the %s kernels", cpu::GetBestQuantisedKernels().name);
+
+#define FLUXEL_BENCHMARK_SHAPE(inputs, hiddenLayers, hidden, outputs) BenchmarkShape(inputs, hiddenLayers, hidden, outputs);
+    FLUXEL_SPECIALISED_MLP_SHAPES(FLUXEL_BENCHMARK_SHAPE)
+#undef FLUXEL_BENCHMARK_SHAPE
+
+    return 0;
+}
@@ -0,0 +1,245 @@
+// Measures the accuracy and the throughput of the approximations of Cpu/FastMath.h for every kernel table the host supports,
+// against the C library, and the transcendental activations of the best kernels against the scalar reference.
+// Also times the batched input encoders of Cpu/InputEncoding.h and checks that every kernel table encodes the same values.
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "Core/Logger.h"
+#include "Cpu/InputEncoding.h"
+#include "Cpu/Kernels.h"
+
+using namespace fluxel;
+
+namespace
+{
+constexpr size_t s_batchSize = 1 << 16;
+constexpr int s_repetitions = 50;
+
+// Every s_sweepStride-th bit pattern of the 32 bit floats is tested for accuracy.
+constexpr uint64_t s_sweepStride = 251;
+
+using FastMathKernel = void (*)(const float* src, float* dst, size_t count);
+
+struct MathFunction
+{
+    const char* name;
+    FastMathKernel cpu::KernelTable::*kernel;
+    double (*reference)(double x);
+    float (*library)(float x);
+};
+
+const MathFunction s_functions[] = {
+    { "exp", &cpu::KernelTable::fastExp, [](double x) { return std::exp(x); }, [](float x) { return std::exp(x); } },
+    { "sigmoid", &cpu::KernelTable::fastSigmoid, [](double x) { return 1.0 / (1.0 + std::exp(-x)); }, [](float x) { return 1.f / (1.f + std::exp(-x)); } },
+    { "tanh", &cpu::KernelTable::fastTanh, [](double x) { return std::tanh(x); }, [](float x) { return std::tanh(x); } },
+    { "softplus", &cpu::KernelTable::fastSoftplus, [](double x) { return std::max(x, 0.0) + std::log1p(std::exp(-std::fabs(x))); },
+      [](float x) { return std::max(x, 0.f) + std::log1p(std::exp(-std::fabs(x))); } },
+};
+
+// Error of value in units in the last place of the float nearest to the exact result.
+double UlpError(float value, double exact)
+{
+    const float rounded = float(exact);
+    if (std::isnan(rounded) || std::isnan(value))
+    {
+        return std::isnan(rounded) == std::isnan(value) ? 0.0 : INFINITY;
+    }
+    if (std::isinf(rounded) || std::isinf(value))
+    {
+        return value == rounded ? 0.0 : INFINITY;
+    }
+    const float magnitude = std::fabs(rounded);
+    const double ulp = double(std::nextafter(magnitude, INFINITY)) - double(magnitude);
+    return std::fabs(double(value) - exact) / ulp;
+}
+
+// Maximum error over the sweep of the finite floats.
+double MaxUlpError(MathFunction const& function, FastMathKernel kernel)
+{
+    std::vector<float> inputs, outputs(s_batchSize);
+    inputs.reserve(s_batchSize);
+    double maxError = 0.0;
+    auto flush = [&]() {
+        kernel(inputs.data(), outputs.data(), inputs.size());
+        for (size_t i = 0; i < inputs.size(); i++)
+        {
+            maxError = std::max(maxError, UlpError(outputs[i], function.reference(double(inputs[i]))));
+        }
+        inputs.clear();
+    };
+
+    for (uint64_t bits = 0; bits < (uint64_t(1) << 32); bits += s_sweepStride)
+    {
+        const float x = std::bit_cast<float>(uint32_t(bits));
+        if (std::isfinite(x))
+        {
+            inputs.push_back(x);
+        }
+        if (inputs.size() == s_batchSize)
+        {
+            flush();
+        }
+    }
+    flush();
+    return maxError;
+}
+
+// Best of s_repetitions calls in nanoseconds per value.
+template <typename F>
+double Benchmark(F const& function)
+{
+    double best = INFINITY;
+    for (int i = 0; i < s_repetitions; i++)
+    {
+        const auto start = std::chrono::high_resolution_clock::now();
+        function();
+        const auto end = std::chrono::high_resolution_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::nano>(end - start).count());
+    }
+    return best / double(s_batchSize);
+}
+
+void BenchmarkFunction(MathFunction const& function, std::vector<cpu::KernelTable const*> const& tables, std::vector<float> const& inputs)
+{
+    std::vector<float> outputs(inputs.size());
+    const double libraryTime = Benchmark([&]() {
+        for (size_t i = 0; i < inputs.size(); i++)
+        {
+            outputs[i] = function.library(inputs[i]);
+        }
+    });
+    Log(Info, "%-8s  %-8s                    %7.3f ns/value", function.name, "C library", libraryTime);
+
+    for (cpu::KernelTable const* table : tables)
+    {
+        const FastMathKernel kernel = table->*function.kernel;
+        const double time = Benchmark([&]() { kernel(inputs.data(), outputs.data(), inputs.size()); });
+        Log(Info, "%-8s  %-8s  max error %5.2f ULP  %7.3f ns/value  speedup %5.2fx", function.name, table->name, MaxUlpError(function, kernel), time,
+            libraryTime / time);
+    }
+}
+
+void BenchmarkActivation(const char* name, cpu::ActivationDesc const& act, std::vector<float> const& inputs)
+{
+    cpu::KernelTable const& reference = cpu::GetScalarKernels();
+    cpu::KernelTable const& best = cpu::GetBestKernels();
+    std::vector<float> referenceOutputs(inputs), outputs(inputs);
+    reference.activate(act, referenceOutputs.data(), referenceOutputs.size());
+    best.activate(act, outputs.data(), outputs.size());
+
+    float maxError = 0.f;
+    for (size_t i = 0; i < outputs.size(); i++)
+    {
+        maxError = std::max(maxError, std::fabs(outputs[i] - referenceOutputs[i]));
+    }
+
+    // The activations work in place, so every repetition starts from a copy of the inputs
+    const double referenceTime = Benchmark([&]() {
+        std::memcpy(referenceOutputs.data(), inputs.data(), inputs.size() * sizeof(float));
+        reference.activate(act, referenceOutputs.data(), referenceOutputs.size());
+    });
+    const double time = Benchmark([&]() {
+        std::memcpy(outputs.data(), inputs.data(), inputs.size() * sizeof(float));
+        best.activate(act, outputs.data(), outputs.size());
+    });
+    Log(Info, "%-20s  scalar %7.3f ns/value  %s %7.3f ns/value  speedup %5.2fx  max error %g", name, referenceTime, best.name, time, referenceTime / time,
+        maxError);
+}
+// Samples of s_encodingParameters parameters, encoded by the kernels of every table and by the batched encoders.
+constexpr uint32_t s_encodingParameters = 2;
+
+void BenchmarkEncoding(const char* name, uint32_t featuresPerParameter, std::vector<cpu::KernelTable const*> const& tables, std::vector<float> const& inputs,
+                       void (*encodeKernel)(cpu::KernelTable const& kernels, const float* x, float* features, size_t count),
+                       void (*encodeBatch)(cpu::EncodingBatch const& batch))
+{
+    // The inputs are used as s_encodingParameters rows of s_batchSize / s_encodingParameters samples
+    const size_t count = inputs.size() / s_encodingParameters;
+    std::vector<float> reference(inputs.size() * featuresPerParameter), features(reference.size());
+    encodeKernel(cpu::GetScalarKernels(), inputs.data(), reference.data(), inputs.size());
+
+    double scalarTime = 0.0;
+    for (cpu::KernelTable const* table : tables)
+    {
+        encodeKernel(*table, inputs.data(), features.data(), inputs.size());
+        const bool identical = std::memcmp(features.data(), reference.data(), features.size() * sizeof(float)) == 0;
+        const double time = Benchmark([&]() { encodeKernel(*table, inputs.data(), features.data(), inputs.size()); });
+        scalarTime = scalarTime > 0.0 ? scalarTime : time;
+        Log(Info, "%-18s  %-8s  %7.3f ns/value  speedup %5.2fx  %s", name, table->name, time, scalarTime / time,
+            identical ? "identical to scalar" : "DIFFERS from scalar");
+    }
+
+    cpu::EncodingBatch batch;
+    batch.parameters = inputs.data();
+    batch.parameterCount = s_encodingParameters;
+    batch.count = count;
+    batch.outputs = features.data();
+    const double batchTime = Benchmark([&]() { encodeBatch(batch); });
+    Log(Info, "%-18s  batched to sample major rows %7.3f ns/value", name, batchTime);
+}
+} // namespace
+
+int main()
+{
+    std::vector<cpu::KernelTable const*> tables = { &cpu::GetScalarKernels() };
+    for (cpu::KernelTable const* table : { cpu::GetAvx2Kernels(), cpu::GetAvx512Kernels() })
+    {
+        if (table)
+        {
+            tables.push_back(table);
+        }
+    }
+
+    // Activation inputs of a typical network, uniform in [-8, 8]
+    std::vector<float> inputs(s_batchSize);
+    for (size_t i = 0; i < inputs.size(); i++)
+    {
+        inputs[i] = 16.f * float(i) / float(inputs.size()) - 8.f;
+    }
+
+    Log(Info, "Fast math approximations, %d values per call, accuracy over every %dth float", int(s_batchSize), int(s_sweepStride));
+    for (MathFunction const& function : s_functions)
+    {
+        BenchmarkFunction(function, tables, inputs);
+    }
+
+    Log(Info, "Activations of the %s kernels against the scalar reference", cpu::GetBestKernels().name);
+    BenchmarkActivation("exponential", { cpu::Activation::Exponential, 0.f }, inputs);
+    BenchmarkActivation("sigmoid", { cpu::Activation::Sigmoid, 0.f }, inputs);
+    BenchmarkActivation("swish", { cpu::Activation::Swish, 0.f }, inputs);
+    BenchmarkActivation("tanh", { cpu::Activation::Tanh, 0.f }, inputs);
+    BenchmarkActivation("leaky ReLU", { cpu::Activation::LeakyReLU, 0.01f }, inputs);
+
+    // Encoder inputs in [-1, 1], values per second count the encoded parameters
+    std::vector<float> coordinates(s_batchSize);
+    for (size_t i = 0; i < coordinates.size(); i++)
+    {
+        coordinates[i] = inputs[i] / 8.f;
+    }
+
+    Log(Info, "Input encoders of %d parameters, half precision", int(s_encodingParameters));
+    BenchmarkEncoding(
+        "frequency", cpu::s_frequencyEncodingCount, tables, coordinates,
+        [](cpu::KernelTable const& kernels, const float* x, float* features, size_t count) {
+            kernels.encodeFrequency(x, features, count, count, cpu::s_frequencyEncodingCount / 2, cpu::EncodingRounding::Recurrence);
+        },
+        [](cpu::EncodingBatch const& batch) { cpu::EncodeFrequency(batch, true); });
+    BenchmarkEncoding(
+        "frequency 8 scales", 16, tables, coordinates,
+        [](cpu::KernelTable const& kernels, const float* x, float* features, size_t count) {
+            kernels.encodeFrequency(x, features, count, count, 8, cpu::EncodingRounding::Outputs);
+        },
+        [](cpu::EncodingBatch const& batch) { cpu::EncodeFrequencyN(batch, 8, true); });
+    BenchmarkEncoding(
+        "triangle", cpu::s_triangleEncodingCount, tables, coordinates,
+        [](cpu::KernelTable const& kernels, const float* x, float* features, size_t count) {
+            kernels.encodeTriangle(x, features, count, count, cpu::s_triangleEncodingCount, true);
+        },
+        [](cpu::EncodingBatch const& batch) { cpu::EncodeTriangle(batch, true); });
+
+    return 0;
+}
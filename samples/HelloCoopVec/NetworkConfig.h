@@ -8,14 +8,35 @@
  * license agreement from NVIDIA CORPORATION is strictly prohibited.
  */
 
+// Encode the uv with a multiresolution hash grid (HashGrid.slang) instead of the frequency encoding.
+// The grid resolves the detail of the image with a smaller network and a higher learning rate.
+#define HASH_GRID_ENCODING 0
+
 #define INPUT_FEATURES 2
-#define INPUT_NEURONS (INPUT_FEATURES * 6) // Frequency encoding increases the input by 6 for each input
 #define OUTPUT_NEURONS 3
 
+#if HASH_GRID_ENCODING
+#define HASH_GRID_LEVELS 16
+#define HASH_GRID_FEATURES_PER_LEVEL 2
+#define HASH_GRID_LOG2_TABLE_SIZE 16
+#define HASH_GRID_BASE_RESOLUTION 16
+#define HASH_GRID_FINEST_RESOLUTION 1024
+#define INPUT_NEURONS (HASH_GRID_LEVELS * HASH_GRID_FEATURES_PER_LEVEL)
+
+#define HIDDEN_NEURONS 32
+#define NUM_HIDDEN_LAYERS 2
+
+#define BASE_LEARNING_RATE 0.01f
+#else
+#define INPUT_NEURONS (INPUT_FEATURES * 6) // Frequency encoding increases the input by 6 for each input
+
 #define HIDDEN_NEURONS 64
 #define NUM_HIDDEN_LAYERS 4
 
 #define BASE_LEARNING_RATE 0.001f
+#endif
+// Default learning rate schedule, its shape and the reduce on plateau mode are selected at runtime, see
+// LearningRateScheduleDesc in LearningRateScheduler.h
 #define MIN_LEARNING_RATE 0.0001f
 #define WARMUP_LEARNING_STEPS 0
 #define FLAT_LEARNING_STEPS 1000000
@@ -23,7 +44,29 @@
 
 #define NUM_TRANSITIONS (NUM_HIDDEN_LAYERS + 1)
 #define NUM_TRANSITIONS_ALIGN4 ((NUM_TRANSITIONS + 3) / 4)
+// Optimizer of optimizer_cs, the values of OptimizerType in Optimizers.h. Lion usually needs a 3-10x lower learning rate.
+#define OPTIMIZER_ADAM 0
+#define OPTIMIZER_ADAMW 1
+#define OPTIMIZER_LION 2
+#define OPTIMIZER_SGD_NESTEROV 3
+#define OPTIMIZER OPTIMIZER_ADAM
+
+// Keep the optimizer moments in 8 bits with blockwise dynamic quantisation instead of FP32
+#define OPTIMIZER_STATE_8BIT 0
+
+// Keep an exponential moving average of the parameters in optimizer_cs, selectable for inference and checkpoints.
+// The decay of step t is limited to (1 + t) / (EMA_WARMUP_STEPS + t).
+#define EMA_WEIGHTS 0
+#define EMA_DECAY 0.999f
+#define EMA_WARMUP_STEPS 10
+
+// Initial loss scale, adjusted after every step by UpdateLossScale
 #define LOSS_SCALE 1024.0
+#define LOSS_SCALE_GROWTH_FACTOR 2.0
+#define LOSS_SCALE_BACKOFF_FACTOR 0.5
+#define LOSS_SCALE_GROWTH_INTERVAL 2000
+#define LOSS_SCALE_MIN 1.0
+#define LOSS_SCALE_MAX 65536.0
 #define RELU_LEAK 0.01h
 
 #define VECTOR_FORMAT half
@@ -36,6 +79,9 @@
 #define BATCH_SIZE_X 32
 #define BATCH_SIZE_Y 32
 
+// Steps between readbacks of the training loss
+#define METRICS_READBACK_STEPS 1024
+
 enum class NetworkTransform
 {
     Identity,
@@ -47,6 +93,9 @@ struct NeuralConstants
 {
     uint4 weightOffsets[NUM_TRANSITIONS_ALIGN4];
     uint4 biasOffsets[NUM_TRANSITIONS_ALIGN4];
+#if HASH_GRID_ENCODING
+    uint4 hashGridLevels[HASH_GRID_LEVELS];
+#endif
 
     uint32_t imageWidth;
     uint32_t imageHeight;
@@ -57,4 +106,11 @@ struct NeuralConstants
     uint32_t batchSizeX;
     uint32_t batchSizeY;
     NetworkTransform networkTransform;
+
+    // Per-step constants of the optimizer, see OptimizerStepConstants in Optimizers.h
+    float optimizerStepSize;
+    float optimizerRsqrtBiasCorrection2;
+    float optimizerDecayFactor;
+    uint32_t convertWeights; ///< Non-zero on the first step after the parameters were uploaded.
+    float emaDecay;
 };
\ No newline at end of file
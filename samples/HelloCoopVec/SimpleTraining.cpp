@@ -25,19 +25,16 @@
 #include <donut/core/math/math.h>
 #include <donut/core/json.h>
 #include <nvrhi/utils.h>
-#include <random>
 
 #include "Utils/DeviceUtils.h"
 #include "plugins/CooperativeVectors/CooperativeVectors.h"
-#include "plugins/CooperativeVectors/Network.h"
-#include "plugins/CooperativeVectors/LearningRateScheduler.h"
 #include "Utils/FileSystem.h"
+#include "TrainingPipeline.h"
 
 using namespace donut;
 using namespace donut::math;
 using namespace fluxel;
 
-#include "NetworkConfig.h"
 #include <donut/shaders/view_cb.h>
 
 static const char* g_windowTitle = "RTX Neural Shading Example: Simple Training (Ground Truth | Training | Loss )";
@@ -47,11 +44,19 @@ struct UIData
     bool reset = false;
     bool training = true;
     bool load = false;
+    bool trainingState = false; ///< The file is a training state instead of a network.
     std::string fileName;
     float trainingTime = 0.0f;
     uint32_t epochs = 0;
     uint32_t adamSteps = 0;
     float learningRate = 0.0f;
+    float loss = 0.0f;
+    float lossScale = LOSS_SCALE;
+    uint64_t skippedSteps = 0;
+    bool emaWeights = false; ///< Infer and save with the moving average of the parameters.
+    LearningRateSchedule learningRateSchedule = LearningRateSchedule::Cosine;
+    bool reduceOnPlateau = false;
+    bool updateSchedule = false; ///< Apply the schedule selection to the training pipeline.
     NetworkTransform networkTransform = NetworkTransform::Identity;
 };
 
@@ -91,236 +96,67 @@ public:
         }
         m_InputTexture = texture->texture;
 
-        ////////////////////
-        //
-        // Create the Neural network class and initialise it the hyper parameters from NetworkConfig.h.
-        //
-        ////////////////////
-        m_networkUtils = std::make_shared<NetworkUtilities>(GetDevice());
-        m_neuralNetwork = std::make_unique<HostNetwork>(m_networkUtils);
-
-        // Store the network architecture that is expected in the shaders
-        m_shaderNetworkArch = {};
-        m_shaderNetworkArch.inputNeurons = INPUT_NEURONS;
-        m_shaderNetworkArch.hiddenNeurons = HIDDEN_NEURONS;
-        m_shaderNetworkArch.outputNeurons = OUTPUT_NEURONS;
-        m_shaderNetworkArch.numHiddenLayers = NUM_HIDDEN_LAYERS;
-        m_shaderNetworkArch.biasPrecision = NETWORK_PRECISION;
-        m_shaderNetworkArch.weightPrecision = NETWORK_PRECISION;
-
-        if (!m_neuralNetwork->Initialise(m_shaderNetworkArch))
-        {
-            log::error("Failed to create a network.");
-            return false;
-        }
+        auto inputTexDesc = m_InputTexture->getDesc();
+        inputTexDesc.debugName = "InferenceTexture";
+        inputTexDesc.format = nvrhi::Format::RGBA16_FLOAT;
+        inputTexDesc.isUAV = true;
+        inputTexDesc.initialState = nvrhi::ResourceStates::UnorderedAccess;
+        inputTexDesc.keepInitialState = true;
+        m_InferenceTexture = GetDevice()->createTexture(inputTexDesc);
 
-        // Get a device optimized layout
-        m_deviceNetworkLayout = m_networkUtils->GetNewMatrixLayout(m_neuralNetwork->GetNetworkLayout(), MatrixLayout::TrainingOptimal);
+        inputTexDesc.debugName = "LossTexture";
+        m_LossTexture = GetDevice()->createTexture(inputTexDesc);
 
         ////////////////////
         //
-        // Create the shaders/buffers/textures for the Neural Training
+        // Create the network and the training passes, see TrainingPipeline.h
         //
         ////////////////////
-        m_InferencePass.m_ShaderCS = m_ShaderFactory->CreateShader("app/SimpleTraining_Inference", "inference_cs", nullptr, nvrhi::ShaderType::Compute);
-        m_TrainingPass.m_ShaderCS = m_ShaderFactory->CreateShader("app/SimpleTraining_Training", "training_cs", nullptr, nvrhi::ShaderType::Compute);
-        m_OptimizerPass.m_ShaderCS = m_ShaderFactory->CreateShader("app/SimpleTraining_Optimizer", "adam_cs", nullptr, nvrhi::ShaderType::Compute);
-        m_ConvertWeightsPass.m_ShaderCS = m_ShaderFactory->CreateShader("app/SimpleTraining_Optimizer", "convert_weights_cs", nullptr, nvrhi::ShaderType::Compute);
-
-        const auto& params = m_neuralNetwork->GetNetworkParams();
-
-        nvrhi::BufferDesc paramsBufferDesc;
-        paramsBufferDesc.byteSize = params.size();
-        paramsBufferDesc.debugName = "MLPParamsHostBuffer";
-        paramsBufferDesc.canHaveUAVs = true;
-        paramsBufferDesc.initialState = nvrhi::ResourceStates::CopyDest;
-        paramsBufferDesc.keepInitialState = true;
-        m_mlpHostBuffer = GetDevice()->createBuffer(paramsBufferDesc);
-
-        // Create a buffer for a device optimized parameters layout
-        paramsBufferDesc.byteSize = m_deviceNetworkLayout.networkSize;
-        paramsBufferDesc.canHaveRawViews = true;
-        paramsBufferDesc.canHaveUAVs = true;
-        paramsBufferDesc.canHaveTypedViews = true;
-        paramsBufferDesc.format = nvrhi::Format::R16_FLOAT;
-        paramsBufferDesc.debugName = "MLPParamsByteAddressBuffer";
-        paramsBufferDesc.initialState = nvrhi::ResourceStates::UnorderedAccess;
-        m_mlpDeviceBuffer = GetDevice()->createBuffer(paramsBufferDesc);
-
-        // Upload the parameters
-        UpdateDeviceNetworkParameters(m_commandList);
-
-        m_TotalParamCount = (uint32_t)(paramsBufferDesc.byteSize / sizeof(uint16_t));
-
-        paramsBufferDesc.debugName = "MLPParametersFloat";
-        paramsBufferDesc.initialState = nvrhi::ResourceStates::UnorderedAccess;
-        paramsBufferDesc.byteSize = m_TotalParamCount * sizeof(float); // convert to float
-        paramsBufferDesc.format = nvrhi::Format::R32_FLOAT;
-        m_mlpDeviceFloatBuffer = GetDevice()->createBuffer(paramsBufferDesc);
-        m_commandList->beginTrackingBufferState(m_mlpDeviceFloatBuffer, nvrhi::ResourceStates::UnorderedAccess);
-        m_commandList->clearBufferUInt(m_mlpDeviceFloatBuffer, 0);
-
-        paramsBufferDesc.debugName = "MLPGradientsBuffer";
-        paramsBufferDesc.initialState = nvrhi::ResourceStates::UnorderedAccess;
-        paramsBufferDesc.byteSize = (m_TotalParamCount * sizeof(uint16_t) + 3) & ~3; // Round up to nearest multiple of 4
-        paramsBufferDesc.format = nvrhi::Format::R16_FLOAT;
-        m_mlpGradientsBuffer = GetDevice()->createBuffer(paramsBufferDesc);
-        m_commandList->beginTrackingBufferState(m_mlpGradientsBuffer, nvrhi::ResourceStates::UnorderedAccess);
-        m_commandList->clearBufferUInt(m_mlpGradientsBuffer, 0);
-
-        paramsBufferDesc.debugName = "MLPMoments1Buffer";
-        paramsBufferDesc.initialState = nvrhi::ResourceStates::UnorderedAccess;
-        paramsBufferDesc.byteSize = m_TotalParamCount * sizeof(float);
-        paramsBufferDesc.format = nvrhi::Format::R32_FLOAT;
-        paramsBufferDesc.canHaveRawViews = false;
-        m_mlpMoments1Buffer = GetDevice()->createBuffer(paramsBufferDesc);
-        m_commandList->beginTrackingBufferState(m_mlpMoments1Buffer, nvrhi::ResourceStates::UnorderedAccess);
-        m_commandList->clearBufferUInt(m_mlpMoments1Buffer, 0);
-
-        paramsBufferDesc.debugName = "MLPMoments2Buffer";
-        m_mlpMoments2Buffer = GetDevice()->createBuffer(paramsBufferDesc);
-        m_commandList->beginTrackingBufferState(m_mlpMoments2Buffer, nvrhi::ResourceStates::UnorderedAccess);
-        m_commandList->clearBufferUInt(m_mlpMoments2Buffer, 0);
-
-        paramsBufferDesc.debugName = "RandStateBuffer";
-        paramsBufferDesc.initialState = nvrhi::ResourceStates::UnorderedAccess;
-        paramsBufferDesc.byteSize = BATCH_SIZE_X * BATCH_SIZE_Y * 4;
-        paramsBufferDesc.structStride = sizeof(uint32_t);
-        m_RandStateBuffer = GetDevice()->createBuffer(paramsBufferDesc);
-
-        std::mt19937 gen(1337);
-        std::uniform_int_distribution<uint32_t> dist;
-        std::vector<uint32_t> buff(BATCH_SIZE_X * BATCH_SIZE_Y);
-        for (uint32_t i = 0; i < buff.size(); i++)
+        m_trainingPipeline = std::make_unique<TrainingPipeline>(GetDevice(), m_ShaderFactory);
+        if (!m_trainingPipeline->Init(m_commandList, m_InputTexture, m_InferenceTexture, m_LossTexture))
         {
-            buff[i] = dist(gen);
+            return false;
         }
 
-        m_commandList->writeBuffer(m_RandStateBuffer, buff.data(), buff.size() * sizeof(uint32_t));
-        m_commandList->beginTrackingBufferState(m_RandStateBuffer, nvrhi::ResourceStates::UnorderedAccess);
-
         m_commandList->close();
         GetDevice()->executeCommandList(m_commandList);
         GetDevice()->waitForIdle();
 
-        auto inputTexDesc = m_InputTexture->getDesc();
-        inputTexDesc.debugName = "InferenceTexture";
-        inputTexDesc.format = nvrhi::Format::RGBA16_FLOAT;
-        inputTexDesc.isUAV = true;
-        inputTexDesc.initialState = nvrhi::ResourceStates::UnorderedAccess;
-        inputTexDesc.keepInitialState = true;
-        m_InferenceTexture = GetDevice()->createTexture(inputTexDesc);
-
-        inputTexDesc.debugName = "LossTexture";
-        m_LossTexture = GetDevice()->createTexture(inputTexDesc);
-
-        // Set up the constant buffers
-        m_NeuralConstantBuffer = GetDevice()->createBuffer(nvrhi::utils::CreateStaticConstantBufferDesc(sizeof(NeuralConstants), "NeuralConstantBuffer")
-                                                               .setInitialState(nvrhi::ResourceStates::ConstantBuffer)
-                                                               .setKeepInitialState(true));
-
         ////////////////////
         //
-        // Create the pipelines for each neural pass
+        // Create the pipeline for the inference pass
         //
         ////////////////////
-        // Inference Pass
+        m_InferencePass.m_ShaderCS = m_ShaderFactory->CreateShader("app/SimpleTraining_Inference", "inference_cs", nullptr, nvrhi::ShaderType::Compute);
+
         nvrhi::BindingSetDesc bindingSetDesc;
         bindingSetDesc.bindings = {
-            nvrhi::BindingSetItem::ConstantBuffer(0, m_NeuralConstantBuffer),
-            nvrhi::BindingSetItem::RawBuffer_SRV(0, m_mlpDeviceBuffer),
+            nvrhi::BindingSetItem::ConstantBuffer(0, m_trainingPipeline->GetConstantBuffer()),
+            nvrhi::BindingSetItem::RawBuffer_SRV(0, m_trainingPipeline->GetParamsBuffer()),
             nvrhi::BindingSetItem::Texture_SRV(1, m_InputTexture),
             nvrhi::BindingSetItem::Texture_UAV(0, m_InferenceTexture),
         };
         nvrhi::utils::CreateBindingSetAndLayout(GetDevice(), nvrhi::ShaderType::All, 0, bindingSetDesc, m_InferencePass.m_BindingLayout, m_InferencePass.m_BindingSet);
 
+        // Same layout with the moving average of the parameters in place of the parameters
+        bindingSetDesc.bindings[1] = nvrhi::BindingSetItem::RawBuffer_SRV(0, m_trainingPipeline->GetParamsBuffer(true));
+        m_InferenceEmaBindingSet = GetDevice()->createBindingSet(bindingSetDesc, m_InferencePass.m_BindingLayout);
+
         nvrhi::ComputePipelineDesc pipelineDesc;
         pipelineDesc.bindingLayouts = { m_InferencePass.m_BindingLayout };
         pipelineDesc.CS = m_InferencePass.m_ShaderCS;
         m_InferencePass.m_Pipeline = GetDevice()->createComputePipeline(pipelineDesc);
 
-        // Training Pass
-        bindingSetDesc.bindings = {
-            nvrhi::BindingSetItem::ConstantBuffer(0, m_NeuralConstantBuffer),
-            nvrhi::BindingSetItem::RawBuffer_SRV(0, m_mlpDeviceBuffer),
-            nvrhi::BindingSetItem::Texture_SRV(1, m_InputTexture),
-            nvrhi::BindingSetItem::RawBuffer_UAV(0, m_mlpGradientsBuffer),
-            nvrhi::BindingSetItem::StructuredBuffer_UAV(1, m_RandStateBuffer),
-            nvrhi::BindingSetItem::Texture_UAV(2, m_InferenceTexture),
-            nvrhi::BindingSetItem::Texture_UAV(3, m_LossTexture),
-        };
-        nvrhi::utils::CreateBindingSetAndLayout(GetDevice(), nvrhi::ShaderType::All, 0, bindingSetDesc, m_TrainingPass.m_BindingLayout, m_TrainingPass.m_BindingSet);
-
-        pipelineDesc.bindingLayouts = { m_TrainingPass.m_BindingLayout };
-        pipelineDesc.CS = m_TrainingPass.m_ShaderCS;
-        m_TrainingPass.m_Pipeline = GetDevice()->createComputePipeline(pipelineDesc);
-
-        // Optimization Pass
-        bindingSetDesc.bindings = {
-            nvrhi::BindingSetItem::ConstantBuffer(0, m_NeuralConstantBuffer),  nvrhi::BindingSetItem::TypedBuffer_UAV(0, m_mlpDeviceBuffer),
-            nvrhi::BindingSetItem::TypedBuffer_UAV(1, m_mlpDeviceFloatBuffer), nvrhi::BindingSetItem::TypedBuffer_UAV(2, m_mlpGradientsBuffer),
-            nvrhi::BindingSetItem::TypedBuffer_UAV(3, m_mlpMoments1Buffer),    nvrhi::BindingSetItem::TypedBuffer_UAV(4, m_mlpMoments2Buffer),
-        };
-        nvrhi::utils::CreateBindingSetAndLayout(GetDevice(), nvrhi::ShaderType::All, 0, bindingSetDesc, m_OptimizerPass.m_BindingLayout, m_OptimizerPass.m_BindingSet);
-
-        pipelineDesc.bindingLayouts = { m_OptimizerPass.m_BindingLayout };
-        pipelineDesc.CS = m_OptimizerPass.m_ShaderCS;
-        m_OptimizerPass.m_Pipeline = GetDevice()->createComputePipeline(pipelineDesc);
-
-        // Convert weights to float
-        nvrhi::utils::CreateBindingSetAndLayout(GetDevice(), nvrhi::ShaderType::All, 0, bindingSetDesc, m_ConvertWeightsPass.m_BindingLayout, m_ConvertWeightsPass.m_BindingSet);
-        pipelineDesc.bindingLayouts = { m_ConvertWeightsPass.m_BindingLayout };
-        pipelineDesc.CS = m_ConvertWeightsPass.m_ShaderCS;
-        m_ConvertWeightsPass.m_Pipeline = GetDevice()->createComputePipeline(pipelineDesc);
-
-        m_learningRateScheduler = std::make_unique<LearningRateScheduler>(BASE_LEARNING_RATE, MIN_LEARNING_RATE, WARMUP_LEARNING_STEPS, FLAT_LEARNING_STEPS, DECAY_LEARNING_STEPS);
-
         return true;
     }
 
-    // expects an open command list
-    void UpdateDeviceNetworkParameters(nvrhi::CommandListHandle commandList)
+    void ResetUIData()
     {
-        // Upload the host side parameters
-        m_commandList->setBufferState(m_mlpHostBuffer, nvrhi::ResourceStates::CopyDest);
-        m_commandList->commitBarriers();
-        m_commandList->writeBuffer(m_mlpHostBuffer, m_neuralNetwork->GetNetworkParams().data(), m_neuralNetwork->GetNetworkParams().size());
-
-        // Convert to GPU optimized layout
-        m_networkUtils->ConvertWeights(m_neuralNetwork->GetNetworkLayout(), m_deviceNetworkLayout, m_mlpHostBuffer, 0, m_mlpDeviceBuffer, 0, GetDevice(), m_commandList);
-
-        // Update barriers for use
-        m_commandList->setBufferState(m_mlpDeviceBuffer, nvrhi::ResourceStates::ShaderResource);
-        m_commandList->commitBarriers();
-        m_convertWeights = true;
-    }
-
-    // expects an open command list
-    void ResetTrainingData(nvrhi::CommandListHandle commandList)
-    {
-        // Validate the loaded file matches the shaders
-        if (!m_neuralNetwork->Initialise(m_shaderNetworkArch))
-        {
-            log::error("Failed to create a network.");
-            return;
-        }
-
-        // Get a device optimized layout
-        m_deviceNetworkLayout = m_networkUtils->GetNewMatrixLayout(m_neuralNetwork->GetNetworkLayout(), MatrixLayout::TrainingOptimal);
-
-        // Upload the parameters
-        UpdateDeviceNetworkParameters(commandList);
-
-        // Clear buffers
-        commandList->clearBufferUInt(m_mlpDeviceFloatBuffer, 0);
-        commandList->clearBufferUInt(m_mlpGradientsBuffer, 0);
-        commandList->clearBufferUInt(m_mlpMoments1Buffer, 0);
-        commandList->clearBufferUInt(m_mlpMoments2Buffer, 0);
-
         m_uiParams->epochs = 0;
         m_uiParams->trainingTime = 0.0f;
-
-        m_AdamCurrentStep = 1;
+        m_uiParams->loss = 0.0f;
+        m_uiParams->lossScale = LOSS_SCALE;
+        m_uiParams->skippedSteps = 0;
     }
 
     bool LoadScene(std::shared_ptr<vfs::IFileSystem> fs, const std::filesystem::path& sceneFileName) override
@@ -350,6 +186,15 @@ public:
 
         GetDeviceManager()->SetInformativeWindowTitle(g_windowTitle, true);
 
+        if (m_uiParams->updateSchedule)
+        {
+            LearningRateScheduleDesc schedule = m_trainingPipeline->GetLearningRateSchedule();
+            schedule.schedule = m_uiParams->learningRateSchedule;
+            schedule.reduceOnPlateau = m_uiParams->reduceOnPlateau;
+            m_trainingPipeline->SetLearningRateSchedule(schedule);
+            m_uiParams->updateSchedule = false;
+        }
+
         ////////////////////
         //
         // Load/Save the Neural network if required
@@ -359,41 +204,27 @@ public:
         {
             if (m_uiParams->load)
             {
-                // Network network(GetDevice());
-                if (m_neuralNetwork->InitialiseFromFile(m_uiParams->fileName))
-                {
-                    // Validate the loaded file against what the shaders expect
-                    if (m_networkUtils->ValidateNetworkArchitecture(m_shaderNetworkArch))
-                    {
-                        m_commandList = GetDevice()->createCommandList();
-                        m_commandList->open();
-
-                        // Get a device optimized layout
-                        m_deviceNetworkLayout = m_networkUtils->GetNewMatrixLayout(m_neuralNetwork->GetNetworkLayout(), MatrixLayout::TrainingOptimal);
-
-                        // Upload the parameters
-                        UpdateDeviceNetworkParameters(m_commandList);
-
-                        // Clear buffers
-                        m_commandList->clearBufferUInt(m_mlpDeviceFloatBuffer, 0);
-                        m_commandList->clearBufferUInt(m_mlpGradientsBuffer, 0);
-                        m_commandList->clearBufferUInt(m_mlpMoments1Buffer, 0);
-                        m_commandList->clearBufferUInt(m_mlpMoments2Buffer, 0);
+                m_commandList = GetDevice()->createCommandList();
+                m_commandList->open();
 
-                        m_uiParams->epochs = 0;
-                        m_uiParams->trainingTime = 0.0f;
-
-                        m_AdamCurrentStep = 1;
-
-                        m_commandList->close();
-                        GetDevice()->executeCommandList(m_commandList);
-                    }
+                const bool loaded = m_uiParams->trainingState ? m_trainingPipeline->LoadTrainingState(m_commandList, m_uiParams->fileName)
+                                                              : m_trainingPipeline->Load(m_commandList, m_uiParams->fileName);
+                if (loaded)
+                {
+                    ResetUIData();
+                    m_uiParams->adamSteps = m_trainingPipeline->GetCurrentStep();
                 }
+
+                m_commandList->close();
+                GetDevice()->executeCommandList(m_commandList);
+            }
+            else if (m_uiParams->trainingState)
+            {
+                m_trainingPipeline->RequestTrainingState(m_uiParams->fileName);
             }
             else
             {
-                m_neuralNetwork->UpdateFromBufferToFile(
-                    m_mlpHostBuffer, m_mlpDeviceBuffer, m_neuralNetwork->GetNetworkLayout(), m_deviceNetworkLayout, m_uiParams->fileName, GetDevice(), m_commandList);
+                m_trainingPipeline->RequestCheckpoint(m_uiParams->fileName, m_uiParams->emaWeights);
             }
             m_uiParams->fileName = "";
         }
@@ -413,7 +244,10 @@ public:
 
         if (m_uiParams->reset)
         {
-            ResetTrainingData(m_commandList);
+            if (m_trainingPipeline->Reset(m_commandList))
+            {
+                ResetUIData();
+            }
             m_uiParams->reset = false;
         }
 
@@ -421,77 +255,25 @@ public:
 
         ////////////////////
         //
-        // Update the Constant buffer
-        //
-        ////////////////////
-        NeuralConstants neuralConstants = {};
-
-        for (int i = 0; i < NUM_TRANSITIONS; ++i)
-        {
-            neuralConstants.weightOffsets[i / 4][i % 4] = m_deviceNetworkLayout.networkLayers[i].weightOffset;
-            neuralConstants.biasOffsets[i / 4][i % 4] = m_deviceNetworkLayout.networkLayers[i].biasOffset;
-        }
-
-        neuralConstants.imageWidth = m_InferenceTexture->getDesc().width;
-        neuralConstants.imageHeight = m_InferenceTexture->getDesc().height;
-        neuralConstants.maxParamSize = m_TotalParamCount;
-        neuralConstants.currentStep = m_AdamCurrentStep;
-        neuralConstants.learningRate = m_learningRateScheduler->GetLearningRate(m_AdamCurrentStep);
-        neuralConstants.batchSizeX = BATCH_SIZE_X;
-        neuralConstants.batchSizeY = BATCH_SIZE_Y;
-        neuralConstants.networkTransform = m_uiParams->networkTransform;
-        m_commandList->writeBuffer(m_NeuralConstantBuffer, &neuralConstants, sizeof(neuralConstants));
-
-        nvrhi::ComputeState state;
-
-        ////////////////////
-        //
-        // Start the training loop
+        // Start the training loop, or only update the constant buffer for the inference pass
         //
         ////////////////////
         if (m_uiParams->training)
         {
-            if (m_convertWeights)
-            {
-                state.bindings = { m_ConvertWeightsPass.m_BindingSet };
-                state.pipeline = m_ConvertWeightsPass.m_Pipeline;
-                m_commandList->beginMarker("ConvertWeights");
-                m_commandList->setComputeState(state);
-                m_commandList->dispatch(dm::div_ceil(m_TotalParamCount, 32), 1, 1);
-                m_commandList->endMarker();
-                m_convertWeights = false;
-            }
-
-            for (uint32_t batch = 0; batch < BATCH_COUNT; batch++)
-            {
-                // run the training pass
-                state.bindings = { m_TrainingPass.m_BindingSet };
-                state.pipeline = m_TrainingPass.m_Pipeline;
-                m_commandList->beginMarker("Training");
-                m_commandList->setComputeState(state);
-                m_commandList->dispatch(dm::div_ceil(BATCH_SIZE_X, 8), dm::div_ceil(BATCH_SIZE_Y, 8), 1);
-                m_commandList->endMarker();
-
-                // optimizer pass
-                state.bindings = { m_OptimizerPass.m_BindingSet };
-                state.pipeline = m_OptimizerPass.m_Pipeline;
-                m_commandList->beginMarker("Update Weights");
-                m_commandList->setComputeState(state);
-                m_commandList->dispatch(dm::div_ceil(m_TotalParamCount, 32), 1, 1);
-                m_commandList->endMarker();
-
-                neuralConstants.currentStep = ++m_AdamCurrentStep;
-                neuralConstants.learningRate = m_learningRateScheduler->GetLearningRate(m_AdamCurrentStep);
-                m_commandList->writeBuffer(m_NeuralConstantBuffer, &neuralConstants, sizeof(neuralConstants));
-            }
+            m_trainingPipeline->Train(m_commandList, BATCH_COUNT, m_uiParams->networkTransform);
             m_uiParams->epochs++;
-            m_uiParams->adamSteps = m_AdamCurrentStep;
-            m_uiParams->learningRate = neuralConstants.learningRate;
+            m_uiParams->adamSteps = m_trainingPipeline->GetCurrentStep();
+            m_uiParams->learningRate = m_trainingPipeline->GetLearningRate();
+        }
+        else
+        {
+            m_trainingPipeline->UpdateConstants(m_commandList, m_uiParams->networkTransform);
         }
 
         {
             // inference pass
-            state.bindings = { m_InferencePass.m_BindingSet };
+            nvrhi::ComputeState state;
+            state.bindings = { m_uiParams->emaWeights ? m_InferenceEmaBindingSet : m_InferencePass.m_BindingSet };
             state.pipeline = m_InferencePass.m_Pipeline;
             m_commandList->beginMarker("Inference");
             m_commandList->setComputeState(state);
@@ -545,6 +327,16 @@ public:
 
         m_commandList->close();
         GetDevice()->executeCommandList(m_commandList);
+
+        // Read back the loss of the executed steps and write the requested checkpoints
+        m_trainingPipeline->Update();
+        TrainingMetrics metrics;
+        while (m_trainingPipeline->PopMetrics(metrics))
+        {
+            m_uiParams->loss = float(metrics.GetMeanLoss());
+            m_uiParams->lossScale = metrics.lossScale;
+            m_uiParams->skippedSteps += metrics.skippedSteps;
+        }
     }
 
 private:
@@ -561,25 +353,12 @@ private:
     };
 
     NeuralPass m_InferencePass;
-    NeuralPass m_TrainingPass;
-    NeuralPass m_OptimizerPass;
-    NeuralPass m_ConvertWeightsPass;
-
-    nvrhi::BufferHandle m_NeuralConstantBuffer;
-    nvrhi::BufferHandle m_OptimisationConstantBuffer;
+    nvrhi::BindingSetHandle m_InferenceEmaBindingSet;
 
     nvrhi::TextureHandle m_InputTexture;
     nvrhi::TextureHandle m_InferenceTexture;
     nvrhi::TextureHandle m_LossTexture;
 
-    nvrhi::BufferHandle m_mlpHostBuffer;
-    nvrhi::BufferHandle m_mlpDeviceBuffer;
-    nvrhi::BufferHandle m_mlpDeviceFloatBuffer;
-    nvrhi::BufferHandle m_mlpGradientsBuffer;
-    nvrhi::BufferHandle m_mlpMoments1Buffer;
-    nvrhi::BufferHandle m_mlpMoments2Buffer;
-    nvrhi::BufferHandle m_RandStateBuffer;
-
     nvrhi::FramebufferHandle m_Framebuffer;
 
     std::shared_ptr<engine::ShaderFactory> m_ShaderFactory;
@@ -587,16 +366,7 @@ private:
     std::shared_ptr<engine::DescriptorTableManager> m_DescriptorTableManager;
     std::unique_ptr<engine::BindingCache> m_BindingCache;
 
-    NetworkArchitecture m_shaderNetworkArch;
-    std::shared_ptr<NetworkUtilities> m_networkUtils;
-    std::unique_ptr<HostNetwork> m_neuralNetwork;
-    NetworkLayout m_deviceNetworkLayout;
-
-    std::unique_ptr<LearningRateScheduler> m_learningRateScheduler;
-
-    uint m_TotalParamCount = 0;
-    uint m_AdamCurrentStep = 1;
-    bool m_convertWeights = true;
+    std::unique_ptr<TrainingPipeline> m_trainingPipeline;
 
     UIData* m_uiParams;
 };
@@ -622,6 +392,19 @@ public:
         ImGui::Text("Adam Steps : %d", m_uiParams->adamSteps);
         ImGui::Text("Training Time : %.2f s", m_uiParams->trainingTime);
         ImGui::Text("Learning Rate : %.9f", m_uiParams->learningRate);
+        // The shape applies to the steps of NetworkConfig.h, the plateau mode reduces the rate when the loss stalls
+        m_uiParams->updateSchedule |= ImGui::Combo("##learningRateSchedule", (int*)&m_uiParams->learningRateSchedule,
+                                                   "Cosine\0"
+                                                   "One Cycle\0"
+                                                   "Exponential\0"
+                                                   "Step\0"
+                                                   "Cosine Restarts\0");
+        m_uiParams->updateSchedule |= ImGui::Checkbox("Reduce On Plateau", &m_uiParams->reduceOnPlateau);
+        ImGui::Text("Loss : %.6f", m_uiParams->loss);
+        ImGui::Text("Loss Scale : %.0f (%d skipped steps)", m_uiParams->lossScale, int(m_uiParams->skippedSteps));
+#if EMA_WEIGHTS
+        ImGui::Checkbox("EMA Weights", &m_uiParams->emaWeights);
+#endif
 
         if (ImGui::Button(m_uiParams->training ? "Disable Training" : "Enable Training"))
         {
@@ -635,6 +418,7 @@ public:
             {
                 m_uiParams->fileName = fileName;
                 m_uiParams->load = true;
+                m_uiParams->trainingState = false;
             }
         }
         if (ImGui::Button("Save Model"))
@@ -644,6 +428,28 @@ public:
             {
                 m_uiParams->fileName = fileName;
                 m_uiParams->load = false;
+                m_uiParams->trainingState = false;
+            }
+        }
+        // Training states hold the optimizer state too, training continues exactly where it was saved
+        if (ImGui::Button("Load Training State"))
+        {
+            std::string fileName;
+            if (app::FileDialog(true, "Training state files\0*.state\0All files\0*.*\0\0", fileName))
+            {
+                m_uiParams->fileName = fileName;
+                m_uiParams->load = true;
+                m_uiParams->trainingState = true;
+            }
+        }
+        if (ImGui::Button("Save Training State"))
+        {
+            std::string fileName;
+            if (app::FileDialog(false, "Training state files\0*.state\0All files\0*.*\0\0", fileName))
+            {
+                m_uiParams->fileName = fileName;
+                m_uiParams->load = false;
+                m_uiParams->trainingState = true;
             }
         }
 
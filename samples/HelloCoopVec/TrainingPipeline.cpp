@@ -0,0 +1,664 @@
+/*
+ * Copyright (c) 2015 - 2025, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#include <donut/core/log.h>
+#include <nvrhi/utils.h>
+#include <cstring>
+#include <random>
+
+#include "TrainingPipeline.h"
+
+using namespace donut;
+using namespace donut::math;
+using namespace fluxel;
+
+TrainingPipeline::TrainingPipeline(nvrhi::DeviceHandle device, std::shared_ptr<engine::ShaderFactory> shaderFactory, uint32_t metricsInterval)
+    : m_device(device), m_ShaderFactory(shaderFactory), m_metricsInterval(metricsInterval)
+{
+}
+
+bool TrainingPipeline::Init(nvrhi::ICommandList* commandList, nvrhi::TextureHandle inputTexture, nvrhi::TextureHandle outputTexture, nvrhi::TextureHandle lossTexture)
+{
+    m_InputTexture = inputTexture;
+
+    ////////////////////
+    //
+    // Create the Neural network class and initialise it the hyper parameters from NetworkConfig.h.
+    //
+    ////////////////////
+    m_networkUtils = std::make_shared<NetworkUtilities>(m_device);
+    m_neuralNetwork = std::make_unique<HostNetwork>(m_networkUtils);
+
+    // Store the network architecture that is expected in the shaders
+    m_shaderNetworkArch = {};
+    m_shaderNetworkArch.inputNeurons = INPUT_NEURONS;
+    m_shaderNetworkArch.hiddenNeurons = HIDDEN_NEURONS;
+    m_shaderNetworkArch.outputNeurons = OUTPUT_NEURONS;
+    m_shaderNetworkArch.numHiddenLayers = NUM_HIDDEN_LAYERS;
+    m_shaderNetworkArch.biasPrecision = NETWORK_PRECISION;
+    m_shaderNetworkArch.weightPrecision = NETWORK_PRECISION;
+
+    if (!m_neuralNetwork->Initialise(m_shaderNetworkArch))
+    {
+        log::error("Failed to create a network.");
+        return false;
+    }
+
+    // Get a device optimized layout
+    m_deviceNetworkLayout = m_networkUtils->GetNewMatrixLayout(m_neuralNetwork->GetNetworkLayout(), MatrixLayout::TrainingOptimal);
+    if (m_deviceNetworkLayout.networkLayers.empty())
+    {
+        log::error("Failed to create the device network layout.");
+        return false;
+    }
+
+#if HASH_GRID_ENCODING
+    // The grid features follow the network in the parameter buffers, so the optimizer passes train them with the network
+    m_hashGridDesc = {};
+    m_hashGridDesc.inputDimensions = INPUT_FEATURES;
+    m_hashGridDesc.numLevels = HASH_GRID_LEVELS;
+    m_hashGridDesc.featuresPerLevel = HASH_GRID_FEATURES_PER_LEVEL;
+    m_hashGridDesc.log2TableSize = HASH_GRID_LOG2_TABLE_SIZE;
+    m_hashGridDesc.baseResolution = HASH_GRID_BASE_RESOLUTION;
+    m_hashGridDesc.finestResolution = HASH_GRID_FINEST_RESOLUTION;
+    if (!m_hashGrid.Initialise(m_hashGridDesc, 1337))
+    {
+        log::error("Failed to create a hash grid.");
+        return false;
+    }
+    m_hashGridOffset = HashGrid::GetOffsetAfter(m_deviceNetworkLayout.networkSize);
+#endif
+
+    ////////////////////
+    //
+    // Create the shaders/buffers for the Neural Training
+    //
+    ////////////////////
+    m_TrainingPass.m_ShaderCS = m_ShaderFactory->CreateShader("app/SimpleTraining_Training", "training_cs", nullptr, nvrhi::ShaderType::Compute);
+    m_CheckGradientsPass.m_ShaderCS = m_ShaderFactory->CreateShader("app/SimpleTraining_Optimizer", "check_gradients_cs", nullptr, nvrhi::ShaderType::Compute);
+    m_OptimizerPass.m_ShaderCS = m_ShaderFactory->CreateShader("app/SimpleTraining_Optimizer", "optimizer_cs", nullptr, nvrhi::ShaderType::Compute);
+    m_UpdateLossScalePass.m_ShaderCS = m_ShaderFactory->CreateShader("app/SimpleTraining_Optimizer", "update_loss_scale_cs", nullptr, nvrhi::ShaderType::Compute);
+    if (!m_TrainingPass.m_ShaderCS || !m_CheckGradientsPass.m_ShaderCS || !m_OptimizerPass.m_ShaderCS || !m_UpdateLossScalePass.m_ShaderCS)
+    {
+        log::error("Failed to load the training shaders.");
+        return false;
+    }
+
+    const auto& params = m_neuralNetwork->GetNetworkParams();
+
+    nvrhi::BufferDesc paramsBufferDesc;
+    paramsBufferDesc.byteSize = params.size();
+    paramsBufferDesc.debugName = "MLPParamsHostBuffer";
+    paramsBufferDesc.canHaveUAVs = true;
+    paramsBufferDesc.initialState = nvrhi::ResourceStates::CopyDest;
+    paramsBufferDesc.keepInitialState = true;
+    m_mlpHostBuffer = m_device->createBuffer(paramsBufferDesc);
+
+    // Create a buffer for a device optimized parameters layout
+    paramsBufferDesc.byteSize = m_deviceNetworkLayout.networkSize;
+#if HASH_GRID_ENCODING
+    paramsBufferDesc.byteSize = m_hashGridOffset + m_hashGrid.GetSize();
+#endif
+    paramsBufferDesc.canHaveRawViews = true;
+    paramsBufferDesc.canHaveUAVs = true;
+    paramsBufferDesc.canHaveTypedViews = true;
+    paramsBufferDesc.format = nvrhi::Format::R16_FLOAT;
+    paramsBufferDesc.debugName = "MLPParamsByteAddressBuffer";
+    paramsBufferDesc.initialState = nvrhi::ResourceStates::UnorderedAccess;
+    m_mlpDeviceBuffer = m_device->createBuffer(paramsBufferDesc);
+
+#if EMA_WEIGHTS
+    // The moving average is written by optimizer_cs in the layout of the parameters, so the inference pass and the
+    // checkpoints read it in place
+    paramsBufferDesc.debugName = "MLPParamsEmaBuffer";
+    m_mlpEmaBuffer = m_device->createBuffer(paramsBufferDesc);
+    commandList->beginTrackingBufferState(m_mlpEmaBuffer, nvrhi::ResourceStates::UnorderedAccess);
+#endif
+
+    // Checkpoints are read back and written to file in the background
+    auto checkpointSource = std::make_shared<DeviceCheckpointSource>(
+        m_device, m_networkUtils, m_neuralNetwork->GetNetworkLayout(), m_deviceNetworkLayout, m_mlpHostBuffer, m_mlpDeviceBuffer);
+    m_checkpointWriter = std::make_unique<CheckpointWriter>(checkpointSource, m_neuralNetwork->GetNetworkArchitecture(), m_neuralNetwork->GetNetworkLayout());
+#if EMA_WEIGHTS
+    // The readbacks of both writers are recorded in order, so they share the host layout buffer
+    auto emaCheckpointSource = std::make_shared<DeviceCheckpointSource>(
+        m_device, m_networkUtils, m_neuralNetwork->GetNetworkLayout(), m_deviceNetworkLayout, m_mlpHostBuffer, m_mlpEmaBuffer);
+    m_emaCheckpointWriter = std::make_unique<CheckpointWriter>(emaCheckpointSource, m_neuralNetwork->GetNetworkArchitecture(), m_neuralNetwork->GetNetworkLayout());
+#endif
+
+    // Upload the parameters
+    UpdateDeviceNetworkParameters(commandList);
+
+    m_TotalParamCount = (uint32_t)(paramsBufferDesc.byteSize / sizeof(uint16_t));
+
+    paramsBufferDesc.debugName = "MLPParametersFloat";
+    paramsBufferDesc.initialState = nvrhi::ResourceStates::UnorderedAccess;
+    paramsBufferDesc.byteSize = m_TotalParamCount * sizeof(float); // convert to float
+    paramsBufferDesc.format = nvrhi::Format::R32_FLOAT;
+    m_mlpDeviceFloatBuffer = m_device->createBuffer(paramsBufferDesc);
+    commandList->beginTrackingBufferState(m_mlpDeviceFloatBuffer, nvrhi::ResourceStates::UnorderedAccess);
+    commandList->clearBufferUInt(m_mlpDeviceFloatBuffer, 0);
+
+#if EMA_WEIGHTS
+    paramsBufferDesc.debugName = "MLPParamsEmaFloat";
+    m_mlpEmaFloatBuffer = m_device->createBuffer(paramsBufferDesc);
+    commandList->beginTrackingBufferState(m_mlpEmaFloatBuffer, nvrhi::ResourceStates::UnorderedAccess);
+    commandList->clearBufferUInt(m_mlpEmaFloatBuffer, 0);
+#endif
+
+    paramsBufferDesc.debugName = "MLPGradientsBuffer";
+    paramsBufferDesc.initialState = nvrhi::ResourceStates::UnorderedAccess;
+    paramsBufferDesc.byteSize = (m_TotalParamCount * sizeof(uint16_t) + 3) & ~3; // Round up to nearest multiple of 4
+    paramsBufferDesc.format = nvrhi::Format::R16_FLOAT;
+    m_mlpGradientsBuffer = m_device->createBuffer(paramsBufferDesc);
+    commandList->beginTrackingBufferState(m_mlpGradientsBuffer, nvrhi::ResourceStates::UnorderedAccess);
+    commandList->clearBufferUInt(m_mlpGradientsBuffer, 0);
+
+    // The moments are FP32, or with OPTIMIZER_STATE_8BIT one byte per parameter followed by the scales of the blocks
+    m_optimizerDesc = GetDefaultOptimizerDesc(OptimizerType(OPTIMIZER));
+    m_optimizerDesc.quantisedState = OPTIMIZER_STATE_8BIT != 0;
+#if EMA_WEIGHTS
+    m_optimizerDesc.emaDecay = EMA_DECAY;
+    m_optimizerDesc.emaWarmupSteps = EMA_WARMUP_STEPS;
+#endif
+    const size_t momentsSize = m_optimizerDesc.quantisedState ? GetQuantisedStateSize(m_TotalParamCount) : m_TotalParamCount * sizeof(float);
+
+    paramsBufferDesc.debugName = "MLPMoments1Buffer";
+    paramsBufferDesc.initialState = nvrhi::ResourceStates::UnorderedAccess;
+    paramsBufferDesc.byteSize = momentsSize;
+    paramsBufferDesc.format = nvrhi::Format::R32_FLOAT;
+    paramsBufferDesc.canHaveRawViews = m_optimizerDesc.quantisedState;
+    m_mlpMoments1Buffer = m_device->createBuffer(paramsBufferDesc);
+    commandList->beginTrackingBufferState(m_mlpMoments1Buffer, nvrhi::ResourceStates::UnorderedAccess);
+    commandList->clearBufferUInt(m_mlpMoments1Buffer, 0);
+
+    // Lion and SGD only keep one moment per parameter, a placeholder stays bound in place of the second
+    paramsBufferDesc.debugName = "MLPMoments2Buffer";
+    paramsBufferDesc.byteSize = GetOptimizerMomentCount(m_optimizerDesc.type) > 1 ? momentsSize : sizeof(float);
+    m_mlpMoments2Buffer = m_device->createBuffer(paramsBufferDesc);
+    commandList->beginTrackingBufferState(m_mlpMoments2Buffer, nvrhi::ResourceStates::UnorderedAccess);
+    commandList->clearBufferUInt(m_mlpMoments2Buffer, 0);
+
+    // Values of the 8-bit codes, the signed map of the first moments followed by the unsigned map of the second
+    std::vector<float> quantisationMaps = CreateDynamicQuantisationMap(true);
+    const std::vector<float> unsignedMap = CreateDynamicQuantisationMap(false);
+    quantisationMaps.insert(quantisationMaps.end(), unsignedMap.begin(), unsignedMap.end());
+
+    nvrhi::BufferDesc mapsBufferDesc;
+    mapsBufferDesc.byteSize = quantisationMaps.size() * sizeof(float);
+    mapsBufferDesc.structStride = sizeof(float);
+    mapsBufferDesc.debugName = "QuantisationMapsBuffer";
+    mapsBufferDesc.initialState = nvrhi::ResourceStates::ShaderResource;
+    mapsBufferDesc.keepInitialState = true;
+    m_QuantisationMapsBuffer = m_device->createBuffer(mapsBufferDesc);
+    commandList->writeBuffer(m_QuantisationMapsBuffer, quantisationMaps.data(), mapsBufferDesc.byteSize);
+
+    paramsBufferDesc.debugName = "RandStateBuffer";
+    paramsBufferDesc.canHaveRawViews = false;
+    paramsBufferDesc.initialState = nvrhi::ResourceStates::UnorderedAccess;
+    paramsBufferDesc.byteSize = BATCH_SIZE_X * BATCH_SIZE_Y * 4;
+    paramsBufferDesc.structStride = sizeof(uint32_t);
+    m_RandStateBuffer = m_device->createBuffer(paramsBufferDesc);
+
+    std::mt19937 gen(1337);
+    std::uniform_int_distribution<uint32_t> dist;
+    std::vector<uint32_t> buff(BATCH_SIZE_X * BATCH_SIZE_Y);
+    for (uint32_t i = 0; i < buff.size(); i++)
+    {
+        buff[i] = dist(gen);
+    }
+
+    commandList->writeBuffer(m_RandStateBuffer, buff.data(), buff.size() * sizeof(uint32_t));
+    commandList->beginTrackingBufferState(m_RandStateBuffer, nvrhi::ResourceStates::UnorderedAccess);
+
+    // The dynamic loss scale is adjusted on the device, so the steps never wait for an overflow check on the host
+    nvrhi::BufferDesc lossScaleBufferDesc;
+    lossScaleBufferDesc.byteSize = sizeof(LossScaleState);
+    lossScaleBufferDesc.canHaveRawViews = true;
+    lossScaleBufferDesc.canHaveUAVs = true;
+    lossScaleBufferDesc.debugName = "LossScaleBuffer";
+    lossScaleBufferDesc.initialState = nvrhi::ResourceStates::UnorderedAccess;
+    m_LossScaleBuffer = m_device->createBuffer(lossScaleBufferDesc);
+    commandList->beginTrackingBufferState(m_LossScaleBuffer, nvrhi::ResourceStates::UnorderedAccess);
+    ResetLossScale(commandList);
+
+    // The training pass reduces the loss into a small buffer that is read back in the background
+    m_metricsReadback = std::make_unique<MetricsReadback>(m_device, m_metricsInterval);
+
+    // Set up the constant buffers
+    m_NeuralConstantBuffer = m_device->createBuffer(nvrhi::utils::CreateStaticConstantBufferDesc(sizeof(NeuralConstants), "NeuralConstantBuffer")
+                                                        .setInitialState(nvrhi::ResourceStates::ConstantBuffer)
+                                                        .setKeepInitialState(true));
+
+    ////////////////////
+    //
+    // Create the pipelines for each neural pass
+    //
+    ////////////////////
+    // Training Pass
+    nvrhi::BindingSetDesc bindingSetDesc;
+    bindingSetDesc.bindings = {
+        nvrhi::BindingSetItem::ConstantBuffer(0, m_NeuralConstantBuffer),
+        nvrhi::BindingSetItem::RawBuffer_SRV(0, m_mlpDeviceBuffer),
+        nvrhi::BindingSetItem::Texture_SRV(1, m_InputTexture),
+        nvrhi::BindingSetItem::RawBuffer_UAV(0, m_mlpGradientsBuffer),
+        nvrhi::BindingSetItem::StructuredBuffer_UAV(1, m_RandStateBuffer),
+        nvrhi::BindingSetItem::Texture_UAV(2, outputTexture),
+        nvrhi::BindingSetItem::Texture_UAV(3, lossTexture),
+        nvrhi::BindingSetItem::RawBuffer_UAV(4, m_metricsReadback->GetBuffer()),
+        nvrhi::BindingSetItem::RawBuffer_UAV(5, m_LossScaleBuffer),
+    };
+    nvrhi::utils::CreateBindingSetAndLayout(m_device, nvrhi::ShaderType::All, 0, bindingSetDesc, m_TrainingPass.m_BindingLayout, m_TrainingPass.m_BindingSet);
+
+    nvrhi::ComputePipelineDesc pipelineDesc;
+    pipelineDesc.bindingLayouts = { m_TrainingPass.m_BindingLayout };
+    pipelineDesc.CS = m_TrainingPass.m_ShaderCS;
+    m_TrainingPass.m_Pipeline = m_device->createComputePipeline(pipelineDesc);
+
+    // Optimization Pass
+    auto MomentsBinding = [this](uint32_t slot, nvrhi::IBuffer* buffer) {
+        return m_optimizerDesc.quantisedState ? nvrhi::BindingSetItem::RawBuffer_UAV(slot, buffer) : nvrhi::BindingSetItem::TypedBuffer_UAV(slot, buffer);
+    };
+    bindingSetDesc.bindings = {
+        nvrhi::BindingSetItem::ConstantBuffer(0, m_NeuralConstantBuffer),  nvrhi::BindingSetItem::TypedBuffer_UAV(0, m_mlpDeviceBuffer),
+        nvrhi::BindingSetItem::TypedBuffer_UAV(1, m_mlpDeviceFloatBuffer), nvrhi::BindingSetItem::TypedBuffer_UAV(2, m_mlpGradientsBuffer),
+        MomentsBinding(3, m_mlpMoments1Buffer),                            MomentsBinding(4, m_mlpMoments2Buffer),
+        nvrhi::BindingSetItem::RawBuffer_UAV(5, m_LossScaleBuffer),        nvrhi::BindingSetItem::RawBuffer_UAV(6, m_metricsReadback->GetBuffer()),
+        nvrhi::BindingSetItem::StructuredBuffer_SRV(0, m_QuantisationMapsBuffer),
+    };
+#if EMA_WEIGHTS
+    bindingSetDesc.bindings.push_back(nvrhi::BindingSetItem::TypedBuffer_UAV(7, m_mlpEmaBuffer));
+    bindingSetDesc.bindings.push_back(nvrhi::BindingSetItem::TypedBuffer_UAV(8, m_mlpEmaFloatBuffer));
+#endif
+    nvrhi::utils::CreateBindingSetAndLayout(m_device, nvrhi::ShaderType::All, 0, bindingSetDesc, m_OptimizerPass.m_BindingLayout, m_OptimizerPass.m_BindingSet);
+
+    pipelineDesc.bindingLayouts = { m_OptimizerPass.m_BindingLayout };
+    pipelineDesc.CS = m_OptimizerPass.m_ShaderCS;
+    m_OptimizerPass.m_Pipeline = m_device->createComputePipeline(pipelineDesc);
+
+    // Gradient check and loss scale update, with the bindings of the optimization pass
+    nvrhi::utils::CreateBindingSetAndLayout(m_device, nvrhi::ShaderType::All, 0, bindingSetDesc, m_CheckGradientsPass.m_BindingLayout, m_CheckGradientsPass.m_BindingSet);
+    pipelineDesc.bindingLayouts = { m_CheckGradientsPass.m_BindingLayout };
+    pipelineDesc.CS = m_CheckGradientsPass.m_ShaderCS;
+    m_CheckGradientsPass.m_Pipeline = m_device->createComputePipeline(pipelineDesc);
+
+    nvrhi::utils::CreateBindingSetAndLayout(m_device, nvrhi::ShaderType::All, 0, bindingSetDesc, m_UpdateLossScalePass.m_BindingLayout, m_UpdateLossScalePass.m_BindingSet);
+    pipelineDesc.bindingLayouts = { m_UpdateLossScalePass.m_BindingLayout };
+    pipelineDesc.CS = m_UpdateLossScalePass.m_ShaderCS;
+    m_UpdateLossScalePass.m_Pipeline = m_device->createComputePipeline(pipelineDesc);
+
+    m_learningRateScheduler = std::make_unique<LearningRateScheduler>(BASE_LEARNING_RATE, MIN_LEARNING_RATE, WARMUP_LEARNING_STEPS, FLAT_LEARNING_STEPS, DECAY_LEARNING_STEPS);
+
+    InitTrainingState();
+
+    UpdateConstants(commandList, NetworkTransform::Identity);
+
+    return true;
+}
+
+void TrainingPipeline::InitTrainingState()
+{
+    // Parameter sized sections are stored in the device layout, indexed like the parameter buffers of the passes
+    const size_t momentsSize = m_mlpMoments1Buffer->getDesc().byteSize;
+    m_trainingStateDesc = {};
+    m_trainingStateDesc.optimizer = m_optimizerDesc.type;
+    m_trainingStateDesc.quantisedState = m_optimizerDesc.quantisedState;
+    m_trainingStateDesc.matrixLayout = m_deviceNetworkLayout.matrixLayout;
+    m_trainingStateDesc.paramCount = m_TotalParamCount;
+
+    std::vector<TrainingStateSource::Section> sections;
+    auto AddSection = [&](TrainingStateSection id, size_t size, nvrhi::BufferHandle buffer) {
+        m_trainingStateDesc.sections.push_back({ id, size });
+        sections.push_back({ buffer, nullptr });
+    };
+
+    m_trainingStateDesc.sections.push_back({ TrainingStateSection::Progress, sizeof(TrainingProgress) });
+    sections.push_back({ nullptr, [this](uint8_t* dst) {
+                            TrainingProgress progress;
+                            progress.currentStep = m_AdamCurrentStep;
+                            progress.convertWeights = m_convertWeights ? 1 : 0;
+                            std::memcpy(dst, &progress, sizeof(progress));
+                        } });
+    AddSection(TrainingStateSection::NetworkParams, m_TotalParamCount * sizeof(uint16_t), m_mlpDeviceBuffer);
+    AddSection(TrainingStateSection::MasterParams, m_TotalParamCount * sizeof(float), m_mlpDeviceFloatBuffer);
+    AddSection(TrainingStateSection::Moments1, momentsSize, m_mlpMoments1Buffer);
+    if (GetOptimizerMomentCount(m_optimizerDesc.type) > 1)
+    {
+        AddSection(TrainingStateSection::Moments2, momentsSize, m_mlpMoments2Buffer);
+    }
+    if (m_mlpEmaBuffer)
+    {
+        AddSection(TrainingStateSection::EmaParams, m_TotalParamCount * sizeof(float), m_mlpEmaFloatBuffer);
+        AddSection(TrainingStateSection::EmaNetworkParams, m_TotalParamCount * sizeof(uint16_t), m_mlpEmaBuffer);
+    }
+    AddSection(TrainingStateSection::RandState, BATCH_SIZE_X * BATCH_SIZE_Y * sizeof(uint32_t), m_RandStateBuffer);
+    AddSection(TrainingStateSection::LossScale, sizeof(LossScaleState), m_LossScaleBuffer);
+
+    m_trainingStateDesc.sections.push_back({ TrainingStateSection::Scheduler, sizeof(LearningRatePlateauState) });
+    sections.push_back({ nullptr, [this](uint8_t* dst) { std::memcpy(dst, &m_learningRateScheduler->GetPlateauState(), sizeof(LearningRatePlateauState)); } });
+
+    m_trainingStateBuffers.clear();
+    for (TrainingStateSource::Section const& section : sections)
+    {
+        m_trainingStateBuffers.push_back(section.buffer);
+    }
+    m_trainingStateWriter = CreateTrainingStateWriter(std::make_shared<TrainingStateSource>(m_device, m_trainingStateDesc, sections));
+}
+
+void TrainingPipeline::UpdateDeviceNetworkParameters(nvrhi::ICommandList* commandList)
+{
+    // Upload the host side parameters
+    commandList->setBufferState(m_mlpHostBuffer, nvrhi::ResourceStates::CopyDest);
+    commandList->commitBarriers();
+    commandList->writeBuffer(m_mlpHostBuffer, m_neuralNetwork->GetNetworkParams().data(), m_neuralNetwork->GetNetworkParams().size());
+
+    // Convert to GPU optimized layout
+    m_networkUtils->ConvertWeights(m_neuralNetwork->GetNetworkLayout(), m_deviceNetworkLayout, m_mlpHostBuffer, 0, m_mlpDeviceBuffer, 0, m_device, commandList);
+
+#if HASH_GRID_ENCODING
+    // Upload the grid features after the network
+    commandList->setBufferState(m_mlpDeviceBuffer, nvrhi::ResourceStates::CopyDest);
+    commandList->commitBarriers();
+    commandList->writeBuffer(m_mlpDeviceBuffer, m_hashGrid.GetParams().data(), m_hashGrid.GetSize(), m_hashGridOffset);
+#endif
+
+    // The moving average starts at the uploaded parameters, so it can be used for inference before the first step
+    if (m_mlpEmaBuffer)
+    {
+        commandList->setBufferState(m_mlpDeviceBuffer, nvrhi::ResourceStates::CopySource);
+        commandList->setBufferState(m_mlpEmaBuffer, nvrhi::ResourceStates::CopyDest);
+        commandList->commitBarriers();
+        commandList->copyBuffer(m_mlpEmaBuffer, 0, m_mlpDeviceBuffer, 0, m_mlpDeviceBuffer->getDesc().byteSize);
+        commandList->setBufferState(m_mlpEmaBuffer, nvrhi::ResourceStates::ShaderResource);
+    }
+
+    // Update barriers for use
+    commandList->setBufferState(m_mlpDeviceBuffer, nvrhi::ResourceStates::ShaderResource);
+    commandList->commitBarriers();
+    m_convertWeights = true;
+}
+
+bool TrainingPipeline::ClearTrainingState(nvrhi::ICommandList* commandList)
+{
+    // Get a device optimized layout
+    m_deviceNetworkLayout = m_networkUtils->GetNewMatrixLayout(m_neuralNetwork->GetNetworkLayout(), MatrixLayout::TrainingOptimal);
+    if (m_deviceNetworkLayout.networkLayers.empty())
+    {
+        log::error("Failed to create the device network layout.");
+        return false;
+    }
+
+    // Upload the parameters
+    UpdateDeviceNetworkParameters(commandList);
+
+    // Clear buffers
+    commandList->clearBufferUInt(m_mlpDeviceFloatBuffer, 0);
+    commandList->clearBufferUInt(m_mlpGradientsBuffer, 0);
+    commandList->clearBufferUInt(m_mlpMoments1Buffer, 0);
+    commandList->clearBufferUInt(m_mlpMoments2Buffer, 0);
+    ResetLossScale(commandList);
+
+    m_AdamCurrentStep = 1;
+    m_metricsReadback->Reset(commandList, m_AdamCurrentStep);
+    m_metrics.clear();
+    m_learningRateScheduler->ResetPlateauState();
+    return true;
+}
+
+void TrainingPipeline::ResetLossScale(nvrhi::ICommandList* commandList)
+{
+    LossScaleState lossScaleState;
+    lossScaleState.scale = LOSS_SCALE;
+    commandList->writeBuffer(m_LossScaleBuffer, &lossScaleState, sizeof(lossScaleState));
+}
+
+bool TrainingPipeline::Reset(nvrhi::ICommandList* commandList)
+{
+    if (!m_neuralNetwork->Initialise(m_shaderNetworkArch))
+    {
+        log::error("Failed to create a network.");
+        return false;
+    }
+
+#if HASH_GRID_ENCODING
+    if (!m_hashGrid.Initialise(m_hashGridDesc, 1337))
+    {
+        log::error("Failed to create a hash grid.");
+        return false;
+    }
+#endif
+
+    return ClearTrainingState(commandList);
+}
+
+bool TrainingPipeline::Load(nvrhi::ICommandList* commandList, const std::string& fileName)
+{
+#if HASH_GRID_ENCODING
+    // A network without its grid features is not the trained model, training states hold both
+    log::error("%s does not store the hash grid features, load a training state instead.", fileName.c_str());
+    return false;
+#else
+    if (!m_neuralNetwork->InitialiseFromFile(fileName))
+    {
+        return false;
+    }
+
+    // Validate the loaded file against what the shaders expect
+    if (!m_networkUtils->ValidateNetworkArchitecture(m_shaderNetworkArch))
+    {
+        return false;
+    }
+
+    return ClearTrainingState(commandList);
+#endif
+}
+
+bool TrainingPipeline::LoadTrainingState(nvrhi::ICommandList* commandList, const std::string& fileName)
+{
+    TrainingStateDesc desc;
+    std::vector<uint8_t> data;
+    if (!ReadTrainingStateFile(fileName, desc, data) || !IsTrainingStateCompatible(m_trainingStateDesc, desc))
+    {
+        log::error("Failed to load the training state %s.", fileName.c_str());
+        return false;
+    }
+
+    // Every section has to be present before anything is restored
+    std::vector<size_t> offsets(m_trainingStateDesc.sections.size());
+    for (size_t i = 0; i < m_trainingStateDesc.sections.size(); i++)
+    {
+        size_t size;
+        if (!desc.FindSection(m_trainingStateDesc.sections[i].id, offsets[i], size) || size != m_trainingStateDesc.sections[i].size)
+        {
+            log::error("The training state %s has no section %d of %d bytes.", fileName.c_str(), int(m_trainingStateDesc.sections[i].id),
+                       int(m_trainingStateDesc.sections[i].size));
+            return false;
+        }
+    }
+
+    // The snapshots in flight belong to the previous training
+    FlushCheckpoints();
+
+    for (size_t i = 0; i < m_trainingStateDesc.sections.size(); i++)
+    {
+        const size_t offset = offsets[i];
+        const size_t size = m_trainingStateDesc.sections[i].size;
+        if (m_trainingStateBuffers[i])
+        {
+            commandList->writeBuffer(m_trainingStateBuffers[i], data.data() + offset, size);
+            commandList->setBufferState(m_trainingStateBuffers[i], nvrhi::ResourceStates::UnorderedAccess);
+        }
+        else if (m_trainingStateDesc.sections[i].id == TrainingStateSection::Progress)
+        {
+            TrainingProgress progress;
+            std::memcpy(&progress, data.data() + offset, sizeof(progress));
+            m_AdamCurrentStep = progress.currentStep;
+            m_convertWeights = progress.convertWeights != 0;
+        }
+        else if (m_trainingStateDesc.sections[i].id == TrainingStateSection::Scheduler)
+        {
+            LearningRatePlateauState plateau;
+            std::memcpy(&plateau, data.data() + offset, sizeof(plateau));
+            m_learningRateScheduler->SetPlateauState(plateau);
+        }
+    }
+    commandList->clearBufferUInt(m_mlpGradientsBuffer, 0);
+    commandList->commitBarriers();
+
+    m_metricsReadback->Reset(commandList, m_AdamCurrentStep);
+    m_metrics.clear();
+    return true;
+}
+
+NeuralConstants TrainingPipeline::GetConstants(NetworkTransform networkTransform) const
+{
+    NeuralConstants neuralConstants = {};
+
+    for (int i = 0; i < NUM_TRANSITIONS; ++i)
+    {
+        neuralConstants.weightOffsets[i / 4][i % 4] = m_deviceNetworkLayout.networkLayers[i].weightOffset;
+        neuralConstants.biasOffsets[i / 4][i % 4] = m_deviceNetworkLayout.networkLayers[i].biasOffset;
+    }
+
+#if HASH_GRID_ENCODING
+    const std::vector<uint32_t> hashGridLevels = m_hashGrid.CreateLevelTable(m_hashGridOffset);
+    std::memcpy(neuralConstants.hashGridLevels, hashGridLevels.data(), sizeof(neuralConstants.hashGridLevels));
+#endif
+
+    neuralConstants.imageWidth = m_InputTexture->getDesc().width;
+    neuralConstants.imageHeight = m_InputTexture->getDesc().height;
+    neuralConstants.maxParamSize = m_TotalParamCount;
+    neuralConstants.batchSizeX = BATCH_SIZE_X;
+    neuralConstants.batchSizeY = BATCH_SIZE_Y;
+    neuralConstants.networkTransform = networkTransform;
+    neuralConstants.convertWeights = m_convertWeights ? 1 : 0;
+    UpdateStepConstants(neuralConstants);
+    return neuralConstants;
+}
+
+void TrainingPipeline::UpdateStepConstants(NeuralConstants& neuralConstants) const
+{
+    // The optimizer constants only depend on the step, so they are computed here once instead of for every parameter
+    const float learningRate = m_learningRateScheduler->GetLearningRate(m_AdamCurrentStep);
+    const OptimizerStepConstants optimizerConstants = GetOptimizerStepConstants(m_optimizerDesc, learningRate, m_AdamCurrentStep);
+    neuralConstants.currentStep = m_AdamCurrentStep;
+    neuralConstants.learningRate = learningRate;
+    neuralConstants.optimizerStepSize = optimizerConstants.stepSize;
+    neuralConstants.optimizerRsqrtBiasCorrection2 = optimizerConstants.rsqrtBiasCorrection2;
+    neuralConstants.optimizerDecayFactor = optimizerConstants.decayFactor;
+    neuralConstants.emaDecay = optimizerConstants.emaDecay;
+}
+
+void TrainingPipeline::UpdateConstants(nvrhi::ICommandList* commandList, NetworkTransform networkTransform)
+{
+    const NeuralConstants neuralConstants = GetConstants(networkTransform);
+    commandList->writeBuffer(m_NeuralConstantBuffer, &neuralConstants, sizeof(neuralConstants));
+}
+
+void TrainingPipeline::Train(nvrhi::ICommandList* commandList, uint32_t steps, NetworkTransform networkTransform)
+{
+    NeuralConstants neuralConstants = GetConstants(networkTransform);
+    commandList->writeBuffer(m_NeuralConstantBuffer, &neuralConstants, sizeof(neuralConstants));
+
+    nvrhi::ComputeState state;
+
+    for (uint32_t step = 0; step < steps; step++)
+    {
+        // run the training pass
+        state.bindings = { m_TrainingPass.m_BindingSet };
+        state.pipeline = m_TrainingPass.m_Pipeline;
+        commandList->beginMarker("Training");
+        commandList->setComputeState(state);
+        commandList->dispatch(dm::div_ceil(BATCH_SIZE_X, 8), dm::div_ceil(BATCH_SIZE_Y, 8), 1);
+        commandList->endMarker();
+
+        // flag the step when a gradient is not finite
+        state.bindings = { m_CheckGradientsPass.m_BindingSet };
+        state.pipeline = m_CheckGradientsPass.m_Pipeline;
+        commandList->beginMarker("Check Gradients");
+        commandList->setComputeState(state);
+        commandList->dispatch(dm::div_ceil(m_TotalParamCount, 32), 1, 1);
+        commandList->endMarker();
+
+        // optimizer pass, skipped after an overflow, also converts the uploaded parameters to float on the first step
+        state.bindings = { m_OptimizerPass.m_BindingSet };
+        state.pipeline = m_OptimizerPass.m_Pipeline;
+        commandList->beginMarker("Update Weights");
+        commandList->setComputeState(state);
+        commandList->dispatch(dm::div_ceil(m_TotalParamCount, 32), 1, 1);
+        commandList->endMarker();
+
+        // adjust the loss scale for the next step
+        state.bindings = { m_UpdateLossScalePass.m_BindingSet };
+        state.pipeline = m_UpdateLossScalePass.m_Pipeline;
+        commandList->beginMarker("Update Loss Scale");
+        commandList->setComputeState(state);
+        commandList->dispatch(1, 1, 1);
+        commandList->endMarker();
+
+        ++m_AdamCurrentStep;
+        m_convertWeights = false;
+        neuralConstants.convertWeights = 0;
+        UpdateStepConstants(neuralConstants);
+        commandList->writeBuffer(m_NeuralConstantBuffer, &neuralConstants, sizeof(neuralConstants));
+    }
+}
+
+void TrainingPipeline::Update()
+{
+    m_metricsReadback->Update(m_AdamCurrentStep);
+    ReportMetrics();
+    m_checkpointWriter->Update();
+    m_trainingStateWriter->Update();
+    if (m_emaCheckpointWriter)
+    {
+        m_emaCheckpointWriter->Update();
+    }
+}
+
+void TrainingPipeline::ReportMetrics()
+{
+    TrainingMetrics metrics;
+    while (m_metricsReadback->PopMetrics(metrics))
+    {
+        if (metrics.sampleCount)
+        {
+            m_learningRateScheduler->ReportLoss(metrics.firstStep + metrics.stepCount - 1, metrics.GetMeanLoss());
+        }
+        m_metrics.push_back(metrics);
+    }
+}
+
+bool TrainingPipeline::RequestTrainingState(const std::string& fileName)
+{
+    m_metricsReadback->Flush();
+    ReportMetrics();
+    return m_trainingStateWriter->RequestCheckpoint(fileName);
+}
+
+bool TrainingPipeline::RequestCheckpoint(const std::string& fileName, bool emaWeights)
+{
+    if (emaWeights && !m_emaCheckpointWriter)
+    {
+        log::warning("EMA_WEIGHTS is disabled, checkpointing the parameters instead of their average.");
+    }
+    CheckpointWriter& writer = emaWeights && m_emaCheckpointWriter ? *m_emaCheckpointWriter : *m_checkpointWriter;
+    return writer.RequestCheckpoint(fileName);
+}
+
+void TrainingPipeline::FlushCheckpoints()
+{
+    m_checkpointWriter->Flush();
+    m_trainingStateWriter->Flush();
+    if (m_emaCheckpointWriter)
+    {
+        m_emaCheckpointWriter->Flush();
+    }
+}
@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2015 - 2025, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#pragma once
+
+#include <donut/engine/ShaderFactory.h>
+#include <donut/core/math/math.h>
+#include <nvrhi/nvrhi.h>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "plugins/CooperativeVectors/Network.h"
+#include "plugins/CooperativeVectors/HashGrid.h"
+#include "plugins/CooperativeVectors/CheckpointWriter.h"
+#include "plugins/CooperativeVectors/LearningRateScheduler.h"
+#include "plugins/CooperativeVectors/LossScaling.h"
+#include "plugins/CooperativeVectors/Optimizers.h"
+#include "plugins/CooperativeVectors/TrainingMetrics.h"
+#include "plugins/CooperativeVectors/TrainingState.h"
+
+// NetworkConfig.h is shared with the shaders and uses their vector types
+using donut::math::uint4;
+#include "NetworkConfig.h"
+
+////////////////////
+//
+// Training of the network of NetworkConfig.h on a texture with the training, gradient check, optimizer and loss scale
+// passes.
+// Owns the network, its device buffers, the metrics readback and the checkpoint writer, but no window or swap chain,
+// so it is driven by SimpleTraining every frame and by the headless TrainingRunner.
+// The shaders are loaded from app/ of the shader factory. Methods taking a command list expect it to be open.
+//
+////////////////////
+class TrainingPipeline
+{
+public:
+    // The training loss is read back every metricsInterval steps.
+    TrainingPipeline(nvrhi::DeviceHandle device, std::shared_ptr<donut::engine::ShaderFactory> shaderFactory, uint32_t metricsInterval = METRICS_READBACK_STEPS);
+
+    // Create the network, the buffers and the passes. The training pass writes the loss visualisation to lossTexture
+    // and binds outputTexture, both have to be UAVs.
+    bool Init(nvrhi::ICommandList* commandList, nvrhi::TextureHandle inputTexture, nvrhi::TextureHandle outputTexture, nvrhi::TextureHandle lossTexture);
+
+    // Re-initialise the network and clear the optimizer state.
+    bool Reset(nvrhi::ICommandList* commandList);
+
+    // Replace the network with a network file matching NetworkConfig.h and clear the optimizer state. Fails with
+    // HASH_GRID_ENCODING, network files do not store the grid features.
+    bool Load(nvrhi::ICommandList* commandList, const std::string& fileName);
+
+    // Continue training from a training state written by RequestTrainingState with the same NetworkConfig.h and device.
+    bool LoadTrainingState(nvrhi::ICommandList* commandList, const std::string& fileName);
+
+    // Record steps training and optimizer passes and leave the constants of the last step in the constant buffer.
+    void Train(nvrhi::ICommandList* commandList, uint32_t steps, NetworkTransform networkTransform);
+
+    // Write the constants of the current step without training, for the inference pass.
+    void UpdateConstants(nvrhi::ICommandList* commandList, NetworkTransform networkTransform);
+
+    // Start the metrics readbacks and hand completed checkpoints to the writer, never waits for the device.
+    // Call after the command lists of the recorded steps have been executed.
+    void Update();
+
+    // Oldest completed readback of the training loss. Update() reports every readback to the reduce on plateau mode
+    // of the learning rate schedule, the rate is reduced from the step recorded after the readback completes.
+    bool PopMetrics(fluxel::TrainingMetrics& metrics)
+    {
+        if (m_metrics.empty())
+        {
+            return false;
+        }
+        metrics = m_metrics.front();
+        m_metrics.pop_front();
+        return true;
+    }
+
+    // Start a checkpoint of the network parameters of the executed steps, or of their moving average with
+    // EMA_WEIGHTS.
+    bool RequestCheckpoint(const std::string& fileName, bool emaWeights = false);
+
+    // Start a snapshot of everything needed to continue training, see TrainingState.h. The state of the executed steps
+    // is copied on the device and written in the background. Waits for the loss readbacks in flight, so the plateau
+    // state of the learning rate schedule includes them.
+    bool RequestTrainingState(const std::string& fileName);
+
+    // Block until every requested checkpoint and training state has been written.
+    void FlushCheckpoints();
+
+    // Device layout parameters, bound as the ByteAddressBuffer of the inference pass. The moving average of the
+    // parameters is kept in the same layout with EMA_WEIGHTS.
+    nvrhi::BufferHandle GetParamsBuffer(bool emaWeights = false) const
+    {
+        return emaWeights && m_mlpEmaBuffer ? m_mlpEmaBuffer : m_mlpDeviceBuffer;
+    }
+
+    nvrhi::BufferHandle GetConstantBuffer() const
+    {
+        return m_NeuralConstantBuffer;
+    }
+
+    // Step number used for the bias correction of the next update, starts at 1.
+    uint32_t GetCurrentStep() const
+    {
+        return m_AdamCurrentStep;
+    }
+
+    float GetLearningRate() const
+    {
+        return m_learningRateScheduler->GetLearningRate(m_AdamCurrentStep);
+    }
+
+    // Replace the learning rate schedule, from the step of the next update. The schedule starts with the one of
+    // NetworkConfig.h.
+    void SetLearningRateSchedule(LearningRateScheduleDesc const& desc)
+    {
+        m_learningRateScheduler->SetDesc(desc);
+    }
+
+    LearningRateScheduleDesc const& GetLearningRateSchedule() const
+    {
+        return m_learningRateScheduler->GetDesc();
+    }
+
+private:
+    struct NeuralPass
+    {
+        nvrhi::ShaderHandle m_ShaderCS;
+        nvrhi::BindingLayoutHandle m_BindingLayout;
+        nvrhi::BindingSetHandle m_BindingSet;
+        nvrhi::ComputePipelineHandle m_Pipeline;
+    };
+
+    void UpdateDeviceNetworkParameters(nvrhi::ICommandList* commandList);
+    bool ClearTrainingState(nvrhi::ICommandList* commandList);
+    void ResetLossScale(nvrhi::ICommandList* commandList);
+    void InitTrainingState();
+    void ReportMetrics();
+    NeuralConstants GetConstants(NetworkTransform networkTransform) const;
+    void UpdateStepConstants(NeuralConstants& neuralConstants) const;
+
+    nvrhi::DeviceHandle m_device;
+    std::shared_ptr<donut::engine::ShaderFactory> m_ShaderFactory;
+
+    NeuralPass m_TrainingPass;
+    NeuralPass m_CheckGradientsPass;
+    NeuralPass m_OptimizerPass;
+    NeuralPass m_UpdateLossScalePass;
+
+    nvrhi::BufferHandle m_NeuralConstantBuffer;
+
+    nvrhi::TextureHandle m_InputTexture;
+
+    nvrhi::BufferHandle m_mlpHostBuffer;
+    nvrhi::BufferHandle m_mlpDeviceBuffer;
+    nvrhi::BufferHandle m_mlpDeviceFloatBuffer;
+    nvrhi::BufferHandle m_mlpEmaBuffer;
+    nvrhi::BufferHandle m_mlpEmaFloatBuffer;
+    nvrhi::BufferHandle m_mlpGradientsBuffer;
+    nvrhi::BufferHandle m_mlpMoments1Buffer;
+    nvrhi::BufferHandle m_mlpMoments2Buffer;
+    nvrhi::BufferHandle m_QuantisationMapsBuffer;
+    nvrhi::BufferHandle m_RandStateBuffer;
+    nvrhi::BufferHandle m_LossScaleBuffer;
+
+    fluxel::NetworkArchitecture m_shaderNetworkArch;
+    std::shared_ptr<fluxel::NetworkUtilities> m_networkUtils;
+    std::unique_ptr<fluxel::HostNetwork> m_neuralNetwork;
+    std::unique_ptr<fluxel::CheckpointWriter> m_checkpointWriter;
+    std::unique_ptr<fluxel::CheckpointWriter> m_emaCheckpointWriter;
+    std::unique_ptr<fluxel::CheckpointWriter> m_trainingStateWriter;
+    fluxel::TrainingStateDesc m_trainingStateDesc;
+    std::vector<nvrhi::BufferHandle> m_trainingStateBuffers; ///< Device buffer of every section, null for host sections.
+    std::unique_ptr<fluxel::MetricsReadback> m_metricsReadback;
+    std::deque<fluxel::TrainingMetrics> m_metrics; ///< Readbacks reported to the learning rate schedule.
+    fluxel::NetworkLayout m_deviceNetworkLayout;
+#if HASH_GRID_ENCODING
+    // Checkpoints only store the network, the grid features are only saved and restored by training states
+    fluxel::HashGridDesc m_hashGridDesc;
+    fluxel::HashGrid m_hashGrid;
+    size_t m_hashGridOffset = 0;
+#endif
+
+    std::unique_ptr<LearningRateScheduler> m_learningRateScheduler;
+    fluxel::OptimizerDesc m_optimizerDesc;
+
+    uint32_t m_metricsInterval;
+    uint32_t m_TotalParamCount = 0;
+    uint32_t m_AdamCurrentStep = 1;
+    bool m_convertWeights = true;
+};
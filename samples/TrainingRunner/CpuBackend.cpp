@@ -0,0 +1,310 @@
+// CPU backend of the runner, cpu::TrainingEngine with the network, batch and learning rate of NetworkConfig.h.
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <donut/core/math/math.h>
+
+#include "Core/Logger.h"
+#include "CheckpointWriter.h"
+#include "HashGrid.h"
+#include "LearningRateScheduler.h"
+#include "Network.h"
+#include "Optimizers.h"
+#include "TrainingState.h"
+#include "Cpu/InputEncoding.h"
+#include "Cpu/TrainingEngine.h"
+#include "Dataset.h"
+#include "TrainingBackend.h"
+
+using namespace fluxel;
+
+// NetworkConfig.h is shared with the shaders and uses their vector types
+using donut::math::uint4;
+#include "NetworkConfig.h"
+
+namespace
+{
+constexpr size_t s_batchSize = BATCH_SIZE_X * BATCH_SIZE_Y;
+
+// Same generator as training_cs.
+float NextRandom(uint32_t& state)
+{
+    const float r = float(state >> 8) * 0x1p-24f;
+    state = state * 2739110765u + 2739110765u;
+    return r;
+}
+
+class CpuBackend : public ITrainingBackend
+{
+public:
+    const char* GetName() const override
+    {
+        return "cpu";
+    }
+
+    bool Init(Dataset const& dataset, TrainingOptions const& options) override
+    {
+        m_dataset = &dataset;
+        m_metricsInterval = std::max(1u, options.metricsInterval);
+
+        NetworkArchitecture netArch;
+        netArch.inputNeurons = INPUT_NEURONS;
+        netArch.hiddenNeurons = HIDDEN_NEURONS;
+        netArch.outputNeurons = OUTPUT_NEURONS;
+        netArch.numHiddenLayers = NUM_HIDDEN_LAYERS;
+        netArch.biasPrecision = NETWORK_PRECISION;
+        netArch.weightPrecision = NETWORK_PRECISION;
+
+        m_network = std::make_unique<HostNetwork>(std::make_shared<NetworkUtilities>());
+        if (options.networkFileName.empty())
+        {
+            if (!m_network->Initialise(netArch))
+            {
+                Log(Error, "CpuBackend: Failed to create a network.");
+                return false;
+            }
+        }
+#if HASH_GRID_ENCODING
+        else
+        {
+            Log(Error, "CpuBackend: %s does not store the hash grid features, resume from a training state instead.", options.networkFileName.c_str());
+            return false;
+        }
+#else
+        else
+        {
+            if (!m_network->InitialiseFromFile(options.networkFileName))
+            {
+                return false;
+            }
+            NetworkArchitecture const& fileArch = m_network->GetNetworkArchitecture();
+            if (fileArch.inputNeurons != netArch.inputNeurons || fileArch.GetHiddenNeurons(0) != netArch.hiddenNeurons ||
+                fileArch.outputNeurons != netArch.outputNeurons || fileArch.numHiddenLayers != netArch.numHiddenLayers)
+            {
+                Log(Error, "CpuBackend: %s does not match the network of NetworkConfig.h.", options.networkFileName.c_str());
+                return false;
+            }
+        }
+#endif
+
+        // Same dynamic loss scale and optimizer as the optimizer passes of the GPU backend
+        cpu::TrainingEngineDesc engineDesc;
+        engineDesc.dynamicLossScale = true;
+        engineDesc.lossScaleSchedule.initialScale = LOSS_SCALE;
+        engineDesc.lossScaleSchedule.growthFactor = LOSS_SCALE_GROWTH_FACTOR;
+        engineDesc.lossScaleSchedule.backoffFactor = LOSS_SCALE_BACKOFF_FACTOR;
+        engineDesc.lossScaleSchedule.growthInterval = LOSS_SCALE_GROWTH_INTERVAL;
+        engineDesc.lossScaleSchedule.minScale = LOSS_SCALE_MIN;
+        engineDesc.lossScaleSchedule.maxScale = LOSS_SCALE_MAX;
+        engineDesc.optimizer = GetDefaultOptimizerDesc(OptimizerType(OPTIMIZER));
+        engineDesc.optimizer.quantisedState = OPTIMIZER_STATE_8BIT != 0;
+#if EMA_WEIGHTS
+        engineDesc.optimizer.emaDecay = EMA_DECAY;
+        engineDesc.optimizer.emaWarmupSteps = EMA_WARMUP_STEPS;
+#endif
+
+#if HASH_GRID_ENCODING
+        HashGridDesc gridDesc;
+        gridDesc.inputDimensions = INPUT_FEATURES;
+        gridDesc.numLevels = HASH_GRID_LEVELS;
+        gridDesc.featuresPerLevel = HASH_GRID_FEATURES_PER_LEVEL;
+        gridDesc.log2TableSize = HASH_GRID_LOG2_TABLE_SIZE;
+        gridDesc.baseResolution = HASH_GRID_BASE_RESOLUTION;
+        gridDesc.finestResolution = HASH_GRID_FINEST_RESOLUTION;
+        if (!m_hashGrid.Initialise(gridDesc, 1337) || !m_engine.Initialise(*m_network, m_hashGrid, engineDesc))
+#else
+        if (!m_engine.Initialise(*m_network, engineDesc))
+#endif
+        {
+            Log(Error, "CpuBackend: Failed to create the training engine.");
+            return false;
+        }
+
+        // Checkpoints snapshot the FP16 parameters of the engine or their average, the network is at their start
+        if (options.emaCheckpoints && m_engine.GetEmaNetworkParams().empty())
+        {
+            Log(Error, "CpuBackend: EMA checkpoints need EMA_WEIGHTS.");
+            return false;
+        }
+        const std::vector<uint8_t>& checkpointParams = options.emaCheckpoints ? m_engine.GetEmaNetworkParams() : m_engine.GetNetworkParams();
+        auto checkpointSource = std::make_shared<MemoryCheckpointSource>(checkpointParams.data(), m_network->GetNetworkLayout().networkSize);
+        m_checkpointWriter = std::make_unique<CheckpointWriter>(checkpointSource, m_network->GetNetworkArchitecture(), m_network->GetNetworkLayout());
+
+        m_learningRateScheduler = std::make_unique<LearningRateScheduler>(options.learningRateSchedule);
+
+        // Same random states as the RandStateBuffer of the GPU backend
+        std::mt19937 gen(1337);
+        std::uniform_int_distribution<uint32_t> dist;
+        m_randState.resize(s_batchSize);
+        for (uint32_t& state : m_randState)
+        {
+            state = dist(gen);
+        }
+
+        // Training states hold the sections of the engine followed by the random states of the samples and the
+        // plateau state of the learning rate schedule
+        TrainingStateDesc stateDesc = m_engine.GetTrainingStateDesc();
+        std::vector<TrainingStateSource::Section> stateSections;
+        for (TrainingStateSectionDesc const& section : stateDesc.sections)
+        {
+            stateSections.push_back({ nullptr, [this, id = section.id](uint8_t* dst) { m_engine.SaveTrainingState(id, dst); } });
+        }
+        stateDesc.sections.push_back({ TrainingStateSection::RandState, m_randState.size() * sizeof(uint32_t) });
+        stateSections.push_back({ nullptr, [this](uint8_t* dst) { std::memcpy(dst, m_randState.data(), m_randState.size() * sizeof(uint32_t)); } });
+        stateDesc.sections.push_back({ TrainingStateSection::Scheduler, sizeof(LearningRatePlateauState) });
+        stateSections.push_back({ nullptr, [this](uint8_t* dst) { std::memcpy(dst, &m_learningRateScheduler->GetPlateauState(), sizeof(LearningRatePlateauState)); } });
+        m_trainingStateWriter = CreateTrainingStateWriter(std::make_shared<TrainingStateSource>(nullptr, stateDesc, stateSections));
+
+        if (!options.stateFileName.empty())
+        {
+            TrainingStateDesc fileDesc;
+            std::vector<uint8_t> data;
+            size_t offset, size;
+            if (!ReadTrainingStateFile(options.stateFileName, fileDesc, data) || !IsTrainingStateCompatible(stateDesc, fileDesc) ||
+                !m_engine.RestoreTrainingState(fileDesc, data.data()))
+            {
+                Log(Error, "CpuBackend: Failed to resume from %s.", options.stateFileName.c_str());
+                return false;
+            }
+            if (!fileDesc.FindSection(TrainingStateSection::RandState, offset, size) || size != m_randState.size() * sizeof(uint32_t))
+            {
+                Log(Error, "CpuBackend: %s has no random states for %d samples.", options.stateFileName.c_str(), int(m_randState.size()));
+                return false;
+            }
+            std::memcpy(m_randState.data(), data.data() + offset, size);
+            LearningRatePlateauState plateau;
+            if (!fileDesc.FindSection(TrainingStateSection::Scheduler, offset, size) || size != sizeof(plateau))
+            {
+                Log(Error, "CpuBackend: %s has no learning rate schedule state.", options.stateFileName.c_str());
+                return false;
+            }
+            std::memcpy(&plateau, data.data() + offset, sizeof(plateau));
+            m_learningRateScheduler->SetPlateauState(plateau);
+        }
+
+        m_uvs.resize(s_batchSize * INPUT_FEATURES);
+        m_parameters.resize(s_batchSize * INPUT_FEATURES);
+        m_inputs.resize(s_batchSize * INPUT_NEURONS);
+        m_targets.resize(s_batchSize * OUTPUT_NEURONS);
+        m_engine.ResetMetrics();
+        return true;
+    }
+
+    void Train(uint32_t steps) override
+    {
+        for (uint32_t step = 0; step < steps; step++)
+        {
+            for (size_t s = 0; s < s_batchSize; s++)
+            {
+                m_uvs[2 * s] = NextRandom(m_randState[s]);
+                m_uvs[2 * s + 1] = NextRandom(m_randState[s]);
+                m_dataset->Sample(m_uvs[2 * s], m_uvs[2 * s + 1], m_targets.data() + OUTPUT_NEURONS * s);
+            }
+
+            const float learningRate = m_learningRateScheduler->GetLearningRate(m_engine.GetCurrentStep());
+#if HASH_GRID_ENCODING
+            m_engine.Step(m_uvs.data(), m_targets.data(), s_batchSize, learningRate);
+#else
+            // EncodeFrequency takes the parameters as [2][batchSize]
+            for (size_t s = 0; s < s_batchSize; s++)
+            {
+                m_parameters[s] = m_uvs[2 * s];
+                m_parameters[s_batchSize + s] = m_uvs[2 * s + 1];
+            }
+            cpu::EncodingBatch batch;
+            batch.parameters = m_parameters.data();
+            batch.parameterCount = INPUT_FEATURES;
+            batch.count = s_batchSize;
+            batch.outputs = m_inputs.data();
+            cpu::EncodeFrequency(batch, true);
+            m_engine.Step(m_inputs.data(), m_targets.data(), s_batchSize, learningRate);
+#endif
+
+            if (m_engine.GetMetrics().stepCount >= m_metricsInterval)
+            {
+                TrainingMetrics const& metrics = m_engine.GetMetrics();
+                if (metrics.sampleCount)
+                {
+                    m_learningRateScheduler->ReportLoss(metrics.firstStep + metrics.stepCount - 1, metrics.GetMeanLoss());
+                }
+                m_results.push_back(metrics);
+                m_engine.ResetMetrics();
+            }
+        }
+        m_checkpointWriter->Update();
+        m_trainingStateWriter->Update();
+    }
+
+    uint32_t GetBatchSize() const override
+    {
+        return uint32_t(s_batchSize);
+    }
+
+    uint32_t GetCurrentStep() const override
+    {
+        return m_engine.GetCurrentStep();
+    }
+
+    float GetLearningRate() const override
+    {
+        return m_learningRateScheduler->GetLearningRate(m_engine.GetCurrentStep());
+    }
+
+    bool PopMetrics(TrainingMetrics& metrics) override
+    {
+        if (m_results.empty())
+        {
+            return false;
+        }
+        metrics = m_results.front();
+        m_results.pop_front();
+        return true;
+    }
+
+    bool RequestCheckpoint(const std::string& fileName) override
+    {
+        return m_checkpointWriter->RequestCheckpoint(fileName);
+    }
+
+    bool RequestTrainingState(const std::string& fileName) override
+    {
+        return m_trainingStateWriter->RequestCheckpoint(fileName);
+    }
+
+    void Finish() override
+    {
+        m_checkpointWriter->Flush();
+        m_trainingStateWriter->Flush();
+    }
+
+private:
+    Dataset const* m_dataset = nullptr;
+    uint32_t m_metricsInterval = 1;
+
+    std::unique_ptr<HostNetwork> m_network;
+#if HASH_GRID_ENCODING
+    HashGrid m_hashGrid;
+#endif
+    cpu::TrainingEngine m_engine;
+    std::unique_ptr<CheckpointWriter> m_checkpointWriter;
+    std::unique_ptr<CheckpointWriter> m_trainingStateWriter;
+    std::unique_ptr<LearningRateScheduler> m_learningRateScheduler;
+
+    std::vector<uint32_t> m_randState;
+    std::vector<float> m_uvs; ///< [batchSize][2] floats.
+    std::vector<float> m_parameters; ///< [2][batchSize] floats for the frequency encoding.
+    std::vector<float> m_inputs;
+    std::vector<float> m_targets;
+    std::deque<TrainingMetrics> m_results;
+};
+} // namespace
+
+std::unique_ptr<ITrainingBackend> CreateCpuBackend()
+{
+    return std::make_unique<CpuBackend>();
+}
@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iterator>
+
+#include "Core/Logger.h"
+#include "Dataset.h"
+
+using namespace fluxel;
+
+namespace
+{
+// Size of the procedural checker board and squares per side, assets/data/checker.png alternates about every
+// 100 of its 4096 pixels.
+constexpr uint32_t s_checkerSize = 1024;
+constexpr float s_checkerSquares = 42.f;
+
+void CreateChecker(Dataset& dataset)
+{
+    dataset.width = s_checkerSize;
+    dataset.height = s_checkerSize;
+    dataset.texels.resize(size_t(s_checkerSize) * s_checkerSize * 4);
+    for (uint32_t y = 0; y < s_checkerSize; y++)
+    {
+        for (uint32_t x = 0; x < s_checkerSize; x++)
+        {
+            // Alternating squares over a colour gradient, the target of CpuHashGridBenchmark at the texel centres
+            const float u = (float(x) + 0.5f) / s_checkerSize;
+            const float v = (float(y) + 0.5f) / s_checkerSize;
+            const bool dark = ((int(u * s_checkerSquares) + int(v * s_checkerSquares)) & 1) != 0;
+            const float shade = dark ? 0.2f : 0.9f;
+            uint8_t* texel = dataset.texels.data() + (size_t(y) * s_checkerSize + x) * 4;
+            texel[0] = uint8_t(shade * (0.5f + 0.5f * u) * 255.f + 0.5f);
+            texel[1] = uint8_t(shade * (0.5f + 0.5f * v) * 255.f + 0.5f);
+            texel[2] = uint8_t(shade * 255.f + 0.5f);
+            texel[3] = 255;
+        }
+    }
+}
+
+// Next header field of a PPM file, skipping white space and comments.
+bool ReadPpmField(std::vector<uint8_t> const& data, size_t& offset, uint32_t& value)
+{
+    while (offset < data.size() && (std::isspace(data[offset]) || data[offset] == '#'))
+    {
+        if (data[offset] == '#')
+        {
+            while (offset < data.size() && data[offset] != '\n')
+            {
+                offset++;
+            }
+        }
+        else
+        {
+            offset++;
+        }
+    }
+
+    if (offset == data.size() || !std::isdigit(data[offset]))
+    {
+        return false;
+    }
+    value = 0;
+    while (offset < data.size() && std::isdigit(data[offset]))
+    {
+        value = value * 10 + (data[offset++] - '0');
+        if (value > (1u << 16))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool LoadPpm(const std::string& fileName, Dataset& dataset)
+{
+    std::ifstream file(fileName, std::ios::binary);
+    if (!file)
+    {
+        Log(Error, "LoadDataset: Failed to open %s.", fileName.c_str());
+        return false;
+    }
+    const std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    size_t offset = 2;
+    uint32_t width, height, maxValue;
+    if (data.size() < 2 || data[0] != 'P' || data[1] != '6' || !ReadPpmField(data, offset, width) || !ReadPpmField(data, offset, height) ||
+        !ReadPpmField(data, offset, maxValue))
+    {
+        Log(Error, "LoadDataset: %s is not a binary PPM file.", fileName.c_str());
+        return false;
+    }
+    if (width == 0 || height == 0 || maxValue == 0 || maxValue > 255)
+    {
+        Log(Error, "LoadDataset: %s has an unsupported size or maximum value (%d x %d, %d).", fileName.c_str(), int(width), int(height), int(maxValue));
+        return false;
+    }
+
+    // A single white space character separates the header from the texels
+    offset++;
+    const size_t texelCount = size_t(width) * height;
+    if (data.size() < offset + texelCount * 3)
+    {
+        Log(Error, "LoadDataset: %s is truncated.", fileName.c_str());
+        return false;
+    }
+
+    dataset.width = width;
+    dataset.height = height;
+    dataset.texels.resize(texelCount * 4);
+    for (size_t i = 0; i < texelCount; i++)
+    {
+        for (size_t c = 0; c < 3; c++)
+        {
+            dataset.texels[i * 4 + c] = uint8_t((data[offset + i * 3 + c] * 255u + maxValue / 2) / maxValue);
+        }
+        dataset.texels[i * 4 + 3] = 255;
+    }
+    return true;
+}
+} // namespace
+
+void Dataset::Sample(float u, float v, float* rgb) const
+{
+    const uint32_t x = std::min(uint32_t(u * float(width)), width - 1);
+    const uint32_t y = std::min(uint32_t(v * float(height)), height - 1);
+    const uint8_t* texel = texels.data() + (size_t(y) * width + x) * 4;
+    for (int c = 0; c < 3; c++)
+    {
+        rgb[c] = float(texel[c]) / 255.f;
+    }
+}
+
+bool LoadDataset(const std::string& name, Dataset& dataset)
+{
+    dataset = {};
+    dataset.name = name;
+    if (name == "checker")
+    {
+        CreateChecker(dataset);
+        return true;
+    }
+    return LoadPpm(name, dataset);
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Training image of the runner, RGBA8 texels as in the input texture of HelloCoopVec.
+struct Dataset
+{
+    std::string name;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<uint8_t> texels; ///< [height][width] RGBA8 texels.
+
+    // Colour of the texel training_cs loads for uv with the identity transform.
+    void Sample(float u, float v, float* rgb) const;
+};
+
+// "checker" creates a procedural checker board at the scale of assets/data/checker.png,
+// any other name is read as a binary PPM (P6) file.
+bool LoadDataset(const std::string& name, Dataset& dataset);
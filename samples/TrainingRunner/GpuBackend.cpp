@@ -0,0 +1,232 @@
+// GPU backend of the runner, the training passes of HelloCoopVec on a headless device.
+
+#include <donut/app/ApplicationBase.h>
+#include <donut/app/DeviceManager.h>
+#include <donut/core/vfs/VFS.h>
+#include <nvrhi/utils.h>
+#include <algorithm>
+#include <vector>
+
+#include "Core/Logger.h"
+#include "Utils/DeviceUtils.h"
+#include "plugins/CooperativeVectors/CooperativeVectors.h"
+#include "Dataset.h"
+#include "TrainingBackend.h"
+#include "TrainingPipeline.h"
+
+using namespace donut;
+using namespace fluxel;
+
+namespace
+{
+// Command lists recorded ahead of the device, each with BATCH_COUNT steps like a frame of HelloCoopVec.
+constexpr uint32_t s_maxListsInFlight = 2;
+
+class GpuBackend : public ITrainingBackend
+{
+public:
+    ~GpuBackend() override
+    {
+        // Release the resources before the device
+        m_trainingPipeline.reset();
+        m_commandLists.clear();
+        m_queries.clear();
+        m_commandList = nullptr;
+        m_InputTexture = nullptr;
+        m_InferenceTexture = nullptr;
+        m_LossTexture = nullptr;
+        m_device = nullptr;
+        if (m_deviceManager)
+        {
+            m_deviceManager->Shutdown();
+        }
+    }
+
+    const char* GetName() const override
+    {
+        return "gpu";
+    }
+
+    bool Init(Dataset const& dataset, TrainingOptions const& options) override
+    {
+        nvrhi::GraphicsAPI graphicsApi = nvrhi::GraphicsAPI::VULKAN;
+        m_deviceManager.reset(app::DeviceManager::Create(graphicsApi));
+
+        app::DeviceCreationParameters deviceParams;
+#ifdef _DEBUG
+        deviceParams.enableDebugRuntime = true;
+        deviceParams.enableNvrhiValidationLayer = true;
+#endif
+        SetCoopVectorExtensionParameters(deviceParams, graphicsApi, false, "TrainingRunner");
+
+        // Prefer the high-performance (NVIDIA) GPU when multiple adapters are present.
+        if (m_deviceManager->CreateInstance(deviceParams))
+        {
+            SelectPreferredAdapter(m_deviceManager.get(), deviceParams);
+        }
+
+        if (!m_deviceManager->CreateHeadlessDevice(deviceParams))
+        {
+            Log(Error, "GpuBackend: Failed to create a headless device.");
+            m_deviceManager.reset();
+            return false;
+        }
+        m_device = m_deviceManager->GetDevice();
+
+        GraphicsResources graphicsResources(m_device);
+        if (!graphicsResources.GetCoopVectorFeatures().trainingSupported && !graphicsResources.GetCoopVectorFeatures().fp16TrainingSupported)
+        {
+            Log(Error, "GpuBackend: Coop Vector training is not supported by %s.", m_deviceManager->GetRendererString());
+            return false;
+        }
+
+        // The shaders of HelloCoopVec
+        std::filesystem::path appShaderPath = app::GetDirectoryWithExecutable() / "shaders/HelloCoopVec" / app::GetShaderTypeName(graphicsApi);
+        auto rootFS = std::make_shared<vfs::RootFileSystem>();
+        rootFS->mount("/shaders/app", appShaderPath);
+        auto shaderFactory = std::make_shared<engine::ShaderFactory>(m_device, rootFS, "/shaders");
+
+        m_commandList = m_device->createCommandList();
+        m_commandList->open();
+
+        nvrhi::TextureDesc textureDesc;
+        textureDesc.width = dataset.width;
+        textureDesc.height = dataset.height;
+        textureDesc.format = nvrhi::Format::RGBA8_UNORM;
+        textureDesc.debugName = "DatasetTexture";
+        textureDesc.initialState = nvrhi::ResourceStates::ShaderResource;
+        textureDesc.keepInitialState = true;
+        m_InputTexture = m_device->createTexture(textureDesc);
+        m_commandList->writeTexture(m_InputTexture, 0, 0, dataset.texels.data(), size_t(dataset.width) * 4);
+
+        // The loss visualisation is written at the image resolution, the output of the inference pass is not used
+        textureDesc.format = nvrhi::Format::RGBA16_FLOAT;
+        textureDesc.isUAV = true;
+        textureDesc.debugName = "LossTexture";
+        textureDesc.initialState = nvrhi::ResourceStates::UnorderedAccess;
+        m_LossTexture = m_device->createTexture(textureDesc);
+
+        textureDesc.width = 1;
+        textureDesc.height = 1;
+        textureDesc.debugName = "InferenceTexture";
+        m_InferenceTexture = m_device->createTexture(textureDesc);
+
+        m_emaCheckpoints = options.emaCheckpoints;
+        m_trainingPipeline = std::make_unique<TrainingPipeline>(m_device, shaderFactory, options.metricsInterval);
+        if (!m_trainingPipeline->Init(m_commandList, m_InputTexture, m_InferenceTexture, m_LossTexture))
+        {
+            m_commandList->close();
+            return false;
+        }
+        if (!options.networkFileName.empty() && !m_trainingPipeline->Load(m_commandList, options.networkFileName))
+        {
+            Log(Error, "GpuBackend: Failed to load %s.", options.networkFileName.c_str());
+            m_commandList->close();
+            return false;
+        }
+        m_trainingPipeline->SetLearningRateSchedule(options.learningRateSchedule);
+        if (!options.stateFileName.empty() && !m_trainingPipeline->LoadTrainingState(m_commandList, options.stateFileName))
+        {
+            m_commandList->close();
+            return false;
+        }
+
+        m_commandList->close();
+        m_device->executeCommandList(m_commandList);
+        m_device->waitForIdle();
+
+        for (uint32_t i = 0; i < s_maxListsInFlight; i++)
+        {
+            m_commandLists.push_back(m_device->createCommandList());
+            m_queries.push_back(m_device->createEventQuery());
+        }
+
+        Log(Info, "GpuBackend: Training on %s.", m_deviceManager->GetRendererString());
+        return true;
+    }
+
+    void Train(uint32_t steps) override
+    {
+        while (steps > 0)
+        {
+            // Wait for the device before reusing a command list, so the recording stays at most s_maxListsInFlight lists ahead
+            const uint32_t listIndex = m_listCount++ % s_maxListsInFlight;
+            if (m_listCount > s_maxListsInFlight)
+            {
+                m_device->waitEventQuery(m_queries[listIndex]);
+            }
+            m_device->resetEventQuery(m_queries[listIndex]);
+
+            const uint32_t listSteps = std::min<uint32_t>(steps, BATCH_COUNT);
+            nvrhi::ICommandList* commandList = m_commandLists[listIndex];
+            commandList->open();
+            m_trainingPipeline->Train(commandList, listSteps, NetworkTransform::Identity);
+            commandList->close();
+            m_device->executeCommandList(commandList);
+            m_device->setEventQuery(m_queries[listIndex], nvrhi::CommandQueue::Graphics);
+
+            m_trainingPipeline->Update();
+            m_device->runGarbageCollection();
+            steps -= listSteps;
+        }
+    }
+
+    uint32_t GetBatchSize() const override
+    {
+        return BATCH_SIZE_X * BATCH_SIZE_Y;
+    }
+
+    uint32_t GetCurrentStep() const override
+    {
+        return m_trainingPipeline->GetCurrentStep();
+    }
+
+    float GetLearningRate() const override
+    {
+        return m_trainingPipeline->GetLearningRate();
+    }
+
+    bool PopMetrics(TrainingMetrics& metrics) override
+    {
+        return m_trainingPipeline->PopMetrics(metrics);
+    }
+
+    bool RequestCheckpoint(const std::string& fileName) override
+    {
+        return m_trainingPipeline->RequestCheckpoint(fileName, m_emaCheckpoints);
+    }
+
+    bool RequestTrainingState(const std::string& fileName) override
+    {
+        return m_trainingPipeline->RequestTrainingState(fileName);
+    }
+
+    void Finish() override
+    {
+        m_device->waitForIdle();
+        m_trainingPipeline->Update();
+        m_trainingPipeline->FlushCheckpoints();
+    }
+
+private:
+    std::unique_ptr<app::DeviceManager> m_deviceManager;
+    nvrhi::DeviceHandle m_device;
+    nvrhi::CommandListHandle m_commandList;
+
+    nvrhi::TextureHandle m_InputTexture;
+    nvrhi::TextureHandle m_InferenceTexture;
+    nvrhi::TextureHandle m_LossTexture;
+
+    std::unique_ptr<TrainingPipeline> m_trainingPipeline;
+
+    std::vector<nvrhi::CommandListHandle> m_commandLists;
+    std::vector<nvrhi::EventQueryHandle> m_queries;
+    uint32_t m_listCount = 0;
+    bool m_emaCheckpoints = false;
+};
+} // namespace
+
+std::unique_ptr<ITrainingBackend> CreateGpuBackend()
+{
+    return std::make_unique<GpuBackend>();
+}
@@ -0,0 +1,326 @@
+// Trains the network of HelloCoopVec without a window as fast as the backend allows, and reports the training
+// throughput and the wall time to reach a target loss.
+//
+// TrainingRunner [-backend cpu|gpu] [-dataset checker|<file.ppm>] [-steps N] [-network <file.bin>]
+//                [-checkpoint <prefix>] [-checkpoint-interval N] [-ema] [-state] [-resume <file.state>]
+//                [-metrics-interval N] [-target-loss L]
+//                [-lr-schedule cosine|onecycle|exponential|step|restarts] [-lr R] [-lr-min R] [-lr-warmup N] [-lr-flat N]
+//                [-lr-decay N] [-lr-decay-factor F] [-lr-period-factor F]
+//                [-plateau-patience N] [-plateau-factor F] [-plateau-threshold T] [-plateau-cooldown N]
+//
+// The architecture, encoding, batch size and default learning rate schedule are those of HelloCoopVec/NetworkConfig.h,
+// which the GPU backend shares with its shaders. Checkpoints are written as <prefix>_<step>.bin, with -ema they hold
+// the moving average of the parameters instead of the parameters. With -state every checkpoint is accompanied by the
+// training state <prefix>_<step>.state, from which -resume continues with the same results as an uninterrupted run
+// on the same backend. Steps count from the start of the training, including the steps before a resume.
+//
+// The -lr options replace parts of that schedule, see LearningRateScheduleDesc. A plateau patience enables
+// the reduce on plateau mode, which multiplies the rate by the plateau factor when the reported loss has not improved
+// by the relative threshold for the patience steps, so the patience should span a few metrics intervals.
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <string>
+
+#include <donut/core/math/math.h>
+
+#include "Core/Logger.h"
+#include "Dataset.h"
+#include "TrainingBackend.h"
+
+using namespace fluxel;
+
+// NetworkConfig.h is shared with the shaders and uses their vector types
+using donut::math::uint4;
+#include "NetworkConfig.h"
+
+static_assert(s_defaultMetricsInterval == METRICS_READBACK_STEPS, "The default metrics interval must match the GPU readback interval");
+
+namespace
+{
+struct RunnerOptions
+{
+    std::string backend = "gpu";
+    std::string dataset = "checker";
+    uint32_t steps = 100000;
+    std::string checkpointPrefix;
+    uint32_t checkpointInterval = 0; ///< Steps between checkpoints, only the final network is written when 0.
+    bool trainingStates = false; ///< Write a training state with every checkpoint.
+    float targetLoss = 0.f; ///< Training stops at the first metrics with a mean loss at or below, disabled when 0.
+    TrainingOptions training;
+};
+
+bool ProcessCommandLine(int argc, const char* const* argv, RunnerOptions& options)
+{
+    LearningRateScheduleDesc& schedule = options.training.learningRateSchedule;
+    schedule.baseRate = BASE_LEARNING_RATE;
+    schedule.minRate = MIN_LEARNING_RATE;
+    schedule.warmupSteps = WARMUP_LEARNING_STEPS;
+    schedule.flatSteps = FLAT_LEARNING_STEPS;
+    schedule.decaySteps = DECAY_LEARNING_STEPS;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "-backend") && hasValue)
+        {
+            options.backend = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-dataset") && hasValue)
+        {
+            options.dataset = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-steps") && hasValue)
+        {
+            options.steps = uint32_t(std::stoul(argv[++i]));
+        }
+        else if (!strcmp(argv[i], "-network") && hasValue)
+        {
+            options.training.networkFileName = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-checkpoint") && hasValue)
+        {
+            options.checkpointPrefix = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-checkpoint-interval") && hasValue)
+        {
+            options.checkpointInterval = uint32_t(std::stoul(argv[++i]));
+        }
+        else if (!strcmp(argv[i], "-ema"))
+        {
+            options.training.emaCheckpoints = true;
+        }
+        else if (!strcmp(argv[i], "-state"))
+        {
+            options.trainingStates = true;
+        }
+        else if (!strcmp(argv[i], "-resume") && hasValue)
+        {
+            options.training.stateFileName = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-metrics-interval") && hasValue)
+        {
+            options.training.metricsInterval = uint32_t(std::stoul(argv[++i]));
+        }
+        else if (!strcmp(argv[i], "-target-loss") && hasValue)
+        {
+            options.targetLoss = std::stof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-lr-schedule") && hasValue)
+        {
+            if (!ParseLearningRateSchedule(argv[++i], schedule.schedule))
+            {
+                Log(Error, "Unknown learning rate schedule %s.", argv[i]);
+                return false;
+            }
+        }
+        else if (!strcmp(argv[i], "-lr") && hasValue)
+        {
+            schedule.baseRate = std::stof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-lr-min") && hasValue)
+        {
+            schedule.minRate = std::stof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-lr-warmup") && hasValue)
+        {
+            schedule.warmupSteps = std::stoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-lr-flat") && hasValue)
+        {
+            schedule.flatSteps = std::stoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-lr-decay") && hasValue)
+        {
+            schedule.decaySteps = std::stoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-lr-decay-factor") && hasValue)
+        {
+            schedule.decayFactor = std::stof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-lr-period-factor") && hasValue)
+        {
+            schedule.periodFactor = std::stof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-plateau-patience") && hasValue)
+        {
+            schedule.reduceOnPlateau = true;
+            schedule.plateauPatience = std::stoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-plateau-factor") && hasValue)
+        {
+            schedule.plateauFactor = std::stof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-plateau-threshold") && hasValue)
+        {
+            schedule.plateauThreshold = std::stof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-plateau-cooldown") && hasValue)
+        {
+            schedule.plateauCooldown = std::stoi(argv[++i]);
+        }
+        else
+        {
+            Log(Error, "Unknown or incomplete option %s.", argv[i]);
+            return false;
+        }
+    }
+
+    if (options.training.metricsInterval == 0)
+    {
+        Log(Error, "The metrics interval must be positive.");
+        return false;
+    }
+    if (schedule.baseRate <= 0.f || schedule.minRate < 0.f || schedule.warmupSteps < 0 || schedule.flatSteps < 0 || schedule.decaySteps < 0 ||
+        schedule.plateauPatience < 0 || schedule.plateauCooldown < 0)
+    {
+        Log(Error, "Invalid learning rate schedule.");
+        return false;
+    }
+    if (options.trainingStates && options.checkpointPrefix.empty())
+    {
+        Log(Error, "Training states need a checkpoint prefix.");
+        return false;
+    }
+    return true;
+}
+
+std::string GetCheckpointName(RunnerOptions const& options, uint32_t step, const char* extension = ".bin")
+{
+    return options.checkpointPrefix + "_" + std::to_string(step) + extension;
+}
+
+// Request the checkpoint of a step, and its training state when enabled
+bool RequestCheckpoint(ITrainingBackend& backend, RunnerOptions const& options, uint32_t step)
+{
+    bool requested = backend.RequestCheckpoint(GetCheckpointName(options, step));
+    if (options.trainingStates)
+    {
+        requested = backend.RequestTrainingState(GetCheckpointName(options, step, ".state")) && requested;
+    }
+    return requested;
+}
+} // namespace
+
+int main(int argc, const char* const* argv)
+{
+    RunnerOptions options;
+    try
+    {
+        if (!ProcessCommandLine(argc, argv, options))
+        {
+            return 1;
+        }
+    }
+    catch (std::exception const&)
+    {
+        Log(Error, "Invalid number on the command line.");
+        return 1;
+    }
+
+    Dataset dataset;
+    if (!LoadDataset(options.dataset, dataset))
+    {
+        return 1;
+    }
+
+    std::unique_ptr<ITrainingBackend> backend;
+    if (options.backend == "cpu")
+    {
+        backend = CreateCpuBackend();
+    }
+    else if (options.backend == "gpu")
+    {
+        backend = CreateGpuBackend();
+    }
+    else
+    {
+        Log(Error, "Unknown backend %s, expected cpu or gpu.", options.backend.c_str());
+        return 1;
+    }
+
+    if (!backend->Init(dataset, options.training))
+    {
+        Log(Error, "Failed to initialise the %s backend.", backend->GetName());
+        return 1;
+    }
+
+    // GetCurrentStep() is the number of the next step, counting from 1
+    const uint32_t firstStep = backend->GetCurrentStep();
+    Log(Info, "Training on %s (%d x %d) with the %s backend for %d steps from step %d.", dataset.name.c_str(), int(dataset.width),
+        int(dataset.height), backend->GetName(), int(options.steps), int(firstStep - 1));
+
+    // Steps are submitted in chunks of the metrics interval so the target loss is checked while training
+    const auto start = std::chrono::high_resolution_clock::now();
+    auto GetSeconds = [&start]() { return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count(); };
+
+    uint32_t step = 0;
+    uint32_t targetStep = 0;
+    double targetTime = 0.0;
+    while (step < options.steps && targetStep == 0)
+    {
+        uint32_t chunk = std::min(options.steps - step, options.training.metricsInterval);
+        if (options.checkpointInterval)
+        {
+            const uint32_t trainedSteps = firstStep - 1 + step;
+            chunk = std::min(chunk, options.checkpointInterval - trainedSteps % options.checkpointInterval);
+        }
+        backend->Train(chunk);
+        step += chunk;
+
+        const uint32_t trainedSteps = firstStep - 1 + step;
+        if (!options.checkpointPrefix.empty() && options.checkpointInterval && trainedSteps % options.checkpointInterval == 0 && step < options.steps)
+        {
+            if (!RequestCheckpoint(*backend, options, trainedSteps))
+            {
+                Log(Warning, "Checkpoint of step %d skipped, the previous checkpoints are still being written.", int(trainedSteps));
+            }
+        }
+
+        TrainingMetrics metrics;
+        while (backend->PopMetrics(metrics))
+        {
+            const uint32_t lastStep = metrics.firstStep + metrics.stepCount - 1;
+            Log(Info, "step %8d  loss %.6f  max %.6f  non-finite %d  loss scale %.0f  skipped %d  lr %.3g  %.2f s", int(lastStep),
+                metrics.GetMeanLoss(), metrics.maxLoss, int(metrics.nonFiniteCount), metrics.lossScale, int(metrics.skippedSteps),
+                backend->GetLearningRate(), GetSeconds());
+            if (options.targetLoss > 0.f && targetStep == 0 && metrics.sampleCount && metrics.GetMeanLoss() <= options.targetLoss)
+            {
+                targetStep = lastStep;
+                targetTime = GetSeconds();
+            }
+        }
+    }
+
+    // Steps may still be in flight on the device, the wall time includes them
+    backend->Finish();
+    const double wallTime = GetSeconds();
+    const uint32_t stepCount = backend->GetCurrentStep() - firstStep;
+
+    if (!options.checkpointPrefix.empty())
+    {
+        if (RequestCheckpoint(*backend, options, backend->GetCurrentStep() - 1))
+        {
+            backend->Finish();
+        }
+    }
+
+    Log(Info, "%d steps in %.3f s, %.1f steps/s, %.0f samples/s", int(stepCount), wallTime, stepCount / wallTime,
+        double(stepCount) * backend->GetBatchSize() / wallTime);
+    if (options.targetLoss > 0.f)
+    {
+        if (targetStep)
+        {
+            Log(Info, "Target loss %.6f reached at step %d after %.3f s", options.targetLoss, int(targetStep), targetTime);
+        }
+        else
+        {
+            Log(Info, "Target loss %.6f not reached", options.targetLoss);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "LearningRateScheduler.h"
+#include "TrainingMetrics.h"
+
+struct Dataset;
+
+// METRICS_READBACK_STEPS of NetworkConfig.h, which cannot be included here. Main.cpp checks that they match.
+constexpr uint32_t s_defaultMetricsInterval = 1024;
+
+struct TrainingOptions
+{
+    uint32_t metricsInterval = s_defaultMetricsInterval; ///< Steps per reported loss.
+    std::string networkFileName; ///< Network to continue training from, a new network when empty.
+    std::string stateFileName; ///< Training state to resume from, see TrainingState.h.
+    bool emaCheckpoints = false; ///< Checkpoint the moving average of the parameters, EMA_WEIGHTS of NetworkConfig.h.
+    LearningRateScheduleDesc learningRateSchedule; ///< Schedule of NetworkConfig.h unless set on the command line.
+};
+
+// Trains the network of HelloCoopVec/NetworkConfig.h on a dataset, with the same samples, loss and optimizer update
+// on every backend.
+class ITrainingBackend
+{
+public:
+    virtual ~ITrainingBackend() = default;
+
+    virtual const char* GetName() const = 0;
+
+    virtual bool Init(Dataset const& dataset, TrainingOptions const& options) = 0;
+
+    // Run steps training steps. The steps may still be in flight on return, see Finish().
+    virtual void Train(uint32_t steps) = 0;
+
+    // Samples per training step.
+    virtual uint32_t GetBatchSize() const = 0;
+
+    // Step number of the next training step, starts at 1.
+    virtual uint32_t GetCurrentStep() const = 0;
+
+    // Learning rate of the next training step.
+    virtual float GetLearningRate() const = 0;
+
+    // Oldest completed loss metrics, metricsInterval steps each. The loss is also reported to the reduce on plateau
+    // mode of the learning rate schedule.
+    virtual bool PopMetrics(fluxel::TrainingMetrics& metrics) = 0;
+
+    // Start a checkpoint of the network after the steps run so far, written in the background.
+    virtual bool RequestCheckpoint(const std::string& fileName) = 0;
+
+    // Start a snapshot of the training state after the steps run so far, written in the background.
+    virtual bool RequestTrainingState(const std::string& fileName) = 0;
+
+    // Wait for the steps in flight and the requested checkpoints.
+    virtual void Finish() = 0;
+};
+
+std::unique_ptr<ITrainingBackend> CreateCpuBackend();
+std::unique_ptr<ITrainingBackend> CreateGpuBackend();